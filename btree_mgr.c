@@ -0,0 +1,1351 @@
+#include "btree_mgr.h"
+#include "storage_mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*  An index is one page file. Page 0 holds the tree information, every
+ *  other page is a node or on the free list.
+ *
+ *  A node page starts with a 64 byte header, so the keys begin on a cache
+ *  line of their own and a search only touches the key array:
+ *   header   isLeaf, numKeys, next (right sibling of a leaf, or next free page)
+ *   keys     n sorted int keys
+ *   values   leaf: n RIDs, internal node: n+1 child pages
+ *  Child i of an internal node holds the keys k with keys[i-1] <= k < keys[i].
+ *
+ *  Keys are stored as ints. Floats are mapped to ints with the same order,
+ *  so every key type is searched with the same integer compares. */
+#define BTREE_MAGIC        0x31545042   /* "BPT1" */
+#define NODE_HEADER_INTS   16
+#define NODE_INTS          (PAGE_SIZE/(int)sizeof(int))
+#define MAX_KEYS           ((NODE_INTS-NODE_HEADER_INTS-1)/3)
+#define SEARCH_LINEAR      16           // keys left when binary search stops
+#define NODE_FREE          -1
+
+typedef union NodePage{
+    char bytes[PAGE_SIZE];
+    int words[NODE_INTS];
+}NodePage;
+
+#define NODE_IS_LEAF(p)      ((p)->words[0])
+#define NODE_NUM_KEYS(p)     ((p)->words[1])
+#define NODE_NEXT(p)         ((p)->words[2])
+#define NODE_KEYS(p)         (&(p)->words[NODE_HEADER_INTS])
+#define NODE_RIDS(t,p)       ((RID*)&(p)->words[NODE_HEADER_INTS+(t)->n])
+#define NODE_CHILDREN(t,p)   (&(p)->words[NODE_HEADER_INTS+(t)->n])
+
+typedef struct BTreeInfo{
+    SM_FileHandle fh;
+    DataType keyType;
+    int n;
+    int root;
+    int numNodes;
+    int numEntries;
+    int freeList;       // first free node page, -1 if none
+    int nextUnused;     // first page past the used ones, the file may already have it
+    int metaDirty;
+}BTreeInfo;
+
+typedef struct TreeScan{
+    NodePage leaf;
+    int pos;
+    int hasHigh;
+    int high;
+}TreeScan;
+
+/*********************************************************************************
+ * Function:        minLeafKeys / minInternalKeys
+ * Description:     fewest keys a node other than the root may have; a split
+ *                  never leaves fewer, a merge of two underfull nodes fits
+ **********************************************************************************/
+static int minLeafKeys(BTreeInfo* t)
+{
+    return (t->n+1)/2;
+}
+
+static int minInternalKeys(BTreeInfo* t)
+{
+    return t->n/2;
+}
+
+/*********************************************************************************
+ * Function:        keyOf
+ * Description:     the int a key value is stored as
+ * Input:           BTreeInfo* t: tree
+                    Value* key: key of the tree's key type
+ * Output:          int* out: stored key
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC keyOf(BTreeInfo* t, Value* key, int* out)
+{
+    if(key->dt!=t->keyType)
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "key does not have the key type of the index");
+
+    switch(key->dt)
+    {
+    case DT_INT:
+        *out=key->v.intV;
+        return RC_OK;
+    case DT_BOOL:
+        *out=key->v.boolV?1:0;
+        return RC_OK;
+    case DT_FLOAT:
+        {
+            // negative floats order in reverse as ints, flip all but the sign;
+            // -0.0 is the same key as 0.0
+            float f=key->v.floatV==0.0f?0.0f:key->v.floatV;
+            int bits;
+            memcpy(&bits,&f,sizeof(bits));
+            *out=bits^((bits>>31)&0x7fffffff);
+        }
+        return RC_OK;
+    default:
+        THROW(RC_FEATURE_NOT_SUPPORTED, "index keys must be DT_INT, DT_FLOAT or DT_BOOL");
+    }
+}
+
+/*********************************************************************************
+ * Function:        lowerBound
+ * Description:     number of keys smaller than key. Binary search narrows the
+ *                  range to SEARCH_LINEAR keys, which are then counted with
+ *                  AVX2 or SSE2 compares when the compiler targets them.
+ * Input:           const int* keys: sorted keys
+                    int numKeys: number of keys
+                    int key: key to look for
+ * Return:          int: position of the first key >= key
+ **********************************************************************************/
+static int lowerBound(const int* keys, int numKeys, int key)
+{
+    int lo=0, hi=numKeys;
+
+    while(hi-lo>SEARCH_LINEAR)
+    {
+        int mid=lo+(hi-lo)/2;
+        if(keys[mid]<key)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+#if defined(__AVX2__)
+    {
+        const __m256i k=_mm256_set1_epi32(key);
+        for(;lo+8<=hi;lo+=8)
+        {
+            __m256i less=_mm256_cmpgt_epi32(k,_mm256_loadu_si256((const __m256i*)(keys+lo)));
+            int mask=_mm256_movemask_ps(_mm256_castsi256_ps(less));
+            if(mask!=0xFF)
+                return lo+__builtin_popcount(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128i k=_mm_set1_epi32(key);
+        for(;lo+4<=hi;lo+=4)
+        {
+            __m128i less=_mm_cmpgt_epi32(k,_mm_loadu_si128((const __m128i*)(keys+lo)));
+            int mask=_mm_movemask_ps(_mm_castsi128_ps(less));
+            if(mask!=0xF)
+                return lo+__builtin_popcount(mask);
+        }
+    }
+#endif
+    while(lo<hi&&keys[lo]<key)
+        lo++;
+    return lo;
+}
+
+/*********************************************************************************
+ * Function:        childIndex
+ * Description:     child of an internal node whose subtree holds key
+ **********************************************************************************/
+static int childIndex(const int* keys, int numKeys, int key)
+{
+    int pos=lowerBound(keys,numKeys,key);
+    if(pos<numKeys&&keys[pos]==key)
+        pos++;
+    return pos;
+}
+
+/*********************************************************************************
+ * Function:        readNode / writeNode
+ * Description:     read / write a node page
+ **********************************************************************************/
+static RC readNode(BTreeInfo* t, int pageNum, NodePage* node)
+{
+    return readBlock(pageNum,&t->fh,node->bytes);
+}
+
+static RC writeNode(BTreeInfo* t, int pageNum, NodePage* node)
+{
+    return writeBlock(pageNum,&t->fh,node->bytes);
+}
+
+/*********************************************************************************
+ * Function:        allocNode
+ * Description:     take a page from the free list or append one to the file
+ * Output:          int* pageNum: the page for the new node
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC allocNode(BTreeInfo* t, int* pageNum)
+{
+    RC rc;
+
+    if(t->freeList>=0)
+    {
+        NodePage node;
+        rc=readNode(t,t->freeList,&node);
+        if(rc!=RC_OK) return rc;
+        *pageNum=t->freeList;
+        t->freeList=NODE_NEXT(&node);
+    }
+    else
+    {
+        // a bulk load may have extended the file past its last node
+        if(t->nextUnused>=t->fh.totalNumPages)
+        {
+            rc=appendEmptyBlock(&t->fh);
+            if(rc!=RC_OK) return rc;
+        }
+        *pageNum=t->nextUnused++;
+    }
+    t->numNodes++;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeNode
+ * Description:     put a node page on the free list
+ **********************************************************************************/
+static RC freeNode(BTreeInfo* t, int pageNum)
+{
+    NodePage node;
+
+    memset(&node,0,sizeof(node));
+    NODE_IS_LEAF(&node)=NODE_FREE;
+    NODE_NEXT(&node)=t->freeList;
+    RC rc=writeNode(t,pageNum,&node);
+    if(rc!=RC_OK) return rc;
+    t->freeList=pageNum;
+    t->numNodes--;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeMeta / readMeta
+ * Description:     write / read the tree information in page 0
+ **********************************************************************************/
+static RC writeMeta(BTreeInfo* t)
+{
+    NodePage page;
+
+    memset(&page,0,sizeof(page));
+    page.words[0]=BTREE_MAGIC;
+    page.words[1]=(int)t->keyType;
+    page.words[2]=t->n;
+    page.words[3]=t->root;
+    page.words[4]=t->numNodes;
+    page.words[5]=t->numEntries;
+    page.words[6]=t->freeList;
+    page.words[7]=t->nextUnused;
+    RC rc=writeBlock(0,&t->fh,page.bytes);
+    if(rc==RC_OK)
+        t->metaDirty=0;
+    return rc;
+}
+
+static RC readMeta(BTreeInfo* t)
+{
+    NodePage page;
+
+    RC rc=readBlock(0,&t->fh,page.bytes);
+    if(rc!=RC_OK) return rc;
+    if(page.words[0]!=BTREE_MAGIC||page.words[2]<2||page.words[2]>MAX_KEYS)
+        THROW(RC_FILE_HEADER_CORRUPT, "the page file is not a b+-tree index");
+    t->keyType=(DataType)page.words[1];
+    t->n=page.words[2];
+    t->root=page.words[3];
+    t->numNodes=page.words[4];
+    t->numEntries=page.words[5];
+    t->freeList=page.words[6];
+    t->nextUnused=page.words[7];
+    t->metaDirty=0;
+    return RC_OK;
+}
+
+/************************************************************
+ *                    index manager and trees               *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        initIndexManager
+ * Description:     initial the index manager and the storage manager below it
+ * Return:          RC: return code
+ **********************************************************************************/
+RC initIndexManager(void *mgmtData)
+{
+    (void)mgmtData;
+    initStorageManager();
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        shutdownIndexManager
+ * Description:     nothing to release, every tree owns its own state
+ * Return:          RC: return code
+ **********************************************************************************/
+RC shutdownIndexManager(void)
+{
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        createBtree
+ * Description:     create an index file holding an empty leaf as the root
+ * Input:           char* idxId: index name, also the file name
+                    DataType keyType: type of the keys
+                    int n: maximum number of keys in a node
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createBtree(char *idxId, DataType keyType, int n)
+{
+    BTreeInfo t;
+    NodePage root;
+    RC rc;
+
+    if(n>MAX_KEYS)
+        THROW_FMT(RC_IM_N_TO_LAGE, LOG_LEVEL_WARN, "a node holds at most %d keys", MAX_KEYS);
+    if(n<2)
+        THROW(RC_ERROR, "a node must hold at least 2 keys");
+    if(keyType!=DT_INT&&keyType!=DT_FLOAT&&keyType!=DT_BOOL)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "index keys must be DT_INT, DT_FLOAT or DT_BOOL");
+
+    rc=createPageFile(idxId);
+    if(rc!=RC_OK) return rc;
+    memset(&t,0,sizeof(t));
+    rc=openPageFile(idxId,&t.fh);
+    if(rc!=RC_OK) return rc;
+
+    t.keyType=keyType;
+    t.n=n;
+    t.freeList=-1;
+    t.nextUnused=1;
+    rc=allocNode(&t,&t.root);
+    if(rc==RC_OK)
+    {
+        memset(&root,0,sizeof(root));
+        NODE_IS_LEAF(&root)=1;
+        NODE_NEXT(&root)=-1;
+        rc=writeNode(&t,t.root,&root);
+    }
+    if(rc==RC_OK)
+        rc=writeMeta(&t);
+
+    RC closeRc=closePageFile(&t.fh);
+    if(rc!=RC_OK)
+    {
+        destroyPageFile(idxId);
+        return rc;
+    }
+    return closeRc;
+}
+
+/*********************************************************************************
+ * Function:        openBtree
+ * Description:     open an index
+ * Input:           char* idxId: index name
+ * Output:          BTreeHandle** tree: new handle, freed by closeBtree
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openBtree(BTreeHandle **tree, char *idxId)
+{
+    BTreeInfo* t=(BTreeInfo*)calloc(1,sizeof(BTreeInfo));
+    BTreeHandle* handle=(BTreeHandle*)malloc(sizeof(BTreeHandle));
+    RC rc;
+
+    if(t==0||handle==0)
+    {
+        free(t);
+        free(handle);
+        return RC_ERROR;
+    }
+    rc=openPageFile(idxId,&t->fh);
+    if(rc==RC_OK)
+    {
+        rc=readMeta(t);
+        if(rc!=RC_OK)
+            closePageFile(&t->fh);
+        else
+            warmUpPageFile(&t->fh);
+    }
+    if(rc!=RC_OK)
+    {
+        free(t);
+        free(handle);
+        return rc;
+    }
+
+    handle->keyType=t->keyType;
+    handle->idxId=idxId;
+    handle->mgmtData=t;
+    *tree=handle;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeBtree
+ * Description:     write back the tree information, close the file and free
+ *                  the handle
+ * Input:           BTreeHandle* tree: handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeBtree(BTreeHandle *tree)
+{
+    BTreeInfo* t;
+    RC rc=RC_OK;
+
+    if(tree==0||tree->mgmtData==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "index is not open");
+    t=(BTreeInfo*)tree->mgmtData;
+    if(t->metaDirty)
+        rc=writeMeta(t);
+    RC closeRc=closePageFile(&t->fh);
+    if(rc==RC_OK) rc=closeRc;
+    free(t);
+    free(tree);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteBtree
+ * Description:     remove the file of an index
+ * Input:           char* idxId: index name
+ * Return:          RC: return code
+ **********************************************************************************/
+RC deleteBtree(char *idxId)
+{
+    return destroyPageFile(idxId);
+}
+
+/*********************************************************************************
+ * Function:        getNumNodes / getNumEntries / getKeyType
+ * Description:     information about an open index
+ **********************************************************************************/
+RC getNumNodes(BTreeHandle *tree, int *result)
+{
+    *result=((BTreeInfo*)tree->mgmtData)->numNodes;
+    return RC_OK;
+}
+
+RC getNumEntries(BTreeHandle *tree, int *result)
+{
+    *result=((BTreeInfo*)tree->mgmtData)->numEntries;
+    return RC_OK;
+}
+
+RC getKeyType(BTreeHandle *tree, DataType *result)
+{
+    *result=((BTreeInfo*)tree->mgmtData)->keyType;
+    return RC_OK;
+}
+
+/************************************************************
+ *                    index access                          *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        findLeaf
+ * Description:     read the leaf whose key range holds key
+ **********************************************************************************/
+static RC findLeaf(BTreeInfo* t, int key, NodePage* node)
+{
+    int pageNum=t->root;
+
+    for(;;)
+    {
+        RC rc=readNode(t,pageNum,node);
+        if(rc!=RC_OK) return rc;
+        if(NODE_IS_LEAF(node)==1)
+            return RC_OK;
+        if(NODE_IS_LEAF(node)!=0)
+            THROW(RC_FILE_HEADER_CORRUPT, "index points to a free node");
+        pageNum=NODE_CHILDREN(t,node)[childIndex(NODE_KEYS(node),NODE_NUM_KEYS(node),key)];
+    }
+}
+
+/*********************************************************************************
+ * Function:        findKey
+ * Description:     look up the RID stored for a key
+ * Input:           BTreeHandle* tree: handle
+                    Value* key: key
+ * Output:          RID* result: RID of the key
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the key is not in the index
+ **********************************************************************************/
+RC findKey(BTreeHandle *tree, Value *key, RID *result)
+{
+    BTreeInfo* t=(BTreeInfo*)tree->mgmtData;
+    NodePage node;
+    int k;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    rc=findLeaf(t,k,&node);
+    if(rc!=RC_OK) return rc;
+
+    int pos=lowerBound(NODE_KEYS(&node),NODE_NUM_KEYS(&node),k);
+    if(pos>=NODE_NUM_KEYS(&node)||NODE_KEYS(&node)[pos]!=k)
+        THROW(RC_IM_KEY_NOT_FOUND, "key not found");
+    *result=NODE_RIDS(t,&node)[pos];
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        insertInto
+ * Description:     insert a key into the subtree rooted at pageNum. A node that
+ *                  overflows is split, the new right node and its separator
+ *                  are handed back to the parent.
+ * Input:           BTreeInfo* t: tree
+                    int pageNum: subtree root
+                    int key, RID rid: entry
+ * Output:          int* splitKey: separator of the new node
+                    int* splitPage: new node, -1 if there was no split
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC insertInto(BTreeInfo* t, int pageNum, int key, RID rid, int* splitKey, int* splitPage)
+{
+    NodePage node, sibling;
+    int tk[MAX_KEYS+1];
+    int* keys=NODE_KEYS(&node);
+    int num, pos, left, newPage;
+    RC rc;
+
+    *splitPage=-1;
+    rc=readNode(t,pageNum,&node);
+    if(rc!=RC_OK) return rc;
+    num=NODE_NUM_KEYS(&node);
+
+    if(NODE_IS_LEAF(&node))
+    {
+        RID* rids=NODE_RIDS(t,&node);
+        RID tr[MAX_KEYS+1];
+
+        pos=lowerBound(keys,num,key);
+        if(pos<num&&keys[pos]==key)
+            THROW(RC_IM_KEY_ALREADY_EXISTS, "key already exists");
+        if(num<t->n)
+        {
+            memmove(keys+pos+1,keys+pos,(num-pos)*sizeof(int));
+            memmove(rids+pos+1,rids+pos,(num-pos)*sizeof(RID));
+            keys[pos]=key;
+            rids[pos]=rid;
+            NODE_NUM_KEYS(&node)=num+1;
+            return writeNode(t,pageNum,&node);
+        }
+
+        // split the n+1 entries between this leaf and a new right sibling
+        memcpy(tk,keys,pos*sizeof(int));
+        memcpy(tr,rids,pos*sizeof(RID));
+        tk[pos]=key;
+        tr[pos]=rid;
+        memcpy(tk+pos+1,keys+pos,(num-pos)*sizeof(int));
+        memcpy(tr+pos+1,rids+pos,(num-pos)*sizeof(RID));
+        left=(t->n+2)/2;
+
+        rc=allocNode(t,&newPage);
+        if(rc!=RC_OK) return rc;
+        memset(&sibling,0,sizeof(sibling));
+        NODE_IS_LEAF(&sibling)=1;
+        NODE_NUM_KEYS(&sibling)=t->n+1-left;
+        NODE_NEXT(&sibling)=NODE_NEXT(&node);
+        memcpy(NODE_KEYS(&sibling),tk+left,(t->n+1-left)*sizeof(int));
+        memcpy(NODE_RIDS(t,&sibling),tr+left,(t->n+1-left)*sizeof(RID));
+
+        NODE_NUM_KEYS(&node)=left;
+        NODE_NEXT(&node)=newPage;
+        memcpy(keys,tk,left*sizeof(int));
+        memcpy(rids,tr,left*sizeof(RID));
+
+        rc=writeNode(t,newPage,&sibling);
+        if(rc!=RC_OK) return rc;
+        rc=writeNode(t,pageNum,&node);
+        if(rc!=RC_OK) return rc;
+        *splitKey=tk[left];
+        *splitPage=newPage;
+        return RC_OK;
+    }
+
+    int* children=NODE_CHILDREN(t,&node);
+    int tc[MAX_KEYS+2];
+    int childKey, childPage;
+
+    pos=childIndex(keys,num,key);
+    rc=insertInto(t,children[pos],key,rid,&childKey,&childPage);
+    if(rc!=RC_OK||childPage<0)
+        return rc;
+
+    if(num<t->n)
+    {
+        memmove(keys+pos+1,keys+pos,(num-pos)*sizeof(int));
+        memmove(children+pos+2,children+pos+1,(num-pos)*sizeof(int));
+        keys[pos]=childKey;
+        children[pos+1]=childPage;
+        NODE_NUM_KEYS(&node)=num+1;
+        return writeNode(t,pageNum,&node);
+    }
+
+    // split: the middle key moves up, the keys right of it go to the new node
+    memcpy(tk,keys,pos*sizeof(int));
+    tk[pos]=childKey;
+    memcpy(tk+pos+1,keys+pos,(num-pos)*sizeof(int));
+    memcpy(tc,children,(pos+1)*sizeof(int));
+    tc[pos+1]=childPage;
+    memcpy(tc+pos+2,children+pos+1,(num-pos)*sizeof(int));
+    left=(t->n+1)/2;
+
+    rc=allocNode(t,&newPage);
+    if(rc!=RC_OK) return rc;
+    memset(&sibling,0,sizeof(sibling));
+    NODE_IS_LEAF(&sibling)=0;
+    NODE_NUM_KEYS(&sibling)=t->n-left;
+    NODE_NEXT(&sibling)=-1;
+    memcpy(NODE_KEYS(&sibling),tk+left+1,(t->n-left)*sizeof(int));
+    memcpy(NODE_CHILDREN(t,&sibling),tc+left+1,(t->n-left+1)*sizeof(int));
+
+    NODE_NUM_KEYS(&node)=left;
+    memcpy(keys,tk,left*sizeof(int));
+    memcpy(children,tc,(left+1)*sizeof(int));
+
+    rc=writeNode(t,newPage,&sibling);
+    if(rc!=RC_OK) return rc;
+    rc=writeNode(t,pageNum,&node);
+    if(rc!=RC_OK) return rc;
+    *splitKey=tk[left];
+    *splitPage=newPage;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        insertKey
+ * Description:     add a key and its RID; a split of the root grows the tree
+ * Input:           BTreeHandle* tree: handle
+                    Value* key: key
+                    RID rid: RID stored for the key
+ * Return:          RC: RC_IM_KEY_ALREADY_EXISTS for a duplicate key
+ **********************************************************************************/
+RC insertKey(BTreeHandle *tree, Value *key, RID rid)
+{
+    BTreeInfo* t=(BTreeInfo*)tree->mgmtData;
+    int k, splitKey, splitPage, newRoot;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    rc=insertInto(t,t->root,k,rid,&splitKey,&splitPage);
+    if(rc!=RC_OK) return rc;
+
+    if(splitPage>=0)
+    {
+        NodePage root;
+        rc=allocNode(t,&newRoot);
+        if(rc!=RC_OK) return rc;
+        memset(&root,0,sizeof(root));
+        NODE_IS_LEAF(&root)=0;
+        NODE_NUM_KEYS(&root)=1;
+        NODE_NEXT(&root)=-1;
+        NODE_KEYS(&root)[0]=splitKey;
+        NODE_CHILDREN(t,&root)[0]=t->root;
+        NODE_CHILDREN(t,&root)[1]=splitPage;
+        rc=writeNode(t,newRoot,&root);
+        if(rc!=RC_OK) return rc;
+        t->root=newRoot;
+    }
+    t->numEntries++;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        removeChild
+ * Description:     drop separator sep and child sep+1 from an internal node
+ **********************************************************************************/
+static void removeChild(BTreeInfo* t, NodePage* parent, int sep)
+{
+    int* keys=NODE_KEYS(parent);
+    int* children=NODE_CHILDREN(t,parent);
+    int num=NODE_NUM_KEYS(parent);
+
+    memmove(keys+sep,keys+sep+1,(num-sep-1)*sizeof(int));
+    memmove(children+sep+1,children+sep+2,(num-sep-1)*sizeof(int));
+    NODE_NUM_KEYS(parent)=num-1;
+}
+
+/*********************************************************************************
+ * Function:        fixChild
+ * Description:     bring an underfull child of parent back to its minimum by
+ *                  borrowing an entry from a sibling, or merge it with the
+ *                  sibling when the sibling has none to spare. The caller
+ *                  writes the parent.
+ * Input:           BTreeInfo* t: tree
+                    NodePage* parent: parent node
+                    int idx: index of the underfull child
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC fixChild(BTreeInfo* t, NodePage* parent, int idx)
+{
+    NodePage child, sib;
+    int* pkeys=NODE_KEYS(parent);
+    int* pchildren=NODE_CHILDREN(t,parent);
+    int useLeft=idx>0;
+    int sibIdx=useLeft?idx-1:idx+1;
+    int sep=useLeft?idx-1:idx;
+    RC rc;
+
+    rc=readNode(t,pchildren[idx],&child);
+    if(rc!=RC_OK) return rc;
+    rc=readNode(t,pchildren[sibIdx],&sib);
+    if(rc!=RC_OK) return rc;
+
+    int* ckeys=NODE_KEYS(&child);
+    int* skeys=NODE_KEYS(&sib);
+    int cnum=NODE_NUM_KEYS(&child);
+    int snum=NODE_NUM_KEYS(&sib);
+    int leaf=NODE_IS_LEAF(&child);
+
+    if(snum>(leaf?minLeafKeys(t):minInternalKeys(t)))
+    {
+        if(leaf)
+        {
+            RID* crids=NODE_RIDS(t,&child);
+            RID* srids=NODE_RIDS(t,&sib);
+            if(useLeft)
+            {
+                memmove(ckeys+1,ckeys,cnum*sizeof(int));
+                memmove(crids+1,crids,cnum*sizeof(RID));
+                ckeys[0]=skeys[snum-1];
+                crids[0]=srids[snum-1];
+                pkeys[sep]=ckeys[0];
+            }
+            else
+            {
+                ckeys[cnum]=skeys[0];
+                crids[cnum]=srids[0];
+                memmove(skeys,skeys+1,(snum-1)*sizeof(int));
+                memmove(srids,srids+1,(snum-1)*sizeof(RID));
+                pkeys[sep]=skeys[0];
+            }
+        }
+        else
+        {
+            int* cchildren=NODE_CHILDREN(t,&child);
+            int* schildren=NODE_CHILDREN(t,&sib);
+            if(useLeft)
+            {
+                memmove(ckeys+1,ckeys,cnum*sizeof(int));
+                memmove(cchildren+1,cchildren,(cnum+1)*sizeof(int));
+                ckeys[0]=pkeys[sep];
+                cchildren[0]=schildren[snum];
+                pkeys[sep]=skeys[snum-1];
+            }
+            else
+            {
+                ckeys[cnum]=pkeys[sep];
+                cchildren[cnum+1]=schildren[0];
+                pkeys[sep]=skeys[0];
+                memmove(skeys,skeys+1,(snum-1)*sizeof(int));
+                memmove(schildren,schildren+1,snum*sizeof(int));
+            }
+        }
+        NODE_NUM_KEYS(&child)=cnum+1;
+        NODE_NUM_KEYS(&sib)=snum-1;
+        rc=writeNode(t,pchildren[idx],&child);
+        if(rc!=RC_OK) return rc;
+        return writeNode(t,pchildren[sibIdx],&sib);
+    }
+
+    // merge the right node of the pair into the left one
+    NodePage* l=useLeft?&sib:&child;
+    NodePage* r=useLeft?&child:&sib;
+    int lnum=NODE_NUM_KEYS(l);
+    int rnum=NODE_NUM_KEYS(r);
+    int leftPage=pchildren[sep];
+    int rightPage=pchildren[sep+1];
+
+    if(leaf)
+    {
+        memcpy(NODE_KEYS(l)+lnum,NODE_KEYS(r),rnum*sizeof(int));
+        memcpy(NODE_RIDS(t,l)+lnum,NODE_RIDS(t,r),rnum*sizeof(RID));
+        NODE_NUM_KEYS(l)=lnum+rnum;
+        NODE_NEXT(l)=NODE_NEXT(r);
+    }
+    else
+    {
+        NODE_KEYS(l)[lnum]=pkeys[sep];
+        memcpy(NODE_KEYS(l)+lnum+1,NODE_KEYS(r),rnum*sizeof(int));
+        memcpy(NODE_CHILDREN(t,l)+lnum+1,NODE_CHILDREN(t,r),(rnum+1)*sizeof(int));
+        NODE_NUM_KEYS(l)=lnum+rnum+1;
+    }
+    rc=writeNode(t,leftPage,l);
+    if(rc!=RC_OK) return rc;
+    rc=freeNode(t,rightPage);
+    if(rc!=RC_OK) return rc;
+    removeChild(t,parent,sep);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        deleteFrom
+ * Description:     remove a key from the subtree rooted at pageNum
+ * Output:          int* underflow: the subtree root has fewer keys than allowed
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC deleteFrom(BTreeInfo* t, int pageNum, int key, int* underflow)
+{
+    NodePage node;
+    int* keys=NODE_KEYS(&node);
+    int num, pos, childUnderflow;
+    RC rc;
+
+    *underflow=0;
+    rc=readNode(t,pageNum,&node);
+    if(rc!=RC_OK) return rc;
+    num=NODE_NUM_KEYS(&node);
+
+    if(NODE_IS_LEAF(&node))
+    {
+        RID* rids=NODE_RIDS(t,&node);
+        pos=lowerBound(keys,num,key);
+        if(pos>=num||keys[pos]!=key)
+            THROW(RC_IM_KEY_NOT_FOUND, "key not found");
+        memmove(keys+pos,keys+pos+1,(num-pos-1)*sizeof(int));
+        memmove(rids+pos,rids+pos+1,(num-pos-1)*sizeof(RID));
+        NODE_NUM_KEYS(&node)=num-1;
+        *underflow=num-1<minLeafKeys(t);
+        return writeNode(t,pageNum,&node);
+    }
+
+    pos=childIndex(keys,num,key);
+    rc=deleteFrom(t,NODE_CHILDREN(t,&node)[pos],key,&childUnderflow);
+    if(rc!=RC_OK||!childUnderflow)
+        return rc;
+    rc=fixChild(t,&node,pos);
+    if(rc!=RC_OK) return rc;
+    *underflow=NODE_NUM_KEYS(&node)<minInternalKeys(t);
+    return writeNode(t,pageNum,&node);
+}
+
+/*********************************************************************************
+ * Function:        deleteKey
+ * Description:     remove a key; underfull nodes borrow from or merge with a
+ *                  sibling, and a root left without keys is replaced by its child
+ * Input:           BTreeHandle* tree: handle
+                    Value* key: key
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the key is not in the index
+ **********************************************************************************/
+RC deleteKey(BTreeHandle *tree, Value *key)
+{
+    BTreeInfo* t=(BTreeInfo*)tree->mgmtData;
+    NodePage root;
+    int k, underflow;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    rc=deleteFrom(t,t->root,k,&underflow);
+    if(rc!=RC_OK) return rc;
+    t->numEntries--;
+    t->metaDirty=1;
+
+    rc=readNode(t,t->root,&root);
+    if(rc!=RC_OK) return rc;
+    if(!NODE_IS_LEAF(&root)&&NODE_NUM_KEYS(&root)==0)
+    {
+        int oldRoot=t->root;
+        t->root=NODE_CHILDREN(t,&root)[0];
+        rc=freeNode(t,oldRoot);
+    }
+    return rc;
+}
+
+/************************************************************
+ *                    scans                                 *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        openTreeRangeScan
+ * Description:     start a scan over the keys low <= key <= high in key order
+ * Input:           BTreeHandle* tree: handle
+                    Value* low, Value* high: bounds, NULL for an open bound
+ * Output:          BT_ScanHandle** handle: new scan, freed by closeTreeScan
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openTreeRangeScan(BTreeHandle *tree, Value *low, Value *high, BT_ScanHandle **handle)
+{
+    BTreeInfo* t=(BTreeInfo*)tree->mgmtData;
+    int lowKey=0;
+    RC rc;
+
+    TreeScan* scan=(TreeScan*)malloc(sizeof(TreeScan));
+    BT_ScanHandle* h=(BT_ScanHandle*)malloc(sizeof(BT_ScanHandle));
+    if(scan==0||h==0)
+    {
+        free(scan);
+        free(h);
+        return RC_ERROR;
+    }
+    scan->hasHigh=high!=0;
+    rc=RC_OK;
+    if(low!=0)
+        rc=keyOf(t,low,&lowKey);
+    if(rc==RC_OK&&high!=0)
+        rc=keyOf(t,high,&scan->high);
+    if(rc==RC_OK)
+    {
+        if(low!=0)
+            rc=findLeaf(t,lowKey,&scan->leaf);
+        else
+        {
+            // leftmost leaf
+            int pageNum=t->root;
+            for(;;)
+            {
+                rc=readNode(t,pageNum,&scan->leaf);
+                if(rc!=RC_OK||NODE_IS_LEAF(&scan->leaf))
+                    break;
+                pageNum=NODE_CHILDREN(t,&scan->leaf)[0];
+            }
+        }
+    }
+    if(rc!=RC_OK)
+    {
+        free(scan);
+        free(h);
+        return rc;
+    }
+
+    scan->pos=low!=0?lowerBound(NODE_KEYS(&scan->leaf),NODE_NUM_KEYS(&scan->leaf),lowKey):0;
+    h->tree=tree;
+    h->mgmtData=scan;
+    *handle=h;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        openTreeScan
+ * Description:     start a scan over all keys in key order
+ **********************************************************************************/
+RC openTreeScan(BTreeHandle *tree, BT_ScanHandle **handle)
+{
+    return openTreeRangeScan(tree,0,0,handle);
+}
+
+/*********************************************************************************
+ * Function:        nextEntry
+ * Description:     the RID of the next key of a scan, following the leaf chain
+ * Input:           BT_ScanHandle* handle: scan
+ * Output:          RID* result: RID of the next key
+ * Return:          RC: RC_IM_NO_MORE_ENTRIES at the end
+ **********************************************************************************/
+RC nextEntry(BT_ScanHandle *handle, RID *result)
+{
+    TreeScan* scan=(TreeScan*)handle->mgmtData;
+    BTreeInfo* t=(BTreeInfo*)handle->tree->mgmtData;
+
+    while(scan->pos>=NODE_NUM_KEYS(&scan->leaf))
+    {
+        if(NODE_NEXT(&scan->leaf)<0)
+            THROW(RC_IM_NO_MORE_ENTRIES, "no more entries");
+        RC rc=readNode(t,NODE_NEXT(&scan->leaf),&scan->leaf);
+        if(rc!=RC_OK) return rc;
+        scan->pos=0;
+    }
+    if(scan->hasHigh&&NODE_KEYS(&scan->leaf)[scan->pos]>scan->high)
+        THROW(RC_IM_NO_MORE_ENTRIES, "no more entries");
+    *result=NODE_RIDS(t,&scan->leaf)[scan->pos++];
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeTreeScan
+ * Description:     release a scan
+ **********************************************************************************/
+RC closeTreeScan(BT_ScanHandle *handle)
+{
+    if(handle==0) return RC_OK;
+    free(handle->mgmtData);
+    free(handle);
+    return RC_OK;
+}
+
+/************************************************************
+ *                    bulk loading                          *
+ ************************************************************/
+
+/*  A bulk load writes the leaves in key order to pages 1, 2, ..., then every
+ *  internal level above them from the first key and page of each node below,
+ *  until a level has a single node, the root. Nodes are collected in a batch
+ *  of LOAD_BATCH_PAGES pages and written with one writeBlocks call. The last
+ *  leaf stays in the batch until the next one starts, so its next pointer and
+ *  an underfull last leaf can still be fixed. */
+#define LOAD_BATCH_PAGES   64
+
+typedef struct BulkLoad{
+    BTreeInfo t;
+    int leafKeys;           // keys per leaf at the fill factor
+    int innerChildren;      // children per internal node at the fill factor
+    NodePage* batch;        // nodes of pages batchStart.. not written yet
+    int batchStart;
+    int batchCount;
+    int* sepKeys;           // first key and page of every node of the level being built
+    int* sepPages;
+    int numSeps;
+    int capSeps;
+    int hasLast;
+    int lastKey;
+}BulkLoad;
+
+/*********************************************************************************
+ * Function:        loadFlush
+ * Description:     write all but the last keep nodes of the batch
+ **********************************************************************************/
+static RC loadFlush(BulkLoad* load, int keep)
+{
+    int count=load->batchCount-keep;
+    RC rc;
+
+    if(count<=0)
+        return RC_OK;
+    if(load->batchStart+count>load->t.fh.totalNumPages)
+    {
+        // the expected size was too small, grow in large steps
+        int pages=load->t.fh.totalNumPages*2;
+        if(pages<load->batchStart+count)
+            pages=load->batchStart+count;
+        rc=ensureCapacity(pages,&load->t.fh);
+        if(rc!=RC_OK) return rc;
+    }
+    rc=writeBlocks(load->batchStart,count,&load->t.fh,load->batch[0].bytes);
+    if(rc!=RC_OK) return rc;
+
+    memmove(load->batch,load->batch+count,keep*sizeof(NodePage));
+    load->batchStart+=count;
+    load->batchCount=keep;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        loadNewNode
+ * Description:     start an empty node in the batch and remember its first key
+ * Input:           BulkLoad* load: load
+                    int isLeaf: leaf or internal node
+                    int firstKey: first key below the node
+ * Output:          NodePage** node: the node in the batch
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC loadNewNode(BulkLoad* load, int isLeaf, int firstKey, NodePage** node)
+{
+    RC rc;
+
+    if(load->batchCount==LOAD_BATCH_PAGES)
+    {
+        rc=loadFlush(load,1);
+        if(rc!=RC_OK) return rc;
+    }
+    if(load->numSeps==load->capSeps)
+    {
+        int cap=load->capSeps*2;
+        int* keys=(int*)realloc(load->sepKeys,cap*sizeof(int));
+        if(keys==0) return RC_ERROR;
+        load->sepKeys=keys;
+        int* pages=(int*)realloc(load->sepPages,cap*sizeof(int));
+        if(pages==0) return RC_ERROR;
+        load->sepPages=pages;
+        load->capSeps=cap;
+    }
+
+    *node=&load->batch[load->batchCount++];
+    memset(*node,0,sizeof(NodePage));
+    NODE_IS_LEAF(*node)=isLeaf;
+    NODE_NEXT(*node)=-1;
+    load->sepKeys[load->numSeps]=firstKey;
+    load->sepPages[load->numSeps]=load->t.nextUnused++;
+    load->numSeps++;
+    load->t.numNodes++;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        openBulkLoad
+ * Description:     create an index that is filled by bulkLoadKey in key order
+ * Input:           char* idxId: index name, also the file name
+                    DataType keyType: type of the keys
+                    int n: maximum number of keys in a node
+                    float fillFactor: part of a node to fill, 0 < fillFactor <= 1
+                    int expectedEntries: number of keys to size the file for, 0 if unknown
+ * Output:          BT_LoadHandle** handle: new load, finished by closeBulkLoad
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openBulkLoad(char *idxId, DataType keyType, int n, float fillFactor, int expectedEntries, BT_LoadHandle **handle)
+{
+    BulkLoad* load;
+    BT_LoadHandle* h;
+    RC rc;
+
+    if(fillFactor<=0||fillFactor>1)
+        THROW(RC_ERROR, "the fill factor must be in (0, 1]");
+    rc=createBtree(idxId,keyType,n);
+    if(rc!=RC_OK) return rc;
+
+    load=(BulkLoad*)calloc(1,sizeof(BulkLoad));
+    h=(BT_LoadHandle*)malloc(sizeof(BT_LoadHandle));
+    if(load!=0)
+    {
+        load->batch=(NodePage*)malloc(LOAD_BATCH_PAGES*sizeof(NodePage));
+        load->capSeps=1024;
+        load->sepKeys=(int*)malloc(load->capSeps*sizeof(int));
+        load->sepPages=(int*)malloc(load->capSeps*sizeof(int));
+    }
+    if(load==0||h==0||load->batch==0||load->sepKeys==0||load->sepPages==0)
+        rc=RC_ERROR;
+    if(rc==RC_OK)
+        rc=openPageFile(idxId,&load->t.fh);
+    if(rc==RC_OK)
+    {
+        rc=readMeta(&load->t);
+        if(rc!=RC_OK)
+            closePageFile(&load->t.fh);
+    }
+    if(rc!=RC_OK)
+    {
+        if(load!=0)
+        {
+            free(load->batch);
+            free(load->sepKeys);
+            free(load->sepPages);
+        }
+        free(load);
+        free(h);
+        destroyPageFile(idxId);
+        return rc;
+    }
+
+    // the empty root of createBtree is dropped, the nodes start at page 1
+    load->t.numNodes=0;
+    load->t.nextUnused=1;
+    load->batchStart=1;
+
+    load->leafKeys=(int)(n*fillFactor);
+    if(load->leafKeys<minLeafKeys(&load->t)) load->leafKeys=minLeafKeys(&load->t);
+    if(load->leafKeys>n) load->leafKeys=n;
+    if(load->leafKeys<1) load->leafKeys=1;
+    load->innerChildren=(int)((n+1)*fillFactor);
+    if(load->innerChildren<minInternalKeys(&load->t)+1) load->innerChildren=minInternalKeys(&load->t)+1;
+    if(load->innerChildren<2) load->innerChildren=2;
+    if(load->innerChildren>n+1) load->innerChildren=n+1;
+
+    // size the file once for all levels
+    if(expectedEntries>0)
+    {
+        long pages=expectedEntries/load->leafKeys+1;
+        long level=pages;
+        while(level>1)
+        {
+            level=(level+load->innerChildren-1)/load->innerChildren;
+            pages+=level;
+        }
+        if(1+pages<=INT_MAX)
+            ensureCapacity((int)(1+pages),&load->t.fh);
+    }
+
+    h->idxId=idxId;
+    h->mgmtData=load;
+    *handle=h;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        bulkLoadKey
+ * Description:     append the next key; keys must be strictly increasing
+ * Input:           BT_LoadHandle* handle: load
+                    Value* key: key
+                    RID rid: RID stored for the key
+ * Return:          RC: RC_IM_KEY_ALREADY_EXISTS for a key that is not larger
+ *                  than the one before
+ **********************************************************************************/
+RC bulkLoadKey(BT_LoadHandle *handle, Value *key, RID rid)
+{
+    BulkLoad* load=(BulkLoad*)handle->mgmtData;
+    NodePage* leaf;
+    int k;
+
+    RC rc=keyOf(&load->t,key,&k);
+    if(rc!=RC_OK) return rc;
+    if(load->hasLast&&k<=load->lastKey)
+        THROW(RC_IM_KEY_ALREADY_EXISTS, "bulk loaded keys must be strictly increasing");
+
+    leaf=load->batchCount>0?&load->batch[load->batchCount-1]:0;
+    if(leaf==0||NODE_NUM_KEYS(leaf)==load->leafKeys)
+    {
+        rc=loadNewNode(load,1,k,&leaf);
+        if(rc!=RC_OK) return rc;
+        if(load->batchCount>1)
+            NODE_NEXT(&load->batch[load->batchCount-2])=load->sepPages[load->numSeps-1];
+    }
+
+    NODE_KEYS(leaf)[NODE_NUM_KEYS(leaf)]=k;
+    NODE_RIDS(&load->t,leaf)[NODE_NUM_KEYS(leaf)]=rid;
+    NODE_NUM_KEYS(leaf)++;
+    load->t.numEntries++;
+    load->hasLast=1;
+    load->lastKey=k;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        balanceLastLeaf
+ * Description:     the last leaf may be underfull; merge it into the leaf before
+ *                  it, or split the keys of both evenly
+ **********************************************************************************/
+static void balanceLastLeaf(BulkLoad* load)
+{
+    BTreeInfo* t=&load->t;
+
+    if(load->batchCount<2||load->numSeps<2)
+        return;
+    NodePage* prev=&load->batch[load->batchCount-2];
+    NodePage* last=&load->batch[load->batchCount-1];
+    int pnum=NODE_NUM_KEYS(prev);
+    int lnum=NODE_NUM_KEYS(last);
+    int total=pnum+lnum;
+
+    if(lnum>=minLeafKeys(t))
+        return;
+    if(total<=t->n)
+    {
+        memcpy(NODE_KEYS(prev)+pnum,NODE_KEYS(last),lnum*sizeof(int));
+        memcpy(NODE_RIDS(t,prev)+pnum,NODE_RIDS(t,last),lnum*sizeof(RID));
+        NODE_NUM_KEYS(prev)=total;
+        NODE_NEXT(prev)=-1;
+        load->batchCount--;
+        load->numSeps--;
+        load->t.nextUnused--;
+        load->t.numNodes--;
+        return;
+    }
+
+    int move=total/2-lnum;
+    memmove(NODE_KEYS(last)+move,NODE_KEYS(last),lnum*sizeof(int));
+    memmove(NODE_RIDS(t,last)+move,NODE_RIDS(t,last),lnum*sizeof(RID));
+    memcpy(NODE_KEYS(last),NODE_KEYS(prev)+pnum-move,move*sizeof(int));
+    memcpy(NODE_RIDS(t,last),NODE_RIDS(t,prev)+pnum-move,move*sizeof(RID));
+    NODE_NUM_KEYS(prev)=pnum-move;
+    NODE_NUM_KEYS(last)=lnum+move;
+    load->sepKeys[load->numSeps-1]=NODE_KEYS(last)[0];
+}
+
+/*********************************************************************************
+ * Function:        buildLevel
+ * Description:     build the internal nodes over the nodes in sepKeys/sepPages
+ *                  and replace them by the new nodes. The last node takes over
+ *                  children from the one before when it would be underfull.
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC buildLevel(BulkLoad* load)
+{
+    BTreeInfo* t=&load->t;
+    int numChildren=load->numSeps;
+    int per=load->innerChildren;
+    int numNodes=(numChildren+per-1)/per;
+    int lastSize=numChildren-(numNodes-1)*per;
+    int beforeLast=per;
+    int i, j, start=0;
+
+    if(numNodes>1&&lastSize-1<minInternalKeys(t))
+    {
+        int total=per+lastSize;
+        if(total<=t->n+1)
+        {
+            numNodes--;
+            lastSize=total;
+        }
+        else
+        {
+            beforeLast=total-total/2;
+            lastSize=total/2;
+        }
+    }
+
+    load->numSeps=0;
+    for(i=0;i<numNodes;i++)
+    {
+        int size=i==numNodes-1?lastSize:(i==numNodes-2?beforeLast:per);
+        int firstKey=load->sepKeys[start];
+        int pages[MAX_KEYS+2];
+        int keys[MAX_KEYS+1];
+        NodePage* node;
+
+        // the new entry for this node may overwrite entries already used
+        for(j=0;j<size;j++)
+        {
+            pages[j]=load->sepPages[start+j];
+            if(j>0) keys[j-1]=load->sepKeys[start+j];
+        }
+        RC rc=loadNewNode(load,0,firstKey,&node);
+        if(rc!=RC_OK) return rc;
+        NODE_NUM_KEYS(node)=size-1;
+        memcpy(NODE_KEYS(node),keys,(size-1)*sizeof(int));
+        memcpy(NODE_CHILDREN(t,node),pages,size*sizeof(int));
+        start+=size;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeBulkLoad
+ * Description:     write the last leaves, build the levels above them, write the
+ *                  tree information and close the index
+ * Input:           BT_LoadHandle* handle: load, freed here
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeBulkLoad(BT_LoadHandle *handle)
+{
+    BulkLoad* load=(BulkLoad*)handle->mgmtData;
+    NodePage* node;
+    RC rc=RC_OK;
+
+    // an empty load gives an empty leaf as the root
+    if(load->numSeps==0)
+        rc=loadNewNode(load,1,0,&node);
+    if(rc==RC_OK)
+    {
+        balanceLastLeaf(load);
+        rc=loadFlush(load,0);
+    }
+    while(rc==RC_OK&&load->numSeps>1)
+    {
+        rc=buildLevel(load);
+        if(rc==RC_OK)
+            rc=loadFlush(load,0);
+    }
+    if(rc==RC_OK)
+    {
+        load->t.root=load->sepPages[0];
+        load->t.freeList=-1;
+        rc=writeMeta(&load->t);
+    }
+
+    RC closeRc=closePageFile(&load->t.fh);
+    if(rc==RC_OK) rc=closeRc;
+    free(load->batch);
+    free(load->sepKeys);
+    free(load->sepPages);
+    free(load);
+    free(handle);
+    return rc;
+}
@@ -0,0 +1,61 @@
+#ifndef BTREE_MGR_H
+#define BTREE_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+// structure for accessing btrees
+typedef struct BTreeHandle {
+  DataType keyType;
+  char *idxId;
+  void *mgmtData;
+} BTreeHandle;
+
+typedef struct BT_ScanHandle {
+  BTreeHandle *tree;
+  void *mgmtData;
+} BT_ScanHandle;
+
+typedef struct BT_LoadHandle {
+  char *idxId;
+  void *mgmtData;
+} BT_LoadHandle;
+
+// init and shutdown index manager
+extern RC initIndexManager (void *mgmtData);
+extern RC shutdownIndexManager (void);
+
+// create, destroy, open, and close an btree index; n is the maximum
+// number of keys in a node, keys are DT_INT, DT_FLOAT or DT_BOOL values
+extern RC createBtree (char *idxId, DataType keyType, int n);
+extern RC openBtree (BTreeHandle **tree, char *idxId);
+extern RC closeBtree (BTreeHandle *tree);
+extern RC deleteBtree (char *idxId);
+
+// access information about a b-tree
+extern RC getNumNodes (BTreeHandle *tree, int *result);
+extern RC getNumEntries (BTreeHandle *tree, int *result);
+extern RC getKeyType (BTreeHandle *tree, DataType *result);
+
+// index access
+extern RC findKey (BTreeHandle *tree, Value *key, RID *result);
+extern RC insertKey (BTreeHandle *tree, Value *key, RID rid);
+extern RC deleteKey (BTreeHandle *tree, Value *key);
+
+// scans return entries in key order; a range scan returns the keys
+// low <= key <= high, a NULL bound is open. The tree must not be changed
+// while a scan is open.
+extern RC openTreeScan (BTreeHandle *tree, BT_ScanHandle **handle);
+extern RC openTreeRangeScan (BTreeHandle *tree, Value *low, Value *high, BT_ScanHandle **handle);
+extern RC nextEntry (BT_ScanHandle *handle, RID *result);
+extern RC closeTreeScan (BT_ScanHandle *handle);
+
+// bulk loading builds a new index bottom-up from keys in strictly increasing
+// order. Nodes are filled to fillFactor (0 < fillFactor <= 1) of n and written
+// in large sequential batches; expectedEntries (0 if unknown) sizes the file
+// once up front.
+extern RC openBulkLoad (char *idxId, DataType keyType, int n, float fillFactor, int expectedEntries, BT_LoadHandle **handle);
+extern RC bulkLoadKey (BT_LoadHandle *handle, Value *key, RID rid);
+extern RC closeBulkLoad (BT_LoadHandle *handle);
+
+#endif // BTREE_MGR_H
@@ -3,8 +3,34 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 
-char *RC_message;
+THREAD_LOCAL char *RC_message;
+
+// preallocated storage for formatted messages, so reporting an error never allocates
+static THREAD_LOCAL char RC_messageBuffer[RC_MESSAGE_SIZE];
+
+// errors are logged by default, routine conditions like end of file are not
+int logLevel = LOG_LEVEL_ERROR;
+
+/* one record of the log ring. seq is 2*ticket+1 while the record is written
+ * and 2*ticket+2 once it is complete, the reader uses it like a seqlock */
+#define LOG_RECORD_SIZE 160
+
+typedef struct LogRecord {
+  unsigned long seq;
+  int level;
+  int line;
+  const char *file;
+  char text[LOG_RECORD_SIZE];
+} LogRecord;
+
+static LogRecord *logRing = NULL;
+static unsigned long logRingMask;
+static unsigned long logRingHead;  // next ticket to hand out
+static unsigned long logRingTail;  // next ticket to drain
+
+static const char *levelNames[] = { "DEBUG", "INFO", "WARN", "ERROR" };
 
 /* print a message to standard out describing the error */
 void
@@ -34,3 +60,124 @@ errorMessage (RC error)
 
   return message;
 }
+
+/* format a message into the per-thread buffer and make it the current message */
+void
+setErrorMessage (const char *format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(RC_messageBuffer, RC_MESSAGE_SIZE, format, args);
+  va_end(args);
+  RC_message = RC_messageBuffer;
+}
+
+/* set the runtime log level, LOG_LEVEL_NONE turns logging off */
+void
+setLogLevel (int level)
+{
+  logLevel = level;
+}
+
+/* write one log record, to the ring if it is enabled, otherwise to stderr */
+void
+logMessage (int level, const char *file, int line, const char *format, ...)
+{
+  va_list args;
+
+  if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_ERROR)
+    level = LOG_LEVEL_ERROR;
+
+  va_start(args, format);
+  if (logRing != NULL)
+    {
+      // claim a record; when the ring is full the oldest records are overwritten
+      unsigned long ticket = __atomic_fetch_add(&logRingHead, 1, __ATOMIC_RELAXED);
+      LogRecord *rec = &logRing[ticket & logRingMask];
+
+      __atomic_store_n(&rec->seq, 2 * ticket + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      rec->level = level;
+      rec->line = line;
+      rec->file = file;
+      vsnprintf(rec->text, LOG_RECORD_SIZE, format, args);
+      __atomic_store_n(&rec->seq, 2 * ticket + 2, __ATOMIC_RELEASE);
+    }
+  else
+    {
+      fprintf(stderr, "[%s-L%i] %s: ", file, line, levelNames[level]);
+      vfprintf(stderr, format, args);
+      fputc('\n', stderr);
+    }
+  va_end(args);
+}
+
+/* switch logMessage to the ring, capacity is rounded up to a power of two.
+ * Call it before other threads start logging. */
+RC
+enableLogRing (int capacity)
+{
+  unsigned long size = 1;
+
+  if (logRing != NULL)
+    return RC_OK;
+  while (size < (unsigned long) capacity)
+    size <<= 1;
+
+  LogRecord *ring = (LogRecord *) calloc(size, sizeof(LogRecord));
+  if (ring == NULL)
+    return RC_ERROR;
+
+  logRingMask = size - 1;
+  logRingHead = 0;
+  logRingTail = 0;
+  logRing = ring;
+  return RC_OK;
+}
+
+/* print the records logged since the last drain; records that were 
+ * overwritten or are still being written are skipped. Single reader only. */
+void
+drainLogRing (FILE *out)
+{
+  LogRecord copy;
+  unsigned long head;
+
+  if (logRing == NULL)
+    return;
+
+  head = __atomic_load_n(&logRingHead, __ATOMIC_ACQUIRE);
+  if (head - logRingTail > logRingMask + 1)
+    logRingTail = head - (logRingMask + 1);
+
+  for (; logRingTail != head; logRingTail++)
+    {
+      LogRecord *rec = &logRing[logRingTail & logRingMask];
+      unsigned long seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+      if (seq != 2 * logRingTail + 2)
+        continue;
+      memcpy(&copy, rec, sizeof(copy));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      // a writer lapped us while copying
+      if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq)
+        continue;
+
+      copy.text[LOG_RECORD_SIZE - 1] = '\0';
+      fprintf(out, "[%s-L%i] %s: %s\n", copy.file, copy.line, levelNames[copy.level], copy.text);
+    }
+}
+
+/* drain the ring to stderr and go back to logging directly */
+void
+disableLogRing (void)
+{
+  LogRecord *ring = logRing;
+
+  if (ring == NULL)
+    return;
+  drainLogRing(stderr);
+  logRing = NULL;
+  free(ring);
+}
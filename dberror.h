@@ -24,6 +24,9 @@ typedef int RC;
 #define RC_FILE_OPEN_FAILED 6
 #define RC_FILE_REMOVE_FAILED 7
 #define RC_WRITE_NON_EXISTING_PAGE 8
+#define RC_FILE_HEADER_CORRUPT 9
+#define RC_FEATURE_NOT_SUPPORTED 10
+#define RC_DELTA_EPOCH_MISMATCH 11
 
 #define RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE 200
 #define RC_RM_EXPR_RESULT_IS_NOT_BOOLEAN 201
@@ -31,25 +34,81 @@ typedef int RC;
 #define RC_RM_NO_MORE_TUPLES 203
 #define RC_RM_NO_PRINT_FOR_DATATYPE 204
 #define RC_RM_UNKOWN_DATATYPE 205
+#define RC_RM_NO_SUCH_RECORD 206
+#define RC_RM_RECORD_TOO_BIG 207
 
 #define RC_IM_KEY_NOT_FOUND 300
 #define RC_IM_KEY_ALREADY_EXISTS 301
 #define RC_IM_N_TO_LAGE 302
 #define RC_IM_NO_MORE_ENTRIES 303
 
-/* holder for error messages */
-extern char *RC_message;
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* holder for error messages, every thread has its own */
+#define RC_MESSAGE_SIZE 256
+extern THREAD_LOCAL char *RC_message;
 
 /* print a message to standard out describing the error */
 extern void printError (RC error);
 extern char *errorMessage (RC error);
 
+/* format a message into the preallocated per-thread buffer and make it RC_message */
+extern void setErrorMessage (const char *format, ...);
+
+/* log levels, LOG calls below LOG_COMPILE_LEVEL are compiled out and calls 
+ * below the runtime level set by setLogLevel cost one compare */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+extern int logLevel;
+extern void setLogLevel (int level);
+extern void logMessage (int level, const char *file, int line, const char *format, ...);
+
+/* lock-free ring buffer for log records; while enabled logMessage only 
+ * copies the record into the ring and drainLogRing prints them */
+extern RC enableLogRing (int capacity);
+extern void drainLogRing (FILE *out);
+extern void disableLogRing (void);
+
+#define LOG(level, ...)						\
+  do {									\
+    if ((level) >= LOG_COMPILE_LEVEL && (level) >= logLevel)		\
+      logMessage((level), __FILE__, __LINE__, __VA_ARGS__);		\
+  } while (0)
+
 #define THROW(rc,message) \
   do {			  \
     RC_message=message;	  \
     return rc;		  \
   } while (0)		  \
 
+// set a constant message, log it and return the error code
+#define THROW_LOG(rc,level,message)				\
+  do {									\
+    RC_message=message;							\
+    LOG((level), "%s", RC_message);					\
+    return rc;								\
+  } while (0)
+
+// same with a formatted message
+#define THROW_FMT(rc,level,...)					\
+  do {									\
+    setErrorMessage(__VA_ARGS__);					\
+    LOG((level), "%s", RC_message);					\
+    return rc;								\
+  } while (0)
+
 // check the return code and exit if it is an error
 #define CHECK(code)							\
   do {									\
@@ -0,0 +1,760 @@
+#include "hash_mgr.h"
+#include "storage_mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*  Linear hashing: the index has 2^level+next buckets. A key whose hash is
+ *  h goes to bucket h mod 2^level, or h mod 2^(level+1) if that bucket has
+ *  already been split in this round (it is below next). When the entries
+ *  pass SPLIT_LOAD of the bucket slots, bucket next is split into itself
+ *  and bucket next+2^level, so the index grows by one bucket at a time and
+ *  never rehashes as a whole.
+ *
+ *  Page 0 of the index file holds the index information, page b+1 bucket b,
+ *  so a bucket is found without a directory. A bucket that is full chains
+ *  overflow pages, which live in a second page file with a free list.
+ *
+ *  A bucket page holds a one byte fingerprint of the hash of every entry in
+ *  front of the keys and RIDs. A lookup compares the fingerprints 32 or 16
+ *  at a time with AVX2 or SSE2 and only looks at the keys that match. */
+#define HASH_MAGIC         0x31485348   /* "HSH1" */
+#define OVERFLOW_SUFFIX    ".ovf"
+#define BUCKET_SLOTS       312
+#define BUCKET_FP_BYTES    320          // fingerprints, padded to 32 byte blocks
+#define SPLIT_LOAD         0.75
+#define META_INTS          (PAGE_SIZE/(int)sizeof(int))
+
+typedef union BucketPage{
+    char bytes[PAGE_SIZE];
+    struct{
+        int count;
+        int overflow;                       // next page of the chain in the overflow file, -1 ends
+        int pad[2];
+        unsigned char fp[BUCKET_FP_BYTES];
+        int keys[BUCKET_SLOTS];
+        RID rids[BUCKET_SLOTS];
+    }b;
+}BucketPage;
+
+typedef struct HashInfo{
+    SM_FileHandle fh;       // information and buckets
+    SM_FileHandle ovf;      // overflow pages
+    DataType keyType;
+    int level;
+    int next;               // next bucket to split
+    int numBuckets;
+    int numEntries;
+    int numOverflow;        // overflow pages in chains
+    int freeList;           // first free overflow page, -1 if none
+    int nextUnused;         // first overflow page never used
+    int metaDirty;
+}HashInfo;
+
+/*  place of a page of a chain: the bucket page or an overflow page  */
+typedef struct ChainPos{
+    int overflow;
+    int pageNum;
+}ChainPos;
+
+/*********************************************************************************
+ * Function:        keyOf
+ * Description:     the int a key value is stored as
+ * Input:           HashInfo* t: index
+                    Value* key: key of the index's key type
+ * Output:          int* out: stored key
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC keyOf(HashInfo* t, Value* key, int* out)
+{
+    if(key->dt!=t->keyType)
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "key does not have the key type of the index");
+
+    switch(key->dt)
+    {
+    case DT_INT:
+        *out=key->v.intV;
+        return RC_OK;
+    case DT_BOOL:
+        *out=key->v.boolV?1:0;
+        return RC_OK;
+    case DT_FLOAT:
+        {
+            // -0.0 equals 0.0, so it must hash the same
+            float f=key->v.floatV==0.0f?0.0f:key->v.floatV;
+            memcpy(out,&f,sizeof(int));
+        }
+        return RC_OK;
+    default:
+        THROW(RC_FEATURE_NOT_SUPPORTED, "index keys must be DT_INT, DT_FLOAT or DT_BOOL");
+    }
+}
+
+/*********************************************************************************
+ * Function:        hashKey
+ * Description:     32 bit mix of a key; the low bits pick the bucket, the top
+ *                  byte is the fingerprint
+ **********************************************************************************/
+static unsigned int hashKey(int key)
+{
+    unsigned int h=(unsigned int)key;
+    h^=h>>16;
+    h*=0x85ebca6bu;
+    h^=h>>13;
+    h*=0xc2b2ae35u;
+    h^=h>>16;
+    return h;
+}
+
+static unsigned char fingerprintOf(unsigned int h)
+{
+    return (unsigned char)(h>>24);
+}
+
+/*********************************************************************************
+ * Function:        bucketOf
+ * Description:     the bucket of a hash with the current level and split pointer
+ **********************************************************************************/
+static int bucketOf(HashInfo* t, unsigned int h)
+{
+    unsigned int b=h&((1u<<t->level)-1);
+    if((int)b<t->next)
+        b=h&((2u<<t->level)-1);
+    return (int)b;
+}
+
+/*********************************************************************************
+ * Function:        findSlot
+ * Description:     slot of a key in a bucket page. Only the slots whose
+ *                  fingerprint matches are compared, the fingerprints are
+ *                  matched with AVX2 or SSE2 compares when the compiler
+ *                  targets them.
+ * Input:           BucketPage* page: bucket or overflow page
+                    unsigned char fp: fingerprint of the key
+                    int key: key
+ * Return:          int: slot, -1 if the page does not hold the key
+ **********************************************************************************/
+static int findSlot(BucketPage* page, unsigned char fp, int key)
+{
+    int count=page->b.count, base;
+
+    for(base=0;base<count;base+=32)
+    {
+        unsigned int mask;
+#if defined(__AVX2__)
+        __m256i f=_mm256_loadu_si256((const __m256i*)(page->b.fp+base));
+        mask=(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(f,_mm256_set1_epi8((char)fp)));
+#elif defined(__SSE2__)
+        __m128i want=_mm_set1_epi8((char)fp);
+        __m128i lo=_mm_loadu_si128((const __m128i*)(page->b.fp+base));
+        __m128i hi=_mm_loadu_si128((const __m128i*)(page->b.fp+base+16));
+        mask=(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(lo,want))
+            |((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(hi,want))<<16);
+#else
+        int i;
+        mask=0;
+        for(i=0;i<32;i++)
+            if(page->b.fp[base+i]==fp)
+                mask|=1u<<i;
+#endif
+        // slots past the last entry hold stale fingerprints
+        if(count-base<32)
+            mask&=(1u<<(count-base))-1;
+        while(mask!=0)
+        {
+            int slot=base+__builtin_ctz(mask);
+            if(page->b.keys[slot]==key)
+                return slot;
+            mask&=mask-1;
+        }
+    }
+    return -1;
+}
+
+/*********************************************************************************
+ * Function:        readPage / writePage
+ * Description:     read / write a page of a chain
+ **********************************************************************************/
+static RC readPage(HashInfo* t, ChainPos pos, BucketPage* page)
+{
+    return readBlock(pos.pageNum,pos.overflow?&t->ovf:&t->fh,page->bytes);
+}
+
+static RC writePage(HashInfo* t, ChainPos pos, BucketPage* page)
+{
+    return writeBlock(pos.pageNum,pos.overflow?&t->ovf:&t->fh,page->bytes);
+}
+
+static ChainPos bucketPos(int bucket)
+{
+    ChainPos pos;
+    pos.overflow=0;
+    pos.pageNum=bucket+1;
+    return pos;
+}
+
+static ChainPos overflowPos(int pageNum)
+{
+    ChainPos pos;
+    pos.overflow=1;
+    pos.pageNum=pageNum;
+    return pos;
+}
+
+/*********************************************************************************
+ * Function:        allocOverflow
+ * Description:     take an overflow page from the free list or a new one
+ * Output:          int* pageNum: the page
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC allocOverflow(HashInfo* t, int* pageNum)
+{
+    RC rc;
+
+    if(t->freeList>=0)
+    {
+        BucketPage page;
+        rc=readPage(t,overflowPos(t->freeList),&page);
+        if(rc!=RC_OK) return rc;
+        *pageNum=t->freeList;
+        t->freeList=page.b.overflow;
+    }
+    else
+    {
+        if(t->nextUnused>=t->ovf.totalNumPages)
+        {
+            rc=ensureCapacity(t->nextUnused+1,&t->ovf);
+            if(rc!=RC_OK) return rc;
+        }
+        *pageNum=t->nextUnused++;
+    }
+    t->numOverflow++;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeOverflow
+ * Description:     put an overflow page on the free list
+ **********************************************************************************/
+static RC freeOverflow(HashInfo* t, int pageNum)
+{
+    BucketPage page;
+
+    memset(&page,0,sizeof(page));
+    page.b.overflow=t->freeList;
+    RC rc=writePage(t,overflowPos(pageNum),&page);
+    if(rc!=RC_OK) return rc;
+    t->freeList=pageNum;
+    t->numOverflow--;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeMeta / readMeta
+ * Description:     write / read the index information in page 0
+ **********************************************************************************/
+static RC writeMeta(HashInfo* t)
+{
+    int words[META_INTS];
+
+    memset(words,0,sizeof(words));
+    words[0]=HASH_MAGIC;
+    words[1]=(int)t->keyType;
+    words[2]=t->level;
+    words[3]=t->next;
+    words[4]=t->numBuckets;
+    words[5]=t->numEntries;
+    words[6]=t->numOverflow;
+    words[7]=t->freeList;
+    words[8]=t->nextUnused;
+    RC rc=writeBlock(0,&t->fh,(SM_PageHandle)words);
+    if(rc==RC_OK)
+        t->metaDirty=0;
+    return rc;
+}
+
+static RC readMeta(HashInfo* t)
+{
+    int words[META_INTS];
+
+    RC rc=readBlock(0,&t->fh,(SM_PageHandle)words);
+    if(rc!=RC_OK) return rc;
+    if(words[0]!=HASH_MAGIC||words[2]<0||words[2]>30||words[4]!=(1<<words[2])+words[3])
+        THROW(RC_FILE_HEADER_CORRUPT, "the page file is not a hash index");
+    t->keyType=(DataType)words[1];
+    t->level=words[2];
+    t->next=words[3];
+    t->numBuckets=words[4];
+    t->numEntries=words[5];
+    t->numOverflow=words[6];
+    t->freeList=words[7];
+    t->nextUnused=words[8];
+    t->metaDirty=0;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeChain
+ * Description:     fill a bucket and as many new overflow pages as it takes
+ *                  with entries; the bucket has no overflow pages yet
+ * Input:           HashInfo* t: index
+                    int bucket: bucket
+                    int* keys, RID* rids: entries
+                    int n: number of entries
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeChain(HashInfo* t, int bucket, int* keys, RID* rids, int n)
+{
+    BucketPage page;
+    ChainPos pos=bucketPos(bucket);
+    int done=0, i;
+    RC rc=RC_OK;
+
+    do
+    {
+        int count=n-done<BUCKET_SLOTS?n-done:BUCKET_SLOTS;
+        memset(&page,0,sizeof(page));
+        page.b.count=count;
+        page.b.overflow=-1;
+        for(i=0;i<count;i++)
+        {
+            page.b.keys[i]=keys[done+i];
+            page.b.rids[i]=rids[done+i];
+            page.b.fp[i]=fingerprintOf(hashKey(keys[done+i]));
+        }
+        done+=count;
+        if(done<n)
+            rc=allocOverflow(t,&page.b.overflow);
+        if(rc==RC_OK)
+            rc=writePage(t,pos,&page);
+        pos=overflowPos(page.b.overflow);
+    }while(rc==RC_OK&&done<n);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        splitBucket
+ * Description:     split bucket next into itself and bucket next+2^level and
+ *                  move the split pointer on, to the next level after the last
+ *                  bucket of this one
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC splitBucket(HashInfo* t)
+{
+    BucketPage page;
+    int from=t->next, to=t->next+(1<<t->level);
+    int cap=BUCKET_SLOTS, n=0;
+    int* keys=(int*)malloc(sizeof(int)*cap);
+    RID* rids=(RID*)malloc(sizeof(RID)*cap);
+    ChainPos pos=bucketPos(from);
+    RC rc=RC_OK;
+
+    if(keys==0||rids==0)
+        rc=RC_ERROR;
+
+    // take every entry out of the chain, the overflow pages are freed
+    while(rc==RC_OK)
+    {
+        rc=readPage(t,pos,&page);
+        if(rc!=RC_OK) break;
+        if(n+page.b.count>cap)
+        {
+            cap*=2;
+            int* k=(int*)realloc(keys,sizeof(int)*cap);
+            if(k!=0) keys=k;
+            RID* r=(RID*)realloc(rids,sizeof(RID)*cap);
+            if(r!=0) rids=r;
+            if(k==0||r==0)
+            {
+                rc=RC_ERROR;
+                break;
+            }
+        }
+        memcpy(keys+n,page.b.keys,sizeof(int)*page.b.count);
+        memcpy(rids+n,page.b.rids,sizeof(RID)*page.b.count);
+        n+=page.b.count;
+        if(pos.overflow)
+            rc=freeOverflow(t,pos.pageNum);
+        if(page.b.overflow<0)
+            break;
+        pos=overflowPos(page.b.overflow);
+    }
+
+    if(rc==RC_OK&&to+1>=t->fh.totalNumPages)
+        rc=ensureCapacity(to+2,&t->fh);
+    if(rc==RC_OK)
+    {
+        t->numBuckets++;
+        if(++t->next==(1<<t->level))
+        {
+            t->level++;
+            t->next=0;
+        }
+        t->metaDirty=1;
+
+        // entries that stay are packed to the front, the others to the back
+        int stay=0, move=n;
+        while(stay<move)
+        {
+            if(bucketOf(t,hashKey(keys[stay]))==from)
+                stay++;
+            else
+            {
+                move--;
+                int k=keys[stay]; keys[stay]=keys[move]; keys[move]=k;
+                RID r=rids[stay]; rids[stay]=rids[move]; rids[move]=r;
+            }
+        }
+        rc=writeChain(t,from,keys,rids,stay);
+        if(rc==RC_OK)
+            rc=writeChain(t,to,keys+stay,rids+stay,n-stay);
+    }
+    free(keys);
+    free(rids);
+    return rc;
+}
+
+/************************************************************
+ *                    hash indexes                          *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        overflowName
+ * Description:     file name of the overflow pages of an index
+ * Return:          char*: new string, 0 if out of memory
+ **********************************************************************************/
+static char* overflowName(char* idxId)
+{
+    char* name=(char*)malloc(strlen(idxId)+strlen(OVERFLOW_SUFFIX)+1);
+    if(name!=0)
+        sprintf(name,"%s%s",idxId,OVERFLOW_SUFFIX);
+    return name;
+}
+
+/*********************************************************************************
+ * Function:        createHashIndex
+ * Description:     create an index with one empty bucket
+ * Input:           char* idxId: index name, also the file name
+                    DataType keyType: type of the keys
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createHashIndex(char *idxId, DataType keyType)
+{
+    HashInfo t;
+    char* name;
+    RC rc;
+
+    if(keyType!=DT_INT&&keyType!=DT_FLOAT&&keyType!=DT_BOOL)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "index keys must be DT_INT, DT_FLOAT or DT_BOOL");
+    name=overflowName(idxId);
+    if(name==0) return RC_ERROR;
+
+    rc=createPageFile(idxId);
+    if(rc==RC_OK)
+    {
+        rc=createPageFile(name);
+        if(rc!=RC_OK)
+            destroyPageFile(idxId);
+    }
+    if(rc!=RC_OK)
+    {
+        free(name);
+        return rc;
+    }
+    memset(&t,0,sizeof(t));
+    rc=openPageFile(idxId,&t.fh);
+    if(rc==RC_OK)
+    {
+        t.keyType=keyType;
+        t.numBuckets=1;
+        t.freeList=-1;
+        // overflow page 0 is never used, a chain ends with -1 either way
+        t.nextUnused=1;
+        rc=ensureCapacity(2,&t.fh);
+        if(rc==RC_OK)
+            rc=writeChain(&t,0,0,0,0);
+        if(rc==RC_OK)
+            rc=writeMeta(&t);
+        RC closeRc=closePageFile(&t.fh);
+        if(rc==RC_OK) rc=closeRc;
+    }
+    if(rc!=RC_OK)
+    {
+        destroyPageFile(idxId);
+        destroyPageFile(name);
+    }
+    free(name);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        openHashIndex
+ * Description:     open an index
+ * Input:           char* idxId: index name
+ * Output:          HashHandle** index: new handle, freed by closeHashIndex
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openHashIndex(HashHandle **index, char *idxId)
+{
+    HashInfo* t=(HashInfo*)calloc(1,sizeof(HashInfo));
+    HashHandle* handle=(HashHandle*)malloc(sizeof(HashHandle));
+    char* name=overflowName(idxId);
+    RC rc;
+
+    if(t==0||handle==0||name==0)
+    {
+        free(t);
+        free(handle);
+        free(name);
+        return RC_ERROR;
+    }
+    rc=openPageFile(idxId,&t->fh);
+    if(rc==RC_OK)
+    {
+        rc=readMeta(t);
+        if(rc==RC_OK)
+            rc=openPageFile(name,&t->ovf);
+        if(rc!=RC_OK)
+            closePageFile(&t->fh);
+    }
+    free(name);
+    if(rc!=RC_OK)
+    {
+        free(t);
+        free(handle);
+        return rc;
+    }
+
+    handle->keyType=t->keyType;
+    handle->idxId=idxId;
+    handle->mgmtData=t;
+    *index=handle;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeHashIndex
+ * Description:     write back the index information, close the files and free
+ *                  the handle
+ * Input:           HashHandle* index: handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeHashIndex(HashHandle *index)
+{
+    HashInfo* t;
+    RC rc=RC_OK;
+
+    if(index==0||index->mgmtData==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "index is not open");
+    t=(HashInfo*)index->mgmtData;
+    if(t->metaDirty)
+        rc=writeMeta(t);
+    RC closeRc=closePageFile(&t->ovf);
+    if(rc==RC_OK) rc=closeRc;
+    closeRc=closePageFile(&t->fh);
+    if(rc==RC_OK) rc=closeRc;
+    free(t);
+    free(index);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteHashIndex
+ * Description:     remove the files of an index
+ * Input:           char* idxId: index name
+ * Return:          RC: return code
+ **********************************************************************************/
+RC deleteHashIndex(char *idxId)
+{
+    char* name=overflowName(idxId);
+    if(name==0) return RC_ERROR;
+    RC rc=destroyPageFile(idxId);
+    RC ovfRc=destroyPageFile(name);
+    free(name);
+    return rc!=RC_OK?rc:ovfRc;
+}
+
+/*********************************************************************************
+ * Function:        getHashNumEntries / getHashNumBuckets / getHashNumOverflowPages
+ * Description:     information about an open index
+ **********************************************************************************/
+RC getHashNumEntries(HashHandle *index, int *result)
+{
+    *result=((HashInfo*)index->mgmtData)->numEntries;
+    return RC_OK;
+}
+
+RC getHashNumBuckets(HashHandle *index, int *result)
+{
+    *result=((HashInfo*)index->mgmtData)->numBuckets;
+    return RC_OK;
+}
+
+RC getHashNumOverflowPages(HashHandle *index, int *result)
+{
+    *result=((HashInfo*)index->mgmtData)->numOverflow;
+    return RC_OK;
+}
+
+/************************************************************
+ *                    index access                          *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        findHashKey
+ * Description:     look up the RID stored for a key
+ * Input:           HashHandle* index: handle
+                    Value* key: key
+ * Output:          RID* result: RID of the key
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the key is not in the index
+ **********************************************************************************/
+RC findHashKey(HashHandle *index, Value *key, RID *result)
+{
+    HashInfo* t=(HashInfo*)index->mgmtData;
+    BucketPage page;
+    int k;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    unsigned int h=hashKey(k);
+    ChainPos pos=bucketPos(bucketOf(t,h));
+    for(;;)
+    {
+        rc=readPage(t,pos,&page);
+        if(rc!=RC_OK) return rc;
+        int slot=findSlot(&page,fingerprintOf(h),k);
+        if(slot>=0)
+        {
+            *result=page.b.rids[slot];
+            return RC_OK;
+        }
+        if(page.b.overflow<0)
+            THROW(RC_IM_KEY_NOT_FOUND, "key not found");
+        pos=overflowPos(page.b.overflow);
+    }
+}
+
+/*********************************************************************************
+ * Function:        insertHashKey
+ * Description:     add a key to the first page of its chain with room, or to
+ *                  a new overflow page at the end of the chain; a bucket is
+ *                  split when the index gets too full
+ * Input:           HashHandle* index: handle
+                    Value* key: key
+                    RID rid: RID to store for the key
+ * Return:          RC: RC_IM_KEY_ALREADY_EXISTS for a duplicate key
+ **********************************************************************************/
+RC insertHashKey(HashHandle *index, Value *key, RID rid)
+{
+    HashInfo* t=(HashInfo*)index->mgmtData;
+    BucketPage page, room;
+    ChainPos roomPos;
+    int k, found=0;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    unsigned int h=hashKey(k);
+    unsigned char fp=fingerprintOf(h);
+    ChainPos pos=bucketPos(bucketOf(t,h));
+
+    // the whole chain is read to rule out a duplicate anyway
+    for(;;)
+    {
+        rc=readPage(t,pos,&page);
+        if(rc!=RC_OK) return rc;
+        if(findSlot(&page,fp,k)>=0)
+            THROW(RC_IM_KEY_ALREADY_EXISTS, "key already exists");
+        if(!found&&page.b.count<BUCKET_SLOTS)
+        {
+            room=page;
+            roomPos=pos;
+            found=1;
+        }
+        if(page.b.overflow<0)
+            break;
+        pos=overflowPos(page.b.overflow);
+    }
+
+    if(!found)
+    {
+        // link a new overflow page behind the last page
+        int pageNum;
+        rc=allocOverflow(t,&pageNum);
+        if(rc!=RC_OK) return rc;
+        page.b.overflow=pageNum;
+        rc=writePage(t,pos,&page);
+        if(rc!=RC_OK) return rc;
+        memset(&room,0,sizeof(room));
+        room.b.overflow=-1;
+        roomPos=overflowPos(pageNum);
+    }
+    int slot=room.b.count++;
+    room.b.keys[slot]=k;
+    room.b.rids[slot]=rid;
+    room.b.fp[slot]=fp;
+    rc=writePage(t,roomPos,&room);
+    if(rc!=RC_OK) return rc;
+
+    t->numEntries++;
+    t->metaDirty=1;
+    if(t->numEntries>SPLIT_LOAD*BUCKET_SLOTS*t->numBuckets)
+        rc=splitBucket(t);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteHashKey
+ * Description:     remove a key; the last entry of its page takes its slot and
+ *                  an overflow page that becomes empty is unlinked and freed.
+ *                  Buckets are not merged again.
+ * Input:           HashHandle* index: handle
+                    Value* key: key
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the key is not in the index
+ **********************************************************************************/
+RC deleteHashKey(HashHandle *index, Value *key)
+{
+    HashInfo* t=(HashInfo*)index->mgmtData;
+    BucketPage page, prev;
+    ChainPos prevPos=bucketPos(0);
+    int k, slot;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    unsigned int h=hashKey(k);
+    ChainPos pos=bucketPos(bucketOf(t,h));
+    for(;;)
+    {
+        rc=readPage(t,pos,&page);
+        if(rc!=RC_OK) return rc;
+        slot=findSlot(&page,fingerprintOf(h),k);
+        if(slot>=0)
+            break;
+        if(page.b.overflow<0)
+            THROW(RC_IM_KEY_NOT_FOUND, "key not found");
+        prev=page;
+        prevPos=pos;
+        pos=overflowPos(page.b.overflow);
+    }
+
+    int last=--page.b.count;
+    page.b.keys[slot]=page.b.keys[last];
+    page.b.rids[slot]=page.b.rids[last];
+    page.b.fp[slot]=page.b.fp[last];
+    t->numEntries--;
+    t->metaDirty=1;
+    if(page.b.count>0||!pos.overflow)
+        return writePage(t,pos,&page);
+
+    prev.b.overflow=page.b.overflow;
+    rc=writePage(t,prevPos,&prev);
+    if(rc!=RC_OK) return rc;
+    return freeOverflow(t,pos.pageNum);
+}
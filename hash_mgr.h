@@ -0,0 +1,33 @@
+#ifndef HASH_MGR_H
+#define HASH_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+// structure for accessing hash indexes
+typedef struct HashHandle {
+  DataType keyType;
+  char *idxId;
+  void *mgmtData;
+} HashHandle;
+
+// create, destroy, open, and close a linear hashing index; keys are DT_INT,
+// DT_FLOAT or DT_BOOL values. An index is the page file idxId and the page
+// file of its overflow pages, idxId with ".ovf" appended.
+extern RC createHashIndex (char *idxId, DataType keyType);
+extern RC openHashIndex (HashHandle **index, char *idxId);
+extern RC closeHashIndex (HashHandle *index);
+extern RC deleteHashIndex (char *idxId);
+
+// access information about a hash index
+extern RC getHashNumEntries (HashHandle *index, int *result);
+extern RC getHashNumBuckets (HashHandle *index, int *result);
+extern RC getHashNumOverflowPages (HashHandle *index, int *result);
+
+// index access: point lookups only, a lookup reads the bucket page of the
+// key and the overflow pages chained to it, if any
+extern RC findHashKey (HashHandle *index, Value *key, RID *result);
+extern RC insertHashKey (HashHandle *index, Value *key, RID rid);
+extern RC deleteHashKey (HashHandle *index, Value *key);
+
+#endif // HASH_MGR_H
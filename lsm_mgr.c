@@ -0,0 +1,1796 @@
+#include "lsm_mgr.h"
+#include "storage_mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#define LSM_THREADS
+#endif
+
+/*  Writes go to the memtable, a skip list whose nodes and values come from
+ *  an arena. When the memtable reaches memtableBytes it becomes the
+ *  immutable memtable and a new one takes the writes, while a background
+ *  thread writes the full one as a level 0 run. A writer only waits if the
+ *  previous memtable is still being written or level 0 has L0_STOP runs.
+ *
+ *  A run is a page file written once, front to back, in IO_PAGES batches:
+ *   page 0        header
+ *   data pages    entries in key order: key, length, value padded to 4 bytes;
+ *                 a deleted key is an entry with length TOMBSTONE
+ *   index pages   first key of every data page
+ *   Bloom pages   BLOOM_BITS_PER_KEY bits per key, BLOOM_HASHES probes
+ *  Index and Bloom filter stay in memory while the run is open, so a lookup
+ *  in a run reads at most one page, and none if the filter rules it out.
+ *
+ *  Level 0 runs overlap and are searched newest first. The runs of every
+ *  other level have disjoint key ranges, so one run per level is searched.
+ *  Level 0 is compacted into level 1 once it has L0_TRIGGER runs, level l
+ *  into level l+1 once it holds more than LEVEL_RATIO^(l-1) times
+ *  L0_TRIGGER memtables of pages; one run of the level is merged with the
+ *  runs it overlaps in the next level, in key order round the level, and
+ *  moved down without a rewrite if it overlaps none. Compactions of
+ *  disjoint pairs of levels run at the same time on different threads.
+ *
+ *  The page file of the store holds the list of runs. A new run is synced
+ *  before the list naming it is written, and a replaced run is destroyed
+ *  after the list without it is written and the last lookup using it is
+ *  done. Without threads the flushes and compactions run in the writer. */
+#define MANIFEST_MAGIC     0x314d534c   /* "LSM1" */
+#define RUN_MAGIC          0x314e5552   /* "RUN1" */
+#define MANIFEST_INTS      (PAGE_SIZE/(int)sizeof(int))
+#define MAX_RUNS           ((MANIFEST_INTS-4)/2)
+#define RUN_NAME_EXTRA     12           // ".<number>" of a run file
+#define SKIP_HEIGHT        12
+#define ARENA_CHUNK        (64*1024)
+#define L0_TRIGGER         4            // level 0 runs that start a compaction
+#define L0_STOP            12           // level 0 runs that stall writers
+#define LEVEL_RATIO        10
+#define MIN_RUN_PAGES      4
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_HASHES       7
+#define IO_PAGES           16           // pages per read or write of a run
+#define TOMBSTONE          -1
+#define ENTRY_HEADER       (2*(int)sizeof(int))
+#define PAD4(n)            (((n)+3)&~3)
+
+typedef struct SkipNode{
+    int key;
+    int length;                 // TOMBSTONE for a deleted key
+    char* data;
+    struct SkipNode* next[1];   // height pointers
+}SkipNode;
+
+typedef struct ArenaChunk{
+    struct ArenaChunk* next;
+    long used;
+    char mem[ARENA_CHUNK];
+}ArenaChunk;
+
+typedef struct Memtable{
+    SkipNode* head;
+    int height;
+    int count;
+    long bytes;
+    unsigned int seed;
+    ArenaChunk* chunks;
+}Memtable;
+
+typedef struct Run{
+    int id;
+    char* fileName;
+    SM_FileHandle fh;           // used by lookups only
+    int numEntries;
+    int numPages;               // data pages, page 1 to numPages
+    int minKey;
+    int maxKey;
+    int* firstKeys;             // block index
+    unsigned int* bloom;
+    int bloomBits;
+    int refs;                   // one for its level, one per lookup or compaction
+    int obsolete;               // destroyed with the last reference
+}Run;
+
+typedef struct LsmInfo{
+    DataType keyType;
+    char* name;
+    SM_FileHandle manifest;
+    long memtableBytes;
+    int runPages;               // pages of a run written by a compaction
+    Memtable* mem;
+    Memtable* imm;              // full memtable, written by a flush
+    Run** levels[LSM_LEVELS];
+    int numRuns[LSM_LEVELS];
+    int capRuns[LSM_LEVELS];
+    int busy[LSM_LEVELS];       // levels a compaction works on
+    int cursor[LSM_LEVELS];     // smallest key of the next run to compact
+    int nextRunId;
+    int flushing;
+    int running;                // flushes and compactions
+    int stop;
+    RC error;                   // first error of a flush or compaction
+    LSM_Stats stats;
+    int numThreads;
+#ifdef LSM_THREADS
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // new work, or stop
+    pthread_cond_t done;        // a flush or compaction finished
+#endif
+}LsmInfo;
+
+typedef struct RunWriter{
+    Run* run;
+    char* buf;
+    int bufPages;               // finished pages in buf
+    int pos;                    // bytes used of the current page, 0 if none
+    int nextPage;               // page of buf in the file
+    int capPages;
+    int* keys;                  // every key, for the Bloom filter
+    int capKeys;
+}RunWriter;
+
+typedef struct RunIter{
+    SM_FileHandle fh;           // own handle, the run's belongs to lookups
+    char* buf;
+    int numPages;
+    int nextPage;               // next page to read
+    int bufPages;
+    int page;                   // current page in buf
+    int left;                   // entries left on the page
+    int pos;
+    int key;
+    int length;
+    char* data;
+    int done;
+}RunIter;
+
+typedef struct Compaction{
+    int level;                  // from level to level+1
+    Run** inputs;               // newest first, level runs then level+1 runs
+    int numInputs;
+    int numUpper;               // inputs from level
+    int dropTombstones;         // no deeper level holds data
+    int move;
+}Compaction;
+
+/*********************************************************************************
+ * Function:        lockLsm / unlockLsm / waitDone / notifyDone / notifyWork
+ * Description:     synchronisation with the compaction threads, no-ops
+ *                  without threads
+ **********************************************************************************/
+static void lockLsm(LsmInfo* t)
+{
+#ifdef LSM_THREADS
+    pthread_mutex_lock(&t->lock);
+#endif
+}
+
+static void unlockLsm(LsmInfo* t)
+{
+#ifdef LSM_THREADS
+    pthread_mutex_unlock(&t->lock);
+#endif
+}
+
+static void waitDone(LsmInfo* t)
+{
+#ifdef LSM_THREADS
+    pthread_cond_wait(&t->done,&t->lock);
+#endif
+}
+
+static void notifyDone(LsmInfo* t)
+{
+#ifdef LSM_THREADS
+    pthread_cond_broadcast(&t->done);
+#endif
+}
+
+static void notifyWork(LsmInfo* t)
+{
+#ifdef LSM_THREADS
+    pthread_cond_broadcast(&t->work);
+#endif
+}
+
+/*********************************************************************************
+ * Function:        keyOf
+ * Description:     the int a key is stored as, ordered like the keys
+ * Input:           LsmInfo* t: store
+                    Value* key: key of the store's key type
+ * Output:          int* out: stored key
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC keyOf(LsmInfo* t, Value* key, int* out)
+{
+    if(key->dt!=t->keyType)
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "key does not have the key type of the store");
+
+    switch(key->dt)
+    {
+    case DT_INT:
+        *out=key->v.intV;
+        return RC_OK;
+    case DT_BOOL:
+        *out=key->v.boolV?1:0;
+        return RC_OK;
+    case DT_FLOAT:
+        {
+            // negative floats order in reverse as ints, flip all but the sign;
+            // -0.0 is the key 0.0
+            float f=key->v.floatV==0.0f?0.0f:key->v.floatV;
+            int bits;
+            memcpy(&bits,&f,sizeof(bits));
+            *out=bits^((bits>>31)&0x7fffffff);
+        }
+        return RC_OK;
+    default:
+        THROW(RC_FEATURE_NOT_SUPPORTED, "keys must be DT_INT, DT_FLOAT or DT_BOOL");
+    }
+}
+
+/************************************************************
+ *                    memtable                              *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        arenaAlloc
+ * Description:     memory from the arena of a memtable, freed with it
+ * Return:          void*: 8 byte aligned memory, 0 if out of memory
+ **********************************************************************************/
+static void* arenaAlloc(Memtable* m, long size)
+{
+    size=(size+7)&~7L;
+    if(m->chunks==0||m->chunks->used+size>ARENA_CHUNK)
+    {
+        ArenaChunk* c=(ArenaChunk*)malloc(sizeof(ArenaChunk));
+        if(c==0) return 0;
+        c->next=m->chunks;
+        c->used=0;
+        m->chunks=c;
+    }
+    void* p=m->chunks->mem+m->chunks->used;
+    m->chunks->used+=size;
+    m->bytes+=size;
+    return p;
+}
+
+static long nodeSize(int height)
+{
+    return (long)sizeof(SkipNode)+(long)(height-1)*(long)sizeof(SkipNode*);
+}
+
+static void freeMemtable(Memtable* m)
+{
+    if(m==0) return;
+    while(m->chunks!=0)
+    {
+        ArenaChunk* c=m->chunks;
+        m->chunks=c->next;
+        free(c);
+    }
+    free(m);
+}
+
+static Memtable* newMemtable(void)
+{
+    Memtable* m=(Memtable*)calloc(1,sizeof(Memtable));
+    if(m==0) return 0;
+    m->seed=0x9e3779b9u;
+    m->height=1;
+    m->head=(SkipNode*)arenaAlloc(m,nodeSize(SKIP_HEIGHT));
+    if(m->head==0)
+    {
+        freeMemtable(m);
+        return 0;
+    }
+    memset(m->head,0,nodeSize(SKIP_HEIGHT));
+    return m;
+}
+
+/*********************************************************************************
+ * Function:        memtableSeek
+ * Description:     the last node before key on every level of the skip list
+ * Output:          SkipNode** prev: SKIP_HEIGHT nodes, 0 to skip
+ * Return:          SkipNode*: node of key, 0 if it is not in the memtable
+ **********************************************************************************/
+static SkipNode* memtableSeek(Memtable* m, int key, SkipNode** prev)
+{
+    SkipNode* x=m->head;
+    int l;
+
+    for(l=m->height-1;l>=0;l--)
+    {
+        while(x->next[l]!=0&&x->next[l]->key<key)
+            x=x->next[l];
+        if(prev!=0)
+            prev[l]=x;
+    }
+    x=x->next[0];
+    return x!=0&&x->key==key?x:0;
+}
+
+/*********************************************************************************
+ * Function:        memtablePut
+ * Description:     set the value of a key in the memtable, TOMBSTONE deletes
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC memtablePut(Memtable* m, int key, char* data, int length)
+{
+    SkipNode* prev[SKIP_HEIGHT];
+    SkipNode* x=memtableSeek(m,key,prev);
+    char* copy=0;
+    int l;
+
+    if(length>0)
+    {
+        copy=(char*)arenaAlloc(m,length);
+        if(copy==0) return RC_ERROR;
+        memcpy(copy,data,length);
+    }
+    if(x!=0)
+    {
+        // the old value stays in the arena until the memtable is written
+        x->data=copy;
+        x->length=length;
+        return RC_OK;
+    }
+
+    int height=1;
+    unsigned int r=m->seed;
+    r^=r<<13;
+    r^=r>>17;
+    r^=r<<5;
+    m->seed=r;
+    while(height<SKIP_HEIGHT&&(r&3)==0)
+    {
+        height++;
+        r>>=2;
+    }
+    x=(SkipNode*)arenaAlloc(m,nodeSize(height));
+    if(x==0) return RC_ERROR;
+    x->key=key;
+    x->length=length;
+    x->data=copy;
+    for(l=m->height;l<height;l++)
+        prev[l]=m->head;
+    if(height>m->height)
+        m->height=height;
+    for(l=0;l<height;l++)
+    {
+        x->next[l]=prev[l]->next[l];
+        prev[l]->next[l]=x;
+    }
+    m->count++;
+    return RC_OK;
+}
+
+/************************************************************
+ *                    sorted runs                           *
+ ************************************************************/
+
+static unsigned long long mixKey(int key)
+{
+    unsigned long long h=(unsigned int)key+0x9e3779b97f4a7c15ULL;
+    h=(h^(h>>30))*0xbf58476d1ce4e5b9ULL;
+    h=(h^(h>>27))*0x94d049bb133111ebULL;
+    return h^(h>>31);
+}
+
+static void bloomAdd(unsigned int* bits, int numBits, int key)
+{
+    unsigned long long h=mixKey(key);
+    unsigned int h1=(unsigned int)h, h2=(unsigned int)(h>>32)|1;
+    int i;
+    for(i=0;i<BLOOM_HASHES;i++)
+    {
+        unsigned int b=(h1+(unsigned int)i*h2)%(unsigned int)numBits;
+        bits[b>>5]|=1u<<(b&31);
+    }
+}
+
+static int bloomMayContain(unsigned int* bits, int numBits, int key)
+{
+    unsigned long long h=mixKey(key);
+    unsigned int h1=(unsigned int)h, h2=(unsigned int)(h>>32)|1;
+    int i;
+    for(i=0;i<BLOOM_HASHES;i++)
+    {
+        unsigned int b=(h1+(unsigned int)i*h2)%(unsigned int)numBits;
+        if((bits[b>>5]&(1u<<(b&31)))==0)
+            return 0;
+    }
+    return 1;
+}
+
+static char* runFileName(char* name, int id)
+{
+    char* fileName=(char*)malloc(strlen(name)+RUN_NAME_EXTRA);
+    if(fileName!=0)
+        sprintf(fileName,"%s.%d",name,id);
+    return fileName;
+}
+
+static void freeRun(Run* run)
+{
+    free(run->fileName);
+    free(run->firstKeys);
+    free(run->bloom);
+    free(run);
+}
+
+/*********************************************************************************
+ * Function:        unrefRun
+ * Description:     drop a reference to a run; the last one closes it, and
+ *                  destroys the file of a run a compaction replaced
+ **********************************************************************************/
+static void unrefRun(Run* run)
+{
+    if(--run->refs>0)
+        return;
+    closePageFile(&run->fh);
+    if(run->obsolete)
+        destroyPageFile(run->fileName);
+    freeRun(run);
+}
+
+/*********************************************************************************
+ * Function:        loadRun
+ * Description:     open a run of the store with its block index and Bloom
+ *                  filter
+ * Input:           LsmInfo* t: store
+                    int id: number of the run
+ * Output:          Run** out: the run with one reference
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC loadRun(LsmInfo* t, int id, Run** out)
+{
+    Run* run=(Run*)calloc(1,sizeof(Run));
+    int words[MANIFEST_INTS];
+    char* buf=0;
+    RC rc;
+
+    if(run==0) return RC_ERROR;
+    run->id=id;
+    run->refs=1;
+    run->fileName=runFileName(t->name,id);
+    if(run->fileName==0)
+    {
+        free(run);
+        return RC_ERROR;
+    }
+    rc=openPageFile(run->fileName,&run->fh);
+    if(rc!=RC_OK)
+    {
+        freeRun(run);
+        return rc;
+    }
+    rc=readBlock(0,&run->fh,(SM_PageHandle)words);
+    if(rc==RC_OK&&(words[0]!=RUN_MAGIC||words[2]<1||words[5]<32
+        ||1+words[2]+words[6]+words[7]>run->fh.totalNumPages))
+        rc=RC_FILE_HEADER_CORRUPT;
+    if(rc==RC_OK)
+    {
+        run->numEntries=words[1];
+        run->numPages=words[2];
+        run->minKey=words[3];
+        run->maxKey=words[4];
+        run->bloomBits=words[5];
+        run->firstKeys=(int*)malloc(sizeof(int)*run->numPages);
+        run->bloom=(unsigned int*)malloc(run->bloomBits/8);
+        buf=allocPageMemory(words[6]+words[7]);
+        if(run->firstKeys==0||run->bloom==0||buf==0)
+            rc=RC_ERROR;
+    }
+    if(rc==RC_OK)
+        rc=readBlocks(1+run->numPages,words[6]+words[7],&run->fh,buf);
+    if(rc==RC_OK)
+    {
+        memcpy(run->firstKeys,buf,sizeof(int)*run->numPages);
+        memcpy(run->bloom,buf+(long)words[6]*PAGE_SIZE,run->bloomBits/8);
+        *out=run;
+    }
+    else
+    {
+        closePageFile(&run->fh);
+        freeRun(run);
+        if(rc==RC_FILE_HEADER_CORRUPT)
+            THROW_FMT(rc, LOG_LEVEL_ERROR, "%s is not a sorted run", t->name);
+    }
+    freePageMemory(buf);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        runGet
+ * Description:     look up a key in a run: key range, Bloom filter, block
+ *                  index, then the one data page that can hold the key
+ * Input:           Run* run: run
+                    int key: key
+                    char* page: PAGE_SIZE buffer
+ * Output:          char** data: value in page
+                    int* length: length of the value, TOMBSTONE for a delete
+                    int* bloomSkip: 1 if the Bloom filter answered
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the run has no entry for key
+ **********************************************************************************/
+static RC runGet(Run* run, int key, char* page, char** data, int* length, int* bloomSkip)
+{
+    int lo=0, hi=run->numPages-1, i, pos, count;
+
+    *bloomSkip=0;
+    if(key<run->minKey||key>run->maxKey)
+        return RC_IM_KEY_NOT_FOUND;
+    if(!bloomMayContain(run->bloom,run->bloomBits,key))
+    {
+        *bloomSkip=1;
+        return RC_IM_KEY_NOT_FOUND;
+    }
+    // last page whose first key is <= key
+    while(lo<hi)
+    {
+        int mid=(lo+hi+1)/2;
+        if(run->firstKeys[mid]<=key)
+            lo=mid;
+        else
+            hi=mid-1;
+    }
+    RC rc=readBlock(lo+1,&run->fh,page);
+    if(rc!=RC_OK) return rc;
+
+    count=((int*)page)[0];
+    pos=sizeof(int);
+    for(i=0;i<count;i++)
+    {
+        int* e=(int*)(page+pos);
+        if(e[0]==key)
+        {
+            *length=e[1];
+            *data=page+pos+ENTRY_HEADER;
+            return RC_OK;
+        }
+        if(e[0]>key)
+            break;
+        pos+=ENTRY_HEADER+PAD4(e[1]>0?e[1]:0);
+    }
+    return RC_IM_KEY_NOT_FOUND;
+}
+
+/*********************************************************************************
+ * Function:        writerOpen
+ * Description:     start a new run file
+ * Input:           LsmInfo* t: store
+                    int id: number of the run
+ * Output:          RunWriter* w: writer
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writerOpen(LsmInfo* t, int id, RunWriter* w)
+{
+    RC rc;
+
+    memset(w,0,sizeof(RunWriter));
+    w->run=(Run*)calloc(1,sizeof(Run));
+    w->buf=allocPageMemory(IO_PAGES);
+    if(w->run!=0)
+        w->run->fileName=runFileName(t->name,id);
+    if(w->run==0||w->buf==0||w->run->fileName==0)
+        rc=RC_ERROR;
+    else
+    {
+        w->run->id=id;
+        w->run->refs=1;
+        w->run->minKey=INT_MAX;
+        w->run->maxKey=INT_MIN;
+        w->nextPage=1;
+        // a run a crash left behind before it was listed
+        rc=createPageFile(w->run->fileName);
+        if(rc==RC_FILE_ALREADY_EXIST&&destroyPageFile(w->run->fileName)==RC_OK)
+            rc=createPageFile(w->run->fileName);
+        if(rc==RC_OK)
+        {
+            rc=openPageFile(w->run->fileName,&w->run->fh);
+            if(rc!=RC_OK)
+                destroyPageFile(w->run->fileName);
+        }
+    }
+    if(rc!=RC_OK)
+    {
+        if(w->run!=0)
+            freeRun(w->run);
+        freePageMemory(w->buf);
+        w->run=0;
+        w->buf=0;
+    }
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        writerAbort
+ * Description:     drop an unfinished run and its file
+ **********************************************************************************/
+static void writerAbort(RunWriter* w)
+{
+    if(w->run==0) return;
+    closePageFile(&w->run->fh);
+    destroyPageFile(w->run->fileName);
+    freeRun(w->run);
+    freePageMemory(w->buf);
+    free(w->keys);
+    w->run=0;
+}
+
+/*********************************************************************************
+ * Function:        writerFlush
+ * Description:     write the finished pages of the buffer
+ **********************************************************************************/
+static RC writerFlush(RunWriter* w)
+{
+    RC rc;
+
+    if(w->bufPages==0)
+        return RC_OK;
+    rc=ensureCapacity(w->nextPage+w->bufPages,&w->run->fh);
+    if(rc==RC_OK)
+        rc=writeBlocks(w->nextPage,w->bufPages,&w->run->fh,w->buf);
+    w->nextPage+=w->bufPages;
+    w->bufPages=0;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        writerNewPage
+ * Description:     1 if an entry with a value of length bytes starts a new page
+ **********************************************************************************/
+static int writerNewPage(RunWriter* w, int length)
+{
+    int size=ENTRY_HEADER+PAD4(length>0?length:0);
+    return w->pos==0||w->pos+size>PAGE_SIZE;
+}
+
+/*********************************************************************************
+ * Function:        writerAdd
+ * Description:     append an entry; keys must come in increasing order
+ * Input:           RunWriter* w: writer
+                    int key: key
+                    int length: length of the value, TOMBSTONE for a delete
+                    char* data: value
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writerAdd(RunWriter* w, int key, int length, char* data)
+{
+    Run* run=w->run;
+    int size=ENTRY_HEADER+PAD4(length>0?length:0);
+    RC rc;
+
+    if(writerNewPage(w,length))
+    {
+        if(w->pos!=0)
+        {
+            w->pos=0;
+            if(++w->bufPages==IO_PAGES)
+            {
+                rc=writerFlush(w);
+                if(rc!=RC_OK) return rc;
+            }
+        }
+        if(run->numPages==w->capPages)
+        {
+            int cap=w->capPages==0?64:w->capPages*2;
+            int* k=(int*)realloc(run->firstKeys,sizeof(int)*cap);
+            if(k==0) return RC_ERROR;
+            run->firstKeys=k;
+            w->capPages=cap;
+        }
+        run->firstKeys[run->numPages++]=key;
+        memset(w->buf+(long)w->bufPages*PAGE_SIZE,0,PAGE_SIZE);
+        w->pos=sizeof(int);
+    }
+    if(run->numEntries==w->capKeys)
+    {
+        int cap=w->capKeys==0?1024:w->capKeys*2;
+        int* k=(int*)realloc(w->keys,sizeof(int)*cap);
+        if(k==0) return RC_ERROR;
+        w->keys=k;
+        w->capKeys=cap;
+    }
+
+    char* page=w->buf+(long)w->bufPages*PAGE_SIZE;
+    int* e=(int*)(page+w->pos);
+    e[0]=key;
+    e[1]=length;
+    if(length>0)
+        memcpy(page+w->pos+ENTRY_HEADER,data,length);
+    ((int*)page)[0]++;
+    w->pos+=size;
+    w->keys[run->numEntries++]=key;
+    if(key<run->minKey) run->minKey=key;
+    if(key>run->maxKey) run->maxKey=key;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writerFinish
+ * Description:     write the rest of the entries, block index, Bloom filter and
+ *                  header and sync the run. A run without entries is dropped.
+ * Output:          Run** out: the run with one reference, 0 if it was empty
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writerFinish(RunWriter* w, Run** out)
+{
+    Run* run=w->run;
+    int words[MANIFEST_INTS];
+    char* buf=0;
+    int i;
+    RC rc=RC_OK;
+
+    *out=0;
+    if(run->numEntries==0)
+    {
+        writerAbort(w);
+        return RC_OK;
+    }
+    if(w->pos!=0)
+    {
+        w->pos=0;
+        w->bufPages++;
+    }
+    rc=writerFlush(w);
+
+    run->bloomBits=(run->numEntries*BLOOM_BITS_PER_KEY+31)&~31;
+    if(run->bloomBits<64)
+        run->bloomBits=64;
+    int indexPages=(int)(((long)run->numPages*sizeof(int)+PAGE_SIZE-1)/PAGE_SIZE);
+    int bloomPages=(run->bloomBits/8+PAGE_SIZE-1)/PAGE_SIZE;
+    if(rc==RC_OK)
+    {
+        run->bloom=(unsigned int*)calloc(1,run->bloomBits/8);
+        buf=allocPageMemory(indexPages+bloomPages);
+        if(run->bloom==0||buf==0)
+            rc=RC_ERROR;
+    }
+    if(rc==RC_OK)
+    {
+        for(i=0;i<run->numEntries;i++)
+            bloomAdd(run->bloom,run->bloomBits,w->keys[i]);
+        memset(buf,0,(long)(indexPages+bloomPages)*PAGE_SIZE);
+        memcpy(buf,run->firstKeys,sizeof(int)*run->numPages);
+        memcpy(buf+(long)indexPages*PAGE_SIZE,run->bloom,run->bloomBits/8);
+        rc=ensureCapacity(w->nextPage+indexPages+bloomPages,&run->fh);
+    }
+    if(rc==RC_OK)
+        rc=writeBlocks(w->nextPage,indexPages+bloomPages,&run->fh,buf);
+    if(rc==RC_OK)
+    {
+        memset(words,0,sizeof(words));
+        words[0]=RUN_MAGIC;
+        words[1]=run->numEntries;
+        words[2]=run->numPages;
+        words[3]=run->minKey;
+        words[4]=run->maxKey;
+        words[5]=run->bloomBits;
+        words[6]=indexPages;
+        words[7]=bloomPages;
+        rc=writeBlock(0,&run->fh,(SM_PageHandle)words);
+    }
+    if(rc==RC_OK)
+        rc=checkpointPageFile(&run->fh);
+    freePageMemory(buf);
+    if(rc!=RC_OK)
+    {
+        writerAbort(w);
+        return rc;
+    }
+    freePageMemory(w->buf);
+    free(w->keys);
+    w->run=0;
+    *out=run;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        iterOpen / iterNext / iterClose
+ * Description:     read the entries of a run in order, IO_PAGES pages at a
+ *                  time, through a handle of its own
+ **********************************************************************************/
+static RC iterNext(RunIter* it)
+{
+    if(it->left==0)
+    {
+        if(++it->page>=it->bufPages)
+        {
+            int n=it->numPages+1-it->nextPage;
+            if(n<=0)
+            {
+                it->done=1;
+                return RC_OK;
+            }
+            if(n>IO_PAGES)
+                n=IO_PAGES;
+            RC rc=readBlocks(it->nextPage,n,&it->fh,it->buf);
+            if(rc!=RC_OK) return rc;
+            it->nextPage+=n;
+            it->bufPages=n;
+            it->page=0;
+        }
+        char* page=it->buf+(long)it->page*PAGE_SIZE;
+        it->left=((int*)page)[0];
+        it->pos=sizeof(int);
+        if(it->left<=0)
+            THROW(RC_FILE_HEADER_CORRUPT, "empty data page in a sorted run");
+    }
+    char* page=it->buf+(long)it->page*PAGE_SIZE;
+    int* e=(int*)(page+it->pos);
+    it->key=e[0];
+    it->length=e[1];
+    it->data=page+it->pos+ENTRY_HEADER;
+    it->pos+=ENTRY_HEADER+PAD4(e[1]>0?e[1]:0);
+    it->left--;
+    return RC_OK;
+}
+
+static RC iterOpen(Run* run, RunIter* it)
+{
+    memset(it,0,sizeof(RunIter));
+    it->buf=allocPageMemory(IO_PAGES);
+    if(it->buf==0) return RC_ERROR;
+    RC rc=openPageFile(run->fileName,&it->fh);
+    if(rc!=RC_OK)
+    {
+        freePageMemory(it->buf);
+        it->buf=0;
+        return rc;
+    }
+    it->numPages=run->numPages;
+    it->nextPage=1;
+    it->page=-1;
+    return iterNext(it);
+}
+
+static void iterClose(RunIter* it)
+{
+    if(it->buf==0) return;
+    closePageFile(&it->fh);
+    freePageMemory(it->buf);
+    it->buf=0;
+}
+
+/************************************************************
+ *                    levels                                *
+ ************************************************************/
+
+static RC addRun(LsmInfo* t, int level, Run* run)
+{
+    int i;
+
+    if(t->numRuns[level]==t->capRuns[level])
+    {
+        int cap=t->capRuns[level]==0?8:t->capRuns[level]*2;
+        Run** runs=(Run**)realloc(t->levels[level],sizeof(Run*)*cap);
+        if(runs==0) return RC_ERROR;
+        t->levels[level]=runs;
+        t->capRuns[level]=cap;
+    }
+    // level 0 oldest first, the others in key order
+    i=t->numRuns[level];
+    if(level>0)
+        while(i>0&&t->levels[level][i-1]->minKey>run->minKey)
+        {
+            t->levels[level][i]=t->levels[level][i-1];
+            i--;
+        }
+    t->levels[level][i]=run;
+    t->numRuns[level]++;
+    return RC_OK;
+}
+
+static void removeRun(LsmInfo* t, int level, Run* run)
+{
+    int i;
+    for(i=0;i<t->numRuns[level];i++)
+        if(t->levels[level][i]==run)
+        {
+            memmove(t->levels[level]+i,t->levels[level]+i+1,sizeof(Run*)*(t->numRuns[level]-i-1));
+            t->numRuns[level]--;
+            return;
+        }
+}
+
+static long levelPages(LsmInfo* t, int level)
+{
+    long pages=0;
+    int i;
+    for(i=0;i<t->numRuns[level];i++)
+        pages+=t->levels[level][i]->numPages;
+    return pages;
+}
+
+static double levelLimit(LsmInfo* t, int level)
+{
+    double limit=(double)L0_TRIGGER*t->runPages;
+    int i;
+    for(i=1;i<level;i++)
+        limit*=LEVEL_RATIO;
+    return limit;
+}
+
+/*********************************************************************************
+ * Function:        writeManifest
+ * Description:     write the list of runs to the page file of the store and
+ *                  sync it; called with the lock held
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeManifest(LsmInfo* t)
+{
+    int words[MANIFEST_INTS];
+    int l, i, n=0;
+
+    memset(words,0,sizeof(words));
+    words[0]=MANIFEST_MAGIC;
+    words[1]=(int)t->keyType;
+    words[2]=t->nextRunId;
+    for(l=0;l<LSM_LEVELS;l++)
+        for(i=0;i<t->numRuns[l];i++)
+        {
+            if(n==MAX_RUNS)
+                THROW(RC_WRITE_FAILED, "too many sorted runs for the run list");
+            words[4+2*n]=l;
+            words[5+2*n]=t->levels[l][i]->id;
+            n++;
+        }
+    words[3]=n;
+    RC rc=writeBlock(0,&t->manifest,(SM_PageHandle)words);
+    if(rc==RC_OK)
+        rc=checkpointPageFile(&t->manifest);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        pickLevel
+ * Description:     the level most in need of compaction whose compaction can
+ *                  start now; called with the lock held
+ * Return:          int: level, -1 if none needs it
+ **********************************************************************************/
+static int pickLevel(LsmInfo* t)
+{
+    double best=1.0, score;
+    int l, level=-1;
+
+    for(l=0;l<LSM_LEVELS-1;l++)
+    {
+        if(t->busy[l]||t->busy[l+1])
+            continue;
+        if(l==0)
+            score=(double)t->numRuns[0]/L0_TRIGGER;
+        else
+            score=levelPages(t,l)/levelLimit(t,l);
+        if(score>=best)
+        {
+            best=score;
+            level=l;
+        }
+    }
+    return level;
+}
+
+/*********************************************************************************
+ * Function:        pickCompaction
+ * Description:     choose the inputs of the next compaction and mark its
+ *                  levels busy; called with the lock held
+ * Output:          Compaction* c: the compaction
+ * Return:          int: 1 if there is one
+ **********************************************************************************/
+static int pickCompaction(LsmInfo* t, Compaction* c)
+{
+    int level=pickLevel(t), lo=INT_MAX, hi=INT_MIN, i;
+
+    if(level<0)
+        return 0;
+    memset(c,0,sizeof(Compaction));
+    c->level=level;
+    c->inputs=(Run**)malloc(sizeof(Run*)*(t->numRuns[level]+t->numRuns[level+1]));
+    if(c->inputs==0)
+        return 0;
+
+    if(level==0)
+    {
+        for(i=t->numRuns[0]-1;i>=0;i--)
+            c->inputs[c->numInputs++]=t->levels[0][i];
+    }
+    else
+    {
+        // round the level in key order, so every key range gets its turn
+        Run* run=t->levels[level][0];
+        for(i=0;i<t->numRuns[level];i++)
+            if(t->levels[level][i]->minKey>=t->cursor[level])
+            {
+                run=t->levels[level][i];
+                break;
+            }
+        t->cursor[level]=run->maxKey==INT_MAX?INT_MIN:run->maxKey+1;
+        c->inputs[c->numInputs++]=run;
+    }
+    c->numUpper=c->numInputs;
+    for(i=0;i<c->numUpper;i++)
+    {
+        if(c->inputs[i]->minKey<lo) lo=c->inputs[i]->minKey;
+        if(c->inputs[i]->maxKey>hi) hi=c->inputs[i]->maxKey;
+    }
+    for(i=0;i<t->numRuns[level+1];i++)
+    {
+        Run* run=t->levels[level+1][i];
+        if(run->maxKey>=lo&&run->minKey<=hi)
+            c->inputs[c->numInputs++]=run;
+    }
+    c->move=level>0&&c->numInputs==1;
+    c->dropTombstones=1;
+    for(i=level+2;i<LSM_LEVELS;i++)
+        if(t->numRuns[i]>0)
+            c->dropTombstones=0;
+
+    for(i=0;i<c->numInputs;i++)
+        c->inputs[i]->refs++;
+    t->busy[level]=1;
+    t->busy[level+1]=1;
+    t->running++;
+    return 1;
+}
+
+static int newRunId(LsmInfo* t)
+{
+    lockLsm(t);
+    int id=t->nextRunId++;
+    unlockLsm(t);
+    return id;
+}
+
+/*********************************************************************************
+ * Function:        runCompaction
+ * Description:     merge the inputs of a compaction into new runs of up to
+ *                  runPages pages. Of the entries of a key the one of the
+ *                  newest input is kept; a delete is dropped if no deeper
+ *                  level can hold the key.
+ * Input:           LsmInfo* t: store
+                    Compaction* c: compaction
+ * Output:          Run*** outs: new runs
+                    int* numOuts: number of new runs
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC runCompaction(LsmInfo* t, Compaction* c, Run*** outs, int* numOuts)
+{
+    RunIter* its=(RunIter*)calloc(c->numInputs,sizeof(RunIter));
+    RunWriter w;
+    Run** out=0;
+    int n=0, cap=0, i;
+    RC rc=RC_OK;
+
+    *outs=0;
+    *numOuts=0;
+    w.run=0;
+    if(its==0) return RC_ERROR;
+    for(i=0;rc==RC_OK&&i<c->numInputs;i++)
+        rc=iterOpen(c->inputs[i],&its[i]);
+    if(rc==RC_OK)
+        rc=writerOpen(t,newRunId(t),&w);
+
+    while(rc==RC_OK)
+    {
+        // few inputs, a linear pick of the smallest key is enough; on equal
+        // keys the first, newest, input wins
+        int best=-1;
+        for(i=0;i<c->numInputs;i++)
+            if(!its[i].done&&(best<0||its[i].key<its[best].key))
+                best=i;
+        if(best<0)
+            break;
+
+        int key=its[best].key;
+        if(its[best].length!=TOMBSTONE||!c->dropTombstones)
+        {
+            if(w.run->numPages>=t->runPages&&writerNewPage(&w,its[best].length))
+            {
+                Run* run;
+                rc=writerFinish(&w,&run);
+                if(rc==RC_OK&&n==cap)
+                {
+                    cap=cap==0?8:cap*2;
+                    Run** o=(Run**)realloc(out,sizeof(Run*)*cap);
+                    if(o==0) rc=RC_ERROR;
+                    else out=o;
+                }
+                if(rc==RC_OK)
+                {
+                    out[n++]=run;
+                    rc=writerOpen(t,newRunId(t),&w);
+                }
+                else if(run!=0)
+                {
+                    run->obsolete=1;
+                    unrefRun(run);
+                }
+                if(rc!=RC_OK) break;
+            }
+            rc=writerAdd(&w,key,its[best].length,its[best].data);
+        }
+        for(i=best;rc==RC_OK&&i<c->numInputs;i++)
+            if(!its[i].done&&its[i].key==key)
+                rc=iterNext(&its[i]);
+    }
+
+    if(rc==RC_OK)
+    {
+        Run* run;
+        rc=writerFinish(&w,&run);
+        if(rc==RC_OK&&run!=0)
+        {
+            Run** o=(Run**)realloc(out,sizeof(Run*)*(n+1));
+            if(o==0)
+            {
+                run->obsolete=1;
+                unrefRun(run);
+                rc=RC_ERROR;
+            }
+            else
+            {
+                out=o;
+                out[n++]=run;
+            }
+        }
+    }
+    else
+        writerAbort(&w);
+
+    for(i=0;i<c->numInputs;i++)
+        iterClose(&its[i]);
+    free(its);
+    if(rc!=RC_OK)
+    {
+        for(i=0;i<n;i++)
+        {
+            out[i]->obsolete=1;
+            unrefRun(out[i]);
+        }
+        free(out);
+        return rc;
+    }
+    *outs=out;
+    *numOuts=n;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        flushMemtable
+ * Description:     write a memtable as a run
+ * Output:          Run** out: the run, 0 if the memtable was empty
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC flushMemtable(LsmInfo* t, Memtable* m, int id, Run** out)
+{
+    RunWriter w;
+    SkipNode* x;
+
+    RC rc=writerOpen(t,id,&w);
+    if(rc!=RC_OK) return rc;
+    for(x=m->head->next[0];rc==RC_OK&&x!=0;x=x->next[0])
+        rc=writerAdd(&w,x->key,x->length,x->data);
+    if(rc!=RC_OK)
+    {
+        writerAbort(&w);
+        return rc;
+    }
+    return writerFinish(&w,out);
+}
+
+/*********************************************************************************
+ * Function:        doWork
+ * Description:     write the full memtable or run one compaction; called
+ *                  with the lock held, which is released during the I/O
+ * Input:           LsmInfo* t: store
+ * Return:          int: 1 if there was work
+ **********************************************************************************/
+static int doWork(LsmInfo* t)
+{
+    Compaction c;
+    Run** outs;
+    Run* run;
+    int numOuts, i;
+    RC rc;
+
+    if(t->imm!=0&&!t->flushing)
+    {
+        Memtable* m=t->imm;
+        int id=t->nextRunId++;
+        t->flushing=1;
+        t->running++;
+        unlockLsm(t);
+        rc=flushMemtable(t,m,id,&run);
+        lockLsm(t);
+        if(rc==RC_OK&&run!=0)
+        {
+            rc=addRun(t,0,run);
+            if(rc==RC_OK)
+                rc=writeManifest(t);
+            if(rc==RC_OK)
+            {
+                t->stats.flushes++;
+                t->stats.pagesWritten+=run->numPages;
+            }
+            else
+            {
+                // the memtable stays and is flushed again under a new run id
+                removeRun(t,0,run);
+                run->obsolete=1;
+                unrefRun(run);
+            }
+        }
+        if(rc==RC_OK)
+        {
+            t->imm=0;
+            freeMemtable(m);
+        }
+        else if(t->error==RC_OK)
+            t->error=rc;
+        t->flushing=0;
+        t->running--;
+        notifyDone(t);
+        return 1;
+    }
+
+    if(!pickCompaction(t,&c))
+        return 0;
+    if(c.move)
+    {
+        removeRun(t,c.level,c.inputs[0]);
+        rc=addRun(t,c.level+1,c.inputs[0]);
+        if(rc==RC_OK)
+            rc=writeManifest(t);
+        outs=0;
+        numOuts=0;
+    }
+    else
+    {
+        outs=0;
+        numOuts=0;
+        unlockLsm(t);
+        rc=runCompaction(t,&c,&outs,&numOuts);
+        lockLsm(t);
+        for(i=0;rc==RC_OK&&i<numOuts;i++)
+            rc=addRun(t,c.level+1,outs[i]);
+        // the inputs stay, take the outputs added so far out again
+        if(rc!=RC_OK)
+            for(i=0;i<numOuts;i++)
+            {
+                removeRun(t,c.level+1,outs[i]);
+                outs[i]->obsolete=1;
+                unrefRun(outs[i]);
+            }
+        if(rc==RC_OK)
+        {
+            for(i=0;i<c.numInputs;i++)
+            {
+                removeRun(t,i<c.numUpper?c.level:c.level+1,c.inputs[i]);
+                c.inputs[i]->obsolete=1;
+                unrefRun(c.inputs[i]);
+            }
+            rc=writeManifest(t);
+            for(i=0;i<numOuts;i++)
+                t->stats.pagesWritten+=outs[i]->numPages;
+        }
+    }
+    if(rc==RC_OK)
+        t->stats.compactions++;
+    else if(t->error==RC_OK)
+        t->error=rc;
+    for(i=0;i<c.numInputs;i++)
+        unrefRun(c.inputs[i]);
+    free(c.inputs);
+    free(outs);
+    t->busy[c.level]=0;
+    t->busy[c.level+1]=0;
+    t->running--;
+    notifyDone(t);
+    return 1;
+}
+
+#ifdef LSM_THREADS
+static void* lsmThread(void* arg)
+{
+    LsmInfo* t=(LsmInfo*)arg;
+
+    lockLsm(t);
+    while(!t->stop)
+        if(t->error!=RC_OK||!doWork(t))
+            pthread_cond_wait(&t->work,&t->lock);
+    unlockLsm(t);
+    return 0;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        rotateMemtable
+ * Description:     hand the memtable to a flush and start a new one. Waits
+ *                  while the last one is still being written or level 0 is
+ *                  full; without threads the flush and compactions run here.
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC rotateMemtable(LsmInfo* t)
+{
+    Memtable* m=newMemtable();
+    RC rc;
+
+    if(m==0) return RC_ERROR;
+    lockLsm(t);
+    if(t->numThreads>0)
+        while(t->error==RC_OK&&(t->imm!=0||t->numRuns[0]>=L0_STOP))
+            waitDone(t);
+    rc=t->error;
+    if(rc==RC_OK)
+    {
+        t->imm=t->mem;
+        t->mem=m;
+        m=0;
+        if(t->numThreads>0)
+            notifyWork(t);
+        else
+        {
+            while(t->error==RC_OK&&doWork(t))
+                ;
+            rc=t->error;
+        }
+    }
+    unlockLsm(t);
+    freeMemtable(m);
+    return rc;
+}
+
+/************************************************************
+ *                    stores                                *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        createLsm
+ * Description:     create an empty store
+ * Input:           char* name: store name, also the file name
+                    DataType keyType: type of the keys
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createLsm(char *name, DataType keyType)
+{
+    SM_FileHandle fh;
+    int words[MANIFEST_INTS];
+
+    if(keyType!=DT_INT&&keyType!=DT_FLOAT&&keyType!=DT_BOOL)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "keys must be DT_INT, DT_FLOAT or DT_BOOL");
+    RC rc=createPageFile(name);
+    if(rc!=RC_OK) return rc;
+    rc=openPageFile(name,&fh);
+    if(rc==RC_OK)
+    {
+        memset(words,0,sizeof(words));
+        words[0]=MANIFEST_MAGIC;
+        words[1]=(int)keyType;
+        words[2]=1;
+        rc=writeBlock(0,&fh,(SM_PageHandle)words);
+        RC closeRc=closePageFile(&fh);
+        if(rc==RC_OK) rc=closeRc;
+    }
+    if(rc!=RC_OK)
+        destroyPageFile(name);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        readManifest
+ * Description:     read and check the list of runs of a store
+ * Output:          int* words: MANIFEST_INTS words
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC readManifest(SM_FileHandle* fh, int* words)
+{
+    RC rc=readBlock(0,fh,(SM_PageHandle)words);
+    if(rc!=RC_OK) return rc;
+    if(words[0]!=MANIFEST_MAGIC||words[3]<0||words[3]>MAX_RUNS)
+        THROW(RC_FILE_HEADER_CORRUPT, "the page file is not a log-structured merge tree");
+    return RC_OK;
+}
+
+static void freeLsm(LsmInfo* t)
+{
+    int l, i;
+
+    for(l=0;l<LSM_LEVELS;l++)
+    {
+        for(i=0;i<t->numRuns[l];i++)
+            unrefRun(t->levels[l][i]);
+        free(t->levels[l]);
+    }
+    freeMemtable(t->mem);
+    freeMemtable(t->imm);
+#ifdef LSM_THREADS
+    free(t->threads);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->work);
+    pthread_cond_destroy(&t->done);
+#endif
+    free(t);
+}
+
+/*********************************************************************************
+ * Function:        openLsm
+ * Description:     open a store and start its compaction threads
+ * Input:           char* name: store name
+                    long memtableBytes: memtable size, also sets the run size
+                    int numThreads: flush and compaction threads, 0 to flush
+                                    and compact in the writing thread
+ * Output:          LSM_Handle** lsm: new handle, freed by closeLsm
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openLsm(LSM_Handle **lsm, char *name, long memtableBytes, int numThreads)
+{
+    LsmInfo* t=(LsmInfo*)calloc(1,sizeof(LsmInfo));
+    LSM_Handle* handle=(LSM_Handle*)malloc(sizeof(LSM_Handle));
+    int words[MANIFEST_INTS];
+    int l, i;
+    RC rc;
+
+    if(t==0||handle==0)
+    {
+        free(t);
+        free(handle);
+        return RC_ERROR;
+    }
+#ifdef LSM_THREADS
+    pthread_mutex_init(&t->lock,0);
+    pthread_cond_init(&t->work,0);
+    pthread_cond_init(&t->done,0);
+#else
+    numThreads=0;
+#endif
+    t->name=name;
+    t->memtableBytes=memtableBytes;
+    t->runPages=(int)(memtableBytes/PAGE_SIZE);
+    if(t->runPages<MIN_RUN_PAGES)
+        t->runPages=MIN_RUN_PAGES;
+    for(l=0;l<LSM_LEVELS;l++)
+        t->cursor[l]=INT_MIN;
+    t->mem=newMemtable();
+    if(t->mem==0)
+    {
+        freeLsm(t);
+        free(handle);
+        return RC_ERROR;
+    }
+
+    rc=openPageFile(name,&t->manifest);
+    if(rc!=RC_OK)
+    {
+        freeLsm(t);
+        free(handle);
+        return rc;
+    }
+    rc=readManifest(&t->manifest,words);
+    if(rc==RC_OK)
+    {
+        t->keyType=(DataType)words[1];
+        t->nextRunId=words[2];
+        for(i=0;rc==RC_OK&&i<words[3];i++)
+        {
+            Run* run=0;
+            l=words[4+2*i];
+            if(l<0||l>=LSM_LEVELS)
+                rc=RC_FILE_HEADER_CORRUPT;
+            else
+                rc=loadRun(t,words[5+2*i],&run);
+            if(rc==RC_OK)
+            {
+                rc=addRun(t,l,run);
+                if(rc!=RC_OK)
+                    unrefRun(run);
+            }
+        }
+    }
+#ifdef LSM_THREADS
+    if(rc==RC_OK&&numThreads>0)
+    {
+        t->threads=(pthread_t*)malloc(sizeof(pthread_t)*numThreads);
+        if(t->threads==0)
+            rc=RC_ERROR;
+        for(i=0;rc==RC_OK&&i<numThreads;i++)
+        {
+            if(pthread_create(&t->threads[i],0,lsmThread,t)!=0)
+                break;
+            t->numThreads++;
+        }
+    }
+#endif
+    if(rc!=RC_OK)
+    {
+        closePageFile(&t->manifest);
+        freeLsm(t);
+        free(handle);
+        return rc;
+    }
+
+    handle->keyType=t->keyType;
+    handle->name=name;
+    handle->mgmtData=t;
+    *lsm=handle;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeLsm
+ * Description:     write the memtable, stop the threads once their running
+ *                  compactions are done, close the store and free the handle
+ * Input:           LSM_Handle* lsm: handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeLsm(LSM_Handle *lsm)
+{
+    LsmInfo* t;
+    RC rc=RC_OK;
+
+    if(lsm==0||lsm->mgmtData==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "store is not open");
+    t=(LsmInfo*)lsm->mgmtData;
+    if(t->mem->count>0)
+        rc=rotateMemtable(t);
+
+    lockLsm(t);
+    if(t->numThreads>0)
+        while(t->error==RC_OK&&t->imm!=0)
+            waitDone(t);
+    t->stop=1;
+    notifyWork(t);
+    unlockLsm(t);
+#ifdef LSM_THREADS
+    int i;
+    for(i=0;i<t->numThreads;i++)
+        pthread_join(t->threads[i],0);
+#endif
+    if(rc==RC_OK)
+        rc=t->error;
+    RC closeRc=closePageFile(&t->manifest);
+    if(rc==RC_OK) rc=closeRc;
+    freeLsm(t);
+    free(lsm);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteLsm
+ * Description:     remove the page file of a store and its runs
+ * Input:           char* name: store name
+ * Return:          RC: return code
+ **********************************************************************************/
+RC deleteLsm(char *name)
+{
+    SM_FileHandle fh;
+    int words[MANIFEST_INTS];
+    int i;
+
+    RC rc=openPageFile(name,&fh);
+    if(rc!=RC_OK) return rc;
+    rc=readManifest(&fh,words);
+    closePageFile(&fh);
+    for(i=0;rc==RC_OK&&i<words[3];i++)
+    {
+        char* fileName=runFileName(name,words[5+2*i]);
+        if(fileName==0)
+            return RC_ERROR;
+        rc=destroyPageFile(fileName);
+        free(fileName);
+    }
+    if(rc!=RC_OK) return rc;
+    return destroyPageFile(name);
+}
+
+/************************************************************
+ *                    access                                *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        lsmPut
+ * Description:     set the value of a key
+ * Input:           LSM_Handle* lsm: handle
+                    Value* key: key
+                    char* data: value
+                    int length: length of the value, up to LSM_MAX_VALUE
+ * Return:          RC: return code
+ **********************************************************************************/
+RC lsmPut(LSM_Handle *lsm, Value *key, char *data, int length)
+{
+    LsmInfo* t=(LsmInfo*)lsm->mgmtData;
+    int k;
+
+    if(length<0||length>LSM_MAX_VALUE)
+        THROW(RC_RM_RECORD_TOO_BIG, "value is longer than LSM_MAX_VALUE");
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    rc=memtablePut(t->mem,k,data,length);
+    if(rc==RC_OK&&t->mem->bytes>=t->memtableBytes)
+        rc=rotateMemtable(t);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        lsmDelete
+ * Description:     delete a key; deleting a key that is not there is no error
+ * Input:           LSM_Handle* lsm: handle
+                    Value* key: key
+ * Return:          RC: return code
+ **********************************************************************************/
+RC lsmDelete(LSM_Handle *lsm, Value *key)
+{
+    LsmInfo* t=(LsmInfo*)lsm->mgmtData;
+    int k;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    rc=memtablePut(t->mem,k,0,TOMBSTONE);
+    if(rc==RC_OK&&t->mem->bytes>=t->memtableBytes)
+        rc=rotateMemtable(t);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        copyValue
+ * Description:     hand a found value to the caller of lsmGet
+ **********************************************************************************/
+static RC copyValue(char* value, int valueLength, char* data, int* length)
+{
+    if(valueLength==TOMBSTONE)
+        return RC_IM_KEY_NOT_FOUND;
+    if(valueLength>*length)
+    {
+        *length=valueLength;
+        return RC_RM_RECORD_TOO_BIG;
+    }
+    memcpy(data,value,valueLength);
+    *length=valueLength;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        lsmGet
+ * Description:     look up a key in the memtables, then in the level 0 runs
+ *                  newest first, then in the one run of every deeper level
+ *                  whose key range holds the key
+ * Input:           LSM_Handle* lsm: handle
+                    Value* key: key
+                    int* length: size of data
+ * Output:          char* data: value
+                    int* length: length of the value
+ * Return:          RC: RC_IM_KEY_NOT_FOUND if the key is not in the store
+ **********************************************************************************/
+RC lsmGet(LSM_Handle *lsm, Value *key, char *data, int *length)
+{
+    LsmInfo* t=(LsmInfo*)lsm->mgmtData;
+    char page[PAGE_SIZE];
+    Run** runs;
+    int k, n=0, l, i, skips=0;
+
+    RC rc=keyOf(t,key,&k);
+    if(rc!=RC_OK) return rc;
+    SkipNode* x=memtableSeek(t->mem,k,0);
+    if(x!=0)
+        return copyValue(x->data,x->length,data,length);
+
+    lockLsm(t);
+    if(t->imm!=0&&(x=memtableSeek(t->imm,k,0))!=0)
+    {
+        rc=copyValue(x->data,x->length,data,length);
+        unlockLsm(t);
+        return rc;
+    }
+    // the runs to search, held until the search is done
+    runs=(Run**)malloc(sizeof(Run*)*(t->numRuns[0]+LSM_LEVELS));
+    if(runs==0)
+    {
+        unlockLsm(t);
+        return RC_ERROR;
+    }
+    for(i=t->numRuns[0]-1;i>=0;i--)
+        runs[n++]=t->levels[0][i];
+    for(l=1;l<LSM_LEVELS;l++)
+    {
+        int lo=0, hi=t->numRuns[l]-1;
+        while(lo<=hi)
+        {
+            int mid=(lo+hi)/2;
+            Run* run=t->levels[l][mid];
+            if(run->maxKey<k)
+                lo=mid+1;
+            else if(run->minKey>k)
+                hi=mid-1;
+            else
+            {
+                runs[n++]=run;
+                break;
+            }
+        }
+    }
+    for(i=0;i<n;i++)
+        runs[i]->refs++;
+    unlockLsm(t);
+
+    rc=RC_IM_KEY_NOT_FOUND;
+    for(i=0;i<n;i++)
+    {
+        char* value;
+        int valueLength, skip;
+        rc=runGet(runs[i],k,page,&value,&valueLength,&skip);
+        skips+=skip;
+        if(rc==RC_OK)
+        {
+            rc=copyValue(value,valueLength,data,length);
+            break;
+        }
+        if(rc!=RC_IM_KEY_NOT_FOUND)
+            break;
+    }
+
+    lockLsm(t);
+    for(i=0;i<n;i++)
+        unrefRun(runs[i]);
+    t->stats.bloomSkips+=skips;
+    unlockLsm(t);
+    free(runs);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        lsmFlush
+ * Description:     write the memtable as a run and wait until the flush and
+ *                  every compaction it calls for are done
+ * Input:           LSM_Handle* lsm: handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC lsmFlush(LSM_Handle *lsm)
+{
+    LsmInfo* t=(LsmInfo*)lsm->mgmtData;
+    RC rc=RC_OK;
+
+    if(t->mem->count>0)
+        rc=rotateMemtable(t);
+    if(rc!=RC_OK) return rc;
+
+    lockLsm(t);
+    if(t->numThreads>0)
+    {
+        notifyWork(t);
+        while(t->error==RC_OK&&(t->imm!=0||t->running>0||pickLevel(t)>=0))
+            waitDone(t);
+    }
+    else
+        while(t->error==RC_OK&&doWork(t))
+            ;
+    rc=t->error;
+    unlockLsm(t);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        getLsmStats
+ * Description:     runs and pages per level and the work done so far
+ * Input:           LSM_Handle* lsm: handle
+ * Output:          LSM_Stats* stats: statistics
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getLsmStats(LSM_Handle *lsm, LSM_Stats *stats)
+{
+    LsmInfo* t=(LsmInfo*)lsm->mgmtData;
+    int l;
+
+    lockLsm(t);
+    *stats=t->stats;
+    for(l=0;l<LSM_LEVELS;l++)
+    {
+        stats->runs[l]=t->numRuns[l];
+        stats->pages[l]=(int)levelPages(t,l);
+    }
+    stats->memtableBytes=(int)t->mem->bytes;
+    unlockLsm(t);
+    return RC_OK;
+}
@@ -0,0 +1,57 @@
+#ifndef LSM_MGR_H
+#define LSM_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+#define LSM_LEVELS     7
+#define LSM_MAX_VALUE  (PAGE_SIZE - 3 * (int) sizeof(int))
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+typedef struct LSM_Handle {
+  DataType keyType;
+  char *name;
+  void *mgmtData;
+} LSM_Handle;
+
+typedef struct LSM_Stats {
+  int runs[LSM_LEVELS];         /* sorted runs per level, level 0 first */
+  int pages[LSM_LEVELS];        /* data pages per level */
+  int memtableBytes;            /* memory used by the memtable */
+  long long flushes;            /* memtables written as level 0 runs */
+  long long compactions;
+  long long pagesWritten;       /* by flushes and compactions */
+  long long bloomSkips;         /* run lookups answered by a Bloom filter */
+} LSM_Stats;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* a log-structured merge tree of key/value pairs. Keys are DT_INT, DT_FLOAT
+ * or DT_BOOL values, values are up to LSM_MAX_VALUE bytes. Writes go to an
+ * in-memory skip list; a full memtable is written sequentially as a sorted
+ * run, a page file with a block index and a Bloom filter, and up to
+ * numThreads threads compact the runs level by level in the background.
+ * The store is the page file name, holding the list of runs, and the run
+ * files name.<number>. The memtable is written at lsmFlush and closeLsm;
+ * there is no log, a crash loses what was only in the memtable. */
+extern RC createLsm (char *name, DataType keyType);
+extern RC openLsm (LSM_Handle **lsm, char *name, long memtableBytes, int numThreads);
+extern RC closeLsm (LSM_Handle *lsm);
+extern RC deleteLsm (char *name);
+
+/* access: put replaces the value of an existing key. get copies the value
+ * into data, *length is the size of data on entry and the size of the value
+ * on return; RC_IM_KEY_NOT_FOUND if the key is not in the store and
+ * RC_RM_RECORD_TOO_BIG if the value does not fit into data */
+extern RC lsmPut (LSM_Handle *lsm, Value *key, char *data, int length);
+extern RC lsmGet (LSM_Handle *lsm, Value *key, char *data, int *length);
+extern RC lsmDelete (LSM_Handle *lsm, Value *key);
+
+/* write the memtable and wait until no level needs compacting */
+extern RC lsmFlush (LSM_Handle *lsm);
+extern RC getLsmStats (LSM_Handle *lsm, LSM_Stats *stats);
+
+#endif // LSM_MGR_H
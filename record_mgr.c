@@ -0,0 +1,3174 @@
+#include "record_mgr.h"
+#include "storage_mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*  A table is one page file. With the row layout:
+ *   page 0                  table information and the schema
+ *   page 1                  free space map page for data pages 0..FSM_ENTRIES-1
+ *   pages 2..FSM_ENTRIES+1  data pages
+ *   then the next free space map page, its data pages, and so on.
+ *
+ *  Data pages are slotted pages: a PageHeader, the slot directory growing
+ *  up from it, and the records growing down from the end of the page. A RID
+ *  names a data page and a slot, and stays valid while the record lives:
+ *  a record that outgrows its page moves to another page (SLOT_MOVED) and
+ *  its home slot keeps a forward pointer (SLOT_FORWARD) to it.
+ *
+ *  The free space map keeps one byte per data page, the free bytes of the
+ *  page in units of FSM_UNIT. It is kept in memory while the table is open,
+ *  with the largest value of every FSM_GROUP pages, so an insert looks at
+ *  a few bytes instead of reading pages. It is only a hint: a page that
+ *  turns out to be fuller than its entry says just gets its entry fixed.
+ *
+ *  Tables with the columnar layout have no free space map; see the columnar
+ *  pages section. */
+#define TABLE_MAGIC        0x31544d52   /* "RMT1" */
+#define TABLE_MAGIC_PAX    0x31584150   /* "PAX1" */
+#define FSM_ENTRIES        PAGE_SIZE
+#define FSM_GROUP          256
+#define FSM_UNIT           16
+
+#define PAGE_HEADER_SIZE   8
+#define SLOT_SIZE          4
+#define RID_SIZE           8
+#define SLOT_FORWARD       0x8000
+#define SLOT_MOVED         0x4000
+#define SLOT_LENGTH        0x1FFF
+#define MAX_RECORD_SIZE    (PAGE_SIZE - PAGE_HEADER_SIZE - SLOT_SIZE)
+#define LOAD_BATCH_PAGES   64
+#define BATCH_ROWS         1024         // more than the slots of a page
+#define BATCH_WORDS        (BATCH_ROWS/64)
+
+typedef struct PageHeader{
+    unsigned short numSlots;
+    unsigned short freeStart;   // end of the slot directory
+    unsigned short freeEnd;     // start of the record area
+    unsigned short freeSpace;   // free bytes, contiguous and fragmented
+}PageHeader;
+
+typedef struct Slot{
+    unsigned short offset;      // 0 for a free slot
+    unsigned short length;      // record length and SLOT_ flags
+}Slot;
+
+typedef struct TableInfo{
+    SM_FileHandle fh;
+    int numTuples;
+    int numDataPages;
+    int metaDirty;
+    unsigned char* fsm;         // free space category of every data page
+    unsigned char* fsmGroupMax; // largest category in each group of FSM_GROUP pages
+    unsigned char* fsmPageDirty;// per free space map page
+    int fsmCapacity;
+    int lastInsertPage;
+    char* page;                 // cached data page, always the same as on disk
+    int cachedPage;             // -1 if none
+    TableLayout layout;
+    int rowsPerPage;            // columnar tables: rows of a page
+    int* miniOffset;            // columnar tables: minipage of every attribute,
+                                // then the deleted rows bitmap
+    Schema* schema;
+    int summaryAttr;            // attribute of the page summaries, -1 if none
+    SM_FileHandle lob;          // large values, see the large values section
+    int lobOpen;
+    int* lobFree;               // free extents of the large value file
+    int lobNumFree;
+}TableInfo;
+
+/*  A filtered scan decodes the attributes of its predicates from all records
+ *  of a page into columns, one at a time, compares a whole column with the
+ *  constant into bitmaps (AVX2 if there is, a branch free loop if not) and
+ *  keeps the records whose bits survive all predicates. Strings are compared
+ *  by their first 8 bytes, as big endian numbers; only rows whose first 8
+ *  bytes equal those of the constant are compared byte by byte. */
+typedef struct ScanColumn{
+    int attrNum;
+    CompOp op;
+    DataType dt;
+    int offset;                 // fixed attributes: offset in the record
+    int strIndex;               // strings: number of strings before this one
+    int intValue;               // DT_INT and DT_BOOL constant
+    float floatValue;
+    char* str;                  // DT_STRING constant
+    int strLen;
+    unsigned long long strKey;  // first 8 bytes of str
+    unsigned long long zone;    // constant as a zone key
+    void* values;               // ints, floats or string keys of the page
+    unsigned short* lens;       // strings: length
+    unsigned short* offs;       // strings: offset of the characters in the page
+}ScanColumn;
+
+typedef struct ScanInfo{
+    int page;
+    int slot;
+    int loadedPage;
+    char* buf;
+    ScanColumn* cols;           // predicates of a filtered scan
+    int numCols;
+    int fixedEnd;               // offset of the first string in a record
+    unsigned long long sel[BATCH_WORDS];     // matching records of the loaded page
+    unsigned long long forward[BATCH_WORDS]; // forwarded records, checked one by one
+}ScanInfo;
+
+#define PAGE_HEADER(page)  ((PageHeader*)(page))
+#define PAGE_SLOTS(page)   ((Slot*)((page)+PAGE_HEADER_SIZE))
+
+static int fixedAttrSize(DataType dt);
+static char* lobName(char* name);
+
+/*********************************************************************************
+ * Function:        fsmFilePage / dataFilePage
+ * Description:     position of a free space map page / data page in the file
+ **********************************************************************************/
+static int fsmFilePage(int fsmIndex)
+{
+    return 1+fsmIndex*(FSM_ENTRIES+1);
+}
+
+static int dataFilePage(int dataPage)
+{
+    return fsmFilePage(dataPage/FSM_ENTRIES)+1+dataPage%FSM_ENTRIES;
+}
+
+// columnar tables have no free space map, their data pages follow page 0
+static int tableFilePage(TableInfo* t, int dataPage)
+{
+    return t->layout==TABLE_COLUMNS?1+dataPage:dataFilePage(dataPage);
+}
+
+/*********************************************************************************
+ * Function:        allocSize
+ * Description:     bytes a record takes in the page, at least a RID so that
+ *                  the slot can always be turned into a forward pointer
+ **********************************************************************************/
+static int allocSize(int length)
+{
+    return length<RID_SIZE?RID_SIZE:length;
+}
+
+/*********************************************************************************
+ * Function:        compactPage
+ * Description:     move all records to the end of the page, so all free space
+ *                  is between the slot directory and the records
+ * Input:           char* page: data page
+ **********************************************************************************/
+static void compactPage(char* page)
+{
+    PageHeader* h=PAGE_HEADER(page);
+    Slot* slots=PAGE_SLOTS(page);
+    char tmp[PAGE_SIZE];
+    int end=PAGE_SIZE;
+    int i;
+
+    for(i=0;i<h->numSlots;i++)
+    {
+        if(slots[i].offset==0)
+            continue;
+        int alloc=allocSize(slots[i].length&SLOT_LENGTH);
+        end-=alloc;
+        memcpy(tmp+end,page+slots[i].offset,alloc);
+        slots[i].offset=(unsigned short)end;
+    }
+    memcpy(page+end,tmp+end,PAGE_SIZE-end);
+    h->freeEnd=(unsigned short)end;
+}
+
+/*********************************************************************************
+ * Function:        pagePlace
+ * Description:     put a record into a given slot, which is either free or
+ *                  the next new slot
+ * Input:           char* page: data page
+                    int slot: slot number, at most numSlots
+                    char* data, int length: record
+                    unsigned short flags: SLOT_ flags
+ * Return:          int: 1 on success, 0 if the page is too full
+ **********************************************************************************/
+static int pagePlace(char* page, int slot, char* data, int length, unsigned short flags)
+{
+    PageHeader* h=PAGE_HEADER(page);
+    Slot* slots=PAGE_SLOTS(page);
+    int alloc=allocSize(length);
+    int need=alloc+(slot==h->numSlots?SLOT_SIZE:0);
+
+    if(h->freeSpace<need)
+        return 0;
+    if(h->freeEnd-h->freeStart<need)
+        compactPage(page);
+    if(slot==h->numSlots)
+    {
+        h->numSlots++;
+        h->freeStart+=SLOT_SIZE;
+        slots[slot].offset=0;
+    }
+
+    h->freeEnd-=alloc;
+    memcpy(page+h->freeEnd,data,length);
+    slots[slot].offset=h->freeEnd;
+    slots[slot].length=(unsigned short)(length|flags);
+    h->freeSpace-=need;
+    return 1;
+}
+
+/*********************************************************************************
+ * Function:        pageInsert
+ * Description:     put a record into the first free slot or a new one
+ * Return:          int: slot number, -1 if the page is too full
+ **********************************************************************************/
+static int pageInsert(char* page, char* data, int length, unsigned short flags)
+{
+    PageHeader* h=PAGE_HEADER(page);
+    Slot* slots=PAGE_SLOTS(page);
+    int slot;
+
+    for(slot=0;slot<h->numSlots;slot++)
+        if(slots[slot].offset==0)
+            break;
+    return pagePlace(page,slot,data,length,flags)?slot:-1;
+}
+
+/*********************************************************************************
+ * Function:        pageRelease
+ * Description:     give the space of a slot back to the page; with trim the
+ *                  trailing free slots are dropped from the directory as well
+ **********************************************************************************/
+static void pageRelease(char* page, int slot, int trim)
+{
+    PageHeader* h=PAGE_HEADER(page);
+    Slot* slots=PAGE_SLOTS(page);
+
+    h->freeSpace+=allocSize(slots[slot].length&SLOT_LENGTH);
+    slots[slot].offset=0;
+    slots[slot].length=0;
+    while(trim&&h->numSlots>0&&slots[h->numSlots-1].offset==0)
+    {
+        h->numSlots--;
+        h->freeStart-=SLOT_SIZE;
+        h->freeSpace+=SLOT_SIZE;
+    }
+}
+
+/*********************************************************************************
+ * Function:        setFsm
+ * Description:     record the free space of a data page in the free space map
+ **********************************************************************************/
+static void setFsm(TableInfo* t, int dataPage, int freeSpace)
+{
+    unsigned char cat=(unsigned char)(freeSpace/FSM_UNIT);
+    unsigned char old=t->fsm[dataPage];
+    int group=dataPage/FSM_GROUP;
+
+    if(cat==old)
+        return;
+    t->fsm[dataPage]=cat;
+    t->fsmPageDirty[dataPage/FSM_ENTRIES]=1;
+
+    if(cat>t->fsmGroupMax[group])
+        t->fsmGroupMax[group]=cat;
+    else if(old==t->fsmGroupMax[group])
+    {
+        // the page may have been the largest of its group
+        int i, end=(group+1)*FSM_GROUP;
+        unsigned char max=0;
+        for(i=group*FSM_GROUP;i<end&&i<t->numDataPages;i++)
+            if(t->fsm[i]>max) max=t->fsm[i];
+        t->fsmGroupMax[group]=max;
+    }
+}
+
+/*********************************************************************************
+ * Function:        findPageWithSpace
+ * Description:     a data page whose free space map entry promises need bytes
+ * Input:           TableInfo* t: table
+                    int need: bytes needed including a new slot
+                    int exclude: data page not to use, -1 for none
+ * Return:          int: data page, -1 if no page has room
+ **********************************************************************************/
+static int findPageWithSpace(TableInfo* t, int need, int exclude)
+{
+    unsigned char cat=(unsigned char)((need+FSM_UNIT-1)/FSM_UNIT);
+    int group, i;
+
+    // inserts tend to go to the same page until it is full
+    if(t->lastInsertPage>=0&&t->lastInsertPage<t->numDataPages&&
+       t->lastInsertPage!=exclude&&t->fsm[t->lastInsertPage]>=cat)
+        return t->lastInsertPage;
+
+    for(group=0;group*FSM_GROUP<t->numDataPages;group++)
+    {
+        if(t->fsmGroupMax[group]<cat)
+            continue;
+        int end=(group+1)*FSM_GROUP;
+        for(i=group*FSM_GROUP;i<end&&i<t->numDataPages;i++)
+            if(t->fsm[i]>=cat&&i!=exclude)
+                return i;
+    }
+    return -1;
+}
+
+/*********************************************************************************
+ * Function:        loadPage / storePage
+ * Description:     read a data page into the table cache / write the cached
+ *                  page back and refresh its free space map entry
+ **********************************************************************************/
+static RC loadPage(TableInfo* t, int dataPage)
+{
+    if(t->cachedPage==dataPage)
+        return RC_OK;
+    t->cachedPage=-1;
+    RC rc=readBlock(tableFilePage(t,dataPage),&t->fh,t->page);
+    if(rc!=RC_OK)
+        return rc;
+    t->cachedPage=dataPage;
+    return RC_OK;
+}
+
+static RC storePage(TableInfo* t)
+{
+    RC rc=writeBlock(dataFilePage(t->cachedPage),&t->fh,t->page);
+    if(rc!=RC_OK)
+    {
+        t->cachedPage=-1;
+        return rc;
+    }
+    setFsm(t,t->cachedPage,PAGE_HEADER(t->page)->freeSpace);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        growFsm
+ * Description:     make room for one more data page in the in-memory free space map
+ **********************************************************************************/
+static RC growFsm(TableInfo* t, int numDataPages)
+{
+    if(numDataPages<=t->fsmCapacity)
+        return RC_OK;
+
+    int cap=t->fsmCapacity==0?FSM_GROUP:t->fsmCapacity;
+    while(cap<numDataPages)
+        cap*=2;
+
+    unsigned char* fsm=(unsigned char*)realloc(t->fsm,cap);
+    if(fsm==0) return RC_ERROR;
+    t->fsm=fsm;
+    unsigned char* groupMax=(unsigned char*)realloc(t->fsmGroupMax,cap/FSM_GROUP+1);
+    if(groupMax==0) return RC_ERROR;
+    t->fsmGroupMax=groupMax;
+    unsigned char* dirty=(unsigned char*)realloc(t->fsmPageDirty,cap/FSM_ENTRIES+1);
+    if(dirty==0) return RC_ERROR;
+    t->fsmPageDirty=dirty;
+
+    memset(t->fsm+t->fsmCapacity,0,cap-t->fsmCapacity);
+    memset(t->fsmGroupMax+t->fsmCapacity/FSM_GROUP,0,cap/FSM_GROUP+1-t->fsmCapacity/FSM_GROUP);
+    memset(t->fsmPageDirty+t->fsmCapacity/FSM_ENTRIES,0,cap/FSM_ENTRIES+1-t->fsmCapacity/FSM_ENTRIES);
+    t->fsmCapacity=cap;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        allocDataPage
+ * Description:     add an empty data page (and a free space map page when a new
+ *                  one is needed) and make it the cached page
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC allocDataPage(TableInfo* t)
+{
+    int dataPage=t->numDataPages;
+    int filePage=dataFilePage(dataPage);
+    RC rc;
+
+    rc=growFsm(t,dataPage+1);
+    if(rc!=RC_OK) return rc;
+    if(filePage>=t->fh.totalNumPages)
+    {
+        rc=ensureCapacity(filePage+1,&t->fh);
+        if(rc!=RC_OK) return rc;
+    }
+
+    memset(t->page,0,PAGE_SIZE);
+    PAGE_HEADER(t->page)->numSlots=0;
+    PAGE_HEADER(t->page)->freeStart=PAGE_HEADER_SIZE;
+    PAGE_HEADER(t->page)->freeEnd=PAGE_SIZE;
+    PAGE_HEADER(t->page)->freeSpace=PAGE_SIZE-PAGE_HEADER_SIZE;
+    t->cachedPage=dataPage;
+    t->numDataPages++;
+    t->metaDirty=1;
+    // new pages start with category 0, storePage sets the real one
+    t->fsm[dataPage]=0;
+    return storePage(t);
+}
+
+/*********************************************************************************
+ * Function:        placeAnywhere
+ * Description:     insert a record into any page with room, or a new page
+ * Input:           TableInfo* t: table
+                    char* data, int length: record
+                    unsigned short flags: SLOT_ flags
+                    int exclude: data page not to use, -1 for none
+ * Output:          RID* id: where the record went
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC placeAnywhere(TableInfo* t, char* data, int length, unsigned short flags, int exclude, RID* id)
+{
+    int need=allocSize(length)+SLOT_SIZE;
+    RC rc;
+
+    for(;;)
+    {
+        int dataPage=findPageWithSpace(t,need,exclude);
+        if(dataPage<0)
+        {
+            rc=allocDataPage(t);
+            if(rc!=RC_OK) return rc;
+            dataPage=t->cachedPage;
+        }
+        rc=loadPage(t,dataPage);
+        if(rc!=RC_OK) return rc;
+
+        int slot=pageInsert(t->page,data,length,flags);
+        if(slot<0)
+        {
+            // the free space map entry was stale, fix it and look again
+            setFsm(t,dataPage,0);
+            continue;
+        }
+        rc=storePage(t);
+        if(rc!=RC_OK) return rc;
+        t->lastInsertPage=dataPage;
+        id->page=dataPage;
+        id->slot=slot;
+        return RC_OK;
+    }
+}
+
+/*********************************************************************************
+ * Function:        locateSlot
+ * Description:     load the page of a RID and check that the slot holds a record
+ *                  that can be addressed by this RID (not a moved copy)
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC locateSlot(TableInfo* t, RID id)
+{
+    if(id.page<0||id.page>=t->numDataPages||id.slot<0)
+        THROW(RC_RM_NO_SUCH_RECORD, "RID does not name a record");
+
+    RC rc=loadPage(t,id.page);
+    if(rc!=RC_OK) return rc;
+
+    Slot* slots=PAGE_SLOTS(t->page);
+    if(id.slot>=PAGE_HEADER(t->page)->numSlots||slots[id.slot].offset==0||
+       (slots[id.slot].length&SLOT_MOVED))
+        THROW(RC_RM_NO_SUCH_RECORD, "RID does not name a record");
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        readForward
+ * Description:     the RID stored in a forward pointer slot of the cached page
+ **********************************************************************************/
+static RID readForward(TableInfo* t, int slot)
+{
+    RID target;
+    memcpy(&target,t->page+PAGE_SLOTS(t->page)[slot].offset,RID_SIZE);
+    return target;
+}
+
+/*********************************************************************************
+ * Function:        copyOut
+ * Description:     copy a record of the cached page into a Record
+ **********************************************************************************/
+static RC copyOut(RM_TableData* rel, char* page, int slot, RID id, Record* record)
+{
+    Slot* s=&PAGE_SLOTS(page)[slot];
+    int length=s->length&SLOT_LENGTH;
+    int capacity=getRecordSize(rel->schema);
+
+    // keep room for the longest record, so setAttr can grow strings in place
+    char* data=(char*)realloc(record->data,capacity>length?capacity:length);
+    if(data==0) return RC_ERROR;
+    record->data=data;
+    memcpy(record->data,page+s->offset,length);
+    record->size=length;
+    record->id=id;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeMeta
+ * Description:     write page 0: table information and schema
+ **********************************************************************************/
+static RC writeMeta(TableInfo* t, Schema* schema, SM_FileHandle* fh)
+{
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    int values[5];
+    int pos, i;
+
+    values[0]=t->layout==TABLE_COLUMNS?TABLE_MAGIC_PAX:TABLE_MAGIC;
+    values[1]=t->numTuples;
+    values[2]=t->numDataPages;
+    values[3]=schema->numAttr;
+    values[4]=schema->keySize;
+    memcpy(page,values,sizeof(values));
+    pos=sizeof(values);
+
+    for(i=0;i<schema->numAttr;i++)
+    {
+        int nameLen=(int)strlen(schema->attrNames[i]);
+        if(pos+3*(int)sizeof(int)+nameLen>PAGE_SIZE)
+        {
+            free(page);
+            THROW(RC_RM_RECORD_TOO_BIG, "schema does not fit into the table information page");
+        }
+        memcpy(page+pos,&schema->dataTypes[i],sizeof(int));
+        memcpy(page+pos+sizeof(int),&schema->typeLength[i],sizeof(int));
+        memcpy(page+pos+2*sizeof(int),&nameLen,sizeof(int));
+        memcpy(page+pos+3*sizeof(int),schema->attrNames[i],nameLen);
+        pos+=3*sizeof(int)+nameLen;
+    }
+    if(pos+schema->keySize*(int)sizeof(int)>PAGE_SIZE)
+    {
+        free(page);
+        THROW(RC_RM_RECORD_TOO_BIG, "schema does not fit into the table information page");
+    }
+    memcpy(page+pos,schema->keyAttrs,schema->keySize*sizeof(int));
+
+    RC rc=writeBlock(0,fh,page);
+    free(page);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        readMeta
+ * Description:     read page 0 into the table information and a new schema
+ **********************************************************************************/
+static RC readMeta(TableInfo* t, Schema** schemaOut)
+{
+    char* page=(char*)malloc(PAGE_SIZE);
+    int values[5];
+    int pos, i;
+
+    RC rc=readBlock(0,&t->fh,page);
+    if(rc!=RC_OK)
+    {
+        free(page);
+        return rc;
+    }
+    memcpy(values,page,sizeof(values));
+    if((values[0]!=TABLE_MAGIC&&values[0]!=TABLE_MAGIC_PAX)||values[3]<0||values[4]<0)
+    {
+        free(page);
+        THROW(RC_FILE_HEADER_CORRUPT, "the page file is not a table");
+    }
+    t->layout=values[0]==TABLE_MAGIC_PAX?TABLE_COLUMNS:TABLE_ROWS;
+    t->numTuples=values[1];
+    t->numDataPages=values[2];
+
+    int numAttr=values[3];
+    int keySize=values[4];
+    char** names=(char**)malloc(sizeof(char*)*numAttr);
+    DataType* types=(DataType*)malloc(sizeof(DataType)*numAttr);
+    int* lengths=(int*)malloc(sizeof(int)*numAttr);
+    int* keys=(int*)malloc(sizeof(int)*(keySize>0?keySize:1));
+    pos=sizeof(values);
+    for(i=0;i<numAttr;i++)
+    {
+        int type, nameLen;
+        memcpy(&type,page+pos,sizeof(int));
+        memcpy(&lengths[i],page+pos+sizeof(int),sizeof(int));
+        memcpy(&nameLen,page+pos+2*sizeof(int),sizeof(int));
+        types[i]=(DataType)type;
+        names[i]=(char*)malloc(nameLen+1);
+        memcpy(names[i],page+pos+3*sizeof(int),nameLen);
+        names[i][nameLen]='\0';
+        pos+=3*sizeof(int)+nameLen;
+    }
+    memcpy(keys,page+pos,keySize*sizeof(int));
+    free(page);
+
+    *schemaOut=createSchema(numAttr,names,types,lengths,keySize,keys);
+    return RC_OK;
+}
+
+/************************************************************
+ *                    columnar pages                        *
+ ************************************************************/
+
+/*  A columnar data page holds up to rowsPerPage rows:
+ *   PAX_HEADER_SIZE bytes   number of rows and of rows not deleted
+ *   16 bytes per attribute  smallest and largest zone key in the minipage
+ *   bitmap                  deleted rows
+ *   a minipage per attribute, rowsPerPage values of the attribute: 4 byte
+ *   ints and floats, 1 byte bools, strings as a 2 byte length and
+ *   typeLength bytes
+ *  A RID names the data page and the row. Zone keys order like the values,
+ *  strings by their first 8 bytes; they only grow, so after deletes and
+ *  updates they still hold every value of the page. */
+#define PAX_HEADER_SIZE    8
+#define PAX_ROWS(page)     (((unsigned short*)(page))[0])
+#define PAX_LIVE(page)     (((unsigned short*)(page))[1])
+#define PAX_ZONES(page)    ((unsigned long long*)((page)+PAX_HEADER_SIZE))
+
+/*********************************************************************************
+ * Function:        paxWidth
+ * Description:     bytes of one value in the minipage of an attribute
+ **********************************************************************************/
+static int paxWidth(Schema* schema, int attrNum)
+{
+    if(schema->dataTypes[attrNum]==DT_STRING)
+        return 2+schema->typeLength[attrNum];
+    return fixedAttrSize(schema->dataTypes[attrNum]);
+}
+
+/*********************************************************************************
+ * Function:        paxLayout
+ * Description:     place the minipages of a page with the given number of rows,
+ *                  offsets[numAttr] is the deleted rows bitmap
+ * Return:          int: bytes used
+ **********************************************************************************/
+static int paxLayout(Schema* schema, int rows, int* offsets)
+{
+    int pos=PAX_HEADER_SIZE+16*schema->numAttr;
+    int i;
+
+    offsets[schema->numAttr]=pos;
+    pos+=(rows+63)/64*8;
+    for(i=0;i<schema->numAttr;i++)
+    {
+        offsets[i]=pos;
+        pos+=(rows*paxWidth(schema,i)+7)&~7;
+    }
+    return pos;
+}
+
+/*********************************************************************************
+ * Function:        paxPlan
+ * Description:     the most rows that fit into a page, at most BATCH_ROWS so a
+ *                  scan has one bit for every row, and their minipages
+ * Return:          RC: RC_RM_RECORD_TOO_BIG if not even one row fits
+ **********************************************************************************/
+static RC paxPlan(TableInfo* t, Schema* schema)
+{
+    int width=0, rows, i;
+
+    for(i=0;i<schema->numAttr;i++)
+        width+=paxWidth(schema,i);
+    free(t->miniOffset);
+    t->miniOffset=(int*)malloc((schema->numAttr+1)*sizeof(int));
+    if(t->miniOffset==0) return RC_ERROR;
+
+    rows=(PAGE_SIZE-PAX_HEADER_SIZE-16*schema->numAttr)*8/(8*width+1);
+    if(rows>BATCH_ROWS)
+        rows=BATCH_ROWS;
+    while(rows>0&&paxLayout(schema,rows,t->miniOffset)>PAGE_SIZE)
+        rows--;
+    if(rows<1)
+        THROW(RC_RM_RECORD_TOO_BIG, "a row does not fit into a columnar page");
+    t->rowsPerPage=rows;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        stringKey
+ * Description:     the first 8 bytes of a string as a big endian number, zero
+ *                  padded, so that keys compare like the strings
+ **********************************************************************************/
+static unsigned long long stringKey(const char* str, int len)
+{
+    unsigned long long key=0;
+    int i;
+    for(i=0;i<8;i++)
+        key=(key<<8)|(i<len?(unsigned char)str[i]:0);
+    return key;
+}
+
+/*********************************************************************************
+ * Function:        zoneKey
+ * Description:     unsigned key of a value that orders like the value; -0.0 is
+ *                  taken as 0.0 since they compare equal
+ **********************************************************************************/
+static unsigned long long zoneKey(DataType dt, const char* value, int len)
+{
+    switch(dt)
+    {
+    case DT_INT:
+        {
+            int x;
+            memcpy(&x,value,sizeof(x));
+            return (unsigned int)x^0x80000000u;
+        }
+    case DT_FLOAT:
+        {
+            float f;
+            int bits;
+            memcpy(&f,value,sizeof(f));
+            if(f==0)
+                f=0;
+            memcpy(&bits,&f,sizeof(bits));
+            bits^=(bits>>31)&0x7fffffff;
+            return (unsigned int)bits^0x80000000u;
+        }
+    case DT_BOOL:
+        return value[0]!=0;
+    default:
+        return stringKey(value,len);
+    }
+}
+
+/*********************************************************************************
+ * Function:        paxInitPage
+ * Description:     an empty columnar page, zones empty (min above max)
+ **********************************************************************************/
+static void paxInitPage(Schema* schema, char* page)
+{
+    int i;
+    memset(page,0,PAGE_SIZE);
+    for(i=0;i<schema->numAttr;i++)
+        PAX_ZONES(page)[2*i]=~0ULL;
+}
+
+/*********************************************************************************
+ * Function:        paxPut
+ * Description:     store the values of a record in a row and widen the zones
+ **********************************************************************************/
+static void paxPut(TableInfo* t, Schema* schema, char* page, int row, Record* record)
+{
+    int i;
+
+    for(i=0;i<schema->numAttr;i++)
+    {
+        char* dst=page+t->miniOffset[i]+row*paxWidth(schema,i);
+        unsigned long long* zone=PAX_ZONES(page)+2*i;
+        char* data;
+        int len;
+
+        getAttrData(record,schema,i,&data,&len);
+        switch(schema->dataTypes[i])
+        {
+        case DT_STRING:
+            {
+                unsigned short l=(unsigned short)(len<schema->typeLength[i]?len:schema->typeLength[i]);
+                memcpy(dst,&l,2);
+                memcpy(dst+2,data,l);
+                len=l;
+            }
+            break;
+        case DT_BOOL:
+            dst[0]=data[0]!=0;
+            break;
+        default:
+            memcpy(dst,data,4);
+            break;
+        }
+        unsigned long long key=zoneKey(schema->dataTypes[i],data,len);
+        if(key<zone[0]) zone[0]=key;
+        if(key>zone[1]) zone[1]=key;
+    }
+}
+
+/*********************************************************************************
+ * Function:        paxGet
+ * Description:     put the values of a row together into a record
+ **********************************************************************************/
+static RC paxGet(RM_TableData* rel, char* page, int row, RID id, Record* record)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    Schema* schema=rel->schema;
+    int capacity=getRecordSize(schema);
+    int pos=0, i;
+
+    char* data=(char*)realloc(record->data,capacity>0?capacity:1);
+    if(data==0) return RC_ERROR;
+    record->data=data;
+    for(i=0;i<schema->numAttr;i++)
+        if(schema->dataTypes[i]!=DT_STRING)
+        {
+            int width=fixedAttrSize(schema->dataTypes[i]);
+            memcpy(data+pos,page+t->miniOffset[i]+row*width,width);
+            pos+=width;
+        }
+    for(i=0;i<schema->numAttr;i++)
+        if(schema->dataTypes[i]==DT_STRING)
+        {
+            char* src=page+t->miniOffset[i]+row*paxWidth(schema,i);
+            unsigned short len;
+            memcpy(&len,src,2);
+            memcpy(data+pos,src,2+len);
+            pos+=2+len;
+        }
+    record->size=pos;
+    record->id=id;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        paxDeleted
+ * Description:     the deleted rows bitmap of a page
+ **********************************************************************************/
+static unsigned long long* paxDeleted(TableInfo* t, Schema* schema, char* page)
+{
+    return (unsigned long long*)(page+t->miniOffset[schema->numAttr]);
+}
+
+/*********************************************************************************
+ * Function:        paxLocate
+ * Description:     load the page of a RID and check that its row is a record
+ **********************************************************************************/
+static RC paxLocate(TableInfo* t, Schema* schema, RID id)
+{
+    if(id.page<0||id.page>=t->numDataPages||id.slot<0)
+        THROW(RC_RM_NO_SUCH_RECORD, "RID does not name a record");
+    RC rc=loadPage(t,id.page);
+    if(rc!=RC_OK) return rc;
+    if(id.slot>=PAX_ROWS(t->page)||((paxDeleted(t,schema,t->page)[id.slot>>6]>>(id.slot&63))&1))
+        THROW(RC_RM_NO_SUCH_RECORD, "RID does not name a record");
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        paxStore
+ * Description:     write back the cached page
+ **********************************************************************************/
+static RC paxStore(TableInfo* t)
+{
+    RC rc=writeBlock(tableFilePage(t,t->cachedPage),&t->fh,t->page);
+    if(rc!=RC_OK)
+        t->cachedPage=-1;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        paxInsert
+ * Description:     append a record to the last page, or to a new one
+ **********************************************************************************/
+static RC paxInsert(RM_TableData* rel, Record* record)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    RC rc=RC_OK;
+
+    if(t->numDataPages>0)
+        rc=loadPage(t,t->numDataPages-1);
+    if(rc!=RC_OK) return rc;
+    if(t->numDataPages==0||PAX_ROWS(t->page)==t->rowsPerPage)
+    {
+        int file=tableFilePage(t,t->numDataPages);
+        if(file>=t->fh.totalNumPages)
+        {
+            rc=ensureCapacity(file+1,&t->fh);
+            if(rc!=RC_OK) return rc;
+        }
+        paxInitPage(rel->schema,t->page);
+        t->cachedPage=t->numDataPages++;
+        t->metaDirty=1;
+    }
+
+    int row=PAX_ROWS(t->page)++;
+    PAX_LIVE(t->page)++;
+    paxPut(t,rel->schema,t->page,row,record);
+    rc=paxStore(t);
+    if(rc!=RC_OK) return rc;
+    record->id.page=t->cachedPage;
+    record->id.slot=row;
+    t->numTuples++;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        paxBulkInsert
+ * Description:     fill up the last page, then build full pages in memory and
+ *                  write LOAD_BATCH_PAGES of them at a time
+ **********************************************************************************/
+static RC paxBulkInsert(RM_TableData* rel, Record** records, int numRecords)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    int i=0, count=0, first;
+    RC rc=RC_OK;
+
+    if(t->numDataPages>0)
+    {
+        rc=loadPage(t,t->numDataPages-1);
+        while(rc==RC_OK&&i<numRecords&&PAX_ROWS(t->page)<t->rowsPerPage)
+            rc=paxInsert(rel,records[i++]);
+        if(rc!=RC_OK) return rc;
+    }
+    if(i==numRecords)
+        return RC_OK;
+
+    first=t->numDataPages;
+    long pages=(numRecords-i+t->rowsPerPage-1)/t->rowsPerPage;
+    if(first+pages<INT_MAX/2&&tableFilePage(t,first+(int)pages)>t->fh.totalNumPages)
+    {
+        rc=ensureCapacity(tableFilePage(t,first+(int)pages),&t->fh);
+        if(rc!=RC_OK) return rc;
+    }
+    char* batch=(char*)malloc((long)LOAD_BATCH_PAGES*PAGE_SIZE);
+    if(batch==0) return RC_ERROR;
+    for(;i<numRecords&&rc==RC_OK;i++)
+    {
+        char* page=count>0?batch+(long)(count-1)*PAGE_SIZE:0;
+        if(page==0||PAX_ROWS(page)==t->rowsPerPage)
+        {
+            if(count==LOAD_BATCH_PAGES)
+            {
+                rc=writeBlocks(tableFilePage(t,first),count,&t->fh,batch);
+                first+=count;
+                t->numDataPages=first;
+                count=0;
+                if(rc!=RC_OK) break;
+            }
+            page=batch+(long)count++*PAGE_SIZE;
+            paxInitPage(rel->schema,page);
+        }
+        int row=PAX_ROWS(page)++;
+        PAX_LIVE(page)++;
+        paxPut(t,rel->schema,page,row,records[i]);
+        records[i]->id.page=first+count-1;
+        records[i]->id.slot=row;
+        t->numTuples++;
+    }
+    if(rc==RC_OK&&count>0)
+    {
+        rc=writeBlocks(tableFilePage(t,first),count,&t->fh,batch);
+        if(rc==RC_OK)
+            t->numDataPages=first+count;
+    }
+    free(batch);
+    t->metaDirty=1;
+    return rc;
+}
+
+/************************************************************
+ *                    page summaries                        *
+ ************************************************************/
+
+/*  With key summaries on, the storage manager keeps the smallest and largest
+ *  key and a Bloom filter of the keys of every data page (see
+ *  enablePageSummaries), as zone keys of the first key attribute. A filtered
+ *  scan with a predicate on that attribute skips the pages whose summary
+ *  rules it out without reading them. Row pages holding forward pointers
+ *  have no summary, their records live on other pages. */
+
+/*********************************************************************************
+ * Function:        tablePageKeys
+ * Description:     key extractor of the page summaries of a table
+ * Return:          int: number of keys, -1 if unknown
+ **********************************************************************************/
+static int tablePageKeys(int pageNum, SM_PageHandle memPage, unsigned long long *keys, int maxKeys, void *ctx)
+{
+    TableInfo* t=(TableInfo*)ctx;
+    Schema* schema=t->schema;
+    int a=t->summaryAttr;
+    int n=0, i;
+
+    if(t->layout==TABLE_COLUMNS)
+    {
+        if(pageNum<1)
+            return 0;
+        int rows=PAX_ROWS(memPage);
+        int width=paxWidth(schema,a);
+        unsigned long long* deleted=paxDeleted(t,schema,memPage);
+        for(i=0;i<rows&&n<maxKeys;i++)
+        {
+            char* value=memPage+t->miniOffset[a]+i*width;
+            unsigned short len=(unsigned short)width;
+            if((deleted[i>>6]>>(i&63))&1)
+                continue;
+            if(schema->dataTypes[a]==DT_STRING)
+            {
+                memcpy(&len,value,2);
+                value+=2;
+            }
+            keys[n++]=zoneKey(schema->dataTypes[a],value,len);
+        }
+        return i<rows?-1:n;
+    }
+
+    // page 0 and the free space map pages hold no records
+    if(pageNum<1||(pageNum-1)%(FSM_ENTRIES+1)==0)
+        return 0;
+    PageHeader* h=PAGE_HEADER(memPage);
+    Slot* slots=PAGE_SLOTS(memPage);
+    for(i=0;i<h->numSlots;i++)
+    {
+        Record r;
+        char* data;
+        int len;
+
+        if(slots[i].offset==0)
+            continue;
+        if((slots[i].length&SLOT_FORWARD)||n==maxKeys)
+            return -1;
+        r.data=memPage+slots[i].offset;
+        r.size=slots[i].length&SLOT_LENGTH;
+        getAttrData(&r,schema,a,&data,&len);
+        keys[n++]=zoneKey(schema->dataTypes[a],data,len);
+    }
+    return n;
+}
+
+/*********************************************************************************
+ * Function:        enableKeySummaries
+ * Description:     keep page summaries of the first key attribute of a table.
+ *                  They stay on when the table is opened again.
+ * Input:           RM_TableData* rel: open table
+ * Return:          RC: return code
+ **********************************************************************************/
+RC enableKeySummaries(RM_TableData *rel)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+
+    if(t==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "table is not open");
+    if(rel->schema->keySize<1)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "page summaries need a key attribute");
+    t->summaryAttr=rel->schema->keyAttrs[0];
+    RC rc=enablePageSummaries(&t->fh,tablePageKeys,t);
+    if(rc!=RC_OK)
+        t->summaryAttr=-1;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        summaryExcludes
+ * Description:     whether the page summary of a data page rules out the
+ *                  predicates of a scan. Every value matching a predicate has
+ *                  a zone key in [low, high]; string keys are cut to 8 bytes,
+ *                  so only their order is certain.
+ **********************************************************************************/
+static int summaryExcludes(ScanInfo* info, TableInfo* t, int filePage)
+{
+    int p;
+
+    for(p=0;p<info->numCols;p++)
+    {
+        ScanColumn* c=&info->cols[p];
+        unsigned long long v=c->zone, low=0, high=~0ULL;
+        int exact=c->dt!=DT_STRING;
+
+        if(c->attrNum!=t->summaryAttr)
+            continue;
+        switch(c->op)
+        {
+        case CMP_EQ:
+            if(!pageMayContain(&t->fh,filePage,v))
+                return 1;
+            continue;
+        case CMP_NE:
+            continue;
+        case CMP_LT:
+            if(exact&&v==0)
+                return 1;
+            high=exact?v-1:v;
+            break;
+        case CMP_LE: high=v; break;
+        case CMP_GT:
+            if(exact&&v==~0ULL)
+                return 1;
+            low=exact?v+1:v;
+            break;
+        case CMP_GE: low=v; break;
+        default:
+            {
+                int bytes=c->strLen<8?c->strLen:8;
+                unsigned long long mask=bytes==0?0:~0ULL<<(64-8*bytes);
+                low=v&mask;
+                high=low|~mask;
+            }
+            break;
+        }
+        if(!pageMayOverlap(&t->fh,filePage,low,high))
+            return 1;
+    }
+    return 0;
+}
+
+/************************************************************
+ *                    table and manager                     *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        initRecordManager
+ * Description:     initial the record manager and the storage manager below it
+ * Input:           void* mgmtData: unused
+ * Return:          RC: return code
+ **********************************************************************************/
+RC initRecordManager(void *mgmtData)
+{
+    (void)mgmtData;
+    initStorageManager();
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        shutdownRecordManager
+ * Description:     nothing to release, every table owns its own state
+ * Return:          RC: return code
+ **********************************************************************************/
+RC shutdownRecordManager(void)
+{
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        createTable
+ * Description:     create a table with the row layout
+ * Input:           char* name: table name, also the file name
+                    Schema* schema: schema of the table
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createTable(char *name, Schema *schema)
+{
+    return createTableWithLayout(name,schema,TABLE_ROWS);
+}
+
+/*********************************************************************************
+ * Function:        createTableWithLayout
+ * Description:     create the page file of a table with its information page;
+ *                  a row table also gets its first (empty) free space map page
+ * Input:           char* name: table name, also the file name
+                    Schema* schema: schema of the table
+                    TableLayout layout: page layout
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createTableWithLayout(char *name, Schema *schema, TableLayout layout)
+{
+    SM_FileHandle fh;
+    TableInfo t;
+    RC rc;
+
+    memset(&t,0,sizeof(t));
+    t.layout=layout;
+    if(layout==TABLE_COLUMNS)
+    {
+        rc=paxPlan(&t,schema);
+        free(t.miniOffset);
+        if(rc!=RC_OK) return rc;
+    }
+
+    rc=createPageFile(name);
+    if(rc!=RC_OK) return rc;
+    rc=openPageFile(name,&fh);
+    if(rc!=RC_OK) return rc;
+
+    rc=writeMeta(&t,schema,&fh);
+    if(rc==RC_OK&&layout==TABLE_ROWS)
+        rc=ensureCapacity(fsmFilePage(0)+1,&fh);
+
+    RC closeRc=closePageFile(&fh);
+    if(rc!=RC_OK)
+    {
+        destroyPageFile(name);
+        return rc;
+    }
+    return closeRc;
+}
+
+/*********************************************************************************
+ * Function:        openTable
+ * Description:     open a table, read its schema and load the free space map
+ * Input:           char* name: table name
+ * Output:          RM_TableData* rel: table handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openTable(RM_TableData *rel, char *name)
+{
+    TableInfo* t=(TableInfo*)calloc(1,sizeof(TableInfo));
+    Schema* schema=0;
+    int i;
+    RC rc;
+
+    if(t==0) return RC_ERROR;
+    rc=openPageFile(name,&t->fh);
+    if(rc!=RC_OK)
+    {
+        free(t);
+        return rc;
+    }
+    rc=readMeta(t,&schema);
+    if(rc==RC_OK&&t->layout==TABLE_COLUMNS)
+        rc=paxPlan(t,schema);
+    if(rc==RC_OK)
+        rc=growFsm(t,t->numDataPages>0?t->numDataPages:1);
+
+    // one free space map page describes FSM_ENTRIES data pages
+    for(i=0;rc==RC_OK&&t->layout==TABLE_ROWS&&i*FSM_ENTRIES<t->numDataPages;i++)
+    {
+        int count=t->numDataPages-i*FSM_ENTRIES;
+        char* page=(char*)malloc(PAGE_SIZE);
+        rc=readBlock(fsmFilePage(i),&t->fh,page);
+        if(rc==RC_OK)
+            memcpy(t->fsm+i*FSM_ENTRIES,page,count<FSM_ENTRIES?count:FSM_ENTRIES);
+        free(page);
+    }
+    for(i=0;rc==RC_OK&&i<t->numDataPages;i++)
+        if(t->fsm[i]>t->fsmGroupMax[i/FSM_GROUP])
+            t->fsmGroupMax[i/FSM_GROUP]=t->fsm[i];
+
+    t->schema=schema;
+    t->summaryAttr=-1;
+    if(rc==RC_OK&&hasPageSummaries(&t->fh)&&schema->keySize>0)
+    {
+        t->summaryAttr=schema->keyAttrs[0];
+        rc=enablePageSummaries(&t->fh,tablePageKeys,t);
+    }
+    // start reading what the last run read most, if the table keeps a list
+    if(rc==RC_OK)
+        warmUpPageFile(&t->fh);
+
+    t->page=(char*)malloc(PAGE_SIZE);
+    if(rc!=RC_OK||t->page==0)
+    {
+        closePageFile(&t->fh);
+        if(schema!=0) freeSchema(schema);
+        free(t->fsm); free(t->fsmGroupMax); free(t->fsmPageDirty); free(t->page);
+        free(t->miniOffset);
+        free(t);
+        return rc!=RC_OK?rc:RC_ERROR;
+    }
+    t->cachedPage=-1;
+    t->lastInsertPage=t->numDataPages-1;
+
+    rel->name=name;
+    rel->schema=schema;
+    rel->mgmtInfo=t;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeTable
+ * Description:     write back the free space map and table information, close
+ *                  the page file and free the schema
+ * Input:           RM_TableData* rel: table handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeTable(RM_TableData *rel)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    RC rc=RC_OK;
+    int i;
+
+    if(t==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "table is not open");
+
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    for(i=0;rc==RC_OK&&t->layout==TABLE_ROWS&&i*FSM_ENTRIES<t->numDataPages;i++)
+    {
+        if(!t->fsmPageDirty[i])
+            continue;
+        int count=t->numDataPages-i*FSM_ENTRIES;
+        memset(page,0,PAGE_SIZE);
+        memcpy(page,t->fsm+i*FSM_ENTRIES,count<FSM_ENTRIES?count:FSM_ENTRIES);
+        rc=writeBlock(fsmFilePage(i),&t->fh,page);
+    }
+    free(page);
+    if(rc==RC_OK&&t->metaDirty)
+        rc=writeMeta(t,rel->schema,&t->fh);
+
+    RC closeRc=closePageFile(&t->fh);
+    if(rc==RC_OK) rc=closeRc;
+    if(t->lobOpen)
+    {
+        closeRc=closePageFile(&t->lob);
+        if(rc==RC_OK) rc=closeRc;
+    }
+
+    freeSchema(rel->schema);
+    free(t->fsm);
+    free(t->fsmGroupMax);
+    free(t->fsmPageDirty);
+    free(t->page);
+    free(t->miniOffset);
+    free(t->lobFree);
+    free(t);
+    rel->schema=0;
+    rel->mgmtInfo=0;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteTable
+ * Description:     remove the page file of a table and its large values
+ * Input:           char* name: table name
+ * Return:          RC: return code
+ **********************************************************************************/
+RC deleteTable(char *name)
+{
+    RC rc=destroyPageFile(name);
+    char* fileName=lobName(name);
+    if(fileName==0) return RC_ERROR;
+    if(rc==RC_OK&&access(fileName,0)==0)
+        rc=destroyPageFile(fileName);
+    free(fileName);
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        getNumTuples
+ * Description:     number of records in a table
+ * Input:           RM_TableData* rel: table handle
+ * Return:          int: number of records
+ **********************************************************************************/
+int getNumTuples(RM_TableData *rel)
+{
+    return ((TableInfo*)rel->mgmtInfo)->numTuples;
+}
+
+/************************************************************
+ *                    handling records                      *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        insertRecord
+ * Description:     store a record in a page picked with the free space map and
+ *                  set record->id
+ * Input:           RM_TableData* rel: table handle
+                    Record* record: record, data and size are used
+ * Return:          RC: return code
+ **********************************************************************************/
+RC insertRecord(RM_TableData *rel, Record *record)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+
+    if(t->layout==TABLE_COLUMNS)
+        return paxInsert(rel,record);
+
+    if(record->size<0||record->size>MAX_RECORD_SIZE)
+        THROW(RC_RM_RECORD_TOO_BIG, "record does not fit into a page");
+
+    RC rc=placeAnywhere(t,record->data,record->size,0,-1,&record->id);
+    if(rc!=RC_OK) return rc;
+    t->numTuples++;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        flushLoadBatch
+ * Description:     write the new data pages of a bulk insert with one writeBlocks
+ *                  call and add them to the free space map
+ * Input:           TableInfo* t: table
+                    char* batch: count data pages, the first is data page first
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC flushLoadBatch(TableInfo* t, char* batch, int first, int count)
+{
+    int last=dataFilePage(first+count-1);
+    int i;
+    RC rc;
+
+    if(count==0)
+        return RC_OK;
+    rc=growFsm(t,first+count);
+    if(rc!=RC_OK) return rc;
+    if(last>=t->fh.totalNumPages)
+    {
+        rc=ensureCapacity(last+1,&t->fh);
+        if(rc!=RC_OK) return rc;
+    }
+    rc=writeBlocks(dataFilePage(first),count,&t->fh,batch);
+    if(rc!=RC_OK) return rc;
+
+    t->numDataPages=first+count;
+    for(i=0;i<count;i++)
+    {
+        t->fsm[first+i]=0;
+        setFsm(t,first+i,PAGE_HEADER(batch+(long)i*PAGE_SIZE)->freeSpace);
+    }
+    t->lastInsertPage=first+count-1;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        bulkInsertRecords
+ * Description:     insert many records into new data pages. Pages are filled to
+ *                  fillFactor of their space, leaving room for records to grow,
+ *                  built in memory and written LOAD_BATCH_PAGES at a time after
+ *                  the file was extended once for all of them.
+ * Input:           RM_TableData* rel: table handle
+                    Record** records: records, their id is set
+                    int numRecords: number of records
+                    float fillFactor: part of a page to fill, 0 < fillFactor <= 1
+ * Return:          RC: return code
+ **********************************************************************************/
+RC bulkInsertRecords(RM_TableData *rel, Record **records, int numRecords, float fillFactor)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    int limit=(int)(fillFactor*(PAGE_SIZE-PAGE_HEADER_SIZE));
+    long bytes=0;
+    int first=t->numDataPages;
+    int count=0;
+    int i;
+    RC rc=RC_OK;
+
+    if(fillFactor<=0||fillFactor>1)
+        THROW(RC_ERROR, "the fill factor must be in (0, 1]");
+    if(t->layout==TABLE_COLUMNS)
+        return paxBulkInsert(rel,records,numRecords);
+    for(i=0;i<numRecords;i++)
+    {
+        if(records[i]->size<0||records[i]->size>MAX_RECORD_SIZE)
+            THROW(RC_RM_RECORD_TOO_BIG, "record does not fit into a page");
+        bytes+=allocSize(records[i]->size)+SLOT_SIZE;
+    }
+    if(numRecords==0)
+        return RC_OK;
+    if(limit<1)
+        limit=1;
+
+    // extend the file once for the expected number of pages
+    long estimate=bytes/limit+1;
+    if(first+estimate<INT_MAX/2)
+    {
+        int last=dataFilePage(first+(int)estimate-1);
+        if(last>=t->fh.totalNumPages)
+        {
+            rc=ensureCapacity(last+1,&t->fh);
+            if(rc!=RC_OK) return rc;
+        }
+    }
+
+    char* batch=(char*)malloc((long)LOAD_BATCH_PAGES*PAGE_SIZE);
+    if(batch==0) return RC_ERROR;
+    for(i=0;i<numRecords&&rc==RC_OK;i++)
+    {
+        char* page=count>0?batch+(long)(count-1)*PAGE_SIZE:0;
+        int need=allocSize(records[i]->size)+SLOT_SIZE;
+
+        if(page==0||PAGE_HEADER(page)->freeSpace<need||
+           (PAGE_HEADER(page)->numSlots>0&&PAGE_SIZE-PAGE_HEADER_SIZE-PAGE_HEADER(page)->freeSpace+need>limit))
+        {
+            // a batch is written when full or when the next data page is behind a free space map page
+            if(count==LOAD_BATCH_PAGES||(count>0&&(first+count)%FSM_ENTRIES==0))
+            {
+                rc=flushLoadBatch(t,batch,first,count);
+                first+=count;
+                count=0;
+                if(rc!=RC_OK) break;
+            }
+            page=batch+(long)count*PAGE_SIZE;
+            memset(page,0,PAGE_SIZE);
+            PAGE_HEADER(page)->freeStart=PAGE_HEADER_SIZE;
+            PAGE_HEADER(page)->freeEnd=PAGE_SIZE;
+            PAGE_HEADER(page)->freeSpace=PAGE_SIZE-PAGE_HEADER_SIZE;
+            count++;
+        }
+        records[i]->id.page=first+count-1;
+        records[i]->id.slot=pageInsert(page,records[i]->data,records[i]->size,0);
+        t->numTuples++;
+    }
+    if(rc==RC_OK)
+        rc=flushLoadBatch(t,batch,first,count);
+    free(batch);
+    t->metaDirty=1;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteRecord
+ * Description:     remove a record, and its moved copy if it has one
+ * Input:           RM_TableData* rel: table handle
+                    RID id: record id
+ * Return:          RC: return code
+ **********************************************************************************/
+RC deleteRecord(RM_TableData *rel, RID id)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    RC rc;
+
+    if(t->layout==TABLE_COLUMNS)
+    {
+        rc=paxLocate(t,rel->schema,id);
+        if(rc!=RC_OK) return rc;
+        paxDeleted(t,rel->schema,t->page)[id.slot>>6]|=1ULL<<(id.slot&63);
+        PAX_LIVE(t->page)--;
+        rc=paxStore(t);
+        if(rc!=RC_OK) return rc;
+        t->numTuples--;
+        t->metaDirty=1;
+        return RC_OK;
+    }
+
+    rc=locateSlot(t,id);
+    if(rc!=RC_OK) return rc;
+
+    if(PAGE_SLOTS(t->page)[id.slot].length&SLOT_FORWARD)
+    {
+        RID target=readForward(t,id.slot);
+        rc=loadPage(t,target.page);
+        if(rc!=RC_OK) return rc;
+        pageRelease(t->page,target.slot,1);
+        rc=storePage(t);
+        if(rc!=RC_OK) return rc;
+        rc=loadPage(t,id.page);
+        if(rc!=RC_OK) return rc;
+    }
+
+    pageRelease(t->page,id.slot,1);
+    rc=storePage(t);
+    if(rc!=RC_OK) return rc;
+    t->numTuples--;
+    t->metaDirty=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        updateSlot
+ * Description:     replace the record in a slot of the cached page if the page
+ *                  has room for it. A record of unchanged length is written with
+ *                  a range write of just its bytes, unless the table keeps page
+ *                  summaries.
+ * Return:          int: 1 if the record was replaced, -1 on a write error,
+ *                  0 if the page has no room
+ **********************************************************************************/
+static int updateSlot(TableInfo* t, int slot, char* data, int length, unsigned short flags)
+{
+    PageHeader* h=PAGE_HEADER(t->page);
+    Slot* s=&PAGE_SLOTS(t->page)[slot];
+    int oldLength=s->length&SLOT_LENGTH;
+    int oldAlloc=allocSize(oldLength);
+
+    // a range write would cost the page its summary
+    if(length==oldLength&&t->summaryAttr<0)
+    {
+        memcpy(t->page+s->offset,data,length);
+        return writeBlockRange(dataFilePage(t->cachedPage),s->offset,length,&t->fh,data)==RC_OK?1:-1;
+    }
+    if(allocSize(length)<=oldAlloc)
+    {
+        memcpy(t->page+s->offset,data,length);
+        s->length=(unsigned short)(length|flags);
+        h->freeSpace+=oldAlloc-allocSize(length);
+        return storePage(t)==RC_OK?1:-1;
+    }
+    if(h->freeSpace+oldAlloc<allocSize(length))
+        return 0;
+
+    pageRelease(t->page,slot,0);
+    pagePlace(t->page,slot,data,length,flags);
+    return storePage(t)==RC_OK?1:-1;
+}
+
+/*********************************************************************************
+ * Function:        updateRecord
+ * Description:     replace the record record->id with record->data. A record
+ *                  that no longer fits its page moves to another page, the RID
+ *                  stays the same.
+ * Input:           RM_TableData* rel: table handle
+                    Record* record: record
+ * Return:          RC: return code
+ **********************************************************************************/
+RC updateRecord(RM_TableData *rel, Record *record)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    RID id=record->id;
+    RID moved;
+    int done;
+    RC rc;
+
+    if(t->layout==TABLE_COLUMNS)
+    {
+        // every row has room for the longest values
+        rc=paxLocate(t,rel->schema,id);
+        if(rc!=RC_OK) return rc;
+        paxPut(t,rel->schema,t->page,id.slot,record);
+        return paxStore(t);
+    }
+    if(record->size<0||record->size>MAX_RECORD_SIZE)
+        THROW(RC_RM_RECORD_TOO_BIG, "record does not fit into a page");
+    rc=locateSlot(t,id);
+    if(rc!=RC_OK) return rc;
+
+    if(!(PAGE_SLOTS(t->page)[id.slot].length&SLOT_FORWARD))
+    {
+        done=updateSlot(t,id.slot,record->data,record->size,0);
+        if(done!=0)
+            return done>0?RC_OK:RC_WRITE_FAILED;
+
+        // move it out and leave a forward pointer behind
+        rc=placeAnywhere(t,record->data,record->size,SLOT_MOVED,id.page,&moved);
+        if(rc!=RC_OK) return rc;
+        rc=loadPage(t,id.page);
+        if(rc!=RC_OK) return rc;
+        pageRelease(t->page,id.slot,0);
+        pagePlace(t->page,id.slot,(char*)&moved,RID_SIZE,SLOT_FORWARD);
+        return storePage(t);
+    }
+
+    // the record already lives somewhere else
+    RID target=readForward(t,id.slot);
+    rc=loadPage(t,target.page);
+    if(rc!=RC_OK) return rc;
+    done=updateSlot(t,target.slot,record->data,record->size,SLOT_MOVED);
+    if(done!=0)
+        return done>0?RC_OK:RC_WRITE_FAILED;
+
+    rc=placeAnywhere(t,record->data,record->size,SLOT_MOVED,target.page,&moved);
+    if(rc!=RC_OK) return rc;
+    rc=loadPage(t,target.page);
+    if(rc!=RC_OK) return rc;
+    pageRelease(t->page,target.slot,1);
+    rc=storePage(t);
+    if(rc!=RC_OK) return rc;
+
+    rc=loadPage(t,id.page);
+    if(rc!=RC_OK) return rc;
+    return updateSlot(t,id.slot,(char*)&moved,RID_SIZE,SLOT_FORWARD)>0?RC_OK:RC_WRITE_FAILED;
+}
+
+/*********************************************************************************
+ * Function:        getRecord
+ * Description:     read the record with the given RID
+ * Input:           RM_TableData* rel: table handle
+                    RID id: record id
+ * Output:          Record* record: record, data is reallocated to fit
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getRecord(RM_TableData *rel, RID id, Record *record)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    RC rc;
+
+    if(t->layout==TABLE_COLUMNS)
+    {
+        rc=paxLocate(t,rel->schema,id);
+        if(rc!=RC_OK) return rc;
+        return paxGet(rel,t->page,id.slot,id,record);
+    }
+    rc=locateSlot(t,id);
+    if(rc!=RC_OK) return rc;
+
+    int slot=id.slot;
+    if(PAGE_SLOTS(t->page)[slot].length&SLOT_FORWARD)
+    {
+        RID target=readForward(t,slot);
+        rc=loadPage(t,target.page);
+        if(rc!=RC_OK) return rc;
+        slot=target.slot;
+    }
+    return copyOut(rel,t->page,slot,id,record);
+}
+
+/************************************************************
+ *                    large values                          *
+ ************************************************************/
+
+/*  Large values live in the page file <table>.lob, created with the first
+ *  one and opened once per table handle:
+ *   page 0        LOB_MAGIC, the number of free extents and the free
+ *                 extents as start page and number of pages, by start page
+ *   header pages  one per value: BLOB_MAGIC, size, extents of the value
+ *   extents       runs of pages holding only value bytes, in order
+ *  The id of a value is the page of its header. Extents grow with the value
+ *  up to LOB_MAX_EXTENT pages, so a value of n pages has O(log n) extents
+ *  until they reach that size. They are taken from the free list, at least
+ *  LOB_IO_PAGES at a time, or from the end of the file. A handle buffers
+ *  LOB_IO_PAGES pages; reads and writes of whole pages bypass the buffer,
+ *  so a value moves in large chunks and is never in memory as a whole.
+ *
+ *  A value can be read once closeBlob wrote its header, and the free list
+ *  is written right after, so a crash before that only loses the space. */
+#define LOB_SUFFIX         ".lob"
+#define LOB_MAGIC          0x31424f4c   /* "LOB1" */
+#define BLOB_MAGIC         0x31424c42   /* "BLB1" */
+#define LOB_INTS           (PAGE_SIZE/(int)sizeof(int))
+#define LOB_MAX_FREE       ((LOB_INTS-2)/2)
+#define BLOB_MAX_EXTENTS   ((LOB_INTS-4)/2)
+#define LOB_IO_PAGES       64
+#define LOB_MAX_EXTENT     4096
+
+typedef struct BlobInfo{
+    int writing;
+    long long size;
+    int numExtents;
+    int extents[2*BLOB_MAX_EXTENTS];  // start page, number of pages
+    int extentUsed;             // writing: pages used of the last extent
+    long long pos;              // reading: position of the stream
+    char* buf;                  // LOB_IO_PAGES pages
+    int used;                   // writing: bytes in buf; reading: valid bytes
+    long long bufPos;           // reading: position of buf in the value
+}BlobInfo;
+
+/*********************************************************************************
+ * Function:        lobName
+ * Description:     file name of the large values of a table
+ * Return:          char*: new string, 0 if out of memory
+ **********************************************************************************/
+static char* lobName(char* name)
+{
+    char* fileName=(char*)malloc(strlen(name)+strlen(LOB_SUFFIX)+1);
+    if(fileName!=0)
+        sprintf(fileName,"%s%s",name,LOB_SUFFIX);
+    return fileName;
+}
+
+/*********************************************************************************
+ * Function:        writeLobHeader
+ * Description:     write the free extents to page 0 of the large value file
+ **********************************************************************************/
+static RC writeLobHeader(TableInfo* t)
+{
+    int words[LOB_INTS];
+
+    memset(words,0,sizeof(words));
+    words[0]=LOB_MAGIC;
+    words[1]=t->lobNumFree;
+    memcpy(words+2,t->lobFree,sizeof(int)*2*t->lobNumFree);
+    return writeBlock(0,&t->lob,(SM_PageHandle)words);
+}
+
+/*********************************************************************************
+ * Function:        openLob
+ * Description:     open the large value file of a table, creating it if the
+ *                  table has none yet
+ * Input:           RM_TableData* rel: table handle
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC openLob(RM_TableData* rel)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    int words[LOB_INTS];
+    RC rc;
+
+    if(t->lobOpen)
+        return RC_OK;
+    char* fileName=lobName(rel->name);
+    t->lobFree=(int*)malloc(sizeof(int)*2*LOB_MAX_FREE);
+    if(fileName==0||t->lobFree==0)
+    {
+        free(fileName);
+        free(t->lobFree);
+        t->lobFree=0;
+        return RC_ERROR;
+    }
+    int created=0;
+    if(access(fileName,0)!=0)
+    {
+        rc=createPageFile(fileName);
+        created=rc==RC_OK;
+    }
+    else
+        rc=RC_OK;
+    if(rc==RC_OK)
+        rc=openPageFile(fileName,&t->lob);
+    if(rc==RC_OK)
+    {
+        t->lobNumFree=0;
+        if(created)
+            rc=writeLobHeader(t);
+        else
+        {
+            rc=readBlock(0,&t->lob,(SM_PageHandle)words);
+            if(rc==RC_OK&&(words[0]!=LOB_MAGIC||words[1]<0||words[1]>LOB_MAX_FREE))
+                rc=RC_FILE_HEADER_CORRUPT;
+            if(rc==RC_OK)
+            {
+                t->lobNumFree=words[1];
+                memcpy(t->lobFree,words+2,sizeof(int)*2*t->lobNumFree);
+            }
+        }
+        if(rc!=RC_OK)
+            closePageFile(&t->lob);
+    }
+    if(rc!=RC_OK&&created)
+        destroyPageFile(fileName);
+    free(fileName);
+    if(rc!=RC_OK)
+    {
+        free(t->lobFree);
+        t->lobFree=0;
+        if(rc==RC_FILE_HEADER_CORRUPT)
+            THROW_FMT(rc, LOG_LEVEL_ERROR, "the large value file of %s is corrupt", rel->name);
+        return rc;
+    }
+    t->lobOpen=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        allocExtent
+ * Description:     take pages for a value: numPages of the first free extent
+ *                  that is large enough, else the largest free extent of at
+ *                  least minPages, else pages at the end of the file
+ * Input:           TableInfo* t: table
+                    int minPages: fewest pages that will do
+                    int numPages: pages wanted
+ * Output:          int* start: first page
+                    int* got: number of pages
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC allocExtent(TableInfo* t, int minPages, int numPages, int* start, int* got)
+{
+    int i, pick=-1;
+
+    for(i=0;i<t->lobNumFree;i++)
+    {
+        if(t->lobFree[2*i+1]>=numPages)
+        {
+            pick=i;
+            break;
+        }
+        if(t->lobFree[2*i+1]>=minPages&&(pick<0||t->lobFree[2*i+1]>t->lobFree[2*pick+1]))
+            pick=i;
+    }
+    if(pick<0)
+    {
+        *start=t->lob.totalNumPages;
+        *got=numPages;
+        return ensureCapacity(*start+numPages,&t->lob);
+    }
+    *start=t->lobFree[2*pick];
+    *got=t->lobFree[2*pick+1]<numPages?t->lobFree[2*pick+1]:numPages;
+    t->lobFree[2*pick]+=*got;
+    t->lobFree[2*pick+1]-=*got;
+    if(t->lobFree[2*pick+1]==0)
+    {
+        memmove(t->lobFree+2*pick,t->lobFree+2*pick+2,sizeof(int)*2*(t->lobNumFree-pick-1));
+        t->lobNumFree--;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeExtent
+ * Description:     put pages back on the free list, merged with the free
+ *                  extents next to them. If the list is full the pages are
+ *                  lost until the file is rebuilt.
+ **********************************************************************************/
+static void freeExtent(TableInfo* t, int start, int numPages)
+{
+    int i=0;
+
+    if(numPages<=0)
+        return;
+    while(i<t->lobNumFree&&t->lobFree[2*i]<start)
+        i++;
+    int before=i>0&&t->lobFree[2*i-2]+t->lobFree[2*i-1]==start;
+    int after=i<t->lobNumFree&&start+numPages==t->lobFree[2*i];
+    if(before&&after)
+    {
+        t->lobFree[2*i-1]+=numPages+t->lobFree[2*i+1];
+        memmove(t->lobFree+2*i,t->lobFree+2*i+2,sizeof(int)*2*(t->lobNumFree-i-1));
+        t->lobNumFree--;
+    }
+    else if(before)
+        t->lobFree[2*i-1]+=numPages;
+    else if(after)
+    {
+        t->lobFree[2*i]=start;
+        t->lobFree[2*i+1]+=numPages;
+    }
+    else if(t->lobNumFree<LOB_MAX_FREE)
+    {
+        memmove(t->lobFree+2*i+2,t->lobFree+2*i,sizeof(int)*2*(t->lobNumFree-i));
+        t->lobFree[2*i]=start;
+        t->lobFree[2*i+1]=numPages;
+        t->lobNumFree++;
+    }
+}
+
+/*********************************************************************************
+ * Function:        readBlobHeader
+ * Description:     read the header page of a value
+ * Output:          BlobInfo* b: size and extents
+ * Return:          RC: RC_RM_NO_SUCH_RECORD if id is not a value
+ **********************************************************************************/
+static RC readBlobHeader(TableInfo* t, int id, BlobInfo* b)
+{
+    int words[LOB_INTS];
+
+    if(id<1||id>=t->lob.totalNumPages)
+        THROW(RC_RM_NO_SUCH_RECORD, "no large value with this id");
+    RC rc=readBlock(id,&t->lob,(SM_PageHandle)words);
+    if(rc!=RC_OK) return rc;
+    if(words[0]!=BLOB_MAGIC||words[3]<0||words[3]>BLOB_MAX_EXTENTS)
+        THROW(RC_RM_NO_SUCH_RECORD, "no large value with this id");
+    memcpy(&b->size,words+1,sizeof(long long));
+    b->numExtents=words[3];
+    memcpy(b->extents,words+4,sizeof(int)*2*b->numExtents);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        blobPages
+ * Description:     write whole pages at the end of a value being written,
+ *                  taking a new extent when the last one is full
+ * Input:           TableInfo* t: table
+                    BlobInfo* b: value
+                    char* data: pages
+                    int numPages: number of pages
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC blobPages(TableInfo* t, BlobInfo* b, char* data, int numPages)
+{
+    RC rc;
+
+    while(numPages>0)
+    {
+        int last=b->numExtents-1;
+        if(last<0||b->extentUsed==b->extents[2*last+1])
+        {
+            if(b->numExtents==BLOB_MAX_EXTENTS)
+                THROW(RC_RM_RECORD_TOO_BIG, "large value has too many extents");
+            // extents double with the value, from one buffer up to LOB_MAX_EXTENT
+            long long written=b->size/PAGE_SIZE;
+            int want=written<LOB_IO_PAGES?LOB_IO_PAGES:written>LOB_MAX_EXTENT?LOB_MAX_EXTENT:(int)written;
+            last=b->numExtents;
+            rc=allocExtent(t,LOB_IO_PAGES,want,&b->extents[2*last],&b->extents[2*last+1]);
+            if(rc!=RC_OK) return rc;
+            b->numExtents++;
+            b->extentUsed=0;
+        }
+        int n=b->extents[2*last+1]-b->extentUsed;
+        if(n>numPages)
+            n=numPages;
+        rc=writeBlocks(b->extents[2*last]+b->extentUsed,n,&t->lob,data);
+        if(rc!=RC_OK) return rc;
+        b->extentUsed+=n;
+        data+=(long)n*PAGE_SIZE;
+        numPages-=n;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        blobLocate
+ * Description:     file page of a page of a value
+ * Input:           BlobInfo* b: value
+                    long long pageIndex: page of the value
+ * Output:          int* contiguous: pages from there to the end of its extent
+ * Return:          int: page in the large value file
+ **********************************************************************************/
+static int blobLocate(BlobInfo* b, long long pageIndex, int* contiguous)
+{
+    int i;
+
+    for(i=0;i<b->numExtents;i++)
+    {
+        if(pageIndex<b->extents[2*i+1])
+        {
+            *contiguous=b->extents[2*i+1]-(int)pageIndex;
+            return b->extents[2*i]+(int)pageIndex;
+        }
+        pageIndex-=b->extents[2*i+1];
+    }
+    *contiguous=0;
+    return -1;
+}
+
+/*********************************************************************************
+ * Function:        createBlob
+ * Description:     start a new large value; it is written with writeBlob and
+ *                  can be read once closeBlob is done
+ * Input:           RM_TableData* rel: table handle
+ * Output:          RM_BlobHandle* blob: handle, blob->id is the id of the value
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createBlob(RM_TableData *rel, RM_BlobHandle *blob)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    BlobInfo* b;
+    int id, got;
+
+    RC rc=openLob(rel);
+    if(rc!=RC_OK) return rc;
+    b=(BlobInfo*)calloc(1,sizeof(BlobInfo));
+    if(b==0) return RC_ERROR;
+    b->buf=allocPageMemory(LOB_IO_PAGES);
+    if(b->buf==0)
+    {
+        free(b);
+        return RC_ERROR;
+    }
+    rc=allocExtent(t,1,1,&id,&got);
+    if(rc!=RC_OK)
+    {
+        freePageMemory(b->buf);
+        free(b);
+        return rc;
+    }
+    b->writing=1;
+    blob->rel=rel;
+    blob->id=id;
+    blob->size=0;
+    blob->mgmtInfo=b;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeBlob
+ * Description:     append bytes to a large value being written
+ * Input:           RM_BlobHandle* blob: handle from createBlob
+                    char* data: bytes
+                    int length: number of bytes
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeBlob(RM_BlobHandle *blob, char *data, int length)
+{
+    TableInfo* t=(TableInfo*)blob->rel->mgmtInfo;
+    BlobInfo* b=(BlobInfo*)blob->mgmtInfo;
+    RC rc;
+
+    if(b==0||!b->writing)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "large value is not open for writing");
+    if(length<0)
+        THROW(RC_ERROR, "negative length");
+    while(length>0)
+    {
+        // whole pages go straight from the caller's memory to the file
+        if(b->used==0&&length>=PAGE_SIZE)
+        {
+            int pages=length/PAGE_SIZE;
+            rc=blobPages(t,b,data,pages);
+            if(rc!=RC_OK) return rc;
+            b->size+=(long long)pages*PAGE_SIZE;
+            data+=(long)pages*PAGE_SIZE;
+            length-=pages*PAGE_SIZE;
+            continue;
+        }
+        int n=LOB_IO_PAGES*PAGE_SIZE-b->used;
+        if(n>length)
+            n=length;
+        memcpy(b->buf+b->used,data,n);
+        b->used+=n;
+        data+=n;
+        length-=n;
+        if(b->used==LOB_IO_PAGES*PAGE_SIZE)
+        {
+            rc=blobPages(t,b,b->buf,LOB_IO_PAGES);
+            if(rc!=RC_OK) return rc;
+            b->size+=b->used;
+            b->used=0;
+        }
+    }
+    blob->size=b->size+b->used;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        openBlob
+ * Description:     open a large value for reading from its start
+ * Input:           RM_TableData* rel: table handle
+                    int id: id of the value
+ * Output:          RM_BlobHandle* blob: handle, blob->size is the size
+ * Return:          RC: RC_RM_NO_SUCH_RECORD if there is no value with that id
+ **********************************************************************************/
+RC openBlob(RM_TableData *rel, int id, RM_BlobHandle *blob)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    BlobInfo* b;
+
+    RC rc=openLob(rel);
+    if(rc!=RC_OK) return rc;
+    b=(BlobInfo*)calloc(1,sizeof(BlobInfo));
+    if(b==0) return RC_ERROR;
+    b->buf=allocPageMemory(LOB_IO_PAGES);
+    if(b->buf==0)
+        rc=RC_ERROR;
+    else
+        rc=readBlobHeader(t,id,b);
+    if(rc!=RC_OK)
+    {
+        freePageMemory(b->buf);
+        free(b);
+        return rc;
+    }
+    blob->rel=rel;
+    blob->id=id;
+    blob->size=b->size;
+    blob->mgmtInfo=b;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        readBlob
+ * Description:     read the next bytes of a large value
+ * Input:           RM_BlobHandle* blob: handle from openBlob
+                    int length: bytes wanted
+ * Output:          char* data: bytes
+                    int* bytesRead: bytes read, less than length only at the end
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readBlob(RM_BlobHandle *blob, char *data, int length, int *bytesRead)
+{
+    TableInfo* t=(TableInfo*)blob->rel->mgmtInfo;
+    BlobInfo* b=(BlobInfo*)blob->mgmtInfo;
+    int contiguous;
+    RC rc;
+
+    if(b==0||b->writing)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "large value is not open for reading");
+    *bytesRead=0;
+    while(length>0&&b->pos<b->size)
+    {
+        if(b->pos>=b->bufPos&&b->pos<b->bufPos+b->used)
+        {
+            long long n=b->bufPos+b->used-b->pos;
+            if(n>length)
+                n=length;
+            memcpy(data,b->buf+(b->pos-b->bufPos),n);
+            b->pos+=n;
+            data+=n;
+            length-=(int)n;
+            *bytesRead+=(int)n;
+            continue;
+        }
+
+        long long pageIndex=b->pos/PAGE_SIZE;
+        int filePage=blobLocate(b,pageIndex,&contiguous);
+        if(filePage<0)
+            THROW(RC_FILE_HEADER_CORRUPT, "large value is shorter than its size");
+        // whole pages the caller wants go straight into its memory
+        long long full=(b->size-b->pos)/PAGE_SIZE;
+        int pages=length/PAGE_SIZE;
+        if(pages>full) pages=(int)full;
+        if(pages>contiguous) pages=contiguous;
+        if(b->pos%PAGE_SIZE==0&&pages>0)
+        {
+            rc=readBlocks(filePage,pages,&t->lob,data);
+            if(rc!=RC_OK) return rc;
+            b->pos+=(long long)pages*PAGE_SIZE;
+            data+=(long)pages*PAGE_SIZE;
+            length-=pages*PAGE_SIZE;
+            *bytesRead+=pages*PAGE_SIZE;
+            continue;
+        }
+        pages=contiguous<LOB_IO_PAGES?contiguous:LOB_IO_PAGES;
+        rc=readBlocks(filePage,pages,&t->lob,b->buf);
+        if(rc!=RC_OK) return rc;
+        b->bufPos=pageIndex*PAGE_SIZE;
+        b->used=(int)(b->size-b->bufPos<(long long)pages*PAGE_SIZE?b->size-b->bufPos:(long long)pages*PAGE_SIZE);
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        seekBlob
+ * Description:     set the position the next readBlob reads from
+ * Input:           RM_BlobHandle* blob: handle from openBlob
+                    long long offset: position, 0 to the size of the value
+ * Return:          RC: return code
+ **********************************************************************************/
+RC seekBlob(RM_BlobHandle *blob, long long offset)
+{
+    BlobInfo* b=(BlobInfo*)blob->mgmtInfo;
+
+    if(b==0||b->writing)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "large value is not open for reading");
+    if(offset<0||offset>b->size)
+        THROW(RC_READ_NON_EXISTING_PAGE, "position past the end of the large value");
+    b->pos=offset;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeBlob
+ * Description:     close a large value handle. A value being written gets its
+ *                  last page, its unused extent pages go back to the free list
+ *                  and its header is written.
+ * Input:           RM_BlobHandle* blob: handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeBlob(RM_BlobHandle *blob)
+{
+    BlobInfo* b=(BlobInfo*)blob->mgmtInfo;
+    RC rc=RC_OK;
+
+    if(b==0)
+        THROW(RC_FILE_HANDLE_NOT_INIT, "large value is not open");
+    if(b->writing)
+    {
+        TableInfo* t=(TableInfo*)blob->rel->mgmtInfo;
+        int words[LOB_INTS];
+        if(b->used>0)
+        {
+            int pages=(b->used+PAGE_SIZE-1)/PAGE_SIZE;
+            memset(b->buf+b->used,0,(long)pages*PAGE_SIZE-b->used);
+            rc=blobPages(t,b,b->buf,pages);
+            b->size+=b->used;
+        }
+        if(rc==RC_OK&&b->numExtents>0)
+        {
+            int last=b->numExtents-1;
+            freeExtent(t,b->extents[2*last]+b->extentUsed,b->extents[2*last+1]-b->extentUsed);
+            b->extents[2*last+1]=b->extentUsed;
+        }
+        if(rc==RC_OK)
+        {
+            memset(words,0,sizeof(words));
+            words[0]=BLOB_MAGIC;
+            memcpy(words+1,&b->size,sizeof(long long));
+            words[3]=b->numExtents;
+            memcpy(words+4,b->extents,sizeof(int)*2*b->numExtents);
+            rc=writeBlock(blob->id,&t->lob,(SM_PageHandle)words);
+        }
+        if(rc==RC_OK)
+            rc=writeLobHeader(t);
+        else
+        {
+            // the pages of a failed value are free again
+            int i;
+            for(i=0;i<b->numExtents;i++)
+                freeExtent(t,b->extents[2*i],b->extents[2*i+1]);
+            freeExtent(t,blob->id,1);
+        }
+        blob->size=b->size;
+    }
+    freePageMemory(b->buf);
+    free(b);
+    blob->mgmtInfo=0;
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        deleteBlob
+ * Description:     free the pages of a large value
+ * Input:           RM_TableData* rel: table handle
+                    int id: id of the value
+ * Return:          RC: RC_RM_NO_SUCH_RECORD if there is no value with that id
+ **********************************************************************************/
+RC deleteBlob(RM_TableData *rel, int id)
+{
+    TableInfo* t=(TableInfo*)rel->mgmtInfo;
+    BlobInfo* b;
+    int i;
+
+    RC rc=openLob(rel);
+    if(rc!=RC_OK) return rc;
+    b=(BlobInfo*)malloc(sizeof(BlobInfo));
+    if(b==0) return RC_ERROR;
+    rc=readBlobHeader(t,id,b);
+    if(rc==RC_OK)
+    {
+        // a stale id must not find a value any more
+        char* page=(char*)calloc(1,PAGE_SIZE);
+        rc=page==0?RC_ERROR:writeBlock(id,&t->lob,page);
+        free(page);
+    }
+    if(rc==RC_OK)
+    {
+        for(i=0;i<b->numExtents;i++)
+            freeExtent(t,b->extents[2*i],b->extents[2*i+1]);
+        freeExtent(t,id,1);
+        rc=writeLobHeader(t);
+    }
+    free(b);
+    return rc;
+}
+
+/************************************************************
+ *                    scans                                 *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        startScan
+ * Description:     start a scan over all records of a table in RID order
+ * Input:           RM_TableData* rel: table handle
+ * Output:          RM_ScanHandle* scan: scan handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC startScan(RM_TableData *rel, RM_ScanHandle *scan)
+{
+    ScanInfo* info=(ScanInfo*)calloc(1,sizeof(ScanInfo));
+    if(info==0) return RC_ERROR;
+    // room for vector loads past the last value of a columnar page
+    info->buf=(char*)calloc(PAGE_SIZE+32,1);
+    if(info->buf==0)
+    {
+        free(info);
+        return RC_ERROR;
+    }
+    info->page=0;
+    info->slot=0;
+    info->loadedPage=-1;
+    scan->rel=rel;
+    scan->mgmtInfo=info;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        combineBits
+ * Description:     the bits of a comparison from the less, equal and greater bits
+ **********************************************************************************/
+static unsigned long long combineBits(CompOp op, unsigned long long lt, unsigned long long eq, unsigned long long gt)
+{
+    switch(op)
+    {
+    case CMP_NE: return ~eq;
+    case CMP_LT: return lt;
+    case CMP_LE: return lt|eq;
+    case CMP_GT: return gt;
+    case CMP_GE: return gt|eq;
+    default:     return eq;
+    }
+}
+
+/*********************************************************************************
+ * Function:        compareInts / compareFloats / compareKeys
+ * Description:     compare n decoded values with a constant into bitmaps of the
+ *                  rows less than, equal to and greater than it. The columns
+ *                  have BATCH_ROWS entries, so n may be rounded up.
+ **********************************************************************************/
+static void compareInts(const int* col, int n, int v, unsigned long long* lt, unsigned long long* eq, unsigned long long* gt)
+{
+    int i;
+#if defined(__AVX2__)
+    __m256i c=_mm256_set1_epi32(v);
+    for(i=0;i<n;i+=8)
+    {
+        __m256i x=_mm256_loadu_si256((const __m256i*)(col+i));
+        lt[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(c,x)))<<(i&63);
+        eq[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(c,x)))<<(i&63);
+        gt[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x,c)))<<(i&63);
+    }
+#else
+    for(i=0;i<n;i++)
+    {
+        lt[i>>6]|=(unsigned long long)(col[i]<v)<<(i&63);
+        eq[i>>6]|=(unsigned long long)(col[i]==v)<<(i&63);
+        gt[i>>6]|=(unsigned long long)(col[i]>v)<<(i&63);
+    }
+#endif
+}
+
+static void compareFloats(const float* col, int n, float v, unsigned long long* lt, unsigned long long* eq, unsigned long long* gt)
+{
+    int i;
+#if defined(__AVX2__)
+    __m256 c=_mm256_set1_ps(v);
+    for(i=0;i<n;i+=8)
+    {
+        __m256 x=_mm256_loadu_ps(col+i);
+        lt[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_cmp_ps(x,c,_CMP_LT_OQ))<<(i&63);
+        eq[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_cmp_ps(x,c,_CMP_EQ_OQ))<<(i&63);
+        gt[i>>6]|=(unsigned long long)_mm256_movemask_ps(_mm256_cmp_ps(x,c,_CMP_GT_OQ))<<(i&63);
+    }
+#else
+    for(i=0;i<n;i++)
+    {
+        lt[i>>6]|=(unsigned long long)(col[i]<v)<<(i&63);
+        eq[i>>6]|=(unsigned long long)(col[i]==v)<<(i&63);
+        gt[i>>6]|=(unsigned long long)(col[i]>v)<<(i&63);
+    }
+#endif
+}
+
+static void compareKeys(const unsigned long long* col, int n, unsigned long long mask, unsigned long long v,
+                        unsigned long long* lt, unsigned long long* eq, unsigned long long* gt)
+{
+    int i;
+    v&=mask;
+#if defined(__AVX2__)
+    // no unsigned 64 bit compare, flip the sign bits
+    __m256i sign=_mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i m=_mm256_set1_epi64x((long long)mask);
+    __m256i c=_mm256_xor_si256(_mm256_set1_epi64x((long long)v),sign);
+    for(i=0;i<n;i+=4)
+    {
+        __m256i x=_mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(col+i)),m),sign);
+        lt[i>>6]|=(unsigned long long)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(c,x)))<<(i&63);
+        eq[i>>6]|=(unsigned long long)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(c,x)))<<(i&63);
+        gt[i>>6]|=(unsigned long long)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x,c)))<<(i&63);
+    }
+#else
+    for(i=0;i<n;i++)
+    {
+        unsigned long long x=col[i]&mask;
+        lt[i>>6]|=(unsigned long long)(x<v)<<(i&63);
+        eq[i>>6]|=(unsigned long long)(x==v)<<(i&63);
+        gt[i>>6]|=(unsigned long long)(x>v)<<(i&63);
+    }
+#endif
+}
+
+/*********************************************************************************
+ * Function:        compareString
+ * Description:     bytewise compare, a shorter string first; CMP_PREFIX gives 0
+ *                  if str starts with the constant
+ **********************************************************************************/
+static int compareString(ScanColumn* c, const char* str, int len)
+{
+    if(c->op==CMP_PREFIX)
+        return len>=c->strLen&&memcmp(str,c->str,c->strLen)==0?0:1;
+    int cmp=memcmp(str,c->str,len<c->strLen?len:c->strLen);
+    if(cmp!=0)
+        return cmp;
+    return (len>c->strLen)-(len<c->strLen);
+}
+
+/*********************************************************************************
+ * Function:        compareStrings
+ * Description:     compare a decoded string column with the constant: by the
+ *                  first 8 bytes for all rows, then byte by byte for the rows of
+ *                  sel whose first bytes are the same as the constant's
+ **********************************************************************************/
+static void compareStrings(ScanColumn* c, char* page, int n, const unsigned long long* sel,
+                           unsigned long long* lt, unsigned long long* eq, unsigned long long* gt)
+{
+    // a prefix only looks at as many bytes as it has
+    int bytes=c->op==CMP_PREFIX&&c->strLen<8?c->strLen:8;
+    unsigned long long mask=bytes==0?0:~0ULL<<(64-8*bytes);
+    int w;
+
+    compareKeys((const unsigned long long*)c->values,n,mask,c->strKey,lt,eq,gt);
+    for(w=0;w<(n+63)/64;w++)
+    {
+        unsigned long long bits=eq[w]&sel[w];
+        while(bits!=0)
+        {
+            int row=w*64+__builtin_ctzll(bits);
+            unsigned long long bit=bits&(0-bits);
+            int cmp=compareString(c,page+c->offs[row],c->lens[row]);
+            bits^=bit;
+            if(cmp==0)
+                continue;
+            eq[w]^=bit;
+            if(cmp<0)
+                lt[w]|=bit;
+            else
+                gt[w]|=bit;
+        }
+    }
+}
+
+/*********************************************************************************
+ * Function:        decodeColumn
+ * Description:     decode the attribute of a predicate from every record of the
+ *                  loaded page; other rows get zero
+ **********************************************************************************/
+static void decodeColumn(ScanInfo* info, ScanColumn* c, const unsigned long long* live, int n)
+{
+    Slot* slots=PAGE_SLOTS(info->buf);
+    int i, k;
+
+    for(i=0;i<n;i++)
+    {
+        if(!((live[i>>6]>>(i&63))&1))
+        {
+            if(c->dt==DT_STRING)
+                ((unsigned long long*)c->values)[i]=0;
+            else
+                ((int*)c->values)[i]=0;
+            continue;
+        }
+        char* rec=info->buf+slots[i].offset;
+        switch(c->dt)
+        {
+        case DT_STRING:
+            {
+                int off=info->fixedEnd;
+                unsigned short len;
+                for(k=0;k<c->strIndex;k++)
+                {
+                    memcpy(&len,rec+off,2);
+                    off+=2+len;
+                }
+                memcpy(&len,rec+off,2);
+                c->lens[i]=len;
+                c->offs[i]=(unsigned short)(slots[i].offset+off+2);
+                ((unsigned long long*)c->values)[i]=stringKey(rec+off+2,len);
+            }
+            break;
+        case DT_BOOL:
+            ((int*)c->values)[i]=rec[c->offset]!=0;
+            break;
+        default:
+            memcpy((int*)c->values+i,rec+c->offset,4);
+            break;
+        }
+    }
+}
+
+/*********************************************************************************
+ * Function:        evaluatePage
+ * Description:     fill info->sel with the records of the loaded page matching
+ *                  all predicates, and info->forward with its forwarded records
+ **********************************************************************************/
+static void evaluatePage(ScanInfo* info)
+{
+    unsigned long long live[BATCH_WORDS], lt[BATCH_WORDS], eq[BATCH_WORDS], gt[BATCH_WORDS];
+    Slot* slots=PAGE_SLOTS(info->buf);
+    int n=PAGE_HEADER(info->buf)->numSlots;
+    int words, i, w, p;
+
+    if(n>BATCH_ROWS)
+        n=BATCH_ROWS;
+    words=(n+63)/64;
+    memset(live,0,sizeof(live));
+    memset(info->forward,0,sizeof(info->forward));
+    for(i=0;i<n;i++)
+    {
+        if(slots[i].offset==0||(slots[i].length&SLOT_MOVED))
+            continue;
+        if(slots[i].length&SLOT_FORWARD)
+            info->forward[i>>6]|=1ULL<<(i&63);
+        else
+            live[i>>6]|=1ULL<<(i&63);
+    }
+    memcpy(info->sel,live,sizeof(live));
+
+    for(p=0;p<info->numCols;p++)
+    {
+        ScanColumn* c=&info->cols[p];
+        unsigned long long any=0;
+
+        for(w=0;w<words;w++)
+            any|=info->sel[w];
+        if(any==0)
+            break;
+
+        decodeColumn(info,c,live,n);
+        memset(lt,0,sizeof(lt));
+        memset(eq,0,sizeof(eq));
+        memset(gt,0,sizeof(gt));
+        switch(c->dt)
+        {
+        case DT_FLOAT:
+            compareFloats((const float*)c->values,n,c->floatValue,lt,eq,gt);
+            break;
+        case DT_STRING:
+            compareStrings(c,info->buf,n,info->sel,lt,eq,gt);
+            break;
+        default:
+            compareInts((const int*)c->values,n,c->intValue,lt,eq,gt);
+            break;
+        }
+        for(w=0;w<words;w++)
+            info->sel[w]&=combineBits(c->op,lt[w],eq[w],gt[w]);
+    }
+    for(w=words;w<BATCH_WORDS;w++)
+        info->sel[w]=0;
+}
+
+/*********************************************************************************
+ * Function:        zoneExcludes
+ * Description:     whether no value of a zone can match a predicate. String
+ *                  keys are cut to 8 bytes, so only their order is certain.
+ **********************************************************************************/
+static int zoneExcludes(ScanColumn* c, unsigned long long min, unsigned long long max)
+{
+    unsigned long long v=c->zone;
+    int exact=c->dt!=DT_STRING;
+
+    if(min>max)
+        return 1;
+    switch(c->op)
+    {
+    case CMP_EQ: return v<min||v>max;
+    case CMP_NE: return (c->dt==DT_INT||c->dt==DT_BOOL)&&min==v&&max==v;
+    case CMP_LT: return exact?min>=v:min>v;
+    case CMP_LE: return min>v;
+    case CMP_GT: return exact?max<=v:max<v;
+    case CMP_GE: return max<v;
+    default:
+        {
+            int bytes=c->strLen<8?c->strLen:8;
+            unsigned long long mask=bytes==0?0:~0ULL<<(64-8*bytes);
+            return (min&mask)>(v&mask)||(max&mask)<(v&mask);
+        }
+    }
+}
+
+/*********************************************************************************
+ * Function:        paxEvaluatePage
+ * Description:     fill info->sel with the rows of the loaded columnar page that
+ *                  match all predicates. Ints and floats are compared right in
+ *                  their minipage; a predicate whose zone cannot match ends
+ *                  the page.
+ **********************************************************************************/
+static void paxEvaluatePage(ScanInfo* info, TableInfo* t, Schema* schema)
+{
+    unsigned long long lt[BATCH_WORDS], eq[BATCH_WORDS], gt[BATCH_WORDS];
+    unsigned long long* deleted=paxDeleted(t,schema,info->buf);
+    int n=PAX_ROWS(info->buf);
+    int words, i, w, p;
+
+    if(n>t->rowsPerPage)
+        n=t->rowsPerPage;
+    words=(n+63)/64;
+    memset(info->sel,0,sizeof(info->sel));
+    memset(info->forward,0,sizeof(info->forward));
+    for(w=0;w<words;w++)
+    {
+        int rows=n-w*64;
+        info->sel[w]=~deleted[w]&(rows>=64?~0ULL:(1ULL<<rows)-1);
+    }
+
+    for(p=0;p<info->numCols;p++)
+    {
+        ScanColumn* c=&info->cols[p];
+        char* mini=info->buf+t->miniOffset[c->attrNum];
+        unsigned long long* zone=PAX_ZONES(info->buf)+2*c->attrNum;
+        unsigned long long any=0;
+
+        for(w=0;w<words;w++)
+            any|=info->sel[w];
+        if(any==0||zoneExcludes(c,zone[0],zone[1]))
+        {
+            memset(info->sel,0,sizeof(info->sel));
+            break;
+        }
+
+        memset(lt,0,sizeof(lt));
+        memset(eq,0,sizeof(eq));
+        memset(gt,0,sizeof(gt));
+        switch(c->dt)
+        {
+        case DT_INT:
+            compareInts((const int*)mini,n,c->intValue,lt,eq,gt);
+            break;
+        case DT_FLOAT:
+            compareFloats((const float*)mini,n,c->floatValue,lt,eq,gt);
+            break;
+        case DT_BOOL:
+            for(i=0;i<n;i++)
+                ((int*)c->values)[i]=mini[i];
+            compareInts((const int*)c->values,n,c->intValue,lt,eq,gt);
+            break;
+        default:
+            {
+                int width=paxWidth(schema,c->attrNum);
+                for(i=0;i<n;i++)
+                {
+                    char* v=mini+i*width;
+                    unsigned short len;
+                    memcpy(&len,v,2);
+                    c->lens[i]=len;
+                    c->offs[i]=(unsigned short)(v+2-info->buf);
+                    ((unsigned long long*)c->values)[i]=stringKey(v+2,len);
+                }
+                compareStrings(c,info->buf,n,info->sel,lt,eq,gt);
+            }
+            break;
+        }
+        for(w=0;w<words;w++)
+            info->sel[w]&=combineBits(c->op,lt[w],eq[w],gt[w]);
+    }
+}
+
+/*********************************************************************************
+ * Function:        matchRecord
+ * Description:     evaluate the predicates of a scan on one record
+ * Return:          int: 1 if the record matches all predicates
+ **********************************************************************************/
+static int matchRecord(ScanInfo* info, Schema* schema, Record* record)
+{
+    int p;
+
+    for(p=0;p<info->numCols;p++)
+    {
+        ScanColumn* c=&info->cols[p];
+        char* data;
+        int len, lt, eq, gt;
+
+        getAttrData(record,schema,c->attrNum,&data,&len);
+        if(c->dt==DT_STRING)
+        {
+            int cmp=compareString(c,data,len);
+            lt=cmp<0; eq=cmp==0; gt=cmp>0;
+        }
+        else if(c->dt==DT_FLOAT)
+        {
+            float x;
+            memcpy(&x,data,sizeof(x));
+            lt=x<c->floatValue; eq=x==c->floatValue; gt=x>c->floatValue;
+        }
+        else
+        {
+            int x;
+            if(c->dt==DT_BOOL)
+                x=data[0]!=0;
+            else
+                memcpy(&x,data,sizeof(x));
+            lt=x<c->intValue; eq=x==c->intValue; gt=x>c->intValue;
+        }
+        if(!(combineBits(c->op,lt,eq,gt)&1))
+            return 0;
+    }
+    return 1;
+}
+
+/*********************************************************************************
+ * Function:        freeColumns
+ * Description:     free the predicates of a scan
+ **********************************************************************************/
+static void freeColumns(ScanInfo* info)
+{
+    int p;
+    for(p=0;p<info->numCols;p++)
+    {
+        free(info->cols[p].str);
+        free(info->cols[p].values);
+        free(info->cols[p].lens);
+        free(info->cols[p].offs);
+    }
+    free(info->cols);
+    info->cols=0;
+    info->numCols=0;
+}
+
+/*********************************************************************************
+ * Function:        startFilteredScan
+ * Description:     start a scan over the records matching all predicates
+ * Input:           RM_TableData* rel: table handle
+                    ScanPredicate* preds: predicates, copied
+                    int numPreds: number of predicates, 0 for all records
+ * Output:          RM_ScanHandle* scan: scan handle
+ * Return:          RC: RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE if a constant
+ *                  does not have the type of its attribute
+ **********************************************************************************/
+RC startFilteredScan(RM_TableData *rel, RM_ScanHandle *scan, ScanPredicate *preds, int numPreds)
+{
+    Schema* schema=rel->schema;
+    ScanInfo* info;
+    int p, i, fixed=0;
+    RC rc;
+
+    for(p=0;p<numPreds;p++)
+    {
+        if(preds[p].attrNum<0||preds[p].attrNum>=schema->numAttr)
+            THROW(RC_RM_UNKOWN_DATATYPE, "attribute number out of range");
+        if(preds[p].value.dt!=schema->dataTypes[preds[p].attrNum]||
+           (preds[p].op==CMP_PREFIX&&preds[p].value.dt!=DT_STRING))
+            THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "predicate constant does not fit its attribute");
+    }
+
+    rc=startScan(rel,scan);
+    if(rc!=RC_OK) return rc;
+    info=(ScanInfo*)scan->mgmtInfo;
+    if(numPreds<=0)
+        return RC_OK;
+
+    for(i=0;i<schema->numAttr;i++)
+        fixed+=fixedAttrSize(schema->dataTypes[i]);
+    info->fixedEnd=fixed;
+    info->cols=(ScanColumn*)calloc(numPreds,sizeof(ScanColumn));
+    if(info->cols==0)
+    {
+        closeScan(scan);
+        return RC_ERROR;
+    }
+    info->numCols=numPreds;
+    for(p=0;p<numPreds;p++)
+    {
+        ScanColumn* c=&info->cols[p];
+        int a=preds[p].attrNum;
+
+        c->attrNum=a;
+        c->op=preds[p].op;
+        c->dt=schema->dataTypes[a];
+        for(i=0;i<a;i++)
+        {
+            c->offset+=fixedAttrSize(schema->dataTypes[i]);
+            c->strIndex+=schema->dataTypes[i]==DT_STRING;
+        }
+        c->values=calloc(BATCH_ROWS,sizeof(unsigned long long));
+        switch(c->dt)
+        {
+        case DT_INT:
+            c->intValue=preds[p].value.v.intV;
+            c->zone=zoneKey(DT_INT,(char*)&c->intValue,4);
+            break;
+        case DT_BOOL:
+            c->intValue=preds[p].value.v.boolV!=0;
+            c->zone=(unsigned long long)c->intValue;
+            break;
+        case DT_FLOAT:
+            c->floatValue=preds[p].value.v.floatV;
+            c->zone=zoneKey(DT_FLOAT,(char*)&c->floatValue,4);
+            break;
+        default:
+            c->strLen=(int)strlen(preds[p].value.v.stringV);
+            c->str=(char*)malloc(c->strLen+1);
+            c->lens=(unsigned short*)calloc(BATCH_ROWS,sizeof(unsigned short));
+            c->offs=(unsigned short*)calloc(BATCH_ROWS,sizeof(unsigned short));
+            if(c->str!=0)
+            {
+                memcpy(c->str,preds[p].value.v.stringV,c->strLen+1);
+                c->strKey=stringKey(c->str,c->strLen);
+                c->zone=c->strKey;
+            }
+            if(c->str==0||c->lens==0||c->offs==0)
+            {
+                free(c->values);
+                c->values=0;
+            }
+            break;
+        }
+        if(c->values==0)
+        {
+            closeScan(scan);
+            return RC_ERROR;
+        }
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        next
+ * Description:     return the next record of a scan. Moved records are returned
+ *                  once, under the RID of their home slot.
+ * Input:           RM_ScanHandle* scan: scan handle
+ * Output:          Record* record: record, data is reallocated to fit
+ * Return:          RC: RC_RM_NO_MORE_TUPLES at the end
+ **********************************************************************************/
+RC next(RM_ScanHandle *scan, Record *record)
+{
+    ScanInfo* info=(ScanInfo*)scan->mgmtInfo;
+    TableInfo* t=(TableInfo*)scan->rel->mgmtInfo;
+
+    for(;;)
+    {
+        if(info->page>=t->numDataPages)
+            THROW(RC_RM_NO_MORE_TUPLES, "no more tuples");
+        if(info->loadedPage!=info->page)
+        {
+            if(info->numCols>0&&t->summaryAttr>=0&&summaryExcludes(info,t,tableFilePage(t,info->page)))
+            {
+                info->page++;
+                info->slot=0;
+                continue;
+            }
+            RC rc=readBlock(tableFilePage(t,info->page),&t->fh,info->buf);
+            if(rc!=RC_OK) return rc;
+            info->loadedPage=info->page;
+            if(t->layout==TABLE_COLUMNS)
+                paxEvaluatePage(info,t,scan->rel->schema);
+            else if(info->numCols>0)
+                evaluatePage(info);
+        }
+        if(info->numCols>0||t->layout==TABLE_COLUMNS)
+        {
+            // skip to the next selected or forwarded record
+            int w=info->slot>>6;
+            unsigned long long bits=0;
+            if(w<BATCH_WORDS)
+                bits=(info->sel[w]|info->forward[w])&(~0ULL<<(info->slot&63));
+            while(bits==0&&++w<BATCH_WORDS)
+                bits=info->sel[w]|info->forward[w];
+            info->slot=bits==0?BATCH_ROWS:w*64+__builtin_ctzll(bits);
+        }
+        if(info->slot>=(t->layout==TABLE_COLUMNS?PAX_ROWS(info->buf):PAGE_HEADER(info->buf)->numSlots))
+        {
+            info->page++;
+            info->slot=0;
+            continue;
+        }
+
+        int slot=info->slot++;
+        RID id;
+        id.page=info->page;
+        id.slot=slot;
+        if(t->layout==TABLE_COLUMNS)
+            return paxGet(scan->rel,info->buf,slot,id,record);
+        Slot* s=&PAGE_SLOTS(info->buf)[slot];
+        if(s->offset==0||(s->length&SLOT_MOVED))
+            continue;
+        if(s->length&SLOT_FORWARD)
+        {
+            RC rc=getRecord(scan->rel,id,record);
+            if(rc!=RC_OK||info->numCols==0||matchRecord(info,scan->rel->schema,record))
+                return rc;
+            continue;
+        }
+        return copyOut(scan->rel,info->buf,slot,id,record);
+    }
+}
+
+/*********************************************************************************
+ * Function:        closeScan
+ * Description:     release a scan
+ * Input:           RM_ScanHandle* scan: scan handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeScan(RM_ScanHandle *scan)
+{
+    ScanInfo* info=(ScanInfo*)scan->mgmtInfo;
+    if(info!=0)
+    {
+        freeColumns(info);
+        free(info->buf);
+        free(info);
+    }
+    scan->mgmtInfo=0;
+    return RC_OK;
+}
+
+/************************************************************
+ *                    schemas                               *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        fixedAttrSize
+ * Description:     bytes of an attribute in the fixed part of a record, 0 for strings
+ **********************************************************************************/
+static int fixedAttrSize(DataType dt)
+{
+    switch(dt)
+    {
+    case DT_INT:   return sizeof(int);
+    case DT_FLOAT: return sizeof(float);
+    case DT_BOOL:  return 1;
+    default:       return 0;
+    }
+}
+
+/*********************************************************************************
+ * Function:        getRecordSize
+ * Description:     largest encoded size of a record of this schema
+ * Input:           Schema* schema: schema
+ * Return:          int: size in bytes
+ **********************************************************************************/
+int getRecordSize(Schema *schema)
+{
+    int i, size=0;
+    for(i=0;i<schema->numAttr;i++)
+        size+=schema->dataTypes[i]==DT_STRING?2+schema->typeLength[i]:fixedAttrSize(schema->dataTypes[i]);
+    return size;
+}
+
+/*********************************************************************************
+ * Function:        createSchema
+ * Description:     create a schema, it takes ownership of the arrays
+ * Return:          Schema*: new schema
+ **********************************************************************************/
+Schema *createSchema(int numAttr, char **attrNames, DataType *dataTypes, int *typeLength, int keySize, int *keys)
+{
+    Schema* schema=(Schema*)malloc(sizeof(Schema));
+    schema->numAttr=numAttr;
+    schema->attrNames=attrNames;
+    schema->dataTypes=dataTypes;
+    schema->typeLength=typeLength;
+    schema->keySize=keySize;
+    schema->keyAttrs=keys;
+    return schema;
+}
+
+/*********************************************************************************
+ * Function:        freeSchema
+ * Description:     free a schema and the arrays it owns
+ * Return:          RC: return code
+ **********************************************************************************/
+RC freeSchema(Schema *schema)
+{
+    int i;
+    if(schema==0) return RC_OK;
+    for(i=0;i<schema->numAttr;i++)
+        free(schema->attrNames[i]);
+    free(schema->attrNames);
+    free(schema->dataTypes);
+    free(schema->typeLength);
+    free(schema->keyAttrs);
+    free(schema);
+    return RC_OK;
+}
+
+/************************************************************
+ *                    records and attribute values          *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        attrOffset
+ * Description:     byte offset of an attribute in an encoded record, for a string
+ *                  the offset of its 2 byte length
+ **********************************************************************************/
+static int attrOffset(Record* record, Schema* schema, int attrNum)
+{
+    int i, off=0;
+
+    if(schema->dataTypes[attrNum]!=DT_STRING)
+    {
+        for(i=0;i<attrNum;i++)
+            off+=fixedAttrSize(schema->dataTypes[i]);
+        return off;
+    }
+    for(i=0;i<schema->numAttr;i++)
+        off+=fixedAttrSize(schema->dataTypes[i]);
+    for(i=0;i<attrNum;i++)
+        if(schema->dataTypes[i]==DT_STRING)
+        {
+            unsigned short len;
+            memcpy(&len,record->data+off,2);
+            off+=2+len;
+        }
+    return off;
+}
+
+/*********************************************************************************
+ * Function:        createRecord
+ * Description:     create a record with every attribute zero or empty, the data
+ *                  buffer is large enough for the longest record of the schema
+ * Output:          Record** record: new record
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createRecord(Record **record, Schema *schema)
+{
+    int i, size=0;
+    Record* r=(Record*)malloc(sizeof(Record));
+    if(r==0) return RC_ERROR;
+    r->data=(char*)calloc(getRecordSize(schema)>0?getRecordSize(schema):1,1);
+    if(r->data==0)
+    {
+        free(r);
+        return RC_ERROR;
+    }
+    for(i=0;i<schema->numAttr;i++)
+        size+=schema->dataTypes[i]==DT_STRING?2:fixedAttrSize(schema->dataTypes[i]);
+    r->size=size;
+    r->id.page=-1;
+    r->id.slot=-1;
+    *record=r;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeRecord
+ * Description:     free a record and its data
+ * Return:          RC: return code
+ **********************************************************************************/
+RC freeRecord(Record *record)
+{
+    if(record==0) return RC_OK;
+    free(record->data);
+    free(record);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        getAttr
+ * Description:     decode one attribute of a record into a new Value
+ * Input:           Record* record, Schema* schema, int attrNum
+ * Output:          Value** value: new value, free it with freeVal
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getAttr(Record *record, Schema *schema, int attrNum, Value **value)
+{
+    if(attrNum<0||attrNum>=schema->numAttr)
+        THROW(RC_RM_UNKOWN_DATATYPE, "attribute number out of range");
+
+    int off=attrOffset(record,schema,attrNum);
+    Value* v=(Value*)malloc(sizeof(Value));
+    v->dt=schema->dataTypes[attrNum];
+    switch(v->dt)
+    {
+    case DT_INT:
+        memcpy(&v->v.intV,record->data+off,sizeof(int));
+        break;
+    case DT_FLOAT:
+        memcpy(&v->v.floatV,record->data+off,sizeof(float));
+        break;
+    case DT_BOOL:
+        v->v.boolV=record->data[off]!=0;
+        break;
+    case DT_STRING:
+        {
+            unsigned short len;
+            memcpy(&len,record->data+off,2);
+            v->v.stringV=(char*)malloc(len+1);
+            memcpy(v->v.stringV,record->data+off+2,len);
+            v->v.stringV[len]='\0';
+        }
+        break;
+    default:
+        free(v);
+        THROW(RC_RM_UNKOWN_DATATYPE, "unknown data type");
+    }
+    *value=v;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        getAttrData
+ * Description:     where an attribute is in an encoded record, without copying
+ * Input:           Record* record, Schema* schema, int attrNum
+ * Output:          char** data: first byte of the value, for a string the first
+ *                  character
+                    int* length: bytes of the value, for a string its length
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getAttrData(Record *record, Schema *schema, int attrNum, char **data, int *length)
+{
+    if(attrNum<0||attrNum>=schema->numAttr)
+        THROW(RC_RM_UNKOWN_DATATYPE, "attribute number out of range");
+
+    int off=attrOffset(record,schema,attrNum);
+    if(schema->dataTypes[attrNum]==DT_STRING)
+    {
+        unsigned short len;
+        memcpy(&len,record->data+off,2);
+        *data=record->data+off+2;
+        *length=len;
+    }
+    else
+    {
+        *data=record->data+off;
+        *length=fixedAttrSize(schema->dataTypes[attrNum]);
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        setAttr
+ * Description:     encode a value into an attribute of a record. Strings are cut
+ *                  at typeLength and the following strings are shifted.
+ * Input:           Record* record, Schema* schema, int attrNum, Value* value
+ * Return:          RC: return code
+ **********************************************************************************/
+RC setAttr(Record *record, Schema *schema, int attrNum, Value *value)
+{
+    if(attrNum<0||attrNum>=schema->numAttr)
+        THROW(RC_RM_UNKOWN_DATATYPE, "attribute number out of range");
+    if(value->dt!=schema->dataTypes[attrNum])
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "value does not have the type of the attribute");
+
+    int off=attrOffset(record,schema,attrNum);
+    switch(value->dt)
+    {
+    case DT_INT:
+        memcpy(record->data+off,&value->v.intV,sizeof(int));
+        break;
+    case DT_FLOAT:
+        memcpy(record->data+off,&value->v.floatV,sizeof(float));
+        break;
+    case DT_BOOL:
+        record->data[off]=value->v.boolV?1:0;
+        break;
+    case DT_STRING:
+        {
+            unsigned short oldLen;
+            int newLen=(int)strlen(value->v.stringV);
+            if(newLen>schema->typeLength[attrNum])
+                newLen=schema->typeLength[attrNum];
+            memcpy(&oldLen,record->data+off,2);
+            int tail=off+2+oldLen;
+            memmove(record->data+off+2+newLen,record->data+tail,record->size-tail);
+            memcpy(record->data+off+2,value->v.stringV,newLen);
+            unsigned short len=(unsigned short)newLen;
+            memcpy(record->data+off,&len,2);
+            record->size+=newLen-oldLen;
+        }
+        break;
+    default:
+        THROW(RC_RM_UNKOWN_DATATYPE, "unknown data type");
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeVal
+ * Description:     free a value created by getAttr
+ **********************************************************************************/
+void freeVal(Value *value)
+{
+    if(value==0) return;
+    if(value->dt==DT_STRING)
+        free(value->v.stringV);
+    free(value);
+}
@@ -0,0 +1,115 @@
+#ifndef RECORD_MGR_H
+#define RECORD_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+typedef struct RM_ScanHandle {
+  RM_TableData *rel;
+  void *mgmtInfo;
+} RM_ScanHandle;
+
+/* page layout of a table. TABLE_ROWS keeps whole records in slotted pages.
+ * TABLE_COLUMNS (PAX) keeps the values of every attribute of a page together
+ * in a minipage with their min and max, for scans that look at few
+ * attributes: records are appended, strings take their full typeLength,
+ * the space of deleted records is not used again and the fill factor of
+ * bulkInsertRecords is ignored */
+typedef enum TableLayout {
+  TABLE_ROWS = 0,
+  TABLE_COLUMNS = 1
+} TableLayout;
+
+/* a filtered scan compares attributes with constants; CMP_PREFIX matches
+ * strings that start with the constant */
+typedef enum CompOp {
+  CMP_EQ = 0,
+  CMP_NE = 1,
+  CMP_LT = 2,
+  CMP_LE = 3,
+  CMP_GT = 4,
+  CMP_GE = 5,
+  CMP_PREFIX = 6
+} CompOp;
+
+typedef struct ScanPredicate {
+  int attrNum;
+  CompOp op;
+  Value value;
+} ScanPredicate;
+
+/* handle of a large value, see createBlob */
+typedef struct RM_BlobHandle {
+  RM_TableData *rel;
+  int id;
+  long long size;
+  void *mgmtInfo;
+} RM_BlobHandle;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* table and manager */
+extern RC initRecordManager (void *mgmtData);
+extern RC shutdownRecordManager (void);
+extern RC createTable (char *name, Schema *schema);
+extern RC createTableWithLayout (char *name, Schema *schema, TableLayout layout);
+extern RC openTable (RM_TableData *rel, char *name);
+extern RC closeTable (RM_TableData *rel);
+extern RC deleteTable (char *name);
+extern int getNumTuples (RM_TableData *rel);
+
+/* handling records in a table, record->data is owned by the record and
+ * reallocated by getRecord and next to fit the stored record */
+extern RC insertRecord (RM_TableData *rel, Record *record);
+extern RC deleteRecord (RM_TableData *rel, RID id);
+extern RC updateRecord (RM_TableData *rel, Record *record);
+extern RC getRecord (RM_TableData *rel, RID id, Record *record);
+
+/* insert many records into new pages filled to fillFactor (0 < fillFactor <= 1),
+ * written in large sequential batches; the id of every record is set */
+extern RC bulkInsertRecords (RM_TableData *rel, Record **records, int numRecords, float fillFactor);
+
+/* large values: byte strings of any size, kept in runs of whole pages of the
+ * file <table>.lob and moved in large chunks. A record refers to a value by
+ * its id, e.g. in a DT_INT attribute. A value is written once, front to
+ * back, from createBlob to closeBlob, and read as a stream from any position;
+ * only the buffer of the handle is in memory */
+extern RC createBlob (RM_TableData *rel, RM_BlobHandle *blob);
+extern RC writeBlob (RM_BlobHandle *blob, char *data, int length);
+extern RC openBlob (RM_TableData *rel, int id, RM_BlobHandle *blob);
+extern RC readBlob (RM_BlobHandle *blob, char *data, int length, int *bytesRead);
+extern RC seekBlob (RM_BlobHandle *blob, long long offset);
+extern RC closeBlob (RM_BlobHandle *blob);
+extern RC deleteBlob (RM_TableData *rel, int id);
+
+/* keep the key range and a Bloom filter of the first key attribute of every
+ * page, so filtered scans on it skip pages without reading them */
+extern RC enableKeySummaries (RM_TableData *rel);
+
+/* scans */
+extern RC startScan (RM_TableData *rel, RM_ScanHandle *scan);
+/* a filtered scan returns only the records matching all numPreds predicates,
+ * strings compare bytewise with a shorter string first. The predicates are
+ * evaluated a page at a time; the value strings are copied */
+extern RC startFilteredScan (RM_TableData *rel, RM_ScanHandle *scan, ScanPredicate *preds, int numPreds);
+extern RC next (RM_ScanHandle *scan, Record *record);
+extern RC closeScan (RM_ScanHandle *scan);
+
+/* dealing with schemas */
+extern int getRecordSize (Schema *schema);
+extern Schema *createSchema (int numAttr, char **attrNames, DataType *dataTypes, int *typeLength, int keySize, int *keys);
+extern RC freeSchema (Schema *schema);
+
+/* dealing with records and attribute values */
+extern RC createRecord (Record **record, Schema *schema);
+extern RC freeRecord (Record *record);
+extern RC getAttr (Record *record, Schema *schema, int attrNum, Value **value);
+extern RC setAttr (Record *record, Schema *schema, int attrNum, Value *value);
+extern RC getAttrData (Record *record, Schema *schema, int attrNum, char **data, int *length);
+extern void freeVal (Value *value);
+
+#endif // RECORD_MGR_H
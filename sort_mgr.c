@@ -0,0 +1,1137 @@
+#include "sort_mgr.h"
+#include "record_mgr.h"
+#include "storage_mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#define SORT_THREADS
+#endif
+
+/*  openSort reads the table with a record scan into one of numThreads+1
+ *  chunks of the memory budget. A full chunk is handed to a thread that
+ *  sorts it and writes it as a run, while the table is read on into the next
+ *  chunk. If the whole table fits into the first chunk no run is written.
+ *
+ *  Runs are temporary page files holding the records back to back, each as
+ *  its RID, its size and its bytes. A run stays in memory if its pages fit
+ *  into what the memory budget has left after the other open runs, else it
+ *  goes to disk; runs are gone once closed. They are written and read
+ *  through two buffers per run: one is filled or consumed while the other
+ *  one is with the I/O thread, which does all run file writes and reads
+ *  with writeBlocks and readBlocks. When there are more runs than the
+ *  budget has buffers for, groups of runs are merged into longer runs
+ *  first. The last merge feeds nextSorted through a loser tree, one compare
+ *  per tree level per record.
+ *
+ *  Without threads the same steps run one after the other. */
+#define RUN_HEADER_SIZE    12   // RID and size in front of every record in a run
+#define MIN_BUFFER_PAGES   4
+#define MAX_BUFFER_PAGES   64
+#define MAX_STORED_RECORD  PAGE_SIZE
+
+typedef struct SortEntry{
+    unsigned long long key; // order preserving key, for strings the first 8 bytes
+    char* data;
+    RID id;
+    int size;
+    int strOff;             // string key in data, -1 for other types
+    int strLen;
+}SortEntry;
+
+typedef struct IORequest{
+    SM_FileHandle* fh;
+    int pageNum;
+    int numPages;
+    char* buf;
+    int write;
+    int pending;
+    RC rc;
+    struct IORequest* next;
+}IORequest;
+
+typedef struct SortIO{
+#ifdef SORT_THREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+#endif
+    IORequest* head;
+    IORequest* tail;
+    int stop;
+    int started;
+}SortIO;
+
+typedef struct Run{
+    SM_FileHandle fh;       // temporary page file, mgmtInfo is 0 if there is none
+    long bytes;
+    int numPages;
+    int memoryPages;        // pages of the budget the run holds in memory
+}Run;
+
+typedef struct RunWriter{
+    SM_FileHandle fh;
+    char* buf[2];
+    IORequest req[2];
+    int cur;
+    int used;
+    int bufPages;
+    int nextPage;
+    long bytes;
+    int memoryPages;        // pages of the budget claimed for the run file
+}RunWriter;
+
+typedef struct RunReader{
+    SM_FileHandle fh;
+    char* buf[2];
+    int avail[2];
+    IORequest req[2];
+    int cur;
+    int pos;
+    int bufPages;
+    int nextPage;
+    int numPages;
+    long left;
+    char* rec;              // current record with its run header
+    SortEntry e;
+    int done;
+    int open;
+}RunReader;
+
+typedef struct Chunk{
+    char* mem;              // entries from the front, record bytes from the back
+    long size;
+    int count;
+    long dataStart;
+    int running;
+    int threaded;
+#ifdef SORT_THREADS
+    pthread_t thread;
+#endif
+    struct SortState* s;
+    Run run;
+    RC rc;
+}Chunk;
+
+typedef struct SortState{
+    RM_TableData* rel;
+    Schema* schema;
+    int attrNum;
+    long budget;
+    SortIO io;
+    Chunk* chunks;
+    int numChunks;
+    int writerPages;
+    Run* runs;
+    int numRuns;
+    int capRuns;
+    int runPagesLeft;       // pages of the budget runs may still keep in memory
+    // output
+    Chunk* memChunk;        // the table fit into memory, no runs
+    int memPos;
+    RunReader* readers;
+    int k;
+    int* tree;
+    int needAdvance;
+}SortState;
+
+/*********************************************************************************
+ * Function:        makeKey
+ * Description:     fill in the sort key of an entry from its record bytes
+ **********************************************************************************/
+static void makeKey(SortState* s, SortEntry* e)
+{
+    Record r;
+    char* v;
+    int len, i;
+
+    r.data=e->data;
+    r.size=e->size;
+    getAttrData(&r,s->schema,s->attrNum,&v,&len);
+    e->strOff=-1;
+    e->strLen=0;
+    switch(s->schema->dataTypes[s->attrNum])
+    {
+    case DT_INT:
+        {
+            int x;
+            memcpy(&x,v,sizeof(x));
+            e->key=(unsigned int)x^0x80000000u;
+        }
+        break;
+    case DT_FLOAT:
+        {
+            // same mapping as the b+-tree keys, then signed to unsigned order;
+            // -0.0 is the same key as 0.0
+            float f;
+            int bits;
+            memcpy(&f,v,sizeof(f));
+            f=f==0.0f?0.0f:f;
+            memcpy(&bits,&f,sizeof(bits));
+            bits^=(bits>>31)&0x7fffffff;
+            e->key=(unsigned int)bits^0x80000000u;
+        }
+        break;
+    case DT_BOOL:
+        e->key=v[0]!=0;
+        break;
+    default:
+        e->key=0;
+        for(i=0;i<8;i++)
+            e->key=(e->key<<8)|(i<len?(unsigned char)v[i]:0);
+        e->strOff=(int)(v-e->data);
+        e->strLen=len;
+        break;
+    }
+}
+
+/*********************************************************************************
+ * Function:        compareEntries
+ * Description:     qsort order of sort entries: key, then RID
+ **********************************************************************************/
+static int compareEntries(const void* a, const void* b)
+{
+    const SortEntry* x=(const SortEntry*)a;
+    const SortEntry* y=(const SortEntry*)b;
+
+    if(x->key!=y->key)
+        return x->key<y->key?-1:1;
+    if(x->strOff>=0&&(x->strLen>8||y->strLen>8))
+    {
+        int len=x->strLen<y->strLen?x->strLen:y->strLen;
+        int c=memcmp(x->data+x->strOff,y->data+y->strOff,len);
+        if(c!=0)
+            return c;
+        if(x->strLen!=y->strLen)
+            return x->strLen<y->strLen?-1:1;
+    }
+    if(x->id.page!=y->id.page)
+        return x->id.page<y->id.page?-1:1;
+    return (x->id.slot>y->id.slot)-(x->id.slot<y->id.slot);
+}
+
+/************************************************************
+ *                    run file I/O                          *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        ioExecute
+ * Description:     do one run file read or write, growing the file for writes
+ **********************************************************************************/
+static void ioExecute(IORequest* r)
+{
+    if(r->write)
+    {
+        r->rc=RC_OK;
+        if(r->pageNum+r->numPages>r->fh->totalNumPages)
+            r->rc=ensureCapacity(r->pageNum+r->numPages,r->fh);
+        if(r->rc==RC_OK)
+            r->rc=writeBlocks(r->pageNum,r->numPages,r->fh,r->buf);
+    }
+    else
+        r->rc=readBlocks(r->pageNum,r->numPages,r->fh,r->buf);
+}
+
+#ifdef SORT_THREADS
+/*********************************************************************************
+ * Function:        ioMain
+ * Description:     the I/O thread, runs requests in the order they came
+ **********************************************************************************/
+static void* ioMain(void* arg)
+{
+    SortIO* io=(SortIO*)arg;
+
+    pthread_mutex_lock(&io->lock);
+    for(;;)
+    {
+        while(io->head==0&&!io->stop)
+            pthread_cond_wait(&io->work,&io->lock);
+        if(io->head==0)
+            break;
+        IORequest* r=io->head;
+        io->head=r->next;
+        if(io->head==0)
+            io->tail=0;
+        pthread_mutex_unlock(&io->lock);
+
+        ioExecute(r);
+
+        pthread_mutex_lock(&io->lock);
+        r->pending=0;
+        pthread_cond_broadcast(&io->done);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        ioStart / ioStop
+ * Description:     start / stop the I/O thread
+ **********************************************************************************/
+static RC ioStart(SortIO* io)
+{
+    memset(io,0,sizeof(SortIO));
+#ifdef SORT_THREADS
+    pthread_mutex_init(&io->lock,0);
+    pthread_cond_init(&io->work,0);
+    pthread_cond_init(&io->done,0);
+    if(pthread_create(&io->thread,0,ioMain,io)!=0)
+    {
+        pthread_mutex_destroy(&io->lock);
+        pthread_cond_destroy(&io->work);
+        pthread_cond_destroy(&io->done);
+        THROW(RC_ERROR, "can not start the sort I/O thread");
+    }
+#endif
+    io->started=1;
+    return RC_OK;
+}
+
+static void ioStop(SortIO* io)
+{
+    if(!io->started)
+        return;
+#ifdef SORT_THREADS
+    pthread_mutex_lock(&io->lock);
+    io->stop=1;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread,0);
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->work);
+    pthread_cond_destroy(&io->done);
+#endif
+    io->started=0;
+}
+
+/*********************************************************************************
+ * Function:        ioSubmit / ioWait
+ * Description:     queue a request for the I/O thread / wait until it is done
+ **********************************************************************************/
+static void ioSubmit(SortIO* io, IORequest* r)
+{
+#ifdef SORT_THREADS
+    pthread_mutex_lock(&io->lock);
+    r->pending=1;
+    r->next=0;
+    if(io->tail!=0)
+        io->tail->next=r;
+    else
+        io->head=r;
+    io->tail=r;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+#else
+    ioExecute(r);
+#endif
+}
+
+static RC ioWait(SortIO* io, IORequest* r)
+{
+#ifdef SORT_THREADS
+    pthread_mutex_lock(&io->lock);
+    while(r->pending)
+        pthread_cond_wait(&io->done,&io->lock);
+    pthread_mutex_unlock(&io->lock);
+#endif
+    return r->rc;
+}
+
+/*********************************************************************************
+ * Function:        claimRunPages
+ * Description:     take the pages of a run of the given size from what the 
+ *                  budget has left for runs in memory, all or nothing; runs 
+ *                  are written by several threads at once
+ * Return:          int: pages taken, 0 if the run has to go to disk
+ **********************************************************************************/
+static int claimRunPages(SortState* s, long bytes)
+{
+    int pages=(int)((bytes+PAGE_SIZE-1)/PAGE_SIZE)+1;
+    int left=__atomic_load_n(&s->runPagesLeft,__ATOMIC_RELAXED);
+
+    do
+    {
+        if(left<pages)
+            return 0;
+    }while(!__atomic_compare_exchange_n(&s->runPagesLeft,&left,left-pages,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+    return pages;
+}
+
+/*********************************************************************************
+ * Function:        releaseRunPages
+ * Description:     give pages taken by claimRunPages back
+ **********************************************************************************/
+static void releaseRunPages(SortState* s, int pages)
+{
+    if(pages>0)
+        __atomic_add_fetch(&s->runPagesLeft,pages,__ATOMIC_RELAXED);
+}
+
+/*********************************************************************************
+ * Function:        runWriterOpen
+ * Description:     create a run file and its two write buffers. The file is
+ *                  in memory if a run of the expected size fits into the
+ *                  budget, else on disk.
+ **********************************************************************************/
+static RC runWriterOpen(SortState* s, RunWriter* w, long bytes)
+{
+    RC rc;
+
+    memset(w,0,sizeof(RunWriter));
+    w->memoryPages=claimRunPages(s,bytes);
+    rc=openTempPageFile(&w->fh,w->memoryPages);
+    if(rc!=RC_OK)
+    {
+        releaseRunPages(s,w->memoryPages);
+        return rc;
+    }
+    w->bufPages=s->writerPages;
+    w->buf[0]=allocPageMemory(w->bufPages);
+    w->buf[1]=allocPageMemory(w->bufPages);
+    if(w->buf[0]==0||w->buf[1]==0)
+    {
+        freePageMemory(w->buf[0]);
+        freePageMemory(w->buf[1]);
+        closePageFile(&w->fh);
+        releaseRunPages(s,w->memoryPages);
+        return RC_ERROR;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        runWriterSubmit
+ * Description:     hand the current buffer to the I/O thread and switch to the
+ *                  other one once its last write is done
+ **********************************************************************************/
+static RC runWriterSubmit(SortIO* io, RunWriter* w, int numPages)
+{
+    IORequest* r=&w->req[w->cur];
+
+    r->fh=&w->fh;
+    r->pageNum=w->nextPage;
+    r->numPages=numPages;
+    r->buf=w->buf[w->cur];
+    r->write=1;
+    ioSubmit(io,r);
+    w->nextPage+=numPages;
+    w->cur^=1;
+    w->used=0;
+    return ioWait(io,&w->req[w->cur]);
+}
+
+/*********************************************************************************
+ * Function:        runWriterPut
+ * Description:     append bytes to a run
+ **********************************************************************************/
+static RC runWriterPut(SortIO* io, RunWriter* w, char* src, int n)
+{
+    long size=(long)w->bufPages*PAGE_SIZE;
+
+    w->bytes+=n;
+    while(n>0)
+    {
+        int m=(int)(size-w->used<n?size-w->used:n);
+        memcpy(w->buf[w->cur]+w->used,src,m);
+        w->used+=m;
+        src+=m;
+        n-=m;
+        if(w->used==size)
+        {
+            RC rc=runWriterSubmit(io,w,w->bufPages);
+            if(rc!=RC_OK) return rc;
+        }
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        runWriterClose
+ * Description:     write the rest of a run and hand its file over to run
+ **********************************************************************************/
+static RC runWriterClose(SortState* s, RunWriter* w, Run* run)
+{
+    SortIO* io=&s->io;
+    RC rc=RC_OK;
+
+    if(w->used>0)
+    {
+        int pages=(w->used+PAGE_SIZE-1)/PAGE_SIZE;
+        memset(w->buf[w->cur]+w->used,0,(long)pages*PAGE_SIZE-w->used);
+        rc=runWriterSubmit(io,w,pages);
+    }
+    RC other=ioWait(io,&w->req[w->cur^1]);
+    if(rc==RC_OK) rc=other;
+    freePageMemory(w->buf[0]);
+    freePageMemory(w->buf[1]);
+    run->fh=w->fh;
+    run->bytes=w->bytes;
+    run->numPages=w->nextPage;
+    // a run longer than expected spilled, its pages are not in memory
+    run->memoryPages=w->memoryPages;
+    if(w->memoryPages>0&&!isTempFileInMemory(&w->fh))
+    {
+        releaseRunPages(s,w->memoryPages);
+        run->memoryPages=0;
+    }
+    return rc;
+}
+
+/*********************************************************************************
+ * Function:        runReaderFill
+ * Description:     start reading the next pages of a run into buffer b
+ **********************************************************************************/
+static void runReaderFill(SortIO* io, RunReader* r, int b)
+{
+    int n=r->numPages-r->nextPage;
+    if(n>r->bufPages)
+        n=r->bufPages;
+    r->avail[b]=n>0?n*PAGE_SIZE:0;
+    if(n<=0)
+        return;
+    r->req[b].fh=&r->fh;
+    r->req[b].pageNum=r->nextPage;
+    r->req[b].numPages=n;
+    r->req[b].buf=r->buf[b];
+    r->req[b].write=0;
+    r->nextPage+=n;
+    ioSubmit(io,&r->req[b]);
+}
+
+/*********************************************************************************
+ * Function:        runReaderBytes
+ * Description:     take the next n bytes of a run; a used up buffer is refilled
+ *                  in the background with the pages after the other buffer
+ **********************************************************************************/
+static RC runReaderBytes(SortIO* io, RunReader* r, char* dst, int n)
+{
+    while(n>0)
+    {
+        if(r->pos==r->avail[r->cur])
+        {
+            runReaderFill(io,r,r->cur);
+            r->cur^=1;
+            r->pos=0;
+            RC rc=ioWait(io,&r->req[r->cur]);
+            if(rc!=RC_OK) return rc;
+            if(r->avail[r->cur]==0)
+                THROW(RC_READ_NON_EXISTING_PAGE, "run ends in the middle of a record");
+        }
+        int m=r->avail[r->cur]-r->pos<n?r->avail[r->cur]-r->pos:n;
+        memcpy(dst,r->buf[r->cur]+r->pos,m);
+        r->pos+=m;
+        dst+=m;
+        n-=m;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        runReaderAdvance
+ * Description:     read the next record of a run into r->rec and r->e
+ **********************************************************************************/
+static RC runReaderAdvance(SortState* s, RunReader* r)
+{
+    RC rc;
+    int header[3];
+
+    if(r->left==0)
+    {
+        r->done=1;
+        return RC_OK;
+    }
+    rc=runReaderBytes(&s->io,r,(char*)header,RUN_HEADER_SIZE);
+    if(rc!=RC_OK) return rc;
+    if(header[2]<0||header[2]>MAX_STORED_RECORD)
+        THROW(RC_FILE_HEADER_CORRUPT, "bad record size in a sort run");
+    memcpy(r->rec,header,RUN_HEADER_SIZE);
+    rc=runReaderBytes(&s->io,r,r->rec+RUN_HEADER_SIZE,header[2]);
+    if(rc!=RC_OK) return rc;
+    r->left-=RUN_HEADER_SIZE+header[2];
+
+    r->e.id.page=header[0];
+    r->e.id.slot=header[1];
+    r->e.size=header[2];
+    r->e.data=r->rec+RUN_HEADER_SIZE;
+    makeKey(s,&r->e);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        runReaderOpen / runReaderClose
+ * Description:     open a run with both buffers being read / close it
+ **********************************************************************************/
+static RC runReaderOpen(SortState* s, RunReader* r, Run* run, int bufPages)
+{
+    RC rc;
+
+    memset(r,0,sizeof(RunReader));
+    // a copy of the handle, the run keeps the file open
+    r->fh=run->fh;
+    r->open=1;
+    r->bufPages=bufPages;
+    r->numPages=run->numPages;
+    r->left=run->bytes;
+    r->buf[0]=allocPageMemory(bufPages);
+    r->buf[1]=allocPageMemory(bufPages);
+    r->rec=(char*)malloc(RUN_HEADER_SIZE+MAX_STORED_RECORD);
+    if(r->buf[0]==0||r->buf[1]==0||r->rec==0)
+        return RC_ERROR;
+
+    runReaderFill(&s->io,r,0);
+    runReaderFill(&s->io,r,1);
+    rc=ioWait(&s->io,&r->req[0]);
+    if(rc!=RC_OK) return rc;
+    return runReaderAdvance(s,r);
+}
+
+static void runReaderClose(SortState* s, RunReader* r)
+{
+    if(!r->open)
+        return;
+    ioWait(&s->io,&r->req[0]);
+    ioWait(&s->io,&r->req[1]);
+    freePageMemory(r->buf[0]);
+    freePageMemory(r->buf[1]);
+    free(r->rec);
+    r->open=0;
+}
+
+/************************************************************
+ *                    run generation                        *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        chunkEntries
+ * Description:     the entry array at the front of a chunk
+ **********************************************************************************/
+static SortEntry* chunkEntries(Chunk* c)
+{
+    return (SortEntry*)c->mem;
+}
+
+/*********************************************************************************
+ * Function:        chunkAdd
+ * Description:     copy a record into a chunk
+ * Return:          int: 0 if the chunk is full
+ **********************************************************************************/
+static int chunkAdd(SortState* s, Chunk* c, Record* record)
+{
+    long entriesEnd=(long)(c->count+1)*sizeof(SortEntry);
+    if(entriesEnd+record->size>c->dataStart)
+        return 0;
+
+    SortEntry* e=&chunkEntries(c)[c->count++];
+    c->dataStart-=record->size;
+    e->data=c->mem+c->dataStart;
+    memcpy(e->data,record->data,record->size);
+    e->size=record->size;
+    e->id=record->id;
+    makeKey(s,e);
+    return 1;
+}
+
+/*********************************************************************************
+ * Function:        sortChunk
+ * Description:     sort a chunk and write it as a run; runs on a worker thread
+ **********************************************************************************/
+static void* sortChunk(void* arg)
+{
+    Chunk* c=(Chunk*)arg;
+    SortState* s=c->s;
+    SortEntry* entries=chunkEntries(c);
+    RunWriter w;
+    long bytes=(long)c->count*RUN_HEADER_SIZE;
+    int i;
+
+    qsort(entries,c->count,sizeof(SortEntry),compareEntries);
+    for(i=0;i<c->count;i++)
+        bytes+=entries[i].size;
+    c->rc=runWriterOpen(s,&w,bytes);
+    if(c->rc!=RC_OK)
+        return 0;
+    for(i=0;i<c->count&&c->rc==RC_OK;i++)
+    {
+        int header[3];
+        header[0]=entries[i].id.page;
+        header[1]=entries[i].id.slot;
+        header[2]=entries[i].size;
+        c->rc=runWriterPut(&s->io,&w,(char*)header,RUN_HEADER_SIZE);
+        if(c->rc==RC_OK)
+            c->rc=runWriterPut(&s->io,&w,entries[i].data,entries[i].size);
+    }
+    RC rc=runWriterClose(s,&w,&c->run);
+    if(c->rc==RC_OK)
+        c->rc=rc;
+    return 0;
+}
+
+/*********************************************************************************
+ * Function:        addRun
+ * Description:     append a finished run to the run list
+ **********************************************************************************/
+static RC addRun(SortState* s, Run* run)
+{
+    if(s->numRuns==s->capRuns)
+    {
+        int cap=s->capRuns==0?16:s->capRuns*2;
+        Run* runs=(Run*)realloc(s->runs,cap*sizeof(Run));
+        if(runs==0) return RC_ERROR;
+        s->runs=runs;
+        s->capRuns=cap;
+    }
+    s->runs[s->numRuns++]=*run;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        dropRun
+ * Description:     close the file of a run, which removes it
+ **********************************************************************************/
+static void dropRun(SortState* s, Run* run)
+{
+    if(run->fh.mgmtInfo!=0)
+        closePageFile(&run->fh);
+    run->fh.mgmtInfo=0;
+    releaseRunPages(s,run->memoryPages);
+    run->memoryPages=0;
+}
+
+/*********************************************************************************
+ * Function:        finishChunk
+ * Description:     wait for the run of a chunk and add it to the run list
+ **********************************************************************************/
+static RC finishChunk(SortState* s, Chunk* c)
+{
+    if(!c->running)
+        return RC_OK;
+#ifdef SORT_THREADS
+    if(c->threaded)
+        pthread_join(c->thread,0);
+#endif
+    c->running=0;
+    if(c->rc!=RC_OK)
+    {
+        dropRun(s,&c->run);
+        return c->rc;
+    }
+    return addRun(s,&c->run);
+}
+
+/*********************************************************************************
+ * Function:        startChunk
+ * Description:     sort and write a full chunk on a thread of its own
+ **********************************************************************************/
+static RC startChunk(Chunk* c)
+{
+    memset(&c->run,0,sizeof(Run));
+    c->running=1;
+    c->threaded=0;
+#ifdef SORT_THREADS
+    if(pthread_create(&c->thread,0,sortChunk,c)==0)
+    {
+        c->threaded=1;
+        return RC_OK;
+    }
+#endif
+    // no thread, do it here
+    sortChunk(c);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        generateRuns
+ * Description:     read the table into chunks and turn full chunks into runs.
+ *                  A table that fits into one chunk stays in memory.
+ **********************************************************************************/
+static RC generateRuns(SortState* s)
+{
+    RM_ScanHandle scan;
+    Record record;
+    int cur=0, launched=0, i;
+    RC rc, scanRc;
+
+    rc=startScan(s->rel,&scan);
+    if(rc!=RC_OK) return rc;
+    record.data=0;
+    record.size=0;
+
+    while(rc==RC_OK&&(scanRc=next(&scan,&record))==RC_OK)
+    {
+        Chunk* c=&s->chunks[cur];
+        if(record.size>MAX_STORED_RECORD)
+        {
+            rc=RC_RM_RECORD_TOO_BIG;
+            break;
+        }
+        if(chunkAdd(s,c,&record))
+            continue;
+
+        // full: sort it in the background and go on with the next chunk
+        rc=startChunk(c);
+        launched++;
+        cur=(cur+1)%s->numChunks;
+        if(rc==RC_OK)
+            rc=finishChunk(s,&s->chunks[cur]);
+        s->chunks[cur].count=0;
+        s->chunks[cur].dataStart=s->chunks[cur].size;
+        if(rc==RC_OK&&!chunkAdd(s,&s->chunks[cur],&record))
+            rc=RC_RM_RECORD_TOO_BIG;
+    }
+    if(rc==RC_OK&&scanRc!=RC_RM_NO_MORE_TUPLES)
+        rc=scanRc;
+    closeScan(&scan);
+    free(record.data);
+
+    if(rc==RC_OK)
+    {
+        if(launched==0)
+        {
+            // everything is in the first chunk, sort it here
+            s->memChunk=&s->chunks[cur];
+            qsort(chunkEntries(s->memChunk),s->memChunk->count,sizeof(SortEntry),compareEntries);
+        }
+        else if(s->chunks[cur].count>0)
+            rc=startChunk(&s->chunks[cur]);
+    }
+    for(i=0;i<s->numChunks;i++)
+    {
+        RC chunkRc=finishChunk(s,&s->chunks[i]);
+        if(rc==RC_OK) rc=chunkRc;
+    }
+    return rc;
+}
+
+/************************************************************
+ *                    merging                               *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        readerLess
+ * Description:     loser tree order of two readers, a finished run is largest
+ **********************************************************************************/
+static int readerLess(SortState* s, int a, int b)
+{
+    if(s->readers[a].done) return 0;
+    if(s->readers[b].done) return 1;
+    return compareEntries(&s->readers[a].e,&s->readers[b].e)<0;
+}
+
+/*********************************************************************************
+ * Function:        buildTree
+ * Description:     play the tournament below node; internal nodes 1..k-1 keep
+ *                  the loser, leaves are k..2k-1
+ * Return:          int: winner below node
+ **********************************************************************************/
+static int buildTree(SortState* s, int node)
+{
+    if(node>=s->k)
+        return node-s->k;
+    int l=buildTree(s,2*node);
+    int r=buildTree(s,2*node+1);
+    if(readerLess(s,l,r))
+    {
+        s->tree[node]=r;
+        return l;
+    }
+    s->tree[node]=l;
+    return r;
+}
+
+/*********************************************************************************
+ * Function:        replay
+ * Description:     after reader i moved on, replay its path to the root
+ **********************************************************************************/
+static void replay(SortState* s, int i)
+{
+    int winner=i, p;
+
+    for(p=(i+s->k)/2;p>=1;p/=2)
+    {
+        if(readerLess(s,s->tree[p],winner))
+        {
+            int t=s->tree[p];
+            s->tree[p]=winner;
+            winner=t;
+        }
+    }
+    s->tree[0]=winner;
+}
+
+/*********************************************************************************
+ * Function:        mergeOpen / mergeClose
+ * Description:     open readers on k runs and build the loser tree / close them
+ **********************************************************************************/
+static RC mergeOpen(SortState* s, Run* runs, int k)
+{
+    long pages=s->budget/(2L*PAGE_SIZE*(k+1));
+    int bufPages=pages<1?1:(pages>MAX_BUFFER_PAGES?MAX_BUFFER_PAGES:(int)pages);
+    int i;
+    RC rc=RC_OK;
+
+    s->k=k;
+    s->readers=(RunReader*)calloc(k,sizeof(RunReader));
+    s->tree=(int*)calloc(k,sizeof(int));
+    if(s->readers==0||s->tree==0)
+        return RC_ERROR;
+    for(i=0;i<k&&rc==RC_OK;i++)
+        rc=runReaderOpen(s,&s->readers[i],&runs[i],bufPages);
+    if(rc!=RC_OK)
+        return rc;
+    s->tree[0]=buildTree(s,1);
+    s->needAdvance=0;
+    return RC_OK;
+}
+
+static void mergeClose(SortState* s)
+{
+    int i;
+    if(s->readers!=0)
+        for(i=0;i<s->k;i++)
+            runReaderClose(s,&s->readers[i]);
+    free(s->readers);
+    free(s->tree);
+    s->readers=0;
+    s->tree=0;
+    s->k=0;
+}
+
+/*********************************************************************************
+ * Function:        mergeNext
+ * Description:     the reader holding the smallest record, 0 when all are done
+ **********************************************************************************/
+static RC mergeNext(SortState* s, RunReader** winner)
+{
+    if(s->needAdvance)
+    {
+        RC rc=runReaderAdvance(s,&s->readers[s->tree[0]]);
+        if(rc!=RC_OK) return rc;
+        replay(s,s->tree[0]);
+    }
+    s->needAdvance=1;
+    *winner=s->readers[s->tree[0]].done?0:&s->readers[s->tree[0]];
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        mergePasses
+ * Description:     merge groups of runs into longer runs until the budget has
+ *                  room for a buffer pair for every run
+ **********************************************************************************/
+static RC mergePasses(SortState* s)
+{
+    int fanIn=(int)(s->budget/(2L*PAGE_SIZE*MIN_BUFFER_PAGES))-1;
+    RC rc=RC_OK;
+
+    if(fanIn<2)
+        fanIn=2;
+    while(rc==RC_OK&&s->numRuns>fanIn)
+    {
+        RunWriter w;
+        RunReader* r;
+        Run run;
+        int i;
+
+        long bytes=0;
+        memset(&run,0,sizeof(Run));
+        for(i=0;i<fanIn;i++)
+            bytes+=s->runs[i].bytes;
+        rc=mergeOpen(s,s->runs,fanIn);
+        if(rc==RC_OK)
+            rc=runWriterOpen(s,&w,bytes);
+        if(rc!=RC_OK)
+        {
+            mergeClose(s);
+            return rc;
+        }
+        while(rc==RC_OK&&(rc=mergeNext(s,&r))==RC_OK&&r!=0)
+            rc=runWriterPut(&s->io,&w,r->rec,RUN_HEADER_SIZE+r->e.size);
+        RC closeRc=runWriterClose(s,&w,&run);
+        if(rc==RC_OK) rc=closeRc;
+        mergeClose(s);
+
+        // the merged runs are replaced by the new one
+        for(i=0;i<fanIn;i++)
+            dropRun(s,&s->runs[i]);
+        memmove(s->runs,s->runs+fanIn,(s->numRuns-fanIn)*sizeof(Run));
+        s->numRuns-=fanIn;
+        if(rc==RC_OK)
+            rc=addRun(s,&run);
+        else
+            dropRun(s,&run);
+    }
+    return rc;
+}
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+
+/*********************************************************************************
+ * Function:        freeSortState
+ * Description:     stop the I/O thread, remove all runs and free the state
+ **********************************************************************************/
+static void freeSortState(SortState* s)
+{
+    int i;
+
+    mergeClose(s);
+    ioStop(&s->io);
+    for(i=0;i<s->numRuns;i++)
+        dropRun(s,&s->runs[i]);
+    free(s->runs);
+    if(s->chunks!=0)
+        for(i=0;i<s->numChunks;i++)
+            freePageMemory(s->chunks[i].mem);
+    free(s->chunks);
+    free(s);
+}
+
+/*********************************************************************************
+ * Function:        openSort
+ * Description:     read the table and write the sorted runs
+ * Input:           RM_TableData* rel: open table
+                    int attrNum: attribute to sort by
+                    long memBudget: bytes for records and buffers
+                    int numThreads: threads to sort runs with
+ * Output:          RM_SortHandle** handle: new sort, freed by closeSort
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openSort(RM_TableData *rel, int attrNum, long memBudget, int numThreads, RM_SortHandle **handle)
+{
+    SortState* s;
+    RM_SortHandle* h;
+    long chunkBytes, pages;
+    int i;
+    RC rc;
+
+    if(attrNum<0||attrNum>=rel->schema->numAttr)
+        THROW(RC_RM_UNKOWN_DATATYPE, "attribute number out of range");
+    if(numThreads<1)
+        numThreads=1;
+
+    // every chunk needs room for its write buffers and a few records
+    while(numThreads>1&&memBudget/(numThreads+1)<16L*PAGE_SIZE)
+        numThreads--;
+    chunkBytes=memBudget/(numThreads+1);
+    if(chunkBytes<4L*PAGE_SIZE)
+        THROW(RC_ERROR, "the memory budget is too small to sort");
+
+    s=(SortState*)calloc(1,sizeof(SortState));
+    h=(RM_SortHandle*)malloc(sizeof(RM_SortHandle));
+    if(s==0||h==0)
+    {
+        free(s);
+        free(h);
+        return RC_ERROR;
+    }
+    s->rel=rel;
+    s->schema=rel->schema;
+    s->attrNum=attrNum;
+    s->budget=memBudget;
+    // all runs in memory together stay within the budget
+    s->runPagesLeft=(int)(memBudget/PAGE_SIZE);
+
+    // a quarter of a chunk goes to the two write buffers of its run
+    pages=chunkBytes/(8L*PAGE_SIZE);
+    s->writerPages=pages<1?1:(pages>MAX_BUFFER_PAGES?MAX_BUFFER_PAGES:(int)pages);
+    s->numChunks=numThreads+1;
+    s->chunks=(Chunk*)calloc(s->numChunks,sizeof(Chunk));
+    rc=s->chunks==0?RC_ERROR:RC_OK;
+    for(i=0;rc==RC_OK&&i<s->numChunks;i++)
+    {
+        Chunk* c=&s->chunks[i];
+        c->s=s;
+        c->size=chunkBytes-2L*s->writerPages*PAGE_SIZE;
+        c->dataStart=c->size;
+        c->mem=allocPageMemory((int)((c->size+PAGE_SIZE-1)/PAGE_SIZE));
+        if(c->mem==0)
+            rc=RC_ERROR;
+    }
+    if(rc==RC_OK)
+        rc=ioStart(&s->io);
+    if(rc==RC_OK)
+        rc=generateRuns(s);
+
+    // the chunks are not needed for merging, except for an in-memory sort
+    if(rc==RC_OK&&s->memChunk==0)
+    {
+        for(i=0;i<s->numChunks;i++)
+        {
+            freePageMemory(s->chunks[i].mem);
+            s->chunks[i].mem=0;
+        }
+        rc=mergePasses(s);
+        if(rc==RC_OK)
+            rc=mergeOpen(s,s->runs,s->numRuns);
+    }
+    if(rc!=RC_OK)
+    {
+        freeSortState(s);
+        free(h);
+        return rc;
+    }
+
+    h->rel=rel;
+    h->mgmtInfo=s;
+    *handle=h;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        nextSorted
+ * Description:     the next record in sort order
+ * Input:           RM_SortHandle* handle: sort
+ * Output:          Record* record: record, data is reallocated to fit and id is
+ *                  the RID of the record in the table
+ * Return:          RC: RC_RM_NO_MORE_TUPLES at the end
+ **********************************************************************************/
+RC nextSorted(RM_SortHandle *handle, Record *record)
+{
+    SortState* s=(SortState*)handle->mgmtInfo;
+    SortEntry* e;
+
+    if(s->memChunk!=0)
+    {
+        if(s->memPos>=s->memChunk->count)
+            THROW(RC_RM_NO_MORE_TUPLES, "no more tuples");
+        e=&chunkEntries(s->memChunk)[s->memPos++];
+    }
+    else
+    {
+        RunReader* r;
+        RC rc=mergeNext(s,&r);
+        if(rc!=RC_OK) return rc;
+        if(r==0)
+            THROW(RC_RM_NO_MORE_TUPLES, "no more tuples");
+        e=&r->e;
+    }
+
+    // keep room for the longest record, as getRecord does
+    int capacity=getRecordSize(s->schema);
+    char* data=(char*)realloc(record->data,capacity>e->size?capacity:e->size);
+    if(data==0) return RC_ERROR;
+    record->data=data;
+    memcpy(record->data,e->data,e->size);
+    record->size=e->size;
+    record->id=e->id;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeSort
+ * Description:     remove the runs and free the sort
+ * Input:           RM_SortHandle* handle: sort
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closeSort(RM_SortHandle *handle)
+{
+    if(handle==0) return RC_OK;
+    freeSortState((SortState*)handle->mgmtInfo);
+    free(handle);
+    return RC_OK;
+}
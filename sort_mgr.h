@@ -0,0 +1,31 @@
+#ifndef SORT_MGR_H
+#define SORT_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+typedef struct RM_SortHandle {
+  RM_TableData *rel;
+  void *mgmtInfo;
+} RM_SortHandle;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* external merge sort of the records of an open table by one attribute.
+ * openSort reads the whole table and writes sorted runs to temporary page
+ * files, kept in memory while all of them fit into memBudget; nextSorted
+ * then returns the records in attribute order, ties in RID order, with
+ * record->id set to the RID of the record in the table.
+ * At most memBudget bytes are used for records and I/O buffers, and up to
+ * numThreads threads sort and write runs while the table is read; the
+ * memory comes from allocPageMemory. The table must not change until
+ * closeSort. */
+extern RC openSort (RM_TableData *rel, int attrNum, long memBudget, int numThreads, RM_SortHandle **handle);
+extern RC nextSorted (RM_SortHandle *handle, Record *record);
+extern RC closeSort (RM_SortHandle *handle);
+
+#endif // SORT_MGR_H
@@ -1,13 +1,36 @@
+#ifdef __linux__
+// SEEK_DATA, SEEK_HOLE and fallocate
+#define _GNU_SOURCE
+#endif
+
 #include "storage_mgr.h"
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
 #include <malloc.h>
 
-#ifdef __LINUXm__
+#ifdef __linux__
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#define _access access
 #else
 #include <io.h>
 #endif
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*it seems there is no need to implement a header on each page based on the test_assign file...
 typedef struct PageHeader{
     int index;
@@ -34,17 +57,144 @@ void writePageHeader(FILE* fp)
 
 
 /*  this file header contains basic file information, 
- *   and stored in the beginning of file     */
+ *   and stored in the beginning of file     
+ *
+ *  The header area occupies the first PAGE_SIZE bytes of the file, so every
+ *  data page stays aligned to the file system block size. It holds two
+ *  HeaderSlot copies (at offset 0 and HEADER_SLOT_STRIDE). Each write of the
+ *  header goes to the slot that is NOT currently active and carries a higher
+ *  sequence number, so a torn header write always leaves the other slot intact.
+ *  On open the valid slot with the highest sequence number wins.  */
+#define HEADER_MAGIC        0x46504d53   /* "SMPF" */
+#define HEADER_VERSION      1
+#define HEADER_SLOT_SIZE    128
+#define HEADER_SLOT_STRIDE  (PAGE_SIZE / 2)
+#define HEADER_INFO_SIZE    (HEADER_SLOT_SIZE - 6 * sizeof(int))
+
+/* on-disk image of one header slot, all fields are 4 bytes so there is no padding */
+typedef struct HeaderSlot{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int sequence;
+    int currentPage;
+    int maxPageCount;
+    char additionalInfo[HEADER_INFO_SIZE];
+    unsigned int checksum;
+}HeaderSlot;
+
+/*  byte ranges of one page that were staged by stageBlockRange but are not
+ *  on disk yet. The staged bytes live in image at their page offsets;
+ *  ranges are kept sorted and merged, so each one becomes a single write. */
+#define STAGED_PAGE_COUNT   16
+#define STAGED_RANGE_COUNT  8
+
+typedef struct StagedRange{
+    int offset;
+    int length;
+}StagedRange;
+
+typedef struct StagedPage{
+    int pageNum;
+    int numRanges;
+    StagedRange ranges[STAGED_RANGE_COUNT];
+    char* image;
+}StagedPage;
+
+/*  write-behind state of a file, see enableWriteBehind  */
+typedef struct WriteBehind WriteBehind;
+
+/*  page summaries of a file, see enablePageSummaries  */
+typedef struct PageSummaries PageSummaries;
+
+/*  changed pages of a file, see enableChangeTracking  */
+typedef struct ChangeTracking ChangeTracking;
+
+/*  follower of a file, see enableReplication  */
+typedef struct Replication Replication;
+
+/*  read counts and saved hot page list of a file, see enableHotPages  */
+typedef struct HotPages HotPages;
+
+/*  shared page map of a file, see enablePageDedup  */
+typedef struct Dedup Dedup;
+
+/*  memory a file holds against the budget, see setMemoryBudget  */
+typedef struct MemAccount MemAccount;
+
+// kinds of page files, see openTempPageFile
+#define TEMP_NONE    0   // a named, durable page file
+#define TEMP_MEMORY  1   // a temporary file in memory
+#define TEMP_SPILLED 2   // a temporary file on disk
+
 typedef struct DataBaseHeader{
 	FILE* filePointer;
 	int currentPage;
 	int maxPageCount;
 	char* additionalInfo;
 	int sizeofHeader;
+	unsigned int sequence;   // sequence number of the active slot
+	int activeSlot;          // slot holding the newest valid header
+	int headerDirty;         // in-memory metadata differs from the file
+	StagedPage* stagedPages; // pages with staged byte ranges, allocated on first use
+	int numStagedPages;
+	int probeFd;             // private descriptor for SEEK_DATA/SEEK_HOLE, -1 if none
+	long extentStart;        // last extent found by probing, [extentStart, extentEnd)
+	long extentEnd;
+	int extentIsHole;
+	WriteBehind* writeBehind; // write-behind table and flusher, 0 if disabled
+	PageSummaries* summaries; // page summaries, 0 if the file has none
+	ChangeTracking* changes;  // pages changed since the last backup, 0 if not tracked
+	Replication* replication; // shipper to a follower, 0 if there is none
+	HotPages* hot;            // hot page list, 0 if the file has none
+	Dedup* dedup;             // shared page map, 0 if pages are not deduplicated
+	MemAccount* mem;          // memory held for the file, 0 if it is not accounted
+	int temporary;            // TEMP_NONE, or where a temporary file is now
+	int spillPages;           // pages a temporary file keeps in memory, -1 for any number
 }DataBaseHeader;
 
-//this is a databaseheader used in program to help read a page file
-DataBaseHeader* p_dataBaseHeader = 0;
+//this is a databaseheader used in program to help read a page file,
+//per thread so that threads working on different files do not mix them up
+THREAD_LOCAL DataBaseHeader* p_dataBaseHeader = 0;
+
+/*********************************************************************************
+  *Function:        headerChecksum
+  *Description:     CRC-32 of a header slot, excluding the checksum field itself
+  *Input:           HeaderSlot* slot: slot image
+  *Output:          None
+  *Return:          unsigned int: checksum
+**********************************************************************************/
+static unsigned int headerChecksum(HeaderSlot* slot)
+{
+    const unsigned char* data = (const unsigned char*)slot;
+    unsigned int crc = 0xFFFFFFFFu;
+    size_t i;
+    int k;
+
+    for (i = 0; i < offsetof(HeaderSlot, checksum); i++)
+    {
+        crc ^= data[i];
+        for (k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+/*********************************************************************************
+  *Function:        syncFile
+  *Description:     push everything buffered for fp down to the device
+  *Input:           FILE* fp: file pointer
+  *Output:          None
+  *Return:          None
+**********************************************************************************/
+static void syncFile(FILE* fp)
+{
+    fflush(fp);
+#ifdef __linux__
+    fdatasync(fileno(fp));
+#else
+    _commit(_fileno(fp));
+#endif
+}
 
 /*********************************************************************************
   *Function:        initDataBaseHeader
@@ -59,547 +209,5891 @@ void initDataBaseHeader()
     p_dataBaseHeader->currentPage=0;
     p_dataBaseHeader->maxPageCount=1;
     p_dataBaseHeader->filePointer=0;
-    //reserve some space for future use, record the esstienal data
-    p_dataBaseHeader->sizeofHeader=128;
+    p_dataBaseHeader->additionalInfo=0;
+    //reserve a whole page for the two header slots so data pages stay block aligned
+    p_dataBaseHeader->sizeofHeader=PAGE_SIZE;
+    // the first header written goes to slot 0 with sequence 1
+    p_dataBaseHeader->sequence=0;
+    p_dataBaseHeader->activeSlot=1;
+    p_dataBaseHeader->headerDirty=0;
+    p_dataBaseHeader->stagedPages=0;
+    p_dataBaseHeader->numStagedPages=0;
+    p_dataBaseHeader->probeFd=-1;
+    p_dataBaseHeader->extentStart=0;
+    p_dataBaseHeader->extentEnd=0;
+    p_dataBaseHeader->extentIsHole=0;
+    p_dataBaseHeader->writeBehind=0;
+    p_dataBaseHeader->summaries=0;
+    p_dataBaseHeader->changes=0;
+    p_dataBaseHeader->replication=0;
+    p_dataBaseHeader->hot=0;
+    p_dataBaseHeader->dedup=0;
+    p_dataBaseHeader->mem=0;
+    p_dataBaseHeader->temporary=TEMP_NONE;
+    p_dataBaseHeader->spillPages=0;
 }
 
 /*********************************************************************************
- * Function:        writeDataBaseHeader
- * Description:     Write file header into the beginning of a file
- * Input:           FILE* fp: file pointer
+  *Function:        isZeroPage
+  *Description:     check whether a page contains only zero bytes, 
+  *                 vectorized with AVX2 or SSE2 when the compiler targets them
+  *Input:           const char* page: PAGE_SIZE bytes
+  *Output:          None
+  *Return:          int: 1 if every byte is zero
+**********************************************************************************/
+static int isZeroPage(const char* page)
+{
+    int i;
+#if defined(__AVX2__)
+    for(i=0;i<PAGE_SIZE;i+=128)
+    {
+        __m256i acc=_mm256_or_si256(
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(page+i)),
+                            _mm256_loadu_si256((const __m256i*)(page+i+32))),
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(page+i+64)),
+                            _mm256_loadu_si256((const __m256i*)(page+i+96))));
+        if(!_mm256_testz_si256(acc,acc))
+            return 0;
+    }
+#elif defined(__SSE2__)
+    const __m128i zero=_mm_setzero_si128();
+    for(i=0;i<PAGE_SIZE;i+=64)
+    {
+        __m128i acc=_mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(page+i)),
+                         _mm_loadu_si128((const __m128i*)(page+i+16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(page+i+32)),
+                         _mm_loadu_si128((const __m128i*)(page+i+48))));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(acc,zero))!=0xFFFF)
+            return 0;
+    }
+#else
+    unsigned long long acc=0;
+    for(i=0;i<PAGE_SIZE;i+=sizeof(acc))
+    {
+        unsigned long long word;
+        memcpy(&word,page+i,sizeof(word));
+        acc|=word;
+        // check once per cache line so a dirty page bails out early
+        if((i&63)==56&&acc!=0)
+            return 0;
+    }
+#endif
+    return 1;
+}
+
+/*********************************************************************************
+  *Function:        isHolePage
+  *Description:     check whether the page at file offset off is entirely a file 
+  *                 system hole, so it can be returned as zeros without reading.
+  *                 The last extent found is cached until the next write.
+  *Input:           DataBaseHeader* header: header of the open file
+  *                 long off: file offset of the page
+  *Output:          None
+  *Return:          int: 1 if the page is a hole
+**********************************************************************************/
+static int isHolePage(DataBaseHeader* header, long off)
+{
+#ifdef __linux__
+    if(header->probeFd<0)
+        return 0;
+    if(off>=header->extentStart&&off+PAGE_SIZE<=header->extentEnd)
+        return header->extentIsHole;
+
+    off_t data=lseek(header->probeFd,off,SEEK_DATA);
+    if(data<0)
+    {
+        // no data from here to the end of the file
+        if(errno!=ENXIO)
+            return 0;
+        header->extentStart=off;
+        header->extentEnd=LONG_MAX;
+        header->extentIsHole=1;
+        return 1;
+    }
+    if(data>=off+PAGE_SIZE)
+    {
+        header->extentStart=off;
+        header->extentEnd=data;
+        header->extentIsHole=1;
+        return 1;
+    }
+    if(data==off)
+    {
+        off_t hole=lseek(header->probeFd,off,SEEK_HOLE);
+        if(hole>off)
+        {
+            header->extentStart=off;
+            header->extentEnd=hole;
+            header->extentIsHole=0;
+        }
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+/*********************************************************************************
+  *Function:        invalidateExtent
+  *Description:     forget the cached extent after the file content changed
+  *Input:           DataBaseHeader* header: header of the open file
+  *Output:          None
+  *Return:          None
+**********************************************************************************/
+static void invalidateExtent(DataBaseHeader* header)
+{
+    header->extentStart=0;
+    header->extentEnd=0;
+}
+
+/*********************************************************************************
+  *Function:        punchPage
+  *Description:     turn a page of the file into a hole, the page reads back as zeros
+  *Input:           DataBaseHeader* header: header of the open file
+  *                 long off: file offset of the page
+  *Output:          None
+  *Return:          int: 1 on success, 0 if the file system can not punch holes
+**********************************************************************************/
+static int punchPage(DataBaseHeader* header, long off)
+{
+#ifdef __linux__
+    // pending writes must not land after the punch, and buffered input is stale after it
+    fflush(header->filePointer);
+    invalidateExtent(header);
+    return fallocate(fileno(header->filePointer),FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,off,PAGE_SIZE)==0;
+#else
+    return 0;
+#endif
+}
+
+/*  memory governor: one budget for the memory held for all open page files
+ *  of the process. Every open file has a MemAccount with its bytes of each
+ *  kind, see SM_MEM_CACHE. Pages are cached by the OS, not by us, so the
+ *  governor keeps track of the pages each file read, wrote or prefetched in
+ *  chunks of MEM_CHUNK_PAGES pages, and the chunks of all files are on one
+ *  list in the order of their last use. While the files use more than the
+ *  budget, the least recently used chunks, of whatever file, are given back
+ *  with POSIX_FADV_DONTNEED. Write-behind tables, staged page images and
+ *  temporary files in memory can not be given back: they are charged when
+ *  they are allocated, after evicting cached pages to make room, and a
+ *  write-behind table gets fewer pages if the budget can not hold it.
+ *  Cached pages are tracked from the first call of setMemoryBudget on. */
+#define MEM_CHUNK_PAGES  64
+#define MEM_TEMP_NAME    "(temporary)"
+
+typedef struct MemChunk{
+    MemAccount* owner;
+    int chunk;                   // first page / MEM_CHUNK_PAGES
+    unsigned long long pages;    // charged pages, bit i for page chunk*MEM_CHUNK_PAGES+i
+    struct MemChunk* newer;      // list of all chunks in the order of use
+    struct MemChunk* older;
+    struct MemChunk* next;       // bucket of the owner
+}MemChunk;
+
+struct MemAccount{
+    char name[SM_MEM_NAME_SIZE];
+    int fd;                      // to give cached pages back, -1 while they are not tracked
+    long sizeofHeader;
+    long long bytes[SM_MEM_KINDS];
+    long long lastUse;
+    MemChunk** buckets;          // chunks by number
+    int numBuckets;
+    int numChunks;
+    MemAccount* prev;            // list of all accounts
+    MemAccount* next;
+};
+
+static long long memBudget=0;    // 0 for no limit
+static int memTracking=0;        // cached pages are tracked, see setMemoryBudget
+static long long memUsed=0;
+static long long memBytes[SM_MEM_KINDS];
+static long long memClock=0;
+static long long memEvictions=0;
+static long long memEvictedBytes=0;
+static long long memDeniedPages=0;
+static MemChunk* memNewest=0;
+static MemChunk* memOldest=0;
+static MemAccount* memAccounts=0;
+static int memNumAccounts=0;
+
+#ifdef __linux__
+static pthread_mutex_t memMutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*********************************************************************************
+ * Function:        memLock, memUnlock
+ * Description:     guard the accounts, the chunk list and the totals
+ **********************************************************************************/
+static void memLock(void)
+{
+#ifdef __linux__
+    pthread_mutex_lock(&memMutex);
+#endif
+}
+
+static void memUnlock(void)
+{
+#ifdef __linux__
+    pthread_mutex_unlock(&memMutex);
+#endif
+}
+
+/*********************************************************************************
+ * Function:        memCharge
+ * Description:     add bytes of a kind to an account and the totals, a negative 
+ *                  number takes them off; lock must be held
+ * Input:           MemAccount* a: account
+                    int kind: SM_MEM_CACHE, ...
+                    long long bytes: bytes to add
  * Output:          None
  * Return:          None
  **********************************************************************************/
-void writeDataBaseHeader(FILE* fp)
+static void memCharge(MemAccount* a, int kind, long long bytes)
 {
-    fwrite(&p_dataBaseHeader->currentPage,sizeof(int),1,fp);
-    fwrite(&p_dataBaseHeader->maxPageCount,sizeof(int),1,fp);
-    // allocate memory for other info that may be used except currentPage and maxPageCount
-    char* data=(char*)calloc(p_dataBaseHeader->sizeofHeader-sizeof(int)*2,1);
-    fwrite(data,1,p_dataBaseHeader->sizeofHeader-sizeof(int)*2,fp);
-	fflush(fp);
-	free(data);
+    a->bytes[kind]+=bytes;
+    memBytes[kind]+=bytes;
+    memUsed+=bytes;
 }
 
 /*********************************************************************************
- * Function:        readDataBaseHeader
- * Description:     Read file header from the beginning of a file
- * Input:           FILE* fp: file pointer
+ * Function:        memDropChunk
+ * Description:     take a chunk off the list of all chunks and out of its owner, 
+ *                  and free it; lock must be held
+ * Input:           MemChunk* c: chunk
  * Output:          None
  * Return:          None
  **********************************************************************************/
-void readDataBaseHeader(FILE* fp)
+static void memDropChunk(MemChunk* c)
 {
-    fread(&p_dataBaseHeader->currentPage,sizeof(int),1,fp);
-    fread(&p_dataBaseHeader->maxPageCount,sizeof(int),1,fp);
-    int length=p_dataBaseHeader->sizeofHeader-sizeof(int)*2;
-    p_dataBaseHeader->additionalInfo=(char*)malloc(length);
-    fread(p_dataBaseHeader->additionalInfo,1,length,fp);
+    MemAccount* a=c->owner;
+    MemChunk** link=&a->buckets[c->chunk%a->numBuckets];
+
+    if(c->newer!=0) c->newer->older=c->older; else memNewest=c->older;
+    if(c->older!=0) c->older->newer=c->newer; else memOldest=c->newer;
+    while(*link!=c)
+        link=&(*link)->next;
+    *link=c->next;
+    a->numChunks--;
+    free(c);
 }
 
 /*********************************************************************************
- * Function:        initStorageManager
- * Description:     initial storageManager
- * Input:           None
+ * Function:        memEvict
+ * Description:     give the pages of a chunk back to the OS and stop charging 
+ *                  them; lock must be held, so the owner can not close its file
+ * Input:           MemChunk* c: chunk
  * Output:          None
  * Return:          None
  **********************************************************************************/
-void initStorageManager()
+static void memEvict(MemChunk* c)
 {
-    p_dataBaseHeader=0;
+    MemAccount* a=c->owner;
+    long long bytes=(long long)PAGE_SIZE*__builtin_popcountll(c->pages);
+
+#ifdef __linux__
+    // only drops clean pages, dirty ones are written back first
+    posix_fadvise(a->fd,(off_t)PAGE_SIZE*MEM_CHUNK_PAGES*c->chunk+a->sizeofHeader,
+                  (off_t)PAGE_SIZE*MEM_CHUNK_PAGES,POSIX_FADV_DONTNEED);
+#endif
+    memCharge(a,SM_MEM_CACHE,-bytes);
+    memEvictions++;
+    memEvictedBytes+=bytes;
+    memDropChunk(c);
 }
 
 /*********************************************************************************
- * Function:        createPageFile
- * Description:     create a new page file with one page filled with '\0'
- * Input:           char* fileName: file name
+ * Function:        memMakeRoom
+ * Description:     evict the least recently used chunks until bytes more fit into
+ *                  the budget, but never the chunk keep; lock must be held
+ * Input:           long long bytes: bytes about to be charged
+                    MemChunk* keep: chunk that was just used, or 0
  * Output:          None
- * Return:          RC: return code
+ * Return:          None
  **********************************************************************************/
-RC createPageFile(char* fileName)
+static void memMakeRoom(long long bytes, MemChunk* keep)
 {
-    //check whether the file exsit, since we want to create, the file shouldn't exsit
-	int ret = _access(fileName,0);
-    
-    //if the file already exit, do not create and return error.
-    if(ret==0)
-    {
-        printf("The file %s already exsit! Do you mean to open the file?",fileName);
-        return RC_FILE_ALREADY_EXIST;
-    }
+    while(memBudget>0&&memUsed+bytes>memBudget&&memOldest!=0&&memOldest!=keep)
+        memEvict(memOldest);
+}
 
-    //create the file with mode "wb", and check if it has been successfully created
-    FILE* fp=fopen(fileName,"wb");
-    if(fp==0)
+/*********************************************************************************
+ * Function:        memFindChunk
+ * Description:     the chunk of an account with the given number, a new empty 
+ *                  one if it has none yet; lock must be held
+ * Input:           MemAccount* a: account
+                    int chunk: chunk number
+ * Output:          None
+ * Return:          MemChunk*: chunk, 0 if there is no memory for it
+ **********************************************************************************/
+static MemChunk* memFindChunk(MemAccount* a, int chunk)
+{
+    MemChunk* c;
+    int i;
+
+    if(a->numBuckets>0)
+        for(c=a->buckets[chunk%a->numBuckets];c!=0;c=c->next)
+            if(c->chunk==chunk)
+                return c;
+
+    // keep the buckets short
+    if(a->numChunks>=a->numBuckets)
     {
-        printf("Can not create the file %s!!",fileName);
-        return RC_FILE_OPEN_FAILED;
+        int numBuckets=a->numBuckets>0?a->numBuckets*2:16;
+        MemChunk** buckets=(MemChunk**)calloc(numBuckets,sizeof(MemChunk*));
+        if(buckets==0) return 0;
+        for(i=0;i<a->numBuckets;i++)
+            while(a->buckets[i]!=0)
+            {
+                c=a->buckets[i];
+                a->buckets[i]=c->next;
+                c->next=buckets[c->chunk%numBuckets];
+                buckets[c->chunk%numBuckets]=c;
+            }
+        free(a->buckets);
+        a->buckets=buckets;
+        a->numBuckets=numBuckets;
     }
 
-    //record the file header, and write it into the beginning of the file
-	initDataBaseHeader();
-    p_dataBaseHeader->maxPageCount=1;
-    p_dataBaseHeader->currentPage=0;
-    p_dataBaseHeader->filePointer=fp;
-    writeDataBaseHeader(fp);
+    c=(MemChunk*)calloc(1,sizeof(MemChunk));
+    if(c==0) return 0;
+    c->owner=a;
+    c->chunk=chunk;
+    c->next=a->buckets[chunk%a->numBuckets];
+    a->buckets[chunk%a->numBuckets]=c;
+    a->numChunks++;
+    // new chunks start as the most recently used
+    c->older=memNewest;
+    if(memNewest!=0) memNewest->newer=c; else memOldest=c;
+    memNewest=c;
+    return c;
+}
 
-    // write the page with '\0' into the file
-	char* data=(char*)calloc(PAGE_SIZE,1);
-	fwrite(data, 1, PAGE_SIZE, fp);
-    fflush(fp);
+/*********************************************************************************
+ * Function:        memTouch
+ * Description:     note that pages of a file were read, written or prefetched,
+ *                  so they are cached now: charge the new ones and make their 
+ *                  chunks the most recently used, then evict other chunks while
+ *                  the budget is exceeded
+ * Input:           MemAccount* a: account of the file, may be 0
+                    int pageNum: first page
+                    int numPages: number of pages
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void memTouch(MemAccount* a, int pageNum, int numPages)
+{
+    if(a==0||numPages<=0||!__atomic_load_n(&memTracking,__ATOMIC_RELAXED))
+        return;
 
-    fclose(fp);
+    memLock();
+    if(a->fd>=0)
+    {
+        MemChunk* c=0;
+        int page=pageNum, end=pageNum+numPages;
+        while(page<end)
+        {
+            int chunk=page/MEM_CHUNK_PAGES;
+            int last=(chunk+1)*MEM_CHUNK_PAGES<end?(chunk+1)*MEM_CHUNK_PAGES:end;
+            int n=last-page;
+            unsigned long long bits=(n==64?~0ULL:(1ULL<<n)-1)<<(page-chunk*MEM_CHUNK_PAGES);
 
-    // free data
-    free(data);
-    
-    return RC_OK;
+            c=memFindChunk(a,chunk);
+            if(c==0) break;
+            memCharge(a,SM_MEM_CACHE,(long long)PAGE_SIZE*__builtin_popcountll(bits&~c->pages));
+            c->pages|=bits;
+            if(c!=memNewest)
+            {
+                c->newer->older=c->older;
+                if(c->older!=0) c->older->newer=c->newer; else memOldest=c->newer;
+                c->newer=0;
+                c->older=memNewest;
+                memNewest->newer=c;
+                memNewest=c;
+            }
+            page=last;
+        }
+        a->lastUse=++memClock;
+        memMakeRoom(0,c);
+    }
+    memUnlock();
 }
 
 /*********************************************************************************
- * Function:        openPageFile
- * Description:     open an exist page file, read the file header to get the information 
- *                  and save these into handle
- * Input:           char* fileName: file name
- * Output:          SM_FileHandle *fHandle: file handle
- * Return:          RC: return code
+ * Function:        memReserve
+ * Description:     charge memory that can not be given back, after evicting 
+ *                  cached pages to make room for it. If the budget can not hold
+ *                  all of it, less is granted, but at least minBytes.
+ * Input:           MemAccount* a: account of the file, may be 0
+                    int kind: SM_MEM_WRITE_BEHIND, SM_MEM_STAGED or SM_MEM_TEMP
+                    long long bytes: bytes wanted
+                    long long minBytes: bytes needed
+ * Output:          None
+ * Return:          long long: bytes granted and charged
  **********************************************************************************/
-RC openPageFile(char *fileName, SM_FileHandle *fHandle)
+static long long memReserve(MemAccount* a, int kind, long long bytes, long long minBytes)
 {
-    //This function is almost the same as createPageFile
-
-    //check whether the file exsit.
-    int ret=_access(fileName,0|2);
+    if(a==0)
+        return bytes;
 
-    // Return error if the file doesn't exit.
-    if(ret!=0)
+    memLock();
+    memMakeRoom(bytes,0);
+    if(memBudget>0&&memUsed+bytes>memBudget)
     {
-        printf("The file %s does not exsit or have no permit to write!",fileName);
-        return RC_FILE_NOT_FOUND;
+        long long fit=memBudget-memUsed;
+        fit=fit>minBytes?fit:minBytes;
+        if(kind==SM_MEM_WRITE_BEHIND)
+            memDeniedPages+=(bytes-fit)/PAGE_SIZE;
+        bytes=fit;
     }
+    memCharge(a,kind,bytes);
+    a->lastUse=++memClock;
+    memUnlock();
+    return bytes;
+}
 
-    //open the file with mode 'rb', and check if it has been successfully created
-    FILE* fp=fopen(fileName,"rb+");
-    if(fp==0)
-    {
-        printf("Can not open the file %s!!",fileName);
-        return RC_FILE_OPEN_FAILED;
-    }
+/*********************************************************************************
+ * Function:        memRelease
+ * Description:     stop charging memory given back by a file
+ * Input:           MemAccount* a: account of the file, may be 0
+                    int kind: kind of memory
+                    long long bytes: bytes
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void memRelease(MemAccount* a, int kind, long long bytes)
+{
+    if(a==0)
+        return;
+    memLock();
+    memCharge(a,kind,-bytes);
+    memUnlock();
+}
 
-    //create a new dataBaseHeader,record the pointer
-    initDataBaseHeader();
-	p_dataBaseHeader->filePointer = fp;
+/*********************************************************************************
+ * Function:        memOpenAccount
+ * Description:     start accounting the memory of an open file. Without memory 
+ *                  for the account the file is simply not accounted.
+ * Called By:       openPageFile
+                    openTempPageFile
+ * Input:           DataBaseHeader* header: header of the open file
+                    const char* name: file name, 0 for a temporary file
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void memOpenAccount(DataBaseHeader* header, const char* name)
+{
+    MemAccount* a=(MemAccount*)calloc(1,sizeof(MemAccount));
+    if(a==0)
+        return;
+    snprintf(a->name,sizeof(a->name),"%s",name!=0?name:MEM_TEMP_NAME);
+    // the pages of a file in memory are charged as a whole, see spillTempFile
+    a->fd=header->temporary==TEMP_MEMORY?-1:fileno(header->filePointer);
+    a->sizeofHeader=header->sizeofHeader;
 
-    //read file header from file, and save the information in file handle
-    readDataBaseHeader(fp);
-    fHandle->mgmtInfo=p_dataBaseHeader;
-    fHandle->fileName=fileName;
-    fHandle->curPagePos=0;
-    fHandle->totalNumPages=p_dataBaseHeader->maxPageCount;
+    memLock();
+    a->lastUse=++memClock;
+    a->next=memAccounts;
+    if(memAccounts!=0) memAccounts->prev=a;
+    memAccounts=a;
+    memNumAccounts++;
+    memUnlock();
+    header->mem=a;
+}
 
-    return RC_OK;
+/*********************************************************************************
+ * Function:        memCloseAccount
+ * Description:     stop accounting a file, before its descriptor is closed
+ * Called By:       closePageFile
+ * Input:           DataBaseHeader* header: header of the open file
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void memCloseAccount(DataBaseHeader* header)
+{
+    MemAccount* a=header->mem;
+    int i;
+    if(a==0)
+        return;
+
+    memLock();
+    for(i=0;i<a->numBuckets;i++)
+        while(a->buckets[i]!=0)
+            memDropChunk(a->buckets[i]);
+    for(i=0;i<SM_MEM_KINDS;i++)
+        memCharge(a,i,-a->bytes[i]);
+    if(a->prev!=0) a->prev->next=a->next; else memAccounts=a->next;
+    if(a->next!=0) a->next->prev=a->prev;
+    memNumAccounts--;
+    memUnlock();
+
+    free(a->buckets);
+    free(a);
+    header->mem=0;
 }
 
 /*********************************************************************************
- * Function:        closePageFile
- * Description:     close a file
- * Input:           SM_FileHandle *fHandle: file handle
+ * Function:        memSpilled
+ * Description:     a temporary file moved from memory to disk, from now on its 
+ *                  pages are cached like those of any other file
+ * Called By:       spillTempFile
+ * Input:           DataBaseHeader* header: header of the open file
  * Output:          None
- * Return:          RC: return code
+ * Return:          None
  **********************************************************************************/
-RC closePageFile(SM_FileHandle *fHandle)
+static void memSpilled(DataBaseHeader* header)
 {
-    // check if the handle is valid
-    if(fHandle==0||fHandle->mgmtInfo==0)
+    MemAccount* a=header->mem;
+    if(a==0)
+        return;
+    memLock();
+    memCharge(a,SM_MEM_TEMP,-a->bytes[SM_MEM_TEMP]);
+    a->fd=fileno(header->filePointer);
+    memUnlock();
+}
+
+/*********************************************************************************
+  *Function:        extendPageFile
+  *Description:     grow the file to hold numPages zero pages. On Linux the new pages 
+  *                 are holes made by truncating, elsewhere zeros are written.
+  *Called By:       createPageFile
+  *                 appendEmptyBlock
+  *                 ensureCapacity
+  *Input:           DataBaseHeader* header: header of the open file
+  *                 int numPages: new number of pages
+  *Output:          None
+  *Return:          RC: return code
+**********************************************************************************/
+static RC extendPageFile(DataBaseHeader* header, int numPages)
+{
+    FILE* fp=header->filePointer;
+    long start=(long)PAGE_SIZE*header->maxPageCount+header->sizeofHeader;
+    long end=(long)PAGE_SIZE*numPages+header->sizeofHeader;
+
+    fflush(fp);
+    invalidateExtent(header);
+    // a temporary file in memory takes memory for its new pages
+    if(header->temporary==TEMP_MEMORY&&numPages>header->maxPageCount)
     {
-        printf("The fileHandle is Empty!!!");
-        return RC_FILE_HANDLE_NOT_INIT;
+        long long bytes=(long long)PAGE_SIZE*(numPages-header->maxPageCount);
+        memReserve(header->mem,SM_MEM_TEMP,bytes,bytes);
     }
+#ifdef __linux__
+    // a crash before the last checkpoint may have left unreferenced pages 
+    // behind the last page, cut them off first so the new pages read as zeros
+    if(ftruncate(fileno(fp),start)==0&&ftruncate(fileno(fp),end)==0)
+        return RC_OK;
+#endif
 
-    // update the information in header
-    p_dataBaseHeader=fHandle->mgmtInfo;
+    // write pages of zero bytes at the end of the file
+    char* data = (char*)calloc(PAGE_SIZE, 1);
+    fseek(fp,start,SEEK_SET);
+    for(;start<end;start+=PAGE_SIZE)
+    {
+        if(fwrite(data,1,PAGE_SIZE,fp)!=PAGE_SIZE)
+        {
+            free(data);
+            return RC_WRITE_FAILED;
+        }
+    }
+    free(data);
+    fflush(fp);
+    return RC_OK;
+}
 
-    // close file
-    fclose(p_dataBaseHeader->filePointer);
+/*********************************************************************************
+ * Function:        writeDataBaseHeader
+ * Description:     Write file header into the inactive header slot, then make 
+ *                  that slot the active one. The slot is written with a single
+ *                  fwrite and synced before returning.
+ * Input:           FILE* fp: file pointer
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeDataBaseHeader(FILE* fp)
+{
+    HeaderSlot slot;
+    int target=p_dataBaseHeader->activeSlot^1;
 
-    // write header to the file
-    peipei1
+    memset(&slot,0,sizeof(slot));
+    slot.magic=HEADER_MAGIC;
+    slot.version=HEADER_VERSION;
+    slot.sequence=p_dataBaseHeader->sequence+1;
+    slot.currentPage=p_dataBaseHeader->currentPage;
+    slot.maxPageCount=p_dataBaseHeader->maxPageCount;
+    // keep the other info that may be used except currentPage and maxPageCount
+    if(p_dataBaseHeader->additionalInfo!=0)
+        memcpy(slot.additionalInfo,p_dataBaseHeader->additionalInfo,HEADER_INFO_SIZE);
+    slot.checksum=headerChecksum(&slot);
 
-    //we should delete the dataBaseHeader stored in mgmtInfo and then delete the fHandle
-    free(p_dataBaseHeader->additionalInfo);
-    free(p_dataBaseHeader);
-    p_dataBaseHeader=0;
-	fHandle->mgmtInfo = 0;
+    fseek(fp,(long)target*HEADER_SLOT_STRIDE,SEEK_SET);
+    if(fwrite(&slot,sizeof(slot),1,fp)!=1)
+        return RC_WRITE_FAILED;
+    syncFile(fp);
 
+    p_dataBaseHeader->sequence=slot.sequence;
+    p_dataBaseHeader->activeSlot=target;
+    p_dataBaseHeader->headerDirty=0;
     return RC_OK;
 }
 
 /*********************************************************************************
- * Function:        destroyPageFile
- * Description:     destroy a file
- * Input:           char *fileName: file name
+ * Function:        readDataBaseHeader
+ * Description:     Read both header slots from the beginning of a file and keep
+ *                  the valid one with the highest sequence number
+ * Input:           FILE* fp: file pointer
  * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC destroyPageFile(char *fileName)
+RC readDataBaseHeader(FILE* fp)
 {
-    //check whether the file is exsit. 
-    int ret=_access(fileName,0);
+    HeaderSlot slot;
+    int i, found=0;
 
-    // Return error if it doesn't exit.
-    if(ret!=0)
+    p_dataBaseHeader->additionalInfo=(char*)calloc(HEADER_INFO_SIZE,1);
+    for(i=0;i<2;i++)
     {
-        printf("The file %s does not exsit!",fileName);
-        return RC_FILE_NOT_FOUND;
+        fseek(fp,(long)i*HEADER_SLOT_STRIDE,SEEK_SET);
+        if(fread(&slot,sizeof(slot),1,fp)!=1)
+            continue;
+        // skip torn or foreign slots
+        if(slot.magic!=HEADER_MAGIC||slot.version!=HEADER_VERSION||
+           slot.checksum!=headerChecksum(&slot))
+            continue;
+        if(found&&slot.sequence<=p_dataBaseHeader->sequence)
+            continue;
+
+        found=1;
+        p_dataBaseHeader->sequence=slot.sequence;
+        p_dataBaseHeader->activeSlot=i;
+        p_dataBaseHeader->currentPage=slot.currentPage;
+        p_dataBaseHeader->maxPageCount=slot.maxPageCount;
+        memcpy(p_dataBaseHeader->additionalInfo,slot.additionalInfo,HEADER_INFO_SIZE);
     }
 
-    // remove file and check if it is successfully.
-    ret=remove(fileName);
-    if(ret!=0)
+    if(!found)
     {
-        printf("Error in remove the file! Please check the permission!");
-        return RC_FILE_REMOVE_FAILED;
+        THROW_LOG(RC_FILE_HEADER_CORRUPT, LOG_LEVEL_ERROR, "No valid file header found, the file is not a page file or is damaged!");
     }
-
+    p_dataBaseHeader->headerDirty=0;
     return RC_OK;
 }
 
 /*********************************************************************************
- * Function:        check_readBlock_commonError
- * Description:     check if handle is valid
- * Input:           SM_FileHandle* fHandle: file handle
- * Output:          None
- * Return:          RC: return code
+ * Function:        sidecarName
+ * Description:     name of a file kept next to a page file, e.g. its summaries
+ * Input:           const char* fileName: name of the page file
+                    const char* suffix: suffix of the side file
+ * Return:          char*: new string, 0 if out of memory
  **********************************************************************************/
-RC check_readBlock_commonError(SM_FileHandle* fHandle)
+static char* sidecarName(const char* fileName, const char* suffix)
+{
+    char* name=(char*)malloc(strlen(fileName)+strlen(suffix)+1);
+    if(name!=0)
+        sprintf(name,"%s%s",fileName,suffix);
+    return name;
+}
+
+/*********************************************************************************
+ * Function:        sidecarExists / removeSidecar
+ * Description:     whether a side file of a page file exists / remove it if so
+ **********************************************************************************/
+static int sidecarExists(const char* fileName, const char* suffix)
+{
+    char* name=sidecarName(fileName,suffix);
+    int found=name!=0&&_access(name,0)==0;
+    free(name);
+    return found;
+}
+
+static void removeSidecar(const char* fileName, const char* suffix)
+{
+    char* name=sidecarName(fileName,suffix);
+    if(name!=0&&_access(name,0)==0)
+        remove(name);
+    free(name);
+}
+
+/*********************************************************************************
+ * Function:        compareInts
+ * Description:     qsort order of page numbers
+ **********************************************************************************/
+static int compareInts(const void* a, const void* b)
+{
+    int x=*(const int*)a, y=*(const int*)b;
+    return (x>y)-(x<y);
+}
+
+/*  page memory: buffers of whole pages for large caches. With
+ *  SM_MEM_HUGEPAGES they are backed by 2 MB pages, explicit ones from the
+ *  hugetlb pool if it has room, else transparent ones asked for with
+ *  madvise on a 2 MB aligned mapping; one TLB entry then covers 512 pages.
+ *  With SM_MEM_LOCKED they are mlock'ed so the hot set is not swapped out.
+ *  Both are best effort: a buffer the system will not lock or back with
+ *  huge pages is still handed out. Mapped buffers are kept in a small table,
+ *  so freePageMemory knows how to release any buffer it is given. */
+#define HUGE_PAGE_SIZE      (2UL*1024*1024)
+
+static int pageMemoryFlags=0;
+
+#ifdef __linux__
+#include <sys/mman.h>
+
+typedef struct PageMapping{
+    char* addr;
+    size_t length;
+}PageMapping;
+
+static pthread_mutex_t pageMemoryLock=PTHREAD_MUTEX_INITIALIZER;
+static PageMapping* pageMappings=0;
+static int numPageMappings=0;
+static int pageMappingCapacity=0;
+
+/*********************************************************************************
+ * Function:        mapHugePages
+ * Description:     map length bytes, a multiple of HUGE_PAGE_SIZE, backed by
+ *                  huge pages if the system has any to give
+ * Return:          char*: the mapping, 0 if out of memory
+ **********************************************************************************/
+static char* mapHugePages(size_t length)
+{
+    char* addr;
+
+#ifdef MAP_HUGETLB
+    addr=(char*)mmap(0,length,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    if(addr!=MAP_FAILED)
+        return addr;
+#endif
+    // map one huge page more and cut it down to an aligned range, so the
+    // kernel can use transparent huge pages for all of it
+    addr=(char*)mmap(0,length+HUGE_PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(addr==MAP_FAILED)
+        return 0;
+    size_t head=(HUGE_PAGE_SIZE-(size_t)addr%HUGE_PAGE_SIZE)%HUGE_PAGE_SIZE;
+    if(head>0)
+        munmap(addr,head);
+    munmap(addr+head+length,HUGE_PAGE_SIZE-head);
+    addr+=head;
+#ifdef MADV_HUGEPAGE
+    madvise(addr,length,MADV_HUGEPAGE);
+#endif
+    return addr;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        setPageMemoryFlags
+ * Description:     choose how allocPageMemory backs the buffers allocated from
+ *                  now on, for the caller and for the storage manager itself
+ * Input:           int flags: SM_MEM_HUGEPAGES and SM_MEM_LOCKED, or 0 for
+ *                             plain heap memory
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+void setPageMemoryFlags(int flags)
+{
+    pageMemoryFlags=flags;
+}
+
+/*********************************************************************************
+ * Function:        allocPageMemory
+ * Description:     allocate a buffer of numPages pages as set with
+ *                  setPageMemoryFlags. The memory is not cleared.
+ * Input:           int numPages: number of pages
+ * Output:          None
+ * Return:          SM_PageHandle: the buffer, 0 if out of memory
+ **********************************************************************************/
+SM_PageHandle allocPageMemory(int numPages)
+{
+    int flags=pageMemoryFlags;
+    size_t length=(size_t)(numPages>0?numPages:1)*PAGE_SIZE;
+
+#ifdef __linux__
+    if(flags!=0)
+    {
+        char* addr;
+
+        if(flags&SM_MEM_HUGEPAGES)
+        {
+            length=(length+HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+            addr=mapHugePages(length);
+        }
+        else
+        {
+            addr=(char*)mmap(0,length,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+            if(addr==MAP_FAILED)
+                addr=0;
+        }
+        if(addr==0)
+            return 0;
+        // past RLIMIT_MEMLOCK the buffer just stays pageable
+        if(flags&SM_MEM_LOCKED)
+            mlock(addr,length);
+
+        pthread_mutex_lock(&pageMemoryLock);
+        if(numPageMappings==pageMappingCapacity)
+        {
+            int capacity=pageMappingCapacity>0?2*pageMappingCapacity:16;
+            PageMapping* mappings=(PageMapping*)realloc(pageMappings,capacity*sizeof(PageMapping));
+            if(mappings==0)
+            {
+                pthread_mutex_unlock(&pageMemoryLock);
+                munmap(addr,length);
+                return 0;
+            }
+            pageMappings=mappings;
+            pageMappingCapacity=capacity;
+        }
+        pageMappings[numPageMappings].addr=addr;
+        pageMappings[numPageMappings].length=length;
+        numPageMappings++;
+        pthread_mutex_unlock(&pageMemoryLock);
+        return addr;
+    }
+#else
+    (void)flags;
+#endif
+    return (SM_PageHandle)malloc(length);
+}
+
+/*********************************************************************************
+ * Function:        freePageMemory
+ * Description:     release a buffer from allocPageMemory, 0 is ignored
+ * Input:           SM_PageHandle memPages: the buffer
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+void freePageMemory(SM_PageHandle memPages)
+{
+    if(memPages==0)
+        return;
+#ifdef __linux__
+    int i;
+    pthread_mutex_lock(&pageMemoryLock);
+    for(i=0;i<numPageMappings;i++)
+        if(pageMappings[i].addr==memPages)
+        {
+            PageMapping m=pageMappings[i];
+            pageMappings[i]=pageMappings[--numPageMappings];
+            pthread_mutex_unlock(&pageMemoryLock);
+            // munmap drops the lock of the pages too
+            munmap(m.addr,m.length);
+            return;
+        }
+    pthread_mutex_unlock(&pageMemoryLock);
+#endif
+    free(memPages);
+}
+
+/*  page summaries: for every page written with a page extractor set, the
+ *  smallest and largest key of the page and a Bloom filter of its keys.
+ *  They live in memory while the file is open and in "<file>.sum", a page
+ *  file of its own: page 0 holds SummaryFileHeader, then SUMMARIES_PER_PAGE
+ *  PageSummary entries per page. Before the first change after an open or
+ *  checkpoint, page 0 is marked not clean and synced; a checkpoint syncs the
+ *  data, writes the changed entries and marks it clean again. Summaries of a
+ *  file that was not closed cleanly are dropped on open, so they never claim
+ *  a page does not hold a key it holds.  */
+#define SUMMARY_MAGIC        0x314d5553   /* "SUM1" */
+#define SUMMARY_SUFFIX       ".sum"
+#define SUMMARY_BLOOM_BYTES  104
+#define SUMMARY_BLOOM_HASHES 4
+#define SUMMARY_MAX_KEYS     1024
+
+typedef struct PageSummary{
+    unsigned long long min;
+    unsigned long long max;
+    unsigned int numKeys;
+    unsigned int known;      // 0: nothing is known, the page may hold anything
+    unsigned char bloom[SUMMARY_BLOOM_BYTES];
+}PageSummary;
+
+#define SUMMARIES_PER_PAGE   ((int)(PAGE_SIZE/sizeof(PageSummary)))
+
+typedef struct SummaryFileHeader{
+    unsigned int magic;
+    int clean;
+    int numEntries;
+}SummaryFileHeader;
+
+struct PageSummaries{
+    SM_FileHandle fh;        // the summary file
+    char* fileName;
+    PageSummary* entries;
+    int numEntries;
+    int capacity;            // a multiple of SUMMARIES_PER_PAGE
+    unsigned char* dirty;    // per summary page
+    int clean;               // the summary file is marked clean
+    SM_PageKeys pageKeys;
+    void* ctx;
+    unsigned long long* keys;
+};
+
+/*********************************************************************************
+ * Function:        growSummaries
+ * Description:     make room for the entry of a page, new entries are unknown
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC growSummaries(PageSummaries* s, int pageNum)
+{
+    if(pageNum<s->capacity)
+        return RC_OK;
+    int capacity=(pageNum/SUMMARIES_PER_PAGE+1)*SUMMARIES_PER_PAGE;
+    if(capacity<2*s->capacity)
+        capacity=2*s->capacity;
+    PageSummary* entries=(PageSummary*)realloc(s->entries,(size_t)capacity*sizeof(PageSummary));
+    if(entries==0) return RC_ERROR;
+    s->entries=entries;
+    unsigned char* dirty=(unsigned char*)realloc(s->dirty,capacity/SUMMARIES_PER_PAGE);
+    if(dirty==0) return RC_ERROR;
+    s->dirty=dirty;
+    memset(s->entries+s->capacity,0,(size_t)(capacity-s->capacity)*sizeof(PageSummary));
+    memset(s->dirty+s->capacity/SUMMARIES_PER_PAGE,0,(capacity-s->capacity)/SUMMARIES_PER_PAGE);
+    s->capacity=capacity;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeSummaryHeader
+ * Description:     write page 0 of the summary file and sync it
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeSummaryHeader(PageSummaries* s, int clean)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    SummaryFileHeader h;
+    RC ret;
+
+    if(page==0) return RC_ERROR;
+    h.magic=SUMMARY_MAGIC;
+    h.clean=clean;
+    h.numEntries=s->numEntries;
+    memcpy(page,&h,sizeof(h));
+    ret=writeBlock(0,&s->fh,page);
+    if(ret==RC_OK)
+        syncFile(((DataBaseHeader*)s->fh.mgmtInfo)->filePointer);
+    free(page);
+    p_dataBaseHeader=saved;
+    if(ret==RC_OK)
+        s->clean=clean;
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        openSummaries
+ * Description:     open the summary file of a page file and read the summaries,
+ *                  create it if asked to
+ * Input:           DataBaseHeader* header: header of the open page file
+                    char* fileName: name of the page file
+                    int create: create a missing summary file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC openSummaries(DataBaseHeader* header, char* fileName, int create)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    PageSummaries* s=(PageSummaries*)calloc(1,sizeof(PageSummaries));
+    SummaryFileHeader h;
+    char* page=(char*)malloc(PAGE_SIZE);
+    RC ret=RC_OK;
+
+    if(s==0||page==0)
+    {
+        free(s);
+        free(page);
+        return RC_ERROR;
+    }
+    s->fileName=sidecarName(fileName,SUMMARY_SUFFIX);
+    s->keys=(unsigned long long*)malloc(SUMMARY_MAX_KEYS*sizeof(unsigned long long));
+    if(s->fileName==0||s->keys==0)
+        ret=RC_ERROR;
+    else if(_access(s->fileName,0)!=0)
+    {
+        if(create)
+            ret=createPageFile(s->fileName);
+        else
+            ret=RC_FILE_NOT_FOUND;
+        if(ret==RC_OK)
+            ret=openPageFile(s->fileName,&s->fh);
+        if(ret==RC_OK)
+            ret=writeSummaryHeader(s,1);
+    }
+    else
+    {
+        ret=openPageFile(s->fileName,&s->fh);
+        if(ret==RC_OK)
+            ret=readBlock(0,&s->fh,page);
+        if(ret==RC_OK)
+        {
+            memcpy(&h,page,sizeof(h));
+            // summaries that may be behind the data are of no use
+            if(h.magic==SUMMARY_MAGIC&&h.clean&&h.numEntries>0)
+            {
+                int pages=(h.numEntries+SUMMARIES_PER_PAGE-1)/SUMMARIES_PER_PAGE;
+                ret=growSummaries(s,h.numEntries-1);
+                if(ret==RC_OK&&pages+1<=s->fh.totalNumPages)
+                    ret=readBlocks(1,pages,&s->fh,(SM_PageHandle)s->entries);
+                else
+                    memset(s->entries,0,(size_t)s->capacity*sizeof(PageSummary));
+                if(ret==RC_OK)
+                    s->numEntries=h.numEntries;
+            }
+            s->clean=h.magic==SUMMARY_MAGIC&&h.clean;
+        }
+    }
+    free(page);
+    p_dataBaseHeader=saved;
+
+    if(ret!=RC_OK)
+    {
+        if(s->fh.mgmtInfo!=0)
+        {
+            closePageFile(&s->fh);
+            p_dataBaseHeader=saved;
+        }
+        free(s->fileName);
+        free(s->keys);
+        free(s->entries);
+        free(s->dirty);
+        free(s);
+        return ret;
+    }
+    header->summaries=s;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeSummaries
+ * Description:     after syncing the data, write the changed summary pages and
+ *                  mark the summary file clean
+ * Called By:       checkpointPageFile
+ * Input:           DataBaseHeader* header: header of the open page file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeSummaries(DataBaseHeader* header)
+{
+    PageSummaries* s=header->summaries;
+    DataBaseHeader* saved=p_dataBaseHeader;
+    RC ret=RC_OK;
+    int i;
+
+    if(s==0||s->clean)
+        return RC_OK;
+    syncFile(header->filePointer);
+
+    int pages=(s->numEntries+SUMMARIES_PER_PAGE-1)/SUMMARIES_PER_PAGE;
+    if(pages+1>s->fh.totalNumPages)
+        ret=ensureCapacity(pages+1,&s->fh);
+    for(i=0;ret==RC_OK&&i<pages;i++)
+    {
+        if(!s->dirty[i])
+            continue;
+        ret=writeBlock(i+1,&s->fh,(SM_PageHandle)(s->entries+(long)i*SUMMARIES_PER_PAGE));
+        if(ret==RC_OK)
+            s->dirty[i]=0;
+    }
+    p_dataBaseHeader=saved;
+    if(ret==RC_OK)
+        ret=writeSummaryHeader(s,1);
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        closeSummaries
+ * Description:     close the summary file and free the summaries
+ **********************************************************************************/
+static void closeSummaries(DataBaseHeader* header)
+{
+    PageSummaries* s=header->summaries;
+    DataBaseHeader* saved=p_dataBaseHeader;
+
+    if(s==0)
+        return;
+    closePageFile(&s->fh);
+    p_dataBaseHeader=saved;
+    free(s->fileName);
+    free(s->keys);
+    free(s->entries);
+    free(s->dirty);
+    free(s);
+    header->summaries=0;
+}
+
+/*********************************************************************************
+ * Function:        summaryEntry
+ * Description:     the entry of a page about to change; the summary file is
+ *                  marked not clean first
+ * Return:          PageSummary*: the entry, 0 on an error
+ **********************************************************************************/
+static PageSummary* summaryEntry(PageSummaries* s, int pageNum)
+{
+    if(pageNum<0)
+        return 0;
+    if(s->clean&&writeSummaryHeader(s,0)!=RC_OK)
+        return 0;
+    if(growSummaries(s,pageNum)!=RC_OK)
+        return 0;
+    // entries between the old end and this one are unknown, and so must be on disk
+    for(;s->numEntries<=pageNum;s->numEntries++)
+        s->dirty[s->numEntries/SUMMARIES_PER_PAGE]=1;
+    s->dirty[pageNum/SUMMARIES_PER_PAGE]=1;
+    return &s->entries[pageNum];
+}
+
+/*********************************************************************************
+ * Function:        bloomHash
+ * Description:     64 bit mix of a key, two halves give the Bloom filter probes
+ **********************************************************************************/
+static unsigned long long bloomHash(unsigned long long key)
+{
+    key^=key>>33;
+    key*=0xff51afd7ed558ccdULL;
+    key^=key>>33;
+    key*=0xc4ceb9fe1a85ec53ULL;
+    key^=key>>33;
+    return key;
+}
+
+/*********************************************************************************
+ * Function:        summarizePage
+ * Description:     refresh the summary of a page that is being written
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number
+                    char* memPage: new page content
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC summarizePage(DataBaseHeader* header, int pageNum, char* memPage)
+{
+    PageSummaries* s=header->summaries;
+    int n, i, k;
+
+    if(s==0)
+        return RC_OK;
+    PageSummary* e=summaryEntry(s,pageNum);
+    if(e==0)
+        THROW(RC_WRITE_FAILED, "can not update the page summaries");
+
+    n=s->pageKeys!=0?s->pageKeys(pageNum,memPage,s->keys,SUMMARY_MAX_KEYS,s->ctx):-1;
+    memset(e,0,sizeof(PageSummary));
+    if(n<0)
+        return RC_OK;
+    e->known=1;
+    e->numKeys=n;
+    e->min=~0ULL;
+    for(i=0;i<n;i++)
+    {
+        unsigned long long h=bloomHash(s->keys[i]);
+        unsigned int h1=(unsigned int)h, h2=(unsigned int)(h>>32)|1;
+        if(s->keys[i]<e->min) e->min=s->keys[i];
+        if(s->keys[i]>e->max) e->max=s->keys[i];
+        for(k=0;k<SUMMARY_BLOOM_HASHES;k++)
+        {
+            unsigned int bit=(h1+k*h2)%(SUMMARY_BLOOM_BYTES*8);
+            e->bloom[bit>>3]|=(unsigned char)(1<<(bit&7));
+        }
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        forgetPage
+ * Description:     a page changed in a way that is not summarized, from now on
+ *                  it may hold anything
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC forgetPage(DataBaseHeader* header, int pageNum)
+{
+    PageSummaries* s=header->summaries;
+
+    if(s==0||pageNum<0||pageNum>=s->numEntries||!s->entries[pageNum].known)
+        return RC_OK;
+    PageSummary* e=summaryEntry(s,pageNum);
+    if(e==0)
+        THROW(RC_WRITE_FAILED, "can not update the page summaries");
+    e->known=0;
+    return RC_OK;
+}
+
+/*  change tracking: a bitmap of the pages written since the last backup
+ *  epoch, in memory and in "<file>.chg", a page file: page 0 holds
+ *  ChangeFileHeader, the bitmap follows with CHANGE_BITS_PER_PAGE pages per
+ *  page. Like the summaries it is marked not clean before the first change
+ *  after an open or checkpoint and clean again by the checkpoint; if it was
+ *  not, every page counts as changed on open, so a backup never misses one.
+ *  Pages added at the end are not marked, a delta records the page count
+ *  and new pages are zeros on both sides until they are written.
+ *
+ *  A delta file is a DeltaHeader page, the numbers of its pages padded to
+ *  whole pages, then the page images. The copy a delta is applied to keeps
+ *  its epoch in a change file of its own. */
+#define CHANGE_MAGIC         0x31474843   /* "CHG1" */
+#define CHANGE_SUFFIX        ".chg"
+#define CHANGE_BITS_PER_PAGE (PAGE_SIZE*8)
+#define CHANGE_WORDS_PER_PAGE (PAGE_SIZE/8)
+#define DELTA_MAGIC          0x31544c44   /* "DLT1" */
+#define DELTA_BATCH_PAGES    64
+
+typedef struct ChangeFileHeader{
+    unsigned int magic;
+    int clean;
+    int epoch;
+}ChangeFileHeader;
+
+typedef struct DeltaHeader{
+    unsigned int magic;
+    int fromEpoch;
+    int toEpoch;
+    int totalNumPages;
+    int numPages;            // pages in the delta
+}DeltaHeader;
+
+struct ChangeTracking{
+    SM_FileHandle fh;        // the change file
+    int epoch;
+    unsigned long long* bits;
+    int capacity;            // pages, a multiple of CHANGE_BITS_PER_PAGE
+    unsigned char* dirty;    // per bitmap page
+    int clean;               // the change file is marked clean
+};
+
+/*********************************************************************************
+ * Function:        growChanges
+ * Description:     make room in the bitmap for a page
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC growChanges(ChangeTracking* c, int pageNum)
+{
+    if(pageNum<c->capacity)
+        return RC_OK;
+    int capacity=(pageNum/CHANGE_BITS_PER_PAGE+1)*CHANGE_BITS_PER_PAGE;
+    unsigned long long* bits=(unsigned long long*)realloc(c->bits,(size_t)capacity/8);
+    if(bits==0) return RC_ERROR;
+    c->bits=bits;
+    unsigned char* dirty=(unsigned char*)realloc(c->dirty,capacity/CHANGE_BITS_PER_PAGE);
+    if(dirty==0) return RC_ERROR;
+    c->dirty=dirty;
+    memset((char*)c->bits+c->capacity/8,0,(size_t)(capacity-c->capacity)/8);
+    memset(c->dirty+c->capacity/CHANGE_BITS_PER_PAGE,0,(capacity-c->capacity)/CHANGE_BITS_PER_PAGE);
+    c->capacity=capacity;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        markChanged
+ * Description:     set the bits of count pages starting at pageNum
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC markChanged(ChangeTracking* c, int pageNum, int count)
+{
+    int p;
+
+    if(count<=0)
+        return RC_OK;
+    if(growChanges(c,pageNum+count-1)!=RC_OK)
+        return RC_ERROR;
+    for(p=pageNum;p<pageNum+count;p++)
+    {
+        c->bits[p>>6]|=1ULL<<(p&63);
+        c->dirty[p/CHANGE_BITS_PER_PAGE]=1;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeChangeHeader
+ * Description:     write page 0 of the change file and sync it
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeChangeHeader(ChangeTracking* c, int clean)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    ChangeFileHeader h;
+    RC ret;
+
+    if(page==0) return RC_ERROR;
+    h.magic=CHANGE_MAGIC;
+    h.clean=clean;
+    h.epoch=c->epoch;
+    memcpy(page,&h,sizeof(h));
+    ret=writeBlock(0,&c->fh,page);
+    if(ret==RC_OK)
+        syncFile(((DataBaseHeader*)c->fh.mgmtInfo)->filePointer);
+    free(page);
+    p_dataBaseHeader=saved;
+    if(ret==RC_OK)
+        c->clean=clean;
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        saveChanges
+ * Description:     write the changed bitmap pages and mark the change file clean
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC saveChanges(ChangeTracking* c)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    int pages=c->capacity/CHANGE_BITS_PER_PAGE, i;
+    RC ret=RC_OK;
+
+    if(pages+1>c->fh.totalNumPages)
+        ret=ensureCapacity(pages+1,&c->fh);
+    for(i=0;ret==RC_OK&&i<pages;i++)
+    {
+        if(!c->dirty[i])
+            continue;
+        ret=writeBlock(i+1,&c->fh,(SM_PageHandle)(c->bits+(long)i*CHANGE_WORDS_PER_PAGE));
+        if(ret==RC_OK)
+            c->dirty[i]=0;
+    }
+    p_dataBaseHeader=saved;
+    if(ret==RC_OK)
+        ret=writeChangeHeader(c,1);
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        openChanges
+ * Description:     open the change file of a page file and read the bitmap,
+ *                  create it if asked to, with every page marked
+ * Input:           DataBaseHeader* header: header of the open page file
+                    char* fileName: name of the page file
+                    int create: create a missing change file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC openChanges(DataBaseHeader* header, char* fileName, int create)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    ChangeTracking* c=(ChangeTracking*)calloc(1,sizeof(ChangeTracking));
+    char* name=sidecarName(fileName,CHANGE_SUFFIX);
+    char* page=(char*)malloc(PAGE_SIZE);
+    ChangeFileHeader h;
+    int known=0;
+    RC ret=RC_OK;
+
+    if(c==0||name==0||page==0)
+        ret=RC_ERROR;
+    else if(_access(name,0)!=0)
+    {
+        ret=create?createPageFile(name):RC_FILE_NOT_FOUND;
+        if(ret==RC_OK)
+            ret=openPageFile(name,&c->fh);
+        if(ret==RC_OK)
+            ret=writeChangeHeader(c,0);
+    }
+    else
+    {
+        ret=openPageFile(name,&c->fh);
+        if(ret==RC_OK)
+            ret=readBlock(0,&c->fh,page);
+        if(ret==RC_OK)
+        {
+            memcpy(&h,page,sizeof(h));
+            if(h.magic==CHANGE_MAGIC)
+                c->epoch=h.epoch;
+            c->clean=h.magic==CHANGE_MAGIC&&h.clean;
+            // a bitmap that may be behind the data can not be trusted
+            int pages=c->fh.totalNumPages-1;
+            if(c->clean&&pages>0)
+            {
+                ret=growChanges(c,pages*CHANGE_BITS_PER_PAGE-1);
+                if(ret==RC_OK)
+                    ret=readBlocks(1,pages,&c->fh,(SM_PageHandle)c->bits);
+                known=ret==RC_OK;
+            }
+            else
+                known=c->clean;
+        }
+    }
+    if(ret==RC_OK&&!known)
+    {
+        if(c->clean)
+            ret=writeChangeHeader(c,0);
+        if(ret==RC_OK)
+            ret=markChanged(c,0,header->maxPageCount);
+    }
+    free(name);
+    free(page);
+    p_dataBaseHeader=saved;
+
+    if(ret!=RC_OK)
+    {
+        if(c!=0)
+        {
+            if(c->fh.mgmtInfo!=0)
+            {
+                closePageFile(&c->fh);
+                p_dataBaseHeader=saved;
+            }
+            free(c->bits);
+            free(c->dirty);
+            free(c);
+        }
+        return ret;
+    }
+    header->changes=c;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeChanges
+ * Description:     after syncing the data, save the bitmap
+ * Called By:       checkpointPageFile
+ * Input:           DataBaseHeader* header: header of the open page file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeChanges(DataBaseHeader* header)
+{
+    ChangeTracking* c=header->changes;
+
+    if(c==0||c->clean)
+        return RC_OK;
+    syncFile(header->filePointer);
+    return saveChanges(c);
+}
+
+/*********************************************************************************
+ * Function:        closeChanges
+ * Description:     close the change file and free the bitmap
+ **********************************************************************************/
+static void closeChanges(DataBaseHeader* header)
+{
+    ChangeTracking* c=header->changes;
+    DataBaseHeader* saved=p_dataBaseHeader;
+
+    if(c==0)
+        return;
+    closePageFile(&c->fh);
+    p_dataBaseHeader=saved;
+    free(c->bits);
+    free(c->dirty);
+    free(c);
+    header->changes=0;
+}
+
+/*********************************************************************************
+ * Function:        trackChange
+ * Description:     mark pages about to be written; the change file is marked
+ *                  not clean first
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: first page
+                    int count: number of pages
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC trackChange(DataBaseHeader* header, int pageNum, int count)
+{
+    ChangeTracking* c=header->changes;
+
+    if(c==0)
+        return RC_OK;
+    // the bitmap has no bits before page 0
+    if(pageNum<0)
+        THROW(RC_WRITE_NON_EXISTING_PAGE, "can not track changes of a negative page");
+    if((c->clean&&writeChangeHeader(c,0)!=RC_OK)||markChanged(c,pageNum,count)!=RC_OK)
+        THROW(RC_WRITE_FAILED, "can not update the changed pages");
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        startEpoch
+ * Description:     clear the bitmap and move to a new epoch, marking the change
+ *                  file not clean while the bitmap pages are rewritten
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC startEpoch(ChangeTracking* c, int epoch)
+{
+    int i;
+
+    if(c->clean)
+    {
+        RC ret=writeChangeHeader(c,0);
+        if(ret!=RC_OK) return ret;
+    }
+    for(i=0;i<c->capacity/CHANGE_BITS_PER_PAGE;i++)
+    {
+        unsigned long long* words=c->bits+(long)i*CHANGE_WORDS_PER_PAGE;
+        int w;
+        for(w=0;w<CHANGE_WORDS_PER_PAGE&&words[w]==0;w++)
+            ;
+        if(w<CHANGE_WORDS_PER_PAGE)
+        {
+            memset(words,0,PAGE_SIZE);
+            c->dirty[i]=1;
+        }
+    }
+    c->epoch=epoch;
+    return saveChanges(c);
+}
+
+/*********************************************************************************
+ * Function:        copyFileData
+ * Description:     copy length bytes between two files at the given offsets,
+ *                  in the kernel if it can (copy_file_range, then sendfile)
+ * Return:          int: 1 if everything was copied, else 0
+ **********************************************************************************/
+static int copyFileData(FILE* in, long inOff, FILE* out, long outOff, long length)
+{
+#ifdef __linux__
+    int inFd=fileno(in), outFd=fileno(out);
+    loff_t inPos=inOff, outPos=outOff;
+
+    fflush(in);
+    fflush(out);
+    while(length>0)
+    {
+        ssize_t n=-1;
+#ifdef __NR_copy_file_range
+        n=syscall(__NR_copy_file_range,inFd,&inPos,outFd,&outPos,(size_t)length,0);
+#endif
+        if(n<=0)
+        {
+            // other file systems, older kernels
+            off_t pos=(off_t)inPos;
+            n=lseek(outFd,(off_t)outPos,SEEK_SET)<0?-1:sendfile(outFd,inFd,&pos,(size_t)length);
+            if(n>0)
+            {
+                inPos+=n;
+                outPos+=n;
+            }
+        }
+        if(n<=0)
+            return 0;
+        length-=n;
+    }
+    return 1;
+#else
+    char* buf=(char*)malloc(PAGE_SIZE);
+    int ok=buf!=0;
+
+    fseek(in,inOff,SEEK_SET);
+    fseek(out,outOff,SEEK_SET);
+    for(;ok&&length>0;length-=PAGE_SIZE)
+        ok=fread(buf,1,PAGE_SIZE,in)==PAGE_SIZE&&fwrite(buf,1,PAGE_SIZE,out)==PAGE_SIZE;
+    free(buf);
+    fflush(out);
+    return ok;
+#endif
+}
+
+/*  hot pages: with a hot page list enabled, readBlock and readBlocks count
+ *  the reads of every page. A checkpoint after new reads and closePageFile
+ *  save the maxPages most read pages, sorted by page number, to
+ *  "<file>.hot", a page file with HotFileHeader on page 0 and the page
+ *  numbers from page 1 on. After a restart warmUpPageFile hands the saved
+ *  list to prefetchBlocks, which reads it into the page cache in large
+ *  background reads. The pages of the saved list start with a count of 1,
+ *  so a short run keeps the list unless it finds hotter pages. The list is
+ *  only a hint: a stale or lost one costs reads, never data. */
+#define HOT_MAGIC          0x31544f48   /* "HOT1" */
+#define HOT_SUFFIX         ".hot"
+#define HOT_PAGES_PER_PAGE ((int)(PAGE_SIZE/sizeof(int)))
+
+typedef struct HotFileHeader{
+    unsigned int magic;
+    int maxPages;
+    int numPages;
+}HotFileHeader;
+
+typedef struct HotCount{
+    unsigned int count;
+    int pageNum;
+}HotCount;
+
+struct HotPages{
+    SM_FileHandle fh;        // the hot page file
+    int maxPages;            // longest list to save
+    unsigned int* counts;    // reads per page
+    int capacity;
+    int* list;               // the saved list, sorted by page number
+    int numList;
+    int dirty;               // reads since the list was saved
+};
+
+/*********************************************************************************
+ * Function:        growHotCounts
+ * Description:     make room for the read count of a page, new counts are 0
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC growHotCounts(HotPages* h, int pageNum)
+{
+    if(pageNum<h->capacity)
+        return RC_OK;
+    int capacity=pageNum+1<2*h->capacity?2*h->capacity:pageNum+1024;
+    unsigned int* counts=(unsigned int*)realloc(h->counts,(size_t)capacity*sizeof(unsigned int));
+    if(counts==0) return RC_ERROR;
+    memset(counts+h->capacity,0,(size_t)(capacity-h->capacity)*sizeof(unsigned int));
+    h->counts=counts;
+    h->capacity=capacity;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        freeHotPages
+ * Description:     close the hot page file and free the counts
+ **********************************************************************************/
+static void freeHotPages(HotPages* h)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    if(h->fh.mgmtInfo!=0)
+    {
+        closePageFile(&h->fh);
+        p_dataBaseHeader=saved;
+    }
+    free(h->counts);
+    free(h->list);
+    free(h);
+}
+
+/*********************************************************************************
+ * Function:        openHotPages
+ * Description:     open the hot page file of a page file and read the saved
+ *                  list, create it if asked to
+ * Input:           DataBaseHeader* header: header of the open page file
+                    char* fileName: name of the page file
+                    int maxPages: longest list, 0 to take it from the file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC openHotPages(DataBaseHeader* header, char* fileName, int maxPages)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    HotPages* h=(HotPages*)calloc(1,sizeof(HotPages));
+    char* name=sidecarName(fileName,HOT_SUFFIX);
+    char* page=(char*)malloc(PAGE_SIZE);
+    HotFileHeader hf;
+    int i;
+    RC ret=RC_OK;
+
+    if(h==0||name==0||page==0)
+        ret=RC_ERROR;
+    else if(_access(name,0)!=0)
+    {
+        ret=maxPages>0?createPageFile(name):RC_FILE_NOT_FOUND;
+        if(ret==RC_OK)
+            ret=openPageFile(name,&h->fh);
+        // an empty list until the first save
+        h->dirty=1;
+    }
+    else
+    {
+        ret=openPageFile(name,&h->fh);
+        if(ret==RC_OK)
+            ret=readBlock(0,&h->fh,page);
+        memcpy(&hf,page,sizeof(hf));
+        if(ret==RC_OK&&hf.magic==HOT_MAGIC&&hf.numPages>0&&hf.numPages<=hf.maxPages)
+        {
+            int pages=(hf.numPages+HOT_PAGES_PER_PAGE-1)/HOT_PAGES_PER_PAGE;
+            // a list whose pages did not make it to disk is dropped
+            h->list=(int*)malloc((size_t)pages*PAGE_SIZE);
+            if(h->list!=0&&pages+1<=h->fh.totalNumPages&&readBlocks(1,pages,&h->fh,(SM_PageHandle)h->list)==RC_OK)
+                h->numList=hf.numPages;
+        }
+        if(ret==RC_OK&&hf.magic==HOT_MAGIC)
+            h->maxPages=hf.maxPages;
+    }
+    free(name);
+    free(page);
+    p_dataBaseHeader=saved;
+
+    if(ret==RC_OK&&maxPages>0)
+        h->maxPages=maxPages;
+    if(ret==RC_OK&&h->maxPages<=0)
+        ret=RC_FILE_HEADER_CORRUPT;
+    for(i=0;ret==RC_OK&&i<h->numList;i++)
+    {
+        if(h->list[i]<0)
+            continue;
+        ret=growHotCounts(h,h->list[i]);
+        if(ret==RC_OK)
+            h->counts[h->list[i]]=1;
+    }
+    if(ret!=RC_OK)
+    {
+        if(h!=0)
+            freeHotPages(h);
+        return ret;
+    }
+    header->hot=h;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        countReads
+ * Description:     count a read of numPages pages from pageNum on
+ * Called By:       readBlock
+                    readBlocks
+ **********************************************************************************/
+static void countReads(DataBaseHeader* header, int pageNum, int numPages)
+{
+    HotPages* h=header->hot;
+    int i;
+
+    // the counts are a hint, without memory for them reads go uncounted
+    if(h==0||pageNum<0||numPages<=0||growHotCounts(h,pageNum+numPages-1)!=RC_OK)
+        return;
+    for(i=pageNum;i<pageNum+numPages;i++)
+        if(h->counts[i]!=~0u)
+            h->counts[i]++;
+    h->dirty=1;
+}
+
+/*********************************************************************************
+ * Function:        compareHotCounts
+ * Description:     qsort order of read counts, most reads first
+ **********************************************************************************/
+static int compareHotCounts(const void* a, const void* b)
+{
+    const HotCount* x=(const HotCount*)a;
+    const HotCount* y=(const HotCount*)b;
+    if(x->count!=y->count)
+        return x->count<y->count?1:-1;
+    return (x->pageNum>y->pageNum)-(x->pageNum<y->pageNum);
+}
+
+/*********************************************************************************
+ * Function:        writeHotPages
+ * Description:     save the most read pages, if there were reads since the
+ *                  list was last saved
+ * Called By:       checkpointPageFile
+                    closeHotPages
+ * Input:           DataBaseHeader* header: header of the open page file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeHotPages(DataBaseHeader* header)
+{
+    HotPages* h=header->hot;
+    DataBaseHeader* saved=p_dataBaseHeader;
+    HotFileHeader hf;
+    int n=0, i;
+    RC ret=RC_OK;
+
+    if(h==0||!h->dirty)
+        return RC_OK;
+    HotCount* all=(HotCount*)malloc(sizeof(HotCount)*(h->capacity>0?h->capacity:1));
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    if(all==0||page==0)
+    {
+        free(all);
+        free(page);
+        return RC_ERROR;
+    }
+    for(i=0;i<h->capacity&&i<header->maxPageCount;i++)
+        if(h->counts[i]>0)
+        {
+            all[n].count=h->counts[i];
+            all[n++].pageNum=i;
+        }
+    if(n>h->maxPages)
+    {
+        qsort(all,n,sizeof(HotCount),compareHotCounts);
+        n=h->maxPages;
+    }
+
+    // the list is kept in page sized pieces, so it can be written as is
+    int pages=(n+HOT_PAGES_PER_PAGE-1)/HOT_PAGES_PER_PAGE;
+    int* list=(int*)calloc(pages>0?pages:1,PAGE_SIZE);
+    if(list==0)
+        ret=RC_ERROR;
+    else
+    {
+        for(i=0;i<n;i++)
+            list[i]=all[i].pageNum;
+        qsort(list,n,sizeof(int),compareInts);
+    }
+    if(ret==RC_OK&&pages+1>h->fh.totalNumPages)
+        ret=ensureCapacity(pages+1,&h->fh);
+    if(ret==RC_OK&&pages>0)
+        ret=writeBlocks(1,pages,&h->fh,(SM_PageHandle)list);
+    if(ret==RC_OK)
+    {
+        hf.magic=HOT_MAGIC;
+        hf.maxPages=h->maxPages;
+        hf.numPages=n;
+        memcpy(page,&hf,sizeof(hf));
+        ret=writeBlock(0,&h->fh,page);
+    }
+    p_dataBaseHeader=saved;
+    free(all);
+    free(page);
+    if(ret!=RC_OK)
+    {
+        free(list);
+        return ret;
+    }
+    free(h->list);
+    h->list=list;
+    h->numList=n;
+    h->dirty=0;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeHotPages
+ * Description:     save the list a last time, close the hot page file and free
+ *                  the counts
+ **********************************************************************************/
+static void closeHotPages(DataBaseHeader* header)
+{
+    if(header->hot==0)
+        return;
+    // only a hint, a list that can not be saved is not worth failing the close
+    writeHotPages(header);
+    freeHotPages(header->hot);
+    header->hot=0;
+}
+
+/*  page deduplication, see enablePageDedup: every page written is hashed
+ *  and looked up among the pages of the file that hold their own bytes.
+ *  When one of them holds the same bytes, checked byte by byte, the written
+ *  page becomes a reference to it: its place in the file is punched into a
+ *  hole and its reads go to the shared page. A shared page that is written
+ *  moves its old bytes to the first page referring to it, which takes over
+ *  the other references. The map is "<file>.dup", a page file with
+ *  DedupFileHeader on page 0 and a DedupEntry per page from page 1 on.
+ *  Changes of references reach the map before the page they protect is
+ *  punched or overwritten; hashes only at checkpoints, a lost hash costs
+ *  a missed duplicate and nothing else. */
+#define DEDUP_MAGIC            0x31505544   /* "DUP1" */
+#define DEDUP_SUFFIX           ".dup"
+#define DEDUP_ENTRIES_PER_PAGE ((int)(PAGE_SIZE/sizeof(DedupEntry)))
+#define DEDUP_MIN_TABLE        1024
+#define DEDUP_EMPTY            -1           // hash table slots
+#define DEDUP_DELETED          -2
+#define DEDUP_PRIME32          0x9E3779B1ULL
+
+typedef struct DedupFileHeader{
+    unsigned int magic;
+}DedupFileHeader;
+
+/* map entry of a page, all zeros for a page holding its own unknown bytes */
+typedef struct DedupEntry{
+    int copyOf;              // 1 + the page holding the bytes of this one, 0 if it holds them itself
+    int hashed;              // hash is the hash of the bytes this page holds
+    unsigned long long hash;
+}DedupEntry;
+
+struct Dedup{
+    SM_FileHandle fh;        // the map file
+    DedupEntry* entries;     // per page
+    int capacity;            // pages, a multiple of DEDUP_ENTRIES_PER_PAGE
+    unsigned char* dirty;    // per map page
+    int unsynced;            // map pages written since the last sync
+    int* firstRef;           // first page referring to a page, -1 if none
+    int* nextRef;            // next page referring to the same page, -1 ends
+    int* table;              // open addressing on the hash of the hashed pages
+    int tableSize;           // a power of 2, or 0
+    int tableUsed;           // live and deleted slots
+    int numRefs;             // pages that are references
+};
+
+static const unsigned long long dedupSecret[8]={
+    0xbe4ba423396cfeb8ULL,0x1cad21f72c81017cULL,0xdb979083e96dd4deULL,0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL,0x2172ffcc7dd05a82ULL,0x8e2443f7744608b8ULL,0x4c263a81e69035e0ULL};
+
+/*********************************************************************************
+ * Function:        pageHash
+ * Description:     64 bit hash of a page. Eight lanes each add the product of
+ *                  the two halves of a keyed word and the neighbouring lane's
+ *                  word, every 1 KB the lanes are scrambled; vectorized with
+ *                  AVX2 or SSE2 when the compiler targets them, with the same
+ *                  result as the scalar loop, so the map files stay valid.
+ * Input:           const char* page: PAGE_SIZE bytes
+ * Return:          unsigned long long: hash
+ **********************************************************************************/
+static unsigned long long pageHash(const char* page)
+{
+    unsigned long long acc[8], h=(unsigned long long)PAGE_SIZE*0x9E3779B97F4A7C15ULL;
+    int i, j;
+#if defined(__AVX2__)
+    const __m256i prime=_mm256_set1_epi64x((long long)DEDUP_PRIME32);
+    __m256i s[2], a[2];
+    for(j=0;j<2;j++)
+    {
+        s[j]=_mm256_loadu_si256((const __m256i*)(dedupSecret+4*j));
+        a[j]=_mm256_setzero_si256();
+    }
+    for(i=0;i<PAGE_SIZE;i+=64)
+    {
+        for(j=0;j<2;j++)
+        {
+            __m256i d=_mm256_loadu_si256((const __m256i*)(page+i+32*j));
+            __m256i k=_mm256_xor_si256(d,s[j]);
+            a[j]=_mm256_add_epi64(a[j],_mm256_add_epi64(_mm256_mul_epu32(k,_mm256_srli_epi64(k,32)),
+                                                     _mm256_shuffle_epi32(d,_MM_SHUFFLE(1,0,3,2))));
+        }
+        if((i&1023)==1024-64)
+            for(j=0;j<2;j++)
+            {
+                __m256i x=_mm256_xor_si256(_mm256_xor_si256(a[j],_mm256_srli_epi64(a[j],47)),s[j]);
+                a[j]=_mm256_add_epi64(_mm256_mul_epu32(x,prime),
+                                      _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x,32),prime),32));
+            }
+    }
+    for(j=0;j<2;j++)
+        _mm256_storeu_si256((__m256i*)(acc+4*j),a[j]);
+#elif defined(__SSE2__)
+    const __m128i prime=_mm_set1_epi32((int)DEDUP_PRIME32);
+    __m128i s[4], a[4];
+    for(j=0;j<4;j++)
+    {
+        s[j]=_mm_loadu_si128((const __m128i*)(dedupSecret+2*j));
+        a[j]=_mm_setzero_si128();
+    }
+    for(i=0;i<PAGE_SIZE;i+=64)
+    {
+        for(j=0;j<4;j++)
+        {
+            __m128i d=_mm_loadu_si128((const __m128i*)(page+i+16*j));
+            __m128i k=_mm_xor_si128(d,s[j]);
+            a[j]=_mm_add_epi64(a[j],_mm_add_epi64(_mm_mul_epu32(k,_mm_srli_epi64(k,32)),
+                                                  _mm_shuffle_epi32(d,_MM_SHUFFLE(1,0,3,2))));
+        }
+        if((i&1023)==1024-64)
+            for(j=0;j<4;j++)
+            {
+                __m128i x=_mm_xor_si128(_mm_xor_si128(a[j],_mm_srli_epi64(a[j],47)),s[j]);
+                a[j]=_mm_add_epi64(_mm_mul_epu32(x,prime),
+                                   _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(x,32),prime),32));
+            }
+    }
+    for(j=0;j<4;j++)
+        _mm_storeu_si128((__m128i*)(acc+2*j),a[j]);
+#else
+    for(j=0;j<8;j++)
+        acc[j]=0;
+    for(i=0;i<PAGE_SIZE;i+=64)
+    {
+        for(j=0;j<8;j++)
+        {
+            unsigned long long word, key;
+            memcpy(&word,page+i+8*j,sizeof(word));
+            key=word^dedupSecret[j];
+            acc[j^1]+=word;
+            acc[j]+=(key&0xffffffffULL)*(key>>32);
+        }
+        if((i&1023)==1024-64)
+            for(j=0;j<8;j++)
+            {
+                acc[j]^=acc[j]>>47;
+                acc[j]^=dedupSecret[j];
+                acc[j]*=DEDUP_PRIME32;
+            }
+    }
+#endif
+    for(j=0;j<8;j++)
+        h=(h^bloomHash(acc[j]^dedupSecret[j]))*0x9E3779B97F4A7C15ULL;
+    return bloomHash(h);
+}
+
+/*********************************************************************************
+ * Function:        growDedup
+ * Description:     make room in the map for a page, new pages hold their own
+ *                  unknown bytes
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC growDedup(Dedup* d, int pageNum)
+{
+    if(pageNum<d->capacity)
+        return RC_OK;
+    int capacity=(pageNum/DEDUP_ENTRIES_PER_PAGE+1)*DEDUP_ENTRIES_PER_PAGE;
+    if(capacity<2*d->capacity)
+        capacity=2*d->capacity;
+    DedupEntry* entries=(DedupEntry*)realloc(d->entries,sizeof(DedupEntry)*capacity);
+    if(entries==0) return RC_ERROR;
+    d->entries=entries;
+    unsigned char* dirty=(unsigned char*)realloc(d->dirty,capacity/DEDUP_ENTRIES_PER_PAGE);
+    if(dirty==0) return RC_ERROR;
+    d->dirty=dirty;
+    int* firstRef=(int*)realloc(d->firstRef,sizeof(int)*capacity);
+    if(firstRef==0) return RC_ERROR;
+    d->firstRef=firstRef;
+    int* nextRef=(int*)realloc(d->nextRef,sizeof(int)*capacity);
+    if(nextRef==0) return RC_ERROR;
+    d->nextRef=nextRef;
+
+    int i;
+    memset(d->entries+d->capacity,0,sizeof(DedupEntry)*(capacity-d->capacity));
+    memset(d->dirty+d->capacity/DEDUP_ENTRIES_PER_PAGE,0,(capacity-d->capacity)/DEDUP_ENTRIES_PER_PAGE);
+    for(i=d->capacity;i<capacity;i++)
+        d->firstRef[i]=d->nextRef[i]=-1;
+    d->capacity=capacity;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        saveDedup
+ * Description:     write the changed map pages, without syncing them
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC saveDedup(Dedup* d)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    int pages=d->capacity/DEDUP_ENTRIES_PER_PAGE, i;
+    RC ret=RC_OK;
+
+    for(i=0;ret==RC_OK&&i<pages;i++)
+    {
+        if(!d->dirty[i])
+            continue;
+        if(i+2>d->fh.totalNumPages)
+            ret=ensureCapacity(i+2,&d->fh);
+        if(ret==RC_OK)
+            ret=writeBlock(i+1,&d->fh,(SM_PageHandle)(d->entries+(long)i*DEDUP_ENTRIES_PER_PAGE));
+        if(ret==RC_OK)
+        {
+            d->dirty[i]=0;
+            d->unsynced=1;
+        }
+    }
+    p_dataBaseHeader=saved;
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        findDedupHash / addDedupHash / removeDedupHash
+ * Description:     the hashed page with a hash, -1 if there is none / add a
+ *                  hashed page that findDedupHash does not find / remove one
+ **********************************************************************************/
+static int findDedupHash(Dedup* d, unsigned long long hash)
+{
+    int i;
+    if(d->tableSize==0)
+        return -1;
+    for(i=(int)(hash&(d->tableSize-1));d->table[i]!=DEDUP_EMPTY;i=(i+1)&(d->tableSize-1))
+        if(d->table[i]>=0&&d->entries[d->table[i]].hash==hash)
+            return d->table[i];
+    return -1;
+}
+
+static RC addDedupHash(Dedup* d, int pageNum)
+{
+    int i;
+
+    // grow at half full, deleted slots count until the next rehash drops them
+    if(2*(d->tableUsed+1)>d->tableSize)
+    {
+        int live=0, size=DEDUP_MIN_TABLE, old=d->tableSize;
+        int* table=d->table;
+        for(i=0;i<old;i++)
+            if(table[i]>=0)
+                live++;
+        while(size<4*(live+1))
+            size*=2;
+        d->table=(int*)malloc(sizeof(int)*size);
+        if(d->table==0)
+        {
+            d->table=table;
+            return RC_ERROR;
+        }
+        for(i=0;i<size;i++)
+            d->table[i]=DEDUP_EMPTY;
+        d->tableSize=size;
+        d->tableUsed=0;
+        for(i=0;i<old;i++)
+            if(table[i]>=0)
+                addDedupHash(d,table[i]);
+        free(table);
+    }
+
+    for(i=(int)(d->entries[pageNum].hash&(d->tableSize-1));d->table[i]>=0;i=(i+1)&(d->tableSize-1))
+        ;
+    if(d->table[i]==DEDUP_EMPTY)
+        d->tableUsed++;
+    d->table[i]=pageNum;
+    return RC_OK;
+}
+
+static void removeDedupHash(Dedup* d, int pageNum)
+{
+    int i;
+    if(d->tableSize==0)
+        return;
+    for(i=(int)(d->entries[pageNum].hash&(d->tableSize-1));d->table[i]!=DEDUP_EMPTY;i=(i+1)&(d->tableSize-1))
+        if(d->table[i]==pageNum)
+        {
+            d->table[i]=DEDUP_DELETED;
+            return;
+        }
+}
+
+/*********************************************************************************
+ * Function:        linkDedupRef / unlinkDedupRef
+ * Description:     make a page a reference to target / make a reference a
+ *                  page that holds its own bytes again
+ **********************************************************************************/
+static void linkDedupRef(Dedup* d, int pageNum, int target)
+{
+    d->entries[pageNum].copyOf=target+1;
+    d->nextRef[pageNum]=d->firstRef[target];
+    d->firstRef[target]=pageNum;
+    d->numRefs++;
+    d->dirty[pageNum/DEDUP_ENTRIES_PER_PAGE]=1;
+}
+
+static void unlinkDedupRef(Dedup* d, int pageNum)
+{
+    int* link=&d->firstRef[d->entries[pageNum].copyOf-1];
+    while(*link!=pageNum)
+        link=&d->nextRef[*link];
+    *link=d->nextRef[pageNum];
+    d->nextRef[pageNum]=-1;
+    d->entries[pageNum].copyOf=0;
+    d->numRefs--;
+    d->dirty[pageNum/DEDUP_ENTRIES_PER_PAGE]=1;
+}
+
+/*********************************************************************************
+ * Function:        pageSource
+ * Description:     the page of the file holding the bytes of a page
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number
+ * Return:          int: page number
+ **********************************************************************************/
+static int pageSource(DataBaseHeader* header, int pageNum)
+{
+    Dedup* d=header->dedup;
+    if(d==0||pageNum>=d->capacity||d->entries[pageNum].copyOf==0)
+        return pageNum;
+    return d->entries[pageNum].copyOf-1;
+}
+
+/*********************************************************************************
+ * Function:        forgetDedupHash
+ * Description:     the bytes of a page are about to change, its hash is stale
+ **********************************************************************************/
+static void forgetDedupHash(Dedup* d, int pageNum)
+{
+    if(!d->entries[pageNum].hashed)
+        return;
+    removeDedupHash(d,pageNum);
+    d->entries[pageNum].hashed=0;
+    d->dirty[pageNum/DEDUP_ENTRIES_PER_PAGE]=1;
+}
+
+/*********************************************************************************
+ * Function:        freeDedup
+ * Description:     close the map file and free the map
+ **********************************************************************************/
+static void freeDedup(Dedup* d)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    if(d->fh.mgmtInfo!=0)
+    {
+        closePageFile(&d->fh);
+        p_dataBaseHeader=saved;
+    }
+    free(d->entries);
+    free(d->dirty);
+    free(d->firstRef);
+    free(d->nextRef);
+    free(d->table);
+    free(d);
+}
+
+/*********************************************************************************
+ * Function:        openDedup
+ * Description:     open the map file of a page file and rebuild the references
+ *                  and the hash table, create it if asked to
+ * Input:           DataBaseHeader* header: header of the open page file
+                    char* fileName: name of the page file
+                    int create: create a missing map file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC openDedup(DataBaseHeader* header, char* fileName, int create)
+{
+    DataBaseHeader* saved=p_dataBaseHeader;
+    Dedup* d=(Dedup*)calloc(1,sizeof(Dedup));
+    char* name=sidecarName(fileName,DEDUP_SUFFIX);
+    char* page=(char*)calloc(PAGE_SIZE,1);
+    DedupFileHeader h;
+    int i;
+    RC ret=RC_OK;
+
+    if(d==0||name==0||page==0)
+        ret=RC_ERROR;
+    else if(_access(name,0)!=0)
+    {
+        ret=create?createPageFile(name):RC_FILE_NOT_FOUND;
+        if(ret==RC_OK)
+            ret=openPageFile(name,&d->fh);
+        h.magic=DEDUP_MAGIC;
+        memcpy(page,&h,sizeof(h));
+        if(ret==RC_OK)
+            ret=writeBlock(0,&d->fh,page);
+    }
+    else
+    {
+        ret=openPageFile(name,&d->fh);
+        if(ret==RC_OK)
+            ret=readBlock(0,&d->fh,page);
+        memcpy(&h,page,sizeof(h));
+        if(ret==RC_OK&&h.magic!=DEDUP_MAGIC)
+            ret=RC_FILE_HEADER_CORRUPT;
+        int pages=d->fh.totalNumPages-1;
+        if(ret==RC_OK&&pages>0)
+        {
+            ret=growDedup(d,pages*DEDUP_ENTRIES_PER_PAGE-1);
+            if(ret==RC_OK)
+                ret=readBlocks(1,pages,&d->fh,(SM_PageHandle)d->entries);
+        }
+    }
+    free(name);
+    free(page);
+    p_dataBaseHeader=saved;
+
+    // pages past the end were not checkpointed, they read as zeros now
+    for(i=0;ret==RC_OK&&i<d->capacity;i++)
+    {
+        DedupEntry* e=&d->entries[i];
+        if(i>=header->maxPageCount)
+        {
+            if(e->copyOf!=0||e->hashed)
+                d->dirty[i/DEDUP_ENTRIES_PER_PAGE]=1;
+            memset(e,0,sizeof(DedupEntry));
+        }
+        else if(e->copyOf!=0)
+        {
+            int target=e->copyOf-1;
+            if(target<0||target>=header->maxPageCount||d->entries[target].copyOf!=0)
+                ret=RC_FILE_HEADER_CORRUPT;
+            else
+            {
+                d->nextRef[i]=d->firstRef[target];
+                d->firstRef[target]=i;
+                d->numRefs++;
+            }
+        }
+        else if(e->hashed)
+        {
+            if(findDedupHash(d,e->hash)<0)
+                ret=addDedupHash(d,i);
+            else
+                e->hashed=0;
+        }
+    }
+    if(ret!=RC_OK)
+    {
+        if(d!=0)
+            freeDedup(d);
+        return ret;
+    }
+    header->dedup=d;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeDedup
+ * Description:     save the map and sync it, before the data it describes
+ * Called By:       checkpointPageFile
+ * Input:           DataBaseHeader* header: header of the open page file
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeDedup(DataBaseHeader* header)
+{
+    Dedup* d=header->dedup;
+
+    if(d==0)
+        return RC_OK;
+    RC ret=saveDedup(d);
+    if(ret!=RC_OK||!d->unsynced)
+        return ret;
+    syncFile(((DataBaseHeader*)d->fh.mgmtInfo)->filePointer);
+    d->unsynced=0;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closeDedup
+ * Description:     save the map, close the map file and free the map
+ **********************************************************************************/
+static RC closeDedup(DataBaseHeader* header)
+{
+    if(header->dedup==0)
+        return RC_OK;
+    RC ret=writeDedup(header);
+    freeDedup(header->dedup);
+    header->dedup=0;
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        spillTempFile
+ * Description:     move a temporary file that grows past its memory limit to
+ *                  an unnamed file on disk. The stream keeps its descriptor
+ *                  number, only the file behind it changes.
+ * Called By:       appendEmptyBlock
+                    ensureCapacity
+ * Input:           DataBaseHeader* header: header of the open file
+                    int numPages: page count the file is about to grow to
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC spillTempFile(DataBaseHeader* header, int numPages)
+{
+    if(header->temporary!=TEMP_MEMORY||header->spillPages<0||numPages<=header->spillPages)
+        return RC_OK;
+
+    FILE* disk=tmpfile();
+    if(disk==0)
+        THROW(RC_FILE_OPEN_FAILED, "Can not create a file to spill a temporary page file to!");
+    long length=(long)PAGE_SIZE*header->maxPageCount+header->sizeofHeader;
+    int ok=copyFileData(header->filePointer,0,disk,0,length);
+#ifdef __linux__
+    // also frees the memory of the old file
+    ok=ok&&dup2(fileno(disk),fileno(header->filePointer))>=0;
+#endif
+    fclose(disk);
+    if(!ok)
+        THROW(RC_WRITE_FAILED, "Can not spill a temporary page file to disk!");
+    header->temporary=TEMP_SPILLED;
+    invalidateExtent(header);
+    memSpilled(header);
+    return RC_OK;
+}
+
+/*  replication: with a follower attached, every change to a page file is
+ *  also appended as a ShipRecord to a byte ring, and a shipper thread writes
+ *  whatever has piled up with one writev to a pipe or Unix socket, while
+ *  the writers go on filling the ring. A full ring makes writers wait, so
+ *  the follower is never more than SHIP_RING_SIZE bytes behind. Changes
+ *  are whole page images, byte ranges and checkpoints; each record carries
+ *  the page count of the leader's file. followPageFile applies them to a
+ *  copy with writeBlock, writeBlockRange and checkpointPageFile. A follower
+ *  that goes away does not stop the leader, the error is kept for
+ *  disableReplication. Linux only. */
+#define SHIP_MAGIC           0x31504853   /* "SHP1" */
+#define SHIP_RING_SIZE       (256L*(PAGE_SIZE+32))
+#define SHIP_PAGE            1
+#define SHIP_RANGE           2
+#define SHIP_CHECKPOINT      3
+
+typedef struct ShipRecord{
+    unsigned int magic;
+    int type;
+    int pageNum;
+    int offset;              // SHIP_RANGE: first byte in the page
+    int length;              // bytes following the record
+    int numPages;            // pages of the leader's file
+}ShipRecord;
+
+#ifdef __linux__
+#include <signal.h>
+
+struct Replication{
+    pthread_t shipper;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // bytes to ship or stop
+    pthread_cond_t space;    // bytes were shipped
+    int fd;
+    char* ring;
+    long head;               // bytes appended so far
+    long tail;               // bytes shipped so far
+    int stop;
+    RC error;                // first failed write to the follower
+};
+
+/*********************************************************************************
+ * Function:        shipperMain
+ * Description:     background thread writing the ring to the follower
+ **********************************************************************************/
+static void* shipperMain(void* arg)
+{
+    Replication* r=(Replication*)arg;
+    sigset_t pipeSignal;
+
+    // a closed pipe is reported as EPIPE instead of killing the process
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal,SIGPIPE);
+    pthread_sigmask(SIG_BLOCK,&pipeSignal,0);
+
+    pthread_mutex_lock(&r->lock);
+    for(;;)
+    {
+        while(!r->stop&&r->head==r->tail)
+            pthread_cond_wait(&r->work,&r->lock);
+        if(r->head==r->tail)
+            break;
+
+        // everything appended so far goes out at once, in one or two pieces
+        struct iovec iov[2];
+        long start=r->tail%SHIP_RING_SIZE, bytes=r->head-r->tail;
+        int cnt=1;
+        iov[0].iov_base=r->ring+start;
+        iov[0].iov_len=bytes<SHIP_RING_SIZE-start?bytes:SHIP_RING_SIZE-start;
+        if((long)iov[0].iov_len<bytes)
+        {
+            iov[1].iov_base=r->ring;
+            iov[1].iov_len=bytes-iov[0].iov_len;
+            cnt=2;
+        }
+        pthread_mutex_unlock(&r->lock);
+        ssize_t n=writev(r->fd,iov,cnt);
+        while(n<0&&errno==EINTR)
+            n=writev(r->fd,iov,cnt);
+        pthread_mutex_lock(&r->lock);
+
+        if(n<=0)
+        {
+            // the follower is gone, drop what is left
+            if(r->error==RC_OK)
+                r->error=RC_WRITE_FAILED;
+            r->tail=r->head;
+        }
+        else
+            r->tail+=n;
+        pthread_cond_broadcast(&r->space);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+/*********************************************************************************
+ * Function:        shipAppend
+ * Description:     copy bytes into the ring at head, wrapping around
+ **********************************************************************************/
+static void shipAppend(Replication* r, const void* data, long length)
+{
+    long start=r->head%SHIP_RING_SIZE;
+    long first=length<SHIP_RING_SIZE-start?length:SHIP_RING_SIZE-start;
+
+    memcpy(r->ring+start,data,first);
+    memcpy(r->ring,(const char*)data+first,length-first);
+    r->head+=length;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        shipRecord
+ * Description:     queue a change for the follower, waiting while the ring is
+ *                  full. Nothing happens without a follower or after it failed.
+ * Input:           DataBaseHeader* header: header of the open file
+                    int type: SHIP_PAGE, SHIP_RANGE or SHIP_CHECKPOINT
+                    int pageNum: page number
+                    int offset: first byte of a range
+                    int length: bytes of data
+                    char* data: page image or range
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void shipRecord(DataBaseHeader* header, int type, int pageNum, int offset, int length, char* data)
+{
+#ifdef __linux__
+    Replication* r=header->replication;
+    ShipRecord rec;
+    long need=(long)sizeof(rec)+length;
+
+    if(r==0)
+        return;
+    rec.magic=SHIP_MAGIC;
+    rec.type=type;
+    rec.pageNum=pageNum;
+    rec.offset=offset;
+    rec.length=length;
+    rec.numPages=header->maxPageCount;
+
+    pthread_mutex_lock(&r->lock);
+    while(r->error==RC_OK&&SHIP_RING_SIZE-(r->head-r->tail)<need)
+        pthread_cond_wait(&r->space,&r->lock);
+    if(r->error==RC_OK)
+    {
+        shipAppend(r,&rec,sizeof(rec));
+        if(length>0)
+            shipAppend(r,data,length);
+        pthread_cond_signal(&r->work);
+    }
+    pthread_mutex_unlock(&r->lock);
+#else
+    (void)header; (void)type; (void)pageNum; (void)offset; (void)length; (void)data;
+#endif
+}
+
+/*********************************************************************************
+ * Function:        initStorageManager
+ * Description:     initial storageManager
+ * Input:           None
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+void initStorageManager()
+{
+    p_dataBaseHeader=0;
+}
+
+/*********************************************************************************
+ * Function:        createPageFile
+ * Description:     create a new page file with one page filled with '\0'
+ * Input:           char* fileName: file name
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC createPageFile(char* fileName)
+{
+    //check whether the file exsit, since we want to create, the file shouldn't exsit
+	int ret = _access(fileName,0);
+    
+    //if the file already exit, do not create and return error.
+    if(ret==0)
+    {
+        THROW_FMT(RC_FILE_ALREADY_EXIST, LOG_LEVEL_ERROR, "The file %s already exsit! Do you mean to open the file?", fileName);
+    }
+
+    //create the file with mode "wb", and check if it has been successfully created
+    FILE* fp=fopen(fileName,"wb");
+    if(fp==0)
+    {
+        THROW_FMT(RC_FILE_OPEN_FAILED, LOG_LEVEL_ERROR, "Can not create the file %s!!", fileName);
+    }
+
+    //record the file header, and write it into the beginning of the file
+	initDataBaseHeader();
+    p_dataBaseHeader->maxPageCount=1;
+    p_dataBaseHeader->currentPage=0;
+    p_dataBaseHeader->filePointer=fp;
+
+    // make room for the empty header area and the page with '\0',
+    // so the second header slot starts out invalid
+    p_dataBaseHeader->maxPageCount=0;
+    ret=extendPageFile(p_dataBaseHeader,1);
+    p_dataBaseHeader->maxPageCount=1;
+
+    // fill in the first header slot
+    if(ret==RC_OK)
+        ret=writeDataBaseHeader(fp);
+
+    fclose(fp);
+    free(p_dataBaseHeader);
+    p_dataBaseHeader=0;
+
+    // side files left over from an earlier file of the same name describe other pages
+    if(ret==RC_OK)
+    {
+        removeSidecar(fileName,SUMMARY_SUFFIX);
+        removeSidecar(fileName,CHANGE_SUFFIX);
+        removeSidecar(fileName,HOT_SUFFIX);
+        removeSidecar(fileName,DEDUP_SUFFIX);
+    }
+
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        openPageFile
+ * Description:     open an exist page file, read the file header to get the information 
+ *                  and save these into handle
+ * Input:           char* fileName: file name
+ * Output:          SM_FileHandle *fHandle: file handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openPageFile(char *fileName, SM_FileHandle *fHandle)
+{
+    //This function is almost the same as createPageFile
+
+    //check whether the file exsit.
+    int ret=_access(fileName,0|2);
+
+    // Return error if the file doesn't exit.
+    if(ret!=0)
+    {
+        THROW_FMT(RC_FILE_NOT_FOUND, LOG_LEVEL_ERROR, "The file %s does not exsit or have no permit to write!", fileName);
+    }
+
+    //open the file with mode 'rb', and check if it has been successfully created
+    FILE* fp=fopen(fileName,"rb+");
+    if(fp==0)
+    {
+        THROW_FMT(RC_FILE_OPEN_FAILED, LOG_LEVEL_ERROR, "Can not open the file %s!!", fileName);
+    }
+
+    //create a new dataBaseHeader,record the pointer
+    initDataBaseHeader();
+	p_dataBaseHeader->filePointer = fp;
+
+    //read file header from file, and save the information in file handle
+    RC rc=readDataBaseHeader(fp);
+    if(rc!=RC_OK)
+    {
+        fclose(fp);
+        free(p_dataBaseHeader->additionalInfo);
+        free(p_dataBaseHeader);
+        p_dataBaseHeader=0;
+        return rc;
+    }
+#ifdef __linux__
+    // hole probing moves the file offset, keep that away from the stdio stream
+    p_dataBaseHeader->probeFd=open(fileName,O_RDONLY);
+#endif
+    memOpenAccount(p_dataBaseHeader,fileName);
+    fHandle->mgmtInfo=p_dataBaseHeader;
+    fHandle->fileName=fileName;
+    fHandle->curPagePos=0;
+    fHandle->totalNumPages=p_dataBaseHeader->maxPageCount;
+
+    // summaries are optional, a file whose summary file can not be read has none
+    DataBaseHeader* header=p_dataBaseHeader;
+    if(sidecarExists(fileName,SUMMARY_SUFFIX))
+        openSummaries(header,fileName,0);
+    if(sidecarExists(fileName,HOT_SUFFIX))
+        openHotPages(header,fileName,0);
+    // a tracked file must not lose track of its changes
+    if(sidecarExists(fileName,CHANGE_SUFFIX)&&openChanges(header,fileName,0)!=RC_OK)
+    {
+        p_dataBaseHeader=header;
+        closePageFile(fHandle);
+        THROW_FMT(RC_FILE_OPEN_FAILED, LOG_LEVEL_ERROR, "Can not open the changed pages of %s!", fileName);
+    }
+    // without its map the shared pages of a file read as holes
+    if(sidecarExists(fileName,DEDUP_SUFFIX)&&openDedup(header,fileName,0)!=RC_OK)
+    {
+        p_dataBaseHeader=header;
+        closePageFile(fHandle);
+        THROW_FMT(RC_FILE_OPEN_FAILED, LOG_LEVEL_ERROR, "Can not open the shared page map of %s!", fileName);
+    }
+    p_dataBaseHeader=header;
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        closePageFile
+ * Description:     close a file
+ * Input:           SM_FileHandle *fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC closePageFile(SM_FileHandle *fHandle)
+{
+    // check if the handle is valid
+    if(fHandle==0||fHandle->mgmtInfo==0)
+    {
+        THROW_LOG(RC_FILE_HANDLE_NOT_INIT, LOG_LEVEL_ERROR, "The fileHandle is Empty!!!");
+    }
+
+    // write the batched header changes back before the file goes away
+    RC ret=checkpointPageFile(fHandle);
+    RC wbRet=disableWriteBehind(fHandle);
+    if(ret==RC_OK) ret=wbRet;
+    // a lost follower is no reason to fail the close, see disableReplication
+    disableReplication(fHandle);
+
+    // close file
+    p_dataBaseHeader=fHandle->mgmtInfo;
+    closeSummaries(p_dataBaseHeader);
+    closeChanges(p_dataBaseHeader);
+    closeHotPages(p_dataBaseHeader);
+    RC ddRet=closeDedup(p_dataBaseHeader);
+    if(ret==RC_OK) ret=ddRet;
+    memCloseAccount(p_dataBaseHeader);
+    fclose(p_dataBaseHeader->filePointer);
+#ifdef __linux__
+    if(p_dataBaseHeader->probeFd>=0)
+        close(p_dataBaseHeader->probeFd);
+#endif
+
+    //we should delete the dataBaseHeader stored in mgmtInfo and then delete the fHandle
+    if(p_dataBaseHeader->stagedPages!=0)
+    {
+        int i;
+        for(i=0;i<STAGED_PAGE_COUNT;i++)
+            free(p_dataBaseHeader->stagedPages[i].image);
+        free(p_dataBaseHeader->stagedPages);
+    }
+    free(p_dataBaseHeader->additionalInfo);
+    free(p_dataBaseHeader);
+    p_dataBaseHeader=0;
+	fHandle->mgmtInfo = 0;
+
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        checkpointPageFile
+ * Description:     persist the metadata changes batched in memory (page count),
+ *                  any staged byte ranges, the write-behind table, the page
+ *                  summaries, the changed pages and the shared page map.
+ *                  Data pages are synced first, then the header goes to the 
+ *                  inactive slot, so the file never has a header describing 
+ *                  pages that are not on disk.
+ * Called By:       closePageFile
+ * Input:           SM_FileHandle *fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC checkpointPageFile(SM_FileHandle *fHandle)
+{
+    // check if the handle is valid
+    if(fHandle==0||fHandle->mgmtInfo==0)
+    {
+        THROW_LOG(RC_FILE_HANDLE_NOT_INIT, LOG_LEVEL_ERROR, "The fileHandle is Empty!!!");
+    }
+
+    // staged ranges and buffered pages are data too, they must reach the file before the header
+    RC ret=flushBlockRanges(fHandle);
+    if(ret!=RC_OK) return ret;
+    ret=flushWriteBehind(fHandle);
+    if(ret!=RC_OK) return ret;
+
+    p_dataBaseHeader=fHandle->mgmtInfo;
+    ret=writeSummaries(p_dataBaseHeader);
+    if(ret!=RC_OK) return ret;
+    ret=writeChanges(p_dataBaseHeader);
+    if(ret!=RC_OK) return ret;
+    ret=writeHotPages(p_dataBaseHeader);
+    if(ret!=RC_OK) return ret;
+    ret=writeDedup(p_dataBaseHeader);
+    if(ret!=RC_OK) return ret;
+    shipRecord(p_dataBaseHeader,SHIP_CHECKPOINT,0,0,0,0);
+    // a temporary file does not outlive the handle, nothing to make durable
+    if(!p_dataBaseHeader->headerDirty||p_dataBaseHeader->temporary!=TEMP_NONE)
+        return RC_OK;
+
+    // data first, then the header that describes it
+    syncFile(p_dataBaseHeader->filePointer);
+    return writeDataBaseHeader(p_dataBaseHeader->filePointer);
+}
+
+/*********************************************************************************
+ * Function:        destroyPageFile
+ * Description:     destroy a file
+ * Input:           char *fileName: file name
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC destroyPageFile(char *fileName)
+{
+    //check whether the file is exsit. 
+    int ret=_access(fileName,0);
+
+    // Return error if it doesn't exit.
+    if(ret!=0)
+    {
+        THROW_FMT(RC_FILE_NOT_FOUND, LOG_LEVEL_ERROR, "The file %s does not exsit!", fileName);
+    }
+
+    // remove file and check if it is successfully.
+    ret=remove(fileName);
+    if(ret!=0)
+    {
+        THROW_LOG(RC_FILE_REMOVE_FAILED, LOG_LEVEL_ERROR, "Error in remove the file! Please check the permission!");
+    }
+    removeSidecar(fileName,SUMMARY_SUFFIX);
+    removeSidecar(fileName,CHANGE_SUFFIX);
+    removeSidecar(fileName,HOT_SUFFIX);
+    removeSidecar(fileName,DEDUP_SUFFIX);
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        openTempPageFile
+ * Description:     create and open a page file for data that dies with the
+ *                  handle, such as sort runs. It has one empty page and no
+ *                  name; the header is never written, nothing is synced and
+ *                  closePageFile frees it. On Linux the pages are kept in
+ *                  memory (memfd) until the file grows past spillPages, then
+ *                  they move to an unnamed file in the temp directory.
+ * Input:           int spillPages: pages to keep in memory, -1 for no limit,
+                                    0 to go to disk right away
+ * Output:          SM_FileHandle *fHandle: file handle
+ * Return:          RC: return code
+ **********************************************************************************/
+RC openTempPageFile(SM_FileHandle *fHandle, int spillPages)
+{
+    if(fHandle==0)
+    {
+        THROW_LOG(RC_FILE_HANDLE_NOT_INIT, LOG_LEVEL_ERROR, "The fileHandle is NULL!!!, Function will exit.");
+    }
+
+    FILE* fp=0;
+    int temporary=TEMP_SPILLED;
+#if defined(__linux__) && defined(__NR_memfd_create)
+    if(spillPages!=0)
+    {
+        int fd=syscall(__NR_memfd_create,"pagefile",MFD_CLOEXEC);
+        if(fd>=0&&(fp=fdopen(fd,"wb+"))==0)
+            close(fd);
+        if(fp!=0)
+            temporary=TEMP_MEMORY;
+    }
+#endif
+    // no memfd, straight to disk
+    if(fp==0)
+        fp=tmpfile();
+    if(fp==0)
+        THROW(RC_FILE_OPEN_FAILED, "Can not create a temporary page file!");
+
+    initDataBaseHeader();
+    p_dataBaseHeader->filePointer=fp;
+    p_dataBaseHeader->temporary=temporary;
+    p_dataBaseHeader->spillPages=spillPages;
+    p_dataBaseHeader->maxPageCount=0;
+    memOpenAccount(p_dataBaseHeader,0);
+    RC ret=extendPageFile(p_dataBaseHeader,1);
+    if(ret!=RC_OK)
+    {
+        memCloseAccount(p_dataBaseHeader);
+        fclose(fp);
+        free(p_dataBaseHeader);
+        p_dataBaseHeader=0;
+        return ret;
+    }
+    p_dataBaseHeader->maxPageCount=1;
+
+    fHandle->mgmtInfo=p_dataBaseHeader;
+    fHandle->fileName=0;
+    fHandle->curPagePos=0;
+    fHandle->totalNumPages=1;
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        isTempFileInMemory
+ * Description:     whether a temporary page file has not been spilled to disk
+ * Input:           SM_FileHandle *fHandle: file handle
+ * Output:          None
+ * Return:          int: 1 if the pages are in memory, else 0
+ **********************************************************************************/
+int isTempFileInMemory(SM_FileHandle *fHandle)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return 0;
+    return ((DataBaseHeader*)fHandle->mgmtInfo)->temporary==TEMP_MEMORY;
+}
+
+/*********************************************************************************
+ * Function:        findStagedPage
+ * Description:     look up the staged ranges of a page
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number
+ * Output:          None
+ * Return:          StagedPage*: the entry, 0 if nothing is staged for the page
+ **********************************************************************************/
+static StagedPage* findStagedPage(DataBaseHeader* header, int pageNum)
+{
+    int i;
+    for(i=0;i<header->numStagedPages;i++)
+        if(header->stagedPages[i].pageNum==pageNum)
+            return &header->stagedPages[i];
+    return 0;
+}
+
+/*********************************************************************************
+ * Function:        dropStagedPage
+ * Description:     forget the staged ranges of a page, the entry is reused
+ * Input:           DataBaseHeader* header: header of the open file
+                    StagedPage* staged: entry to drop
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void dropStagedPage(DataBaseHeader* header, StagedPage* staged)
+{
+    StagedPage* last=&header->stagedPages[header->numStagedPages-1];
+    StagedPage tmp;
+
+    // swap with the last used entry so the used entries stay packed
+    tmp=*staged;
+    *staged=*last;
+    *last=tmp;
+    last->numRanges=0;
+    last->pageNum=-1;
+    header->numStagedPages--;
+}
+
+/*********************************************************************************
+ * Function:        writeStagedRanges
+ * Description:     write staged ranges of one page to the file
+ * Input:           DataBaseHeader* header: header of the open file
+                    StagedPage* staged: entry holding the page image
+                    StagedRange* ranges: ranges to write
+                    int numRanges: number of ranges
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writeStagedRanges(DataBaseHeader* header, StagedPage* staged, StagedRange* ranges, int numRanges)
+{
+    FILE* fp=header->filePointer;
+    long base=(long)PAGE_SIZE*staged->pageNum+header->sizeofHeader;
+    int i;
+
+    for(i=0;i<numRanges;i++)
+    {
+        StagedRange* r=&ranges[i];
+        fseek(fp,base+r->offset,SEEK_SET);
+        if((int)fwrite(staged->image+r->offset,1,r->length,fp)!=r->length)
+            return RC_WRITE_FAILED;
+    }
+    fflush(fp);
+    invalidateExtent(header);
+    memTouch(header->mem,staged->pageNum,1);
+    return RC_OK;
+}
+
+/*  I/O scheduling: every read and write of page data is admitted by ioBegin
+ *  in the class of the calling thread, see setIOClass. A request waits
+ *  while a request of a higher class is queued or running, but only until
+ *  the deadline of its own class, so background work yields to the reads
+ *  of user queries without starving. A class may also have a token bucket:
+ *  a request takes its size from the bucket, which refills at the rate of
+ *  the class and holds at most IO_BURST_DIVISOR-th of a second of it.
+ *  Nothing is scheduled until setIOClass or setIOClassLimits is first used.
+ *  The write-behind flusher runs in the background class. */
+#define IO_BURST_DIVISOR 10
+
+static THREAD_LOCAL int ioClass=SM_IO_NORMAL;
+static int ioSchedulerOn=0;
+
+#ifdef __linux__
+static int ioDeadlineMs[SM_IO_CLASSES]={0,20,100};
+
+typedef struct IOClass{
+    long rate;               // bytes per second, 0 for no limit
+    double tokens;           // bytes that may go now, negative after a large request
+    double lastRefill;       // seconds
+    int queued;              // waiting in ioBegin
+    int running;             // admitted and not ended
+    SM_IOStats stats;
+}IOClass;
+
+static pthread_mutex_t ioLock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ioOnce=PTHREAD_ONCE_INIT;
+static pthread_cond_t ioChange;  // see ioInit
+static IOClass ioClasses[SM_IO_CLASSES];
+
+/*********************************************************************************
+ * Function:        ioInit
+ * Description:     make ioChange wait on the clock of ioNow, run once before it
+ *                  is used
+ **********************************************************************************/
+static void ioInit(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr,CLOCK_MONOTONIC);
+    pthread_cond_init(&ioChange,&attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/*********************************************************************************
+ * Function:        ioNow
+ * Description:     the clock of the scheduler, in seconds. Monotonic, so that
+ *                  setting the system time does not move deadlines.
+ **********************************************************************************/
+static double ioNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return now.tv_sec+now.tv_nsec/1e9;
+}
+
+/*********************************************************************************
+ * Function:        ioRefill
+ * Description:     add the tokens earned since the last refill, up to a burst
+ **********************************************************************************/
+static void ioRefill(IOClass* c, double now)
+{
+    double burst=(double)c->rate/IO_BURST_DIVISOR;
+    if(burst<PAGE_SIZE)
+        burst=PAGE_SIZE;
+    if(now>c->lastRefill)
+        c->tokens+=(now-c->lastRefill)*c->rate;
+    if(c->tokens>burst)
+        c->tokens=burst;
+    c->lastRefill=now;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        ioBegin
+ * Description:     wait until a request of bytes may go to the device
+ * Input:           long bytes: size of the request
+ * Output:          None
+ * Return:          int: class to pass to ioEnd
+ **********************************************************************************/
+static int ioBegin(long bytes)
+{
+#ifdef __linux__
+    if(!__atomic_load_n(&ioSchedulerOn,__ATOMIC_RELAXED))
+        return -1;
+
+    int cls=ioClass, i;
+    IOClass* c=&ioClasses[cls];
+    double start=ioNow(), now=start, deadline;
+    struct timespec until;
+
+    pthread_once(&ioOnce,ioInit);
+    pthread_mutex_lock(&ioLock);
+    // setIOClassLimits changes the deadline under the lock
+    deadline=start+ioDeadlineMs[cls]/1000.0;
+    c->queued++;
+    for(;;)
+    {
+        int higher=0;
+        double wait=0;
+        for(i=0;i<cls;i++)
+            higher+=ioClasses[i].queued+ioClasses[i].running;
+        if(c->rate>0)
+        {
+            // a request larger than the burst waits for a full bucket only
+            double need=bytes<(double)c->rate/IO_BURST_DIVISOR?bytes:(double)c->rate/IO_BURST_DIVISOR;
+            ioRefill(c,now);
+            if(c->tokens<need)
+                wait=(need-c->tokens)/c->rate;
+        }
+        if(wait==0&&(higher==0||now>=deadline))
+            break;
+
+        // ioEnd wakes us early when a higher class is done
+        double wake=wait>0?now+wait:deadline;
+        until.tv_sec=(time_t)wake;
+        until.tv_nsec=(long)((wake-until.tv_sec)*1e9);
+        pthread_cond_timedwait(&ioChange,&ioLock,&until);
+        now=ioNow();
+    }
+    c->queued--;
+    c->running++;
+    if(c->rate>0)
+        c->tokens-=bytes;
+    long long waited=(long long)((now-start)*1e6);
+    c->stats.requests++;
+    c->stats.bytes+=bytes;
+    c->stats.waitMicros+=waited;
+    if(waited>c->stats.maxWaitMicros)
+        c->stats.maxWaitMicros=waited;
+    pthread_mutex_unlock(&ioLock);
+    return cls;
+#else
+    (void)bytes;
+    return -1;
+#endif
+}
+
+/*********************************************************************************
+ * Function:        ioEnd
+ * Description:     a request admitted by ioBegin is done
+ * Input:           int cls: what ioBegin returned
+ **********************************************************************************/
+static void ioEnd(int cls)
+{
+#ifdef __linux__
+    if(cls<0)
+        return;
+    pthread_once(&ioOnce,ioInit);
+    pthread_mutex_lock(&ioLock);
+    ioClasses[cls].running--;
+    pthread_cond_broadcast(&ioChange);
+    pthread_mutex_unlock(&ioLock);
+#else
+    (void)cls;
+#endif
+}
+
+#ifdef __linux__
+/*  write-behind: writeBlock copies the page into a bounded table and returns,
+ *  a flusher thread writes the dirty pages sorted by page number, each run of
+ *  consecutive pages with a single pwritev. While a page is being written
+ *  (FLUSHING) a newer copy of it may already be DIRTY again, readers take
+ *  the DIRTY copy first. Every field below is protected by lock.  */
+#define WB_FREE      0
+#define WB_DIRTY     1
+#define WB_FLUSHING  2
+#define WB_FLUSH_INTERVAL_MS 50
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct WriteBehindEntry{
+    int pageNum;
+    int state;
+    int next;                // next entry in the hash bucket or the free list, -1 ends
+    char* page;
+}WriteBehindEntry;
+
+struct WriteBehind{
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // wakes the flusher
+    pthread_cond_t space;    // an entry became free
+    pthread_cond_t done;     // a batch was written
+    int fd;
+    long sizeofHeader;
+    MemAccount* mem;         // account of the file, for the pages the flusher writes
+    int maxDirtyPages;
+    WriteBehindEntry* entries;
+    WriteBehindEntry** batch; // flusher only: entries of the running batch
+    struct iovec* iov;        // flusher only
+    char* pages;
+    int* buckets;
+    int numBuckets;
+    int freeList;
+    int numDirty;
+    int numFlushing;
+    int flushRequested;
+    int stop;
+    int extentStale;         // the flusher changed the file behind the cached extent
+    RC error;                // first failed write, reported by the next flush barrier
+};
+
+/*********************************************************************************
+ * Function:        wbLookup
+ * Description:     find the entry of a page in the given state, lock must be held
+ * Input:           WriteBehind* wb: write-behind state
+                    int pageNum: page number
+                    int state: WB_DIRTY or WB_FLUSHING
+ * Output:          None
+ * Return:          int: entry index, -1 if not found
+ **********************************************************************************/
+static int wbLookup(WriteBehind* wb, int pageNum, int state)
+{
+    int idx=wb->buckets[pageNum%wb->numBuckets];
+    while(idx>=0&&(wb->entries[idx].pageNum!=pageNum||wb->entries[idx].state!=state))
+        idx=wb->entries[idx].next;
+    return idx;
+}
+
+/*********************************************************************************
+ * Function:        wbRelease
+ * Description:     unlink a written entry from its bucket and put it on the free 
+ *                  list, lock must be held
+ * Input:           WriteBehind* wb: write-behind state
+                    WriteBehindEntry* e: entry
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void wbRelease(WriteBehind* wb, WriteBehindEntry* e)
+{
+    int idx=(int)(e-wb->entries);
+    int* link=&wb->buckets[e->pageNum%wb->numBuckets];
+
+    while(*link!=idx)
+        link=&wb->entries[*link].next;
+    *link=e->next;
+
+    e->state=WB_FREE;
+    e->next=wb->freeList;
+    wb->freeList=idx;
+}
+
+/*********************************************************************************
+ * Function:        wbComparePages
+ * Description:     qsort order of batch entries by page number
+ **********************************************************************************/
+static int wbComparePages(const void* a, const void* b)
+{
+    const WriteBehindEntry* x=*(const WriteBehindEntry* const*)a;
+    const WriteBehindEntry* y=*(const WriteBehindEntry* const*)b;
+    return (x->pageNum>y->pageNum)-(x->pageNum<y->pageNum);
+}
+
+/*********************************************************************************
+ * Function:        pwritevFully
+ * Description:     pwritev that retries short writes and interrupts
+ * Input:           int fd: file descriptor
+                    struct iovec* iov: buffers, modified on short writes
+                    int cnt: number of buffers
+                    off_t off: file offset
+ * Output:          None
+ * Return:          int: 1 on success
+ **********************************************************************************/
+static int pwritevFully(int fd, struct iovec* iov, int cnt, off_t off)
+{
+    while(cnt>0)
+    {
+        ssize_t written=pwritev(fd,iov,cnt,off);
+        if(written<0)
+        {
+            if(errno==EINTR) continue;
+            return 0;
+        }
+        off+=written;
+        while(cnt>0&&(size_t)written>=iov->iov_len)
+        {
+            written-=iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt>0)
+        {
+            iov->iov_base=(char*)iov->iov_base+written;
+            iov->iov_len-=written;
+        }
+    }
+    return 1;
+}
+
+/*********************************************************************************
+ * Function:        wbWriteBatch
+ * Description:     write a sorted batch, one pwritev per run of consecutive pages.
+ *                  All zero pages are punched into holes instead.
+ * Input:           WriteBehind* wb: write-behind state
+                    int n: number of entries in wb->batch
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC wbWriteBatch(WriteBehind* wb, int n)
+{
+    WriteBehindEntry** batch=wb->batch;
+    int i=0;
+
+    while(i<n)
+    {
+        off_t off=(off_t)PAGE_SIZE*batch[i]->pageNum+wb->sizeofHeader;
+        if(isZeroPage(batch[i]->page)&&
+           fallocate(wb->fd,FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,off,PAGE_SIZE)==0)
+        {
+            i++;
+            continue;
+        }
+
+        int cnt=0;
+        do
+        {
+            wb->iov[cnt].iov_base=batch[i]->page;
+            wb->iov[cnt].iov_len=PAGE_SIZE;
+            cnt++;
+            i++;
+        }while(i<n&&cnt<IOV_MAX&&batch[i]->pageNum==batch[i-1]->pageNum+1&&!isZeroPage(batch[i]->page));
+
+        int cls=ioBegin((long)cnt*PAGE_SIZE);
+        int ok=pwritevFully(wb->fd,wb->iov,cnt,off);
+        ioEnd(cls);
+        if(!ok)
+            return RC_WRITE_FAILED;
+        memTouch(wb->mem,batch[i-cnt]->pageNum,cnt);
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        wbFlusherMain
+ * Description:     flusher thread. Waits until half of the table is dirty, a 
+ *                  barrier is requested or WB_FLUSH_INTERVAL_MS passed, then 
+ *                  takes all dirty pages as one batch and writes it.
+ * Input:           void* arg: WriteBehind* of the file
+ * Output:          None
+ * Return:          void*: 0
+ **********************************************************************************/
+static void* wbFlusherMain(void* arg)
+{
+    WriteBehind* wb=(WriteBehind*)arg;
+    struct timespec deadline;
+    int i, n;
+
+    // flushing is background work, it must not hold up reads
+    ioClass=SM_IO_BACKGROUND;
+    pthread_mutex_lock(&wb->lock);
+    for(;;)
+    {
+        clock_gettime(CLOCK_MONOTONIC,&deadline);
+        deadline.tv_nsec+=WB_FLUSH_INTERVAL_MS*1000000L;
+        if(deadline.tv_nsec>=1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec-=1000000000L;
+        }
+
+        // let dirty pages pile up a little, so there are runs to coalesce
+        while(!wb->stop&&!wb->flushRequested&&wb->numDirty<wb->maxDirtyPages/2)
+        {
+            if(wb->numDirty==0)
+                pthread_cond_wait(&wb->work,&wb->lock);
+            else if(pthread_cond_timedwait(&wb->work,&wb->lock,&deadline)==ETIMEDOUT)
+                break;
+        }
+
+        if(wb->numDirty==0)
+        {
+            wb->flushRequested=0;
+            pthread_cond_broadcast(&wb->done);
+            if(wb->stop) break;
+            continue;
+        }
+
+        n=0;
+        for(i=0;i<wb->maxDirtyPages;i++)
+            if(wb->entries[i].state==WB_DIRTY)
+            {
+                wb->entries[i].state=WB_FLUSHING;
+                wb->batch[n++]=&wb->entries[i];
+            }
+        wb->numDirty-=n;
+        wb->numFlushing+=n;
+        pthread_mutex_unlock(&wb->lock);
+
+        // the pages of FLUSHING entries are not touched by anybody else
+        qsort(wb->batch,n,sizeof(WriteBehindEntry*),wbComparePages);
+        RC rc=wbWriteBatch(wb,n);
+
+        pthread_mutex_lock(&wb->lock);
+        for(i=0;i<n;i++)
+            wbRelease(wb,wb->batch[i]);
+        wb->numFlushing-=n;
+        if(rc!=RC_OK&&wb->error==RC_OK)
+            wb->error=rc;
+        wb->extentStale=1;
+        pthread_cond_broadcast(&wb->space);
+        pthread_cond_broadcast(&wb->done);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return 0;
+}
+
+/*********************************************************************************
+ * Function:        wbWritePage
+ * Description:     copy a page into the write-behind table. Blocks while the 
+ *                  table is full until the flusher frees entries.
+ * Input:           WriteBehind* wb: write-behind state
+                    int pageNum: page number
+                    char* memPage: page content
+ * Output:          None
+ * Return:          None
+ **********************************************************************************/
+static void wbWritePage(WriteBehind* wb, int pageNum, char* memPage)
+{
+    pthread_mutex_lock(&wb->lock);
+    int idx=wbLookup(wb,pageNum,WB_DIRTY);
+    if(idx<0)
+    {
+        // backpressure, the dirty budget is used up
+        while(wb->freeList<0)
+        {
+            pthread_cond_signal(&wb->work);
+            pthread_cond_wait(&wb->space,&wb->lock);
+        }
+        idx=wb->freeList;
+        WriteBehindEntry* e=&wb->entries[idx];
+        wb->freeList=e->next;
+        e->pageNum=pageNum;
+        e->state=WB_DIRTY;
+        e->next=wb->buckets[pageNum%wb->numBuckets];
+        wb->buckets[pageNum%wb->numBuckets]=idx;
+        wb->numDirty++;
+        if(wb->numDirty>=wb->maxDirtyPages/2)
+            pthread_cond_signal(&wb->work);
+    }
+    memcpy(wb->entries[idx].page,memPage,PAGE_SIZE);
+    pthread_mutex_unlock(&wb->lock);
+}
+
+/*********************************************************************************
+ * Function:        wbReadPage
+ * Description:     copy the newest buffered version of a page, if there is one
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number
+ * Output:          char* memPage: page content
+ * Return:          int: 1 if the page came from the table
+ **********************************************************************************/
+static int wbReadPage(DataBaseHeader* header, int pageNum, char* memPage)
+{
+    WriteBehind* wb=header->writeBehind;
+
+    pthread_mutex_lock(&wb->lock);
+    int idx=wbLookup(wb,pageNum,WB_DIRTY);
+    if(idx<0)
+        idx=wbLookup(wb,pageNum,WB_FLUSHING);
+    if(idx>=0)
+        memcpy(memPage,wb->entries[idx].page,PAGE_SIZE);
+    // a written page may have been a cached hole
+    if(wb->extentStale)
+    {
+        invalidateExtent(header);
+        wb->extentStale=0;
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return idx>=0;
+}
+
+/*********************************************************************************
+ * Function:        wbFirstPageFrom
+ * Description:     smallest buffered page number in [pageNum, limit)
+ * Input:           WriteBehind* wb: write-behind state
+                    int pageNum: first page
+                    int limit: upper bound
+ * Output:          None
+ * Return:          int: page number, limit if there is none
+ **********************************************************************************/
+static int wbFirstPageFrom(WriteBehind* wb, int pageNum, int limit)
+{
+    int i;
+    pthread_mutex_lock(&wb->lock);
+    for(i=0;i<wb->maxDirtyPages;i++)
+        if(wb->entries[i].state!=WB_FREE&&wb->entries[i].pageNum>=pageNum&&wb->entries[i].pageNum<limit)
+            limit=wb->entries[i].pageNum;
+    pthread_mutex_unlock(&wb->lock);
+    return limit;
+}
+#endif
+
+/*********************************************************************************
+ * Function:        check_readBlock_commonError
+ * Description:     check if handle is valid
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC check_readBlock_commonError(SM_FileHandle* fHandle)
 {
     // check if handle is valid
 	if (fHandle == 0 || fHandle->mgmtInfo == 0)
 	{
-		printf("The fileHandle is Empty!!!");
-		return RC_FILE_HANDLE_NOT_INIT;
+		THROW_LOG(RC_FILE_HANDLE_NOT_INIT, LOG_LEVEL_ERROR, "The fileHandle is Empty!!!");
+	}
+
+	return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        readPageFile
+ * Description:     read the bytes stored at a page of the file: zeros for a
+ *                  hole, else with a positioned read
+ * Called By:       readPageData
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number, already checked
+ * Output:          char* memPage: page content
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC readPageFile(DataBaseHeader* header, int pageNum, char* memPage)
+{
+    long off=(long)PAGE_SIZE*pageNum + header->sizeofHeader;
+
+    // pages that are file system holes are zeros, no need to read them
+    if(isHolePage(header,off))
+    {
+        memset(memPage,0,PAGE_SIZE);
+        return RC_OK;
+    }
+
+    int cls=ioBegin(PAGE_SIZE);
+#ifdef __linux__
+    // positioned read, bypasses the stdio buffer, which would go stale 
+    // when the flusher or a hole punch changes the file underneath it
+    ssize_t readsize=pread(fileno(header->filePointer),memPage,PAGE_SIZE,off);
+#else
+    // get the position of pageNumth block
+    fseek(header->filePointer,off,SEEK_SET);
+
+    //read the pageNumth block
+    int readsize=fread(memPage,1,PAGE_SIZE,header->filePointer);
+#endif
+    ioEnd(cls);
+    if (readsize != PAGE_SIZE)
+    {
+        return RC_ERROR;
+    }
+    memTouch(header->mem,pageNum,1);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writePageFile
+ * Description:     store a page at its place in the file, as a hole if it is
+ *                  all zeros
+ * Called By:       writePageData
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number, already checked
+                    char* memPage: page content
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writePageFile(DataBaseHeader* header, int pageNum, char* memPage)
+{
+    long off=(long)PAGE_SIZE*pageNum+header->sizeofHeader;
+
+    // an all zero page becomes a hole instead of 4 KB of zeros on disk
+    if(isZeroPage(memPage)&&punchPage(header,off))
+        return RC_OK;
+
+    //get to the pageNumth position
+    fseek(header->filePointer,off,SEEK_SET);
+
+    // write data from memPage to file
+    int cls=ioBegin(PAGE_SIZE);
+    int ok=fwrite(memPage,1,PAGE_SIZE,header->filePointer)==PAGE_SIZE;
+    fflush(header->filePointer);
+    ioEnd(cls);
+    if(!ok)
+        return RC_WRITE_FAILED;
+    invalidateExtent(header);
+    memTouch(header->mem,pageNum,1);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        moveSharedPage
+ * Description:     before the bytes of a shared page change, store them at the
+ *                  first page referring to it, which takes over the references
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page holding its own bytes
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC moveSharedPage(DataBaseHeader* header, int pageNum)
+{
+    Dedup* d=header->dedup;
+    int first=d->firstRef[pageNum];
+    if(first<0)
+        return RC_OK;
+
+    char* page=(char*)malloc(PAGE_SIZE);
+    if(page==0) return RC_ERROR;
+    // until the map is saved the references still lead to pageNum
+    RC ret=readPageFile(header,pageNum,page);
+    if(ret==RC_OK)
+        ret=writePageFile(header,first,page);
+    if(ret==RC_OK)
+    {
+        forgetDedupHash(d,pageNum);
+        unlinkDedupRef(d,first);
+        while(d->firstRef[pageNum]>=0)
+        {
+            int p=d->firstRef[pageNum];
+            unlinkDedupRef(d,p);
+            linkDedupRef(d,p,first);
+        }
+        d->entries[first].hash=pageHash(page);
+        d->entries[first].hashed=findDedupHash(d,d->entries[first].hash)<0;
+        if(d->entries[first].hashed)
+            ret=addDedupHash(d,first);
+        if(ret==RC_OK)
+            ret=saveDedup(d);
+    }
+    free(page);
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        dedupPage
+ * Description:     store a page of a deduplicated file: as a reference when
+ *                  another page holds the same bytes, else at its own place
+ *                  with its hash in the table
+ * Called By:       writePageData
+                    enablePageDedup
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number, already checked
+                    char* memPage: page content
+                    int inPlace: the bytes are at the page already, only share them
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC dedupPage(DataBaseHeader* header, int pageNum, char* memPage, int inPlace)
+{
+    Dedup* d=header->dedup;
+    int other=-1, same=0;
+    unsigned long long hash=0;
+
+    if(pageNum<0)
+        THROW(RC_WRITE_NON_EXISTING_PAGE, "no shared page map entry before page 0");
+    RC ret=growDedup(d,pageNum);
+    if(ret!=RC_OK) return ret;
+
+    // zero pages are holes, sharing them saves nothing
+    int zero=isZeroPage(memPage);
+    if(!zero)
+    {
+        hash=pageHash(memPage);
+        other=findDedupHash(d,hash);
+    }
+    if(other>=0)
+    {
+        char* page=(char*)malloc(PAGE_SIZE);
+        if(page==0) return RC_ERROR;
+        ret=readPageFile(header,other,page);
+        same=ret==RC_OK&&memcmp(page,memPage,PAGE_SIZE)==0;
+        free(page);
+        if(ret!=RC_OK) return ret;
+    }
+    // the same bytes again, or the same reference
+    if(same&&(other==pageNum||d->entries[pageNum].copyOf==other+1))
+        return RC_OK;
+
+    if(d->entries[pageNum].copyOf==0)
+    {
+        ret=moveSharedPage(header,pageNum);
+        if(ret!=RC_OK) return ret;
+        forgetDedupHash(d,pageNum);
+    }
+
+    if(same)
+    {
+        if(d->entries[pageNum].copyOf!=0)
+            unlinkDedupRef(d,pageNum);
+        linkDedupRef(d,pageNum,other);
+        ret=saveDedup(d);
+        if(ret==RC_OK)
+            punchPage(header,(long)PAGE_SIZE*pageNum+header->sizeofHeader);
+        return ret;
+    }
+
+    // the new bytes first, a reference dropped before would read as a hole
+    if(!inPlace)
+        ret=writePageFile(header,pageNum,memPage);
+    if(ret==RC_OK&&d->entries[pageNum].copyOf!=0)
+    {
+        unlinkDedupRef(d,pageNum);
+        ret=saveDedup(d);
+    }
+    // a different page with the same hash keeps its place in the table
+    if(ret==RC_OK&&!zero&&other<0)
+    {
+        d->entries[pageNum].hash=hash;
+        d->entries[pageNum].hashed=1;
+        d->dirty[pageNum/DEDUP_ENTRIES_PER_PAGE]=1;
+        ret=addDedupHash(d,pageNum);
+    }
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        readPageData
+ * Description:     read a page without touching the handle position: from the
+ *                  write-behind table, or from the file at the page holding
+ *                  its bytes, with staged ranges applied on top.
+ * Called By:       readBlock
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number, already checked
+ * Output:          char* memPage: page content
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC readPageData(DataBaseHeader* header, int pageNum, char* memPage)
+{
+#ifdef __linux__
+    // buffered writes are newer than the file
+    if(header->writeBehind!=0&&wbReadPage(header,pageNum,memPage))
+        return RC_OK;
+#endif
+
+    RC ret=readPageFile(header,pageSource(header,pageNum),memPage);
+    if(ret!=RC_OK)
+        return ret;
+
+    // staged ranges are newer than the file content
+    if(header->numStagedPages>0)
+    {
+        StagedPage* staged=findStagedPage(header,pageNum);
+        int i;
+        if(staged!=0)
+            for(i=0;i<staged->numRanges;i++)
+                memcpy(memPage+staged->ranges[i].offset,staged->image+staged->ranges[i].offset,staged->ranges[i].length);
+    }
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        readBlock
+ * Description:     read the pageNumth block from a file into memPage. 
+ * Called By:       readCurrentBlock
+                    readFirstBlock
+                    readLastBlock
+                    readNextBlock
+                    readPreviousBlock
+ * Input:           int pageNum: the sequence number of page that need to be read
+                    SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    //get information from handle
+	p_dataBaseHeader = fHandle->mgmtInfo;
+
+    // check if pageNumber is valid.
+	if (pageNum < 0 || pageNum >= p_dataBaseHeader->maxPageCount)
+	{
+		THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "PAGENUM exceed MAXPAGECOUNT");
+	}
+
+	fHandle->curPagePos = pageNum;
+    countReads(p_dataBaseHeader,pageNum,1);
+
+    return readPageData(p_dataBaseHeader,pageNum,memPage);
+}
+/*********************************************************************************
+ * Function:        readBlocks
+ * Description:     read numPages consecutive pages into one buffer with a single
+ *                  large read. Pages with newer data in the write-behind table or
+ *                  staged ranges are read one by one instead.
+ * Input:           int pageNum: first page
+                    int numPages: number of pages
+                    SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPages: numPages*PAGE_SIZE bytes
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle memPages)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+	p_dataBaseHeader = fHandle->mgmtInfo;
+	if (pageNum < 0 || numPages < 0 || pageNum + numPages > p_dataBaseHeader->maxPageCount)
+	{
+		THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "PAGENUM exceed MAXPAGECOUNT");
+	}
+    countReads(p_dataBaseHeader,pageNum,numPages);
+
+#ifdef __linux__
+    if(p_dataBaseHeader->writeBehind==0&&p_dataBaseHeader->numStagedPages==0&&p_dataBaseHeader->dedup==0)
+    {
+        // holes read back as zeros, no need to look for them
+        size_t length=(size_t)numPages*PAGE_SIZE;
+        size_t done=0;
+        long off=(long)PAGE_SIZE*pageNum+p_dataBaseHeader->sizeofHeader;
+        int cls=ioBegin((long)length);
+        while(done<length)
+        {
+            ssize_t n=pread(fileno(p_dataBaseHeader->filePointer),memPages+done,length-done,off+done);
+            if(n<0&&errno==EINTR)
+                continue;
+            if(n<=0)
+                break;
+            done+=n;
+        }
+        ioEnd(cls);
+        if(done<length)
+            return RC_ERROR;
+        memTouch(p_dataBaseHeader->mem,pageNum,numPages);
+        return RC_OK;
+    }
+#endif
+    int i;
+    for(i=0;i<numPages;i++)
+    {
+        RC ret=readPageData(p_dataBaseHeader,pageNum+i,memPages+(long)i*PAGE_SIZE);
+        if(ret!=RC_OK)
+            return ret;
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        getBlockPos
+ * Description:     get the block position in a file. 
+ * Input:           SM_FileHandle *fHandle: file handle
+ * Output:          None
+ * Return:          int: the block position
+ **********************************************************************************/
+int getBlockPos(SM_FileHandle *fHandle)
+{
+    return fHandle->curPagePos;
+}
+
+/*********************************************************************************
+ * Function:        readCurrentBlock
+ * Description:     read the current block from a file into memPage. 
+ * Calls:           readBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    // check if current page position is valid.
+	if (fHandle->curPagePos >= fHandle->totalNumPages)
+	{
+		THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "CurrentPagePos not in TotalPageNum");
+	}
+
+    //read current block
+    return readBlock(fHandle->curPagePos,fHandle,memPage);
+}
+
+
+/*********************************************************************************
+ * Function:        readFirstBlock
+ * Description:     read the first block from a file into memPage. 
+ * Calls:           readBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readFirstBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    //read the first block
+    return readBlock(0,fHandle,memPage);
+}
+
+/*********************************************************************************
+ * Function:        readLastBlock
+ * Description:     read the last block from a file into memPage. 
+ * Calls:           readBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    // read last block
+    return readBlock(fHandle->totalNumPages-1,fHandle,memPage);
+}
+
+/*********************************************************************************
+ * Function:        readNextBlock
+ * Description:     read the next block from a file into memPage. 
+ * Calls:           readBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    // check if current page is the last one. Return error if it is.
+    if(fHandle->curPagePos>=(fHandle->totalNumPages-1))
+    {
+		THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "Current Page is the last Block!");
+    }
+
+    // read the next block
+    return readBlock(fHandle->curPagePos+1,fHandle,memPage);
+}
+
+/*********************************************************************************
+ * Function:        readPreviousBlock
+ * Description:     read the previous block from a file into memPage. 
+ * Calls:           readBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Return:          RC: return code
+ **********************************************************************************/
+RC readPreviousBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    // check if current page is the first one or invalid. Return error if it is.
+	if (fHandle->curPagePos > fHandle->totalNumPages || fHandle->curPagePos==0)
+	{
+		THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "Current Page is the first Block or current Page exceed last Block!");
+	}
+
+    // read the previous block
+    return readBlock(fHandle->curPagePos-1,fHandle,memPage);
+}
+
+/*********************************************************************************
+ * Function:        writePageData
+ * Description:     write a page without touching the handle position: into the
+ *                  write-behind table, as a reference to a page with the same
+ *                  bytes, as a hole if it is all zeros, or to the file.
+ * Called By:       writeBlock
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number, already checked
+                    char* memPage: page content
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC writePageData(DataBaseHeader* header, int pageNum, char* memPage)
+{
+    RC ret=summarizePage(header,pageNum,memPage);
+    if(ret==RC_OK)
+        ret=trackChange(header,pageNum,1);
+    if(ret!=RC_OK) return ret;
+    shipRecord(header,SHIP_PAGE,pageNum,0,PAGE_SIZE,memPage);
+
+#ifdef __linux__
+    if(header->writeBehind!=0)
+    {
+        wbWritePage(header->writeBehind,pageNum,memPage);
+        return RC_OK;
+    }
+#endif
+
+    ret=header->dedup!=0?dedupPage(header,pageNum,memPage,0):writePageFile(header,pageNum,memPage);
+    if(ret!=RC_OK) return ret;
+
+    // the whole page was replaced, staged ranges for it are stale now
+    if(header->numStagedPages>0)
+    {
+        StagedPage* staged=findStagedPage(header,pageNum);
+        if(staged!=0)
+            dropStagedPage(header,staged);
+    }
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        writeBlock
+ * Description:     write the pageNumth block from a memPage into file. 
+ * Called By:       writeCurrentBlock
+ * Input:           int pageNum: the sequence number of page that need to be written
+                    SM_FileHandle* fHandle: file handle
+                    SM_PageHandle memPage: the page handle that will be written
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    //get information from handle
+	p_dataBaseHeader = fHandle->mgmtInfo;
+
+    // check if pageNum is valid, page -1 would be the header
+    if(pageNum<0||pageNum>=p_dataBaseHeader->maxPageCount)
+    {
+		THROW_LOG(RC_WRITE_NON_EXISTING_PAGE, LOG_LEVEL_ERROR, "The PageNum Exceed the MaxPageCount, Can not Write to Invalid Page!");
+    }
+
+    return writePageData(p_dataBaseHeader,pageNum,memPage);
+}
+
+/*********************************************************************************
+ * Function:        writeCurrentBlock
+ * Description:     write the current block from a memPage into file. 
+ * Calls:           writeBlock
+ * Input:           SM_FileHandle* fHandle: file handle
+                    SM_PageHandle memPage: the page handle that write from
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+{
+    //check if handle given is valid
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    //chekc if current page position is valid
+	if (fHandle->curPagePos >= fHandle->totalNumPages||fHandle->curPagePos<0)
+	{
+		THROW_LOG(RC_WRITE_NON_EXISTING_PAGE, LOG_LEVEL_ERROR, "the CurrentPage is not Exist! Have you modified the FileHandle outside the Program???");
 	}
 
-	return RC_OK;
+    //write block
+    return writeBlock(fHandle->curPagePos,fHandle,memPage);
+}
+
+/*********************************************************************************
+ * Function:        writeBlocks
+ * Description:     write numPages consecutive pages from one buffer with a single
+ *                  large write, for bulk loads into pages that already exist.
+ *                  Zero pages are written as zeros, not punched. With write-behind
+ *                  enabled the pages go through the write-behind table one by one.
+ * Input:           int pageNum: first page
+                    int numPages: number of pages
+                    SM_FileHandle* fHandle: file handle
+                    SM_PageHandle memPages: numPages*PAGE_SIZE bytes
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle memPages)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+	p_dataBaseHeader = fHandle->mgmtInfo;
+    if(pageNum<0||numPages<0||pageNum+numPages>p_dataBaseHeader->maxPageCount)
+    {
+		THROW_LOG(RC_WRITE_NON_EXISTING_PAGE, LOG_LEVEL_ERROR, "The PageNum Exceed the MaxPageCount, Can not Write to Invalid Page!");
+    }
+    if(numPages==0)
+        return RC_OK;
+
+    int i;
+    // every page is looked up in the shared page map on its own
+    if(p_dataBaseHeader->dedup!=0)
+    {
+        DataBaseHeader* header=p_dataBaseHeader;
+        for(i=0;i<numPages;i++)
+        {
+            RC ret=writePageData(header,pageNum+i,memPages+(long)i*PAGE_SIZE);
+            if(ret!=RC_OK) return ret;
+        }
+        return RC_OK;
+    }
+    for(i=0;i<numPages;i++)
+    {
+        RC ret=summarizePage(p_dataBaseHeader,pageNum+i,memPages+(long)i*PAGE_SIZE);
+        if(ret!=RC_OK) return ret;
+    }
+    RC ret=trackChange(p_dataBaseHeader,pageNum,numPages);
+    if(ret!=RC_OK) return ret;
+    for(i=0;i<numPages;i++)
+        shipRecord(p_dataBaseHeader,SHIP_PAGE,pageNum+i,0,PAGE_SIZE,memPages+(long)i*PAGE_SIZE);
+
+    long off=(long)PAGE_SIZE*pageNum+p_dataBaseHeader->sizeofHeader;
+#ifdef __linux__
+    if(p_dataBaseHeader->writeBehind!=0)
+    {
+        for(i=0;i<numPages;i++)
+            wbWritePage(p_dataBaseHeader->writeBehind,pageNum+i,memPages+(long)i*PAGE_SIZE);
+        return RC_OK;
+    }
+
+    struct iovec iov;
+    iov.iov_base=memPages;
+    iov.iov_len=(size_t)numPages*PAGE_SIZE;
+    fflush(p_dataBaseHeader->filePointer);
+    int cls=ioBegin((long)numPages*PAGE_SIZE);
+    int ok=pwritevFully(fileno(p_dataBaseHeader->filePointer),&iov,1,off);
+    ioEnd(cls);
+    if(!ok)
+        return RC_WRITE_FAILED;
+#else
+    fseek(p_dataBaseHeader->filePointer,off,SEEK_SET);
+    int cls=ioBegin((long)numPages*PAGE_SIZE);
+    int ok=fwrite(memPages,PAGE_SIZE,numPages,p_dataBaseHeader->filePointer)==(size_t)numPages;
+    fflush(p_dataBaseHeader->filePointer);
+    ioEnd(cls);
+    if(!ok)
+        return RC_WRITE_FAILED;
+#endif
+    invalidateExtent(p_dataBaseHeader);
+    memTouch(p_dataBaseHeader->mem,pageNum,numPages);
+
+    // the pages were replaced, staged ranges for them are stale now
+    while(p_dataBaseHeader->numStagedPages>0)
+    {
+        for(i=0;i<p_dataBaseHeader->numStagedPages;i++)
+        {
+            int staged=p_dataBaseHeader->stagedPages[i].pageNum;
+            if(staged>=pageNum&&staged<pageNum+numPages)
+                break;
+        }
+        if(i==p_dataBaseHeader->numStagedPages)
+            break;
+        dropStagedPage(p_dataBaseHeader,&p_dataBaseHeader->stagedPages[i]);
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        check_writeBlockRange_args
+ * Description:     check the handle, page number and byte range of a range write
+ * Input:           int pageNum: page number
+                    int offset: first byte in the page
+                    int length: number of bytes
+                    SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC check_writeBlockRange_args(int pageNum, int offset, int length, SM_FileHandle *fHandle)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    if(pageNum<0||pageNum>=((DataBaseHeader*)fHandle->mgmtInfo)->maxPageCount)
+    {
+		THROW_LOG(RC_WRITE_NON_EXISTING_PAGE, LOG_LEVEL_ERROR, "The PageNum Exceed the MaxPageCount, Can not Write to Invalid Page!");
+    }
+    if(offset<0||length<0||offset+length>PAGE_SIZE)
+    {
+        THROW_LOG(RC_MEMPAGE_BIGGER_THAN_PAGESIZE, LOG_LEVEL_ERROR, "The range does not fit into one page!");
+    }
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        patchPage
+ * Description:     apply a byte range to the newest copy of a page and write the 
+ *                  whole page again. Used while write-behind is on, where a direct
+ *                  range write could be overwritten by an older buffered page,
+ *                  and for deduplicated files, where the page may be shared.
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: page number
+                    int offset: first byte in the page
+                    int length: number of bytes
+                    char* data: the bytes to write
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC patchPage(DataBaseHeader* header, int pageNum, int offset, int length, char* data)
+{
+    char* page=(char*)malloc(PAGE_SIZE);
+    if(page==0) return RC_ERROR;
+
+    RC ret=readPageData(header,pageNum,page);
+    if(ret==RC_OK)
+    {
+        memcpy(page+offset,data,length);
+        ret=writePageData(header,pageNum,page);
+    }
+    free(page);
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        writeBlockRange
+ * Description:     write length bytes of data at offset within the pageNumth block,
+ *                  the rest of the page on disk is left untouched.
+ * Input:           int pageNum: the sequence number of page that need to be written
+                    int offset: first byte in the page
+                    int length: number of bytes to write
+                    SM_FileHandle* fHandle: file handle
+                    char* data: the bytes to write
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC writeBlockRange(int pageNum, int offset, int length, SM_FileHandle *fHandle, char *data)
+{
+	RC check = check_writeBlockRange_args(pageNum, offset, length, fHandle);
+	if (check != RC_OK) return check;
+
+	p_dataBaseHeader = fHandle->mgmtInfo;
+    if(p_dataBaseHeader->writeBehind!=0||p_dataBaseHeader->dedup!=0)
+        return patchPage(p_dataBaseHeader,pageNum,offset,length,data);
+
+    // a staged copy of these bytes would overwrite ours at the next flush
+    if(p_dataBaseHeader->numStagedPages>0&&findStagedPage(p_dataBaseHeader,pageNum)!=0)
+        return stageBlockRange(pageNum,offset,length,fHandle,data);
+
+    // the bytes are not seen as a page, so the summary of the page is lost
+    RC ret=forgetPage(p_dataBaseHeader,pageNum);
+    if(ret==RC_OK)
+        ret=trackChange(p_dataBaseHeader,pageNum,1);
+    if(ret!=RC_OK) return ret;
+    shipRecord(p_dataBaseHeader,SHIP_RANGE,pageNum,offset,length,data);
+
+    fseek(p_dataBaseHeader->filePointer,(long)PAGE_SIZE*pageNum+p_dataBaseHeader->sizeofHeader+offset,SEEK_SET);
+    int cls=ioBegin(length);
+    int ok=(int)fwrite(data,1,length,p_dataBaseHeader->filePointer)==length;
+    fflush(p_dataBaseHeader->filePointer);
+    ioEnd(cls);
+    if(!ok)
+        return RC_WRITE_FAILED;
+    invalidateExtent(p_dataBaseHeader);
+    memTouch(p_dataBaseHeader->mem,pageNum,1);
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        stageBlockRange
+ * Description:     like writeBlockRange, but only record the bytes in memory.
+ *                  Overlapping and adjacent ranges of the same page are merged, 
+ *                  so many small updates reach the disk as few writes at
+ *                  flushBlockRanges, checkpointPageFile or closePageFile.
+ *                  readBlock sees staged bytes right away.
+ * Calls:           flushBlockRanges
+ * Input:           int pageNum: the sequence number of page that need to be written
+                    int offset: first byte in the page
+                    int length: number of bytes to write
+                    SM_FileHandle* fHandle: file handle
+                    char* data: the bytes to write
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC stageBlockRange(int pageNum, int offset, int length, SM_FileHandle *fHandle, char *data)
+{
+	RC check = check_writeBlockRange_args(pageNum, offset, length, fHandle);
+	if (check != RC_OK) return check;
+    if(length==0) return RC_OK;
+
+	DataBaseHeader* header = fHandle->mgmtInfo;
+    // the write-behind table already batches and merges page writes,
+    // a deduplicated page is only ever replaced as a whole
+    if(header->writeBehind!=0||header->dedup!=0)
+        return patchPage(header,pageNum,offset,length,data);
+
+    RC ret=forgetPage(header,pageNum);
+    if(ret==RC_OK)
+        ret=trackChange(header,pageNum,1);
+    if(ret!=RC_OK) return ret;
+    shipRecord(header,SHIP_RANGE,pageNum,offset,length,data);
+
+    if(header->stagedPages==0)
+    {
+        header->stagedPages=(StagedPage*)calloc(STAGED_PAGE_COUNT,sizeof(StagedPage));
+        if(header->stagedPages==0) return RC_ERROR;
+    }
+
+    StagedPage* staged=findStagedPage(header,pageNum);
+    if(staged==0)
+    {
+        // table full, make room by writing everything out
+        if(header->numStagedPages==STAGED_PAGE_COUNT)
+        {
+            ret=flushBlockRanges(fHandle);
+            if(ret!=RC_OK) return ret;
+        }
+        staged=&header->stagedPages[header->numStagedPages++];
+        if(staged->image==0)
+        {
+            staged->image=(char*)malloc(PAGE_SIZE);
+            if(staged->image==0)
+            {
+                header->numStagedPages--;
+                return RC_ERROR;
+            }
+            // kept until the file is closed
+            memReserve(header->mem,SM_MEM_STAGED,PAGE_SIZE,PAGE_SIZE);
+        }
+        staged->pageNum=pageNum;
+        staged->numRanges=0;
+    }
+
+    memcpy(staged->image+offset,data,length);
+
+    // merge the new range with every range it overlaps or touches
+    int start=offset, end=offset+length;
+    int i, j=0;
+    StagedRange merged[STAGED_RANGE_COUNT+1];
+    for(i=0;i<staged->numRanges;i++)
+    {
+        StagedRange* r=&staged->ranges[i];
+        if(r->offset+r->length<start||r->offset>end)
+            merged[j++]=*r;
+        else
+        {
+            if(r->offset<start) start=r->offset;
+            if(r->offset+r->length>end) end=r->offset+r->length;
+        }
+    }
+    // insert keeping the ranges ordered by offset
+    for(i=j;i>0&&merged[i-1].offset>start;i--)
+        merged[i]=merged[i-1];
+    merged[i].offset=start;
+    merged[i].length=end-start;
+    j++;
+
+    if(j>STAGED_RANGE_COUNT)
+    {
+        // too fragmented to track, write the page out now
+        ret=writeStagedRanges(header,staged,merged,j);
+        if(ret!=RC_OK) return ret;
+        dropStagedPage(header,staged);
+        return RC_OK;
+    }
+    memcpy(staged->ranges,merged,sizeof(StagedRange)*j);
+    staged->numRanges=j;
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        flushBlockRanges
+ * Description:     write all staged ranges of a file to disk
+ * Called By:       stageBlockRange
+                    checkpointPageFile
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC flushBlockRanges(SM_FileHandle *fHandle)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+	DataBaseHeader* header = fHandle->mgmtInfo;
+    while(header->numStagedPages>0)
+    {
+        StagedPage* staged=&header->stagedPages[header->numStagedPages-1];
+        RC ret=writeStagedRanges(header,staged,staged->ranges,staged->numRanges);
+        if(ret!=RC_OK) return ret;
+        dropStagedPage(header,staged);
+    }
+    return RC_OK;
 }
 
 /*********************************************************************************
- * Function:        readBlock
- * Description:     read the pageNumth block from a file into memPage. 
- * Called By:       readCurrentBlock
-                    readFirstBlock
-                    readLastBlock
-                    readNextBlock
-                    readPreviousBlock
- * Input:           int pageNum: the sequence number of page that need to be read
-                    SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Function:        appendEmptyBlock
+ * Description:     append an new empty block filled with zero bytes at the end of the file.
+ * Calls:           extendPageFile
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC appendEmptyBlock(SM_FileHandle *fHandle)
+{
+    //check if handle given is valid
+    if(fHandle==0)
+    {
+        THROW_LOG(RC_FILE_HANDLE_NOT_INIT, LOG_LEVEL_ERROR, "The fileHandle is NULL!!!, Function will exit.");
+    }
+
+    //get information from handle
+    p_dataBaseHeader=(DataBaseHeader*)fHandle->mgmtInfo;
+
+    // increase the number of pages in file
+    int num=p_dataBaseHeader->maxPageCount+1;
+
+    // add a page of zero bytes at the end of the file
+    RC ret=spillTempFile(p_dataBaseHeader,num);
+    if(ret==RC_OK)
+        ret=extendPageFile(p_dataBaseHeader,num);
+    if(ret!=RC_OK)
+        return ret;
+
+    //update the handle information, the header is written back lazily at checkpoint
+    fHandle->totalNumPages=num;
+    p_dataBaseHeader->maxPageCount=num;
+	fHandle->curPagePos = num - 1;
+	p_dataBaseHeader->currentPage = num - 1;
+    p_dataBaseHeader->headerDirty = 1;
+
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        ensureCapacity
+ * Description:     increase the number of pages to numberOfPages if it is less than that.
+ * Calls:           extendPageFile
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle)
 {
     //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    //get information from handle
-	p_dataBaseHeader = fHandle->mgmtInfo;
+    // shrinking is not supported
+    if (fHandle->totalNumPages > numberOfPages)
+        return RC_ERROR;
+    if (fHandle->totalNumPages == numberOfPages)
+        return RC_OK;
 
-    // check if pageNumber is valid.
-	if (pageNum >= p_dataBaseHeader->maxPageCount)
-	{
-		printf("PAGENUM exceed MAXPAGECOUNT");
-		return RC_READ_NON_EXISTING_PAGE;
-	}
+    // grow in one step instead of one page at a time
+    p_dataBaseHeader=(DataBaseHeader*)fHandle->mgmtInfo;
+    RC ret=spillTempFile(p_dataBaseHeader,numberOfPages);
+    if(ret==RC_OK)
+        ret=extendPageFile(p_dataBaseHeader,numberOfPages);
+    if(ret!=RC_OK)
+        return ret;
 
-	fHandle->curPagePos = pageNum;
+    // same handle state as after appending the pages one by one
+    fHandle->totalNumPages=numberOfPages;
+    p_dataBaseHeader->maxPageCount=numberOfPages;
+	fHandle->curPagePos = numberOfPages - 1;
+	p_dataBaseHeader->currentPage = numberOfPages - 1;
+    p_dataBaseHeader->headerDirty = 1;
 
-    // reset the file pointer to the beginning
-    rewind(p_dataBaseHeader->filePointer);
+	return RC_OK;
+}
 
-    // get the position of pageNumth block
-    fseek(p_dataBaseHeader->filePointer,PAGE_SIZE*pageNum + p_dataBaseHeader->sizeofHeader,SEEK_SET);
+/*********************************************************************************
+ * Function:        getNextDataBlockPos
+ * Description:     find the first page at or after pageNum that is not a file
+ *                  system hole, so scans can skip runs of empty pages.
+ *                  Without hole support every page counts as data.
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int pageNum: first page to look at
+ * Output:          None
+ * Return:          int: page number, totalNumPages if only holes follow
+ **********************************************************************************/
+int getNextDataBlockPos(SM_FileHandle *fHandle, int pageNum)
+{
+    if(check_readBlock_commonError(fHandle)!=RC_OK||pageNum>=fHandle->totalNumPages)
+        return fHandle==0?0:fHandle->totalNumPages;
+    if(pageNum<0)
+        pageNum=0;
 
-    //read the pageNumth block
-    int readsize=fread(memPage,1,PAGE_SIZE,p_dataBaseHeader->filePointer);
-	if (readsize != PAGE_SIZE)
-	{
-		return RC_ERROR;
-	}
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    int next=pageNum;
+#ifdef __linux__
+    if(header->probeFd>=0)
+    {
+        long off=(long)PAGE_SIZE*pageNum+header->sizeofHeader;
+        off_t data=lseek(header->probeFd,off,SEEK_DATA);
+        if(data<0)
+            next=errno==ENXIO?fHandle->totalNumPages:pageNum;
+        else
+            next=(int)((data-header->sizeofHeader)/PAGE_SIZE);
+        if(next>fHandle->totalNumPages)
+            next=fHandle->totalNumPages;
+    }
+#endif
+
+#ifdef __linux__
+    // so are pages in the write-behind table
+    if(header->writeBehind!=0)
+        next=wbFirstPageFrom(header->writeBehind,pageNum,next);
+#endif
+
+    // shared pages are holes in the file, but not empty
+    int i;
+    for(i=pageNum;header->dedup!=0&&i<next&&i<header->dedup->capacity;i++)
+        if(header->dedup->entries[i].copyOf!=0)
+            next=i;
+
+    // staged ranges are data that is not in the file yet
+    for(i=0;i<header->numStagedPages;i++)
+    {
+        int staged=header->stagedPages[i].pageNum;
+        if(staged>=pageNum&&staged<next)
+            next=staged;
+    }
+    return next;
+}
+
+/*********************************************************************************
+ * Function:        enableWriteBehind
+ * Description:     switch a file to write-behind mode. writeBlock then only 
+ *                  copies the page into a table of at most maxDirtyPages pages
+ *                  and a background thread writes them, sorted and coalesced 
+ *                  into runs of consecutive pages. When the table is full 
+ *                  writeBlock waits for the flusher. Reads see buffered pages.
+ *                  Linux only.
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int maxDirtyPages: size of the table in pages
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC enableWriteBehind(SM_FileHandle *fHandle, int maxDirtyPages)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
 
+#ifdef __linux__
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    int i;
+
+    if(header->writeBehind!=0)
+        return RC_OK;
+    if(header->dedup!=0)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "write-behind does not go with page deduplication");
+    if(maxDirtyPages<2)
+        maxDirtyPages=2;
+
+    // the table takes over all page writes, nothing may be pending elsewhere
+    RC ret=flushBlockRanges(fHandle);
+    if(ret!=RC_OK) return ret;
+
+    WriteBehind* wb=(WriteBehind*)calloc(1,sizeof(WriteBehind));
+    if(wb==0) return RC_ERROR;
+    wb->fd=fileno(header->filePointer);
+    wb->sizeofHeader=header->sizeofHeader;
+    wb->mem=header->mem;
+    // the table gets what the memory budget can hold
+    maxDirtyPages=(int)(memReserve(header->mem,SM_MEM_WRITE_BEHIND,(long long)PAGE_SIZE*maxDirtyPages,2L*PAGE_SIZE)/PAGE_SIZE);
+    wb->maxDirtyPages=maxDirtyPages;
+    wb->numBuckets=maxDirtyPages*2;
+    wb->entries=(WriteBehindEntry*)calloc(maxDirtyPages,sizeof(WriteBehindEntry));
+    wb->batch=(WriteBehindEntry**)malloc(sizeof(WriteBehindEntry*)*maxDirtyPages);
+    wb->iov=(struct iovec*)malloc(sizeof(struct iovec)*(maxDirtyPages<IOV_MAX?maxDirtyPages:IOV_MAX));
+    wb->pages=allocPageMemory(maxDirtyPages);
+    wb->buckets=(int*)malloc(sizeof(int)*wb->numBuckets);
+    if(wb->entries==0||wb->batch==0||wb->iov==0||wb->pages==0||wb->buckets==0)
+    {
+        memRelease(header->mem,SM_MEM_WRITE_BEHIND,(long long)PAGE_SIZE*maxDirtyPages);
+        free(wb->entries); free(wb->batch); free(wb->iov); freePageMemory(wb->pages); free(wb->buckets);
+        free(wb);
+        return RC_ERROR;
+    }
+
+    for(i=0;i<wb->numBuckets;i++)
+        wb->buckets[i]=-1;
+    for(i=0;i<maxDirtyPages;i++)
+    {
+        wb->entries[i].page=wb->pages+(size_t)PAGE_SIZE*i;
+        wb->entries[i].next=i+1<maxDirtyPages?i+1:-1;
+    }
+    wb->freeList=0;
+    wb->error=RC_OK;
+
+    // the flush interval must not move with the system time
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr,CLOCK_MONOTONIC);
+    pthread_mutex_init(&wb->lock,0);
+    pthread_cond_init(&wb->work,&attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&wb->space,0);
+    pthread_cond_init(&wb->done,0);
+    if(pthread_create(&wb->flusher,0,wbFlusherMain,wb)!=0)
+    {
+        pthread_mutex_destroy(&wb->lock);
+        pthread_cond_destroy(&wb->work);
+        pthread_cond_destroy(&wb->space);
+        pthread_cond_destroy(&wb->done);
+        memRelease(header->mem,SM_MEM_WRITE_BEHIND,(long long)PAGE_SIZE*maxDirtyPages);
+        free(wb->entries); free(wb->batch); free(wb->iov); freePageMemory(wb->pages); free(wb->buckets);
+        free(wb);
+        return RC_ERROR;
+    }
+
+    header->writeBehind=wb;
     return RC_OK;
+#else
+    THROW_LOG(RC_FEATURE_NOT_SUPPORTED, LOG_LEVEL_ERROR, "Write-behind is not supported on this platform!");
+#endif
 }
+
 /*********************************************************************************
- * Function:        getBlockPos
- * Description:     get the block position in a file. 
- * Input:           SM_FileHandle *fHandle: file handle
+ * Function:        flushWriteBehind
+ * Description:     barrier, returns once every page written before the call is 
+ *                  in the file. Reports the first write error of the flusher.
+ * Called By:       checkpointPageFile
+                    disableWriteBehind
+ * Input:           SM_FileHandle* fHandle: file handle
  * Output:          None
- * Return:          int: the block position
+ * Return:          RC: return code
  **********************************************************************************/
-peipei3
+RC flushWriteBehind(SM_FileHandle *fHandle)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+#ifdef __linux__
+    WriteBehind* wb=((DataBaseHeader*)fHandle->mgmtInfo)->writeBehind;
+    if(wb==0)
+        return RC_OK;
+
+    pthread_mutex_lock(&wb->lock);
+    wb->flushRequested=1;
+    pthread_cond_signal(&wb->work);
+    while(wb->numDirty+wb->numFlushing>0)
+        pthread_cond_wait(&wb->done,&wb->lock);
+    RC ret=wb->error;
+    wb->error=RC_OK;
+    pthread_mutex_unlock(&wb->lock);
+    return ret;
+#else
+    return RC_OK;
+#endif
+}
 
 /*********************************************************************************
- * Function:        readCurrentBlock
- * Description:     read the current block from a file into memPage. 
- * Calls:           readBlock
+ * Function:        disableWriteBehind
+ * Description:     flush the table, stop the flusher and go back to writing
+ *                  pages directly
+ * Called By:       closePageFile
+ * Calls:           flushWriteBehind
  * Input:           SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC readCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC disableWriteBehind(SM_FileHandle *fHandle)
 {
-    //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    // check if current page position is valid.
-	if (fHandle->curPagePos >= fHandle->totalNumPages)
-	{
-		printf("CurrentPagePos not in TotalPageNum");
-		return RC_READ_NON_EXISTING_PAGE;
-	}
+#ifdef __linux__
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    WriteBehind* wb=header->writeBehind;
+    if(wb==0)
+        return RC_OK;
 
-    //read current block
-    return readBlock(fHandle->curPagePos,fHandle,memPage);
+    RC ret=flushWriteBehind(fHandle);
+
+    pthread_mutex_lock(&wb->lock);
+    wb->stop=1;
+    pthread_cond_signal(&wb->work);
+    pthread_mutex_unlock(&wb->lock);
+    pthread_join(wb->flusher,0);
+
+    // the file changed behind the cached extent
+    invalidateExtent(header);
+    header->writeBehind=0;
+
+    pthread_mutex_destroy(&wb->lock);
+    pthread_cond_destroy(&wb->work);
+    pthread_cond_destroy(&wb->space);
+    pthread_cond_destroy(&wb->done);
+    free(wb->entries);
+    free(wb->batch);
+    free(wb->iov);
+    freePageMemory(wb->pages);
+    free(wb->buckets);
+    memRelease(header->mem,SM_MEM_WRITE_BEHIND,(long long)PAGE_SIZE*wb->maxDirtyPages);
+    free(wb);
+    return ret;
+#else
+    return RC_OK;
+#endif
+}
+
+/*********************************************************************************
+ * Function:        enablePageSummaries
+ * Description:     keep a summary of the keys of every page: from now on each page
+ *                  written with writeBlock or writeBlocks is passed to pageKeys,
+ *                  and its smallest and largest key and a Bloom filter of its keys
+ *                  are kept in memory and in the summary file "<fileName>.sum".
+ *                  Existing pages without a summary are read and summarized now.
+ *                  A page changed with writeBlockRange or stageBlockRange has no
+ *                  summary until it is written as a whole again.
+ *                  The summaries are saved by checkpointPageFile and closePageFile
+ *                  and are there again after openPageFile; call this again after
+ *                  opening to keep them up to date.
+ * Input:           SM_FileHandle* fHandle: file handle
+                    SM_PageKeys pageKeys: key extractor, returns the number of keys
+                                          of a page or -1 if they are unknown
+                    void* ctx: passed to pageKeys
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC enablePageSummaries(SM_FileHandle *fHandle, SM_PageKeys pageKeys, void *ctx)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    RC ret=RC_OK;
+    int i;
+
+    if(header->temporary!=TEMP_NONE)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "a temporary page file has no summary file");
+    if(header->summaries==0)
+    {
+        ret=openSummaries(header,fHandle->fileName,1);
+        p_dataBaseHeader=header;
+        if(ret!=RC_OK)
+            THROW_FMT(ret, LOG_LEVEL_ERROR, "Can not create the summary file of %s!", fHandle->fileName);
+    }
+    PageSummaries* s=header->summaries;
+    s->pageKeys=pageKeys;
+    s->ctx=ctx;
+
+    char* page=(char*)malloc(PAGE_SIZE);
+    if(page==0) return RC_ERROR;
+    for(i=0;ret==RC_OK&&i<header->maxPageCount;i++)
+    {
+        if(i<s->numEntries&&s->entries[i].known)
+            continue;
+        ret=readPageData(header,i,page);
+        if(ret==RC_OK)
+            ret=summarizePage(header,i,page);
+    }
+    free(page);
+    return ret;
 }
 
+/*********************************************************************************
+ * Function:        hasPageSummaries
+ * Description:     whether a file keeps page summaries
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          int: 1 if it does, else 0
+ **********************************************************************************/
+int hasPageSummaries(SM_FileHandle *fHandle)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return 0;
+    return ((DataBaseHeader*)fHandle->mgmtInfo)->summaries!=0;
+}
 
 /*********************************************************************************
- * Function:        readFirstBlock
- * Description:     read the first block from a file into memPage. 
- * Calls:           readBlock
+ * Function:        pageMayContain
+ * Description:     check the summary of a page for a key, without reading the page
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int pageNum: page number
+                    unsigned long long key: key as given to the key extractor
+ * Output:          None
+ * Return:          int: 0 if the page does not hold the key, 1 if it may
+ **********************************************************************************/
+int pageMayContain(SM_FileHandle *fHandle, int pageNum, unsigned long long key)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return 1;
+    PageSummaries* s=((DataBaseHeader*)fHandle->mgmtInfo)->summaries;
+    if(s==0||pageNum<0||pageNum>=s->numEntries||!s->entries[pageNum].known)
+        return 1;
+
+    PageSummary* e=&s->entries[pageNum];
+    if(e->numKeys==0||key<e->min||key>e->max)
+        return 0;
+    unsigned long long h=bloomHash(key);
+    unsigned int h1=(unsigned int)h, h2=(unsigned int)(h>>32)|1;
+    int k;
+    for(k=0;k<SUMMARY_BLOOM_HASHES;k++)
+    {
+        unsigned int bit=(h1+k*h2)%(SUMMARY_BLOOM_BYTES*8);
+        if(!(e->bloom[bit>>3]&(1<<(bit&7))))
+            return 0;
+    }
+    return 1;
+}
+
+/*********************************************************************************
+ * Function:        pageMayOverlap
+ * Description:     check the summary of a page for keys in [low, high], without
+ *                  reading the page
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int pageNum: page number
+                    unsigned long long low: smallest key of the range
+                    unsigned long long high: largest key of the range
+ * Output:          None
+ * Return:          int: 0 if the page holds no key of the range, 1 if it may
+ **********************************************************************************/
+int pageMayOverlap(SM_FileHandle *fHandle, int pageNum, unsigned long long low, unsigned long long high)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return 1;
+    PageSummaries* s=((DataBaseHeader*)fHandle->mgmtInfo)->summaries;
+    if(s==0||pageNum<0||pageNum>=s->numEntries||!s->entries[pageNum].known)
+        return 1;
+
+    PageSummary* e=&s->entries[pageNum];
+    return e->numKeys>0&&e->min<=high&&e->max>=low;
+}
+
+/*********************************************************************************
+ * Function:        enableChangeTracking
+ * Description:     keep track of the pages written since the last backup. The
+ *                  first backup after this holds every page; tracking stays on
+ *                  when the file is opened again.
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC enableChangeTracking(SM_FileHandle *fHandle)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    if(header->temporary!=TEMP_NONE)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "a temporary page file has no change file");
+    if(header->changes!=0)
+        return RC_OK;
+    RC ret=openChanges(header,fHandle->fileName,1);
+    p_dataBaseHeader=header;
+    if(ret!=RC_OK)
+        THROW_FMT(ret, LOG_LEVEL_ERROR, "Can not create the change file of %s!", fHandle->fileName);
+    return RC_OK;
+}
+
+/*********************************************************************************
+ * Function:        getChangedPageCount
+ * Description:     number of pages a backup would copy now
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          int: number of changed pages, -1 if changes are not tracked
+ **********************************************************************************/
+int getChangedPageCount(SM_FileHandle *fHandle)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return -1;
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    ChangeTracking* c=header->changes;
+    int count=0, i;
+
+    if(c==0)
+        return -1;
+    // bits of pages past the end of the file do not count
+    int end=header->maxPageCount<c->capacity?header->maxPageCount:c->capacity;
+    for(i=0;i<end/64;i++)
+        count+=__builtin_popcountll(c->bits[i]);
+    if(end%64!=0)
+        count+=__builtin_popcountll(c->bits[end/64]&((1ULL<<(end%64))-1));
+    return count;
+}
+
+/*********************************************************************************
+ * Function:        backupPageDelta
+ * Description:     write the pages changed since the last backup to a new delta
+ *                  file and start the next epoch. Runs of pages are copied from
+ *                  file to file by the kernel. If anything fails, the changed
+ *                  pages stay marked and the next backup copies them again.
+ * Calls:           checkpointPageFile
+ * Input:           SM_FileHandle* fHandle: file handle, changes must be tracked
+                    char* deltaName: name of the delta file to create
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC backupPageDelta(SM_FileHandle *fHandle, char *deltaName)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
+
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    ChangeTracking* c=header->changes;
+    if(c==0)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "changes of the file are not tracked");
+    if(_access(deltaName,0)==0)
+        THROW_FMT(RC_FILE_ALREADY_EXIST, LOG_LEVEL_ERROR, "The file %s already exsit!", deltaName);
+
+    // everything written so far must be in the file for the kernel to copy it
+    RC ret=checkpointPageFile(fHandle);
+    if(ret!=RC_OK) return ret;
+    header=fHandle->mgmtInfo;
+
+    int numPages=getChangedPageCount(fHandle);
+    long listBytes=((long)numPages*sizeof(int)+PAGE_SIZE-1)/PAGE_SIZE*PAGE_SIZE;
+    char* head=(char*)calloc(PAGE_SIZE+listBytes,1);
+    FILE* out=fopen(deltaName,"wb");
+    if(head==0||out==0)
+    {
+        free(head);
+        if(out!=0) fclose(out);
+        THROW_FMT(RC_FILE_OPEN_FAILED, LOG_LEVEL_ERROR, "Can not create the file %s!!", deltaName);
+    }
+
+    DeltaHeader h;
+    int* list=(int*)(head+PAGE_SIZE);
+    int i, n=0;
+    h.magic=DELTA_MAGIC;
+    h.fromEpoch=c->epoch;
+    h.toEpoch=c->epoch+1;
+    h.totalNumPages=header->maxPageCount;
+    h.numPages=numPages;
+    memcpy(head,&h,sizeof(h));
+    for(i=0;i<header->maxPageCount&&i<c->capacity;i++)
+        if((c->bits[i>>6]>>(i&63))&1)
+            list[n++]=i;
+
+    int ok=fwrite(head,1,PAGE_SIZE+listBytes,out)==(size_t)(PAGE_SIZE+listBytes);
+    long outOff=PAGE_SIZE+listBytes;
+    for(i=0;ok&&i<n;)
+    {
+        // one copy for every run of pages stored one after the other
+        int run=1, source=pageSource(header,list[i]);
+        while(i+run<n&&list[i+run]==list[i]+run&&pageSource(header,list[i+run])==source+run)
+            run++;
+        int cls=ioBegin((long)PAGE_SIZE*run);
+        ok=copyFileData(header->filePointer,(long)PAGE_SIZE*source+header->sizeofHeader,
+                        out,outOff,(long)PAGE_SIZE*run);
+        ioEnd(cls);
+        outOff+=(long)PAGE_SIZE*run;
+        i+=run;
+    }
+    if(ok)
+    {
+        fflush(out);
+        syncFile(out);
+    }
+    fclose(out);
+    free(head);
+    if(!ok)
+    {
+        remove(deltaName);
+        THROW_FMT(RC_WRITE_FAILED, LOG_LEVEL_ERROR, "Can not write the delta file %s!", deltaName);
+    }
+
+    ret=startEpoch(c,c->epoch+1);
+    p_dataBaseHeader=header;
+    return ret;
+}
+
+/*********************************************************************************
+ * Function:        applyPageDelta
+ * Description:     bring a copy of a page file to the epoch after a delta. The
+ *                  copy must be at the epoch the delta starts from; a missing
+ *                  copy is created for a delta from epoch 0, the first backup.
+ *                  Applying the same delta again after a failure is harmless.
+ * Input:           char* baseName: the copy
+                    char* deltaName: delta file from backupPageDelta
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC applyPageDelta(char *baseName, char *deltaName)
+{
+    SM_FileHandle fh;
+    DeltaHeader h;
+    RC ret=RC_OK;
+
+    FILE* in=fopen(deltaName,"rb");
+    if(in==0)
+        THROW_FMT(RC_FILE_NOT_FOUND, LOG_LEVEL_ERROR, "The file %s does not exsit!", deltaName);
+    if(fread(&h,sizeof(h),1,in)!=1||h.magic!=DELTA_MAGIC||h.numPages<0||h.numPages>h.totalNumPages)
+    {
+        fclose(in);
+        THROW_FMT(RC_FILE_HEADER_CORRUPT, LOG_LEVEL_ERROR, "The file %s is not a delta file!", deltaName);
+    }
+
+    if(_access(baseName,0)!=0&&h.fromEpoch==0)
+        ret=createPageFile(baseName);
+    if(ret==RC_OK)
+        ret=openPageFile(baseName,&fh);
+    if(ret!=RC_OK)
+    {
+        fclose(in);
+        return ret;
+    }
+    ret=enableChangeTracking(&fh);
+    DataBaseHeader* header=fh.mgmtInfo;
+    if(ret==RC_OK&&header->changes->epoch!=h.fromEpoch)
+    {
+        setErrorMessage("%s is at epoch %d, the delta starts at %d", baseName, header->changes->epoch, h.fromEpoch);
+        LOG(LOG_LEVEL_ERROR, "%s", RC_message);
+        ret=RC_DELTA_EPOCH_MISMATCH;
+    }
+    if(ret==RC_OK&&h.totalNumPages>fh.totalNumPages)
+        ret=ensureCapacity(h.totalNumPages,&fh);
+
+    long listBytes=((long)h.numPages*sizeof(int)+PAGE_SIZE-1)/PAGE_SIZE*PAGE_SIZE;
+    int* list=(int*)malloc(listBytes>0?listBytes:1);
+    char* pages=allocPageMemory(DELTA_BATCH_PAGES);
+    if(ret==RC_OK&&(list==0||pages==0))
+        ret=RC_ERROR;
+    if(ret==RC_OK)
+    {
+        fseek(in,PAGE_SIZE,SEEK_SET);
+        if(fread(list,1,listBytes,in)!=(size_t)listBytes)
+            ret=RC_FILE_HEADER_CORRUPT;
+    }
+    int i, run;
+    for(i=0;ret==RC_OK&&i<h.numPages;i+=run)
+    {
+        // the images of a run of consecutive pages follow each other
+        run=1;
+        while(i+run<h.numPages&&run<DELTA_BATCH_PAGES&&list[i+run]==list[i]+run)
+            run++;
+        if(list[i]<0||list[i]+run>h.totalNumPages)
+            ret=RC_FILE_HEADER_CORRUPT;
+        else if(fread(pages,PAGE_SIZE,run,in)!=(size_t)run)
+            ret=RC_FILE_HEADER_CORRUPT;
+        else
+            ret=writeBlocks(list[i],run,&fh,pages);
+    }
+    free(list);
+    freePageMemory(pages);
+    fclose(in);
+
+    // the pages are synced by the checkpoint before the copy claims the new epoch
+    if(ret==RC_OK)
+        ret=checkpointPageFile(&fh);
+    if(ret==RC_OK)
+        ret=startEpoch(((DataBaseHeader*)fh.mgmtInfo)->changes,h.toEpoch);
+    RC closeRc=closePageFile(&fh);
+    return ret!=RC_OK?ret:closeRc;
+}
+
+/*********************************************************************************
+ * Function:        enableReplication
+ * Description:     stream all changes of a file to a follower from now on, see
+ *                  followPageFile. With sendExisting the follower first gets
+ *                  every page of the file, so it may start from an empty file;
+ *                  else its copy must already equal this file. Linux only.
  * Input:           SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
+                    int fd: write end of a pipe or connected Unix socket,
+                            it stays open after disableReplication
+                    int sendExisting: ship the pages the file has now
+ * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC readFirstBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC enableReplication(SM_FileHandle *fHandle, int fd, int sendExisting)
 {
-    //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    //read the first block
-    return readBlock(0,fHandle,memPage);
+#ifdef __linux__
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    RC ret=RC_OK;
+    int i;
+
+    if(header->replication!=0)
+        THROW(RC_FILE_ALREADY_EXIST, "the file already has a follower");
+    Replication* r=(Replication*)calloc(1,sizeof(Replication));
+    if(r==0) return RC_ERROR;
+    r->ring=(char*)malloc(SHIP_RING_SIZE);
+    if(r->ring==0)
+    {
+        free(r);
+        return RC_ERROR;
+    }
+    r->fd=fd;
+    r->error=RC_OK;
+    pthread_mutex_init(&r->lock,0);
+    pthread_cond_init(&r->work,0);
+    pthread_cond_init(&r->space,0);
+    if(pthread_create(&r->shipper,0,shipperMain,r)!=0)
+    {
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->work);
+        pthread_cond_destroy(&r->space);
+        free(r->ring);
+        free(r);
+        THROW(RC_ERROR, "can not start the shipper thread");
+    }
+    header->replication=r;
+
+    if(sendExisting)
+    {
+        char* page=(char*)malloc(PAGE_SIZE);
+        if(page==0) ret=RC_ERROR;
+        for(i=0;ret==RC_OK&&i<header->maxPageCount;i++)
+        {
+            ret=readPageData(header,i,page);
+            if(ret==RC_OK)
+                shipRecord(header,SHIP_PAGE,i,0,PAGE_SIZE,page);
+        }
+        free(page);
+        if(ret==RC_OK)
+            shipRecord(header,SHIP_CHECKPOINT,0,0,0,0);
+    }
+    if(ret!=RC_OK)
+        disableReplication(fHandle);
+    return ret;
+#else
+    (void)fd; (void)sendExisting;
+    THROW(RC_FEATURE_NOT_SUPPORTED, "replication needs Linux");
+#endif
 }
 
 /*********************************************************************************
- * Function:        readLastBlock
- * Description:     read the last block from a file into memPage. 
- * Calls:           readBlock
+ * Function:        disableReplication
+ * Description:     ship what is queued and stop streaming to the follower
+ * Called By:       closePageFile
  * Input:           SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
- * Return:          RC: return code
+ * Output:          None
+ * Return:          RC: RC_WRITE_FAILED if the follower stopped taking changes
  **********************************************************************************/
-RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC disableReplication(SM_FileHandle *fHandle)
 {
-    //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    // read last block
-    return readBlock(fHandle->totalNumPages-1,fHandle,memPage);
+#ifdef __linux__
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    Replication* r=header->replication;
+    if(r==0)
+        return RC_OK;
+
+    // the shipper drains the ring before it stops
+    pthread_mutex_lock(&r->lock);
+    r->stop=1;
+    pthread_cond_signal(&r->work);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->shipper,0);
+    header->replication=0;
+
+    RC ret=r->error;
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->work);
+    pthread_cond_destroy(&r->space);
+    free(r->ring);
+    free(r);
+    if(ret!=RC_OK)
+        THROW(ret, "the follower stopped taking changes");
+    return RC_OK;
+#else
+    return RC_OK;
+#endif
 }
 
 /*********************************************************************************
- * Function:        readNextBlock
- * Description:     read the next block from a file into memPage. 
- * Calls:           readBlock
- * Input:           SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
+ * Function:        followPageFile
+ * Description:     apply the changes shipped by a leader to a copy of its file
+ *                  until the leader closes the stream. A missing copy is
+ *                  created. Writes go through write-behind, so runs of pages
+ *                  shipped together reach the disk together.
+ * Input:           char* fileName: the copy
+                    int fd: read end of the pipe or socket, left open
+ * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC followPageFile(char *fileName, int fd)
 {
-    //check if handle given is valid
-	RC check = check_readBlock_commonError(fHandle);
-	if (check != RC_OK) return check;
+#ifdef __linux__
+    SM_FileHandle fh;
+    ShipRecord rec;
+    long bufSize=SHIP_RING_SIZE, have=0, pos;
+    RC ret=RC_OK;
 
-    // check if current page is the last one. Return error if it is.
-    if(fHandle->curPagePos>=(fHandle->totalNumPages-1))
+    if(_access(fileName,0)!=0)
+        ret=createPageFile(fileName);
+    if(ret==RC_OK)
+        ret=openPageFile(fileName,&fh);
+    if(ret!=RC_OK)
+        return ret;
+    char* buf=(char*)malloc(bufSize);
+    if(buf==0)
+        ret=RC_ERROR;
+    else
+        enableWriteBehind(&fh,256);
+
+    for(;ret==RC_OK;)
     {
-		printf("Current Page is the last Block!");
-        return RC_READ_NON_EXISTING_PAGE;
+        ssize_t n=read(fd,buf+have,bufSize-have);
+        if(n<0&&errno==EINTR)
+            continue;
+        if(n<=0)
+        {
+            if(n<0||have>0)
+                ret=RC_READ_NON_EXISTING_PAGE;
+            break;
+        }
+        have+=n;
+
+        // apply every complete record, keep the rest for the next read
+        for(pos=0;ret==RC_OK&&have-pos>=(long)sizeof(rec);)
+        {
+            memcpy(&rec,buf+pos,sizeof(rec));
+            if(rec.magic!=SHIP_MAGIC||rec.length<0||rec.length>PAGE_SIZE||
+               rec.offset<0||rec.offset+rec.length>PAGE_SIZE||
+               rec.numPages<0||rec.pageNum<0||rec.pageNum>=rec.numPages)
+            {
+                ret=RC_FILE_HEADER_CORRUPT;
+                break;
+            }
+            if(have-pos<(long)sizeof(rec)+rec.length)
+                break;
+            char* data=buf+pos+sizeof(rec);
+            if(rec.numPages>fh.totalNumPages)
+                ret=ensureCapacity(rec.numPages,&fh);
+            if(ret==RC_OK)
+            {
+                switch(rec.type)
+                {
+                case SHIP_PAGE:
+                    ret=writeBlock(rec.pageNum,&fh,data);
+                    break;
+                case SHIP_RANGE:
+                    ret=writeBlockRange(rec.pageNum,rec.offset,rec.length,&fh,data);
+                    break;
+                case SHIP_CHECKPOINT:
+                    ret=checkpointPageFile(&fh);
+                    break;
+                default:
+                    ret=RC_FILE_HEADER_CORRUPT;
+                    break;
+                }
+            }
+            pos+=sizeof(rec)+rec.length;
+        }
+        memmove(buf,buf+pos,have-pos);
+        have-=pos;
     }
+    free(buf);
 
-    // read the next block
-    return readBlock(fHandle->curPagePos+1,fHandle,memPage);
+    RC closeRc=closePageFile(&fh);
+    if(ret==RC_READ_NON_EXISTING_PAGE)
+        THROW(ret, "the leader stopped in the middle of a change");
+    if(ret==RC_FILE_HEADER_CORRUPT)
+        THROW(ret, "the stream is not a change stream");
+    return ret!=RC_OK?ret:closeRc;
+#else
+    (void)fileName; (void)fd;
+    THROW(RC_FEATURE_NOT_SUPPORTED, "replication needs Linux");
+#endif
 }
 
+// prefetchBlocks reads over gaps of up to this many pages
+#define PREFETCH_MAX_GAP 4
+
 /*********************************************************************************
- * Function:        readPreviousBlock
- * Description:     read the previous block from a file into memPage. 
- * Calls:           readBlock
+ * Function:        prefetchBlocks
+ * Description:     hint that the given pages will be read soon. The pages are
+ *                  sorted and runs of near pages merged into one range, and the
+ *                  kernel starts reading every range into the page cache in the
+ *                  background, so later readBlock calls on them do not wait for
+ *                  the disk. Returns at once; without Linux it does nothing.
  * Input:           SM_FileHandle* fHandle: file handle
- * Output:          SM_PageHandle memPage: the page handle that will be written
+                    int* pageNums: pages in any order, duplicates allowed
+                    int n: number of pages
+ * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC readPreviousBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC prefetchBlocks(SM_FileHandle *fHandle, int *pageNums, int n)
 {
-    //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    // check if current page is the first one or invalid. Return error if it is.
-	if (fHandle->curPagePos > fHandle->totalNumPages || fHandle->curPagePos==0)
-	{
-		printf("Current Page is the first Block or current Page exceed last Block!");
-		return RC_READ_NON_EXISTING_PAGE;
-	}
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    int i;
+    if(n<0||(n>0&&pageNums==0))
+        THROW(RC_ERROR, "no pages to prefetch");
+    for(i=0;i<n;i++)
+        if(pageNums[i]<0||pageNums[i]>=header->maxPageCount)
+        {
+            THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "PAGENUM exceed MAXPAGECOUNT");
+        }
 
-    // read the previous block
-    return readBlock(fHandle->curPagePos-1,fHandle,memPage);
+#ifdef __linux__
+    if(n==0)
+        return RC_OK;
+    int* pages=(int*)malloc(sizeof(int)*n);
+    if(pages==0) return RC_ERROR;
+    memcpy(pages,pageNums,sizeof(int)*n);
+    qsort(pages,n,sizeof(int),compareInts);
+
+    // reading a few pages nobody asked for is cheaper than another request
+    int fd=fileno(header->filePointer), first=pages[0], last=pages[0];
+    for(i=1;i<=n;i++)
+    {
+        if(i<n&&pages[i]<=last+PREFETCH_MAX_GAP)
+        {
+            last=pages[i];
+            continue;
+        }
+        posix_fadvise(fd,(off_t)PAGE_SIZE*first+header->sizeofHeader,
+                      (off_t)PAGE_SIZE*(last-first+1),POSIX_FADV_WILLNEED);
+        memTouch(header->mem,first,last-first+1);
+        if(i<n)
+            first=last=pages[i];
+    }
+    free(pages);
+#endif
+    return RC_OK;
 }
 
 /*********************************************************************************
- * Function:        writeBlock
- * Description:     write the pageNumth block from a memPage into file. 
- * Called By:       writeCurrentBlock
- * Input:           int pageNum: the sequence number of page that need to be written
-                    SM_FileHandle* fHandle: file handle
-                    SM_PageHandle memPage: the page handle that will be written
+ * Function:        setIOClass
+ * Description:     set the class of the page I/O of the calling thread,
+ *                  SM_IO_INTERACTIVE, SM_IO_NORMAL or SM_IO_BACKGROUND
+ * Input:           int cls: class
  * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC setIOClass(int cls)
 {
-    //check if handle given is valid
-	RC check = check_readBlock_commonError(fHandle);
-	if (check != RC_OK) return check;
-
-    //get information from handle
-	p_dataBaseHeader = fHandle->mgmtInfo;
-
-    // check if pageNum is valid
-    if(pageNum>=p_dataBaseHeader->maxPageCount)
-    {
-		printf("The PageNum Exceed the MaxPageCount, Can not Write to Invalid Page!");
-        return RC_WRITE_NON_EXISTING_PAGE;
-    }
-
-    //reset the file pointer to the beginning
-    rewind(p_dataBaseHeader->filePointer);
+    if(cls<0||cls>=SM_IO_CLASSES)
+        THROW(RC_ERROR, "no such I/O class");
+    ioClass=cls;
+    if(cls!=SM_IO_NORMAL)
+        __atomic_store_n(&ioSchedulerOn,1,__ATOMIC_RELAXED);
+    return RC_OK;
+}
 
-    //get to the pageNumth position
-    fseek(p_dataBaseHeader->filePointer,PAGE_SIZE*pageNum+p_dataBaseHeader->sizeofHeader,SEEK_SET);
+/*********************************************************************************
+ * Function:        getIOClass
+ * Description:     the class of the page I/O of the calling thread
+ * Return:          int: class
+ **********************************************************************************/
+int getIOClass(void)
+{
+    return ioClass;
+}
 
-    // write data from memPage to file
-    fwrite(memPage,1,PAGE_SIZE,p_dataBaseHeader->filePointer);
-	fflush(p_dataBaseHeader->filePointer);
+/*********************************************************************************
+ * Function:        setIOClassLimits
+ * Description:     limit the bandwidth of a class and set how long its requests
+ *                  wait for requests of higher classes. Linux only.
+ * Input:           int cls: class
+                    long bytesPerSecond: rate, 0 for no limit
+                    int deadlineMs: longest wait for higher classes
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC setIOClassLimits(int cls, long bytesPerSecond, int deadlineMs)
+{
+    if(cls<0||cls>=SM_IO_CLASSES||bytesPerSecond<0||deadlineMs<0)
+        THROW(RC_ERROR, "bad I/O class limits");
+#ifdef __linux__
+    pthread_once(&ioOnce,ioInit);
+    pthread_mutex_lock(&ioLock);
+    // the next refill starts the class with a full bucket
+    ioClasses[cls].rate=bytesPerSecond;
+    ioClasses[cls].lastRefill=0;
+    ioDeadlineMs[cls]=deadlineMs;
+    __atomic_store_n(&ioSchedulerOn,1,__ATOMIC_RELAXED);
+    pthread_cond_broadcast(&ioChange);
+    pthread_mutex_unlock(&ioLock);
+    return RC_OK;
+#else
+    THROW(RC_FEATURE_NOT_SUPPORTED, "I/O scheduling needs Linux");
+#endif
+}
 
+/*********************************************************************************
+ * Function:        getIOClassStats
+ * Description:     requests, bytes and admission waits of a class so far
+ * Input:           int cls: class
+ * Output:          SM_IOStats* stats: counters, zeros before the scheduler runs
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getIOClassStats(int cls, SM_IOStats *stats)
+{
+    if(cls<0||cls>=SM_IO_CLASSES||stats==0)
+        THROW(RC_ERROR, "no such I/O class");
+#ifdef __linux__
+    pthread_mutex_lock(&ioLock);
+    *stats=ioClasses[cls].stats;
+    pthread_mutex_unlock(&ioLock);
+#else
+    memset(stats,0,sizeof(SM_IOStats));
+#endif
     return RC_OK;
 }
 
 /*********************************************************************************
- * Function:        writeCurrentBlock
- * Description:     write the current block from a memPage into file. 
- * Calls:           writeBlock
+ * Function:        enableHotPages
+ * Description:     count the reads of the pages of a file and keep a list of
+ *                  the maxPages most read ones in a side file, for
+ *                  warmUpPageFile after the next open. Stays on when the file
+ *                  is opened again; calling it again changes maxPages.
  * Input:           SM_FileHandle* fHandle: file handle
-                    SM_PageHandle memPage: the page handle that write from
+                    int maxPages: longest list
  * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage)
+RC enableHotPages(SM_FileHandle *fHandle, int maxPages)
 {
-    //check if handle given is valid
 	RC check = check_readBlock_commonError(fHandle);
 	if (check != RC_OK) return check;
 
-    //chekc if current page position is valid
-	if (fHandle->curPagePos >= fHandle->totalNumPages||fHandle->curPagePos<0)
-	{
-		printf("the CurrentPage is not Exist! Have you modified the FileHandle outside the Program???");
-		return RC_WRITE_NON_EXISTING_PAGE;
-	}
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    if(maxPages<=0)
+        THROW(RC_ERROR, "the hot page list needs room for a page");
+    if(header->temporary!=TEMP_NONE)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "a temporary page file has no hot page file");
+    if(header->hot!=0)
+    {
+        header->hot->maxPages=maxPages;
+        header->hot->dirty=1;
+        return RC_OK;
+    }
+    RC ret=openHotPages(header,fHandle->fileName,maxPages);
+    p_dataBaseHeader=header;
+    if(ret!=RC_OK)
+        THROW_FMT(ret, LOG_LEVEL_ERROR, "Can not create the hot page file of %s!", fHandle->fileName);
+    return RC_OK;
+}
 
-    //write block
-    return writeBlock(fHandle->curPagePos,fHandle,memPage);
+/*********************************************************************************
+ * Function:        getHotPages
+ * Description:     the hot page list saved last, by the last run until the
+ *                  next checkpoint or close of this one
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int max: room in pageNums
+ * Output:          int* pageNums: up to max pages, sorted
+ * Return:          int: length of the list, -1 if the file has none
+ **********************************************************************************/
+int getHotPages(SM_FileHandle *fHandle, int *pageNums, int max)
+{
+    if(fHandle==0||fHandle->mgmtInfo==0)
+        return -1;
+    HotPages* h=((DataBaseHeader*)fHandle->mgmtInfo)->hot;
+    if(h==0)
+        return -1;
+    if(pageNums!=0&&max>0)
+        memcpy(pageNums,h->list,sizeof(int)*(h->numList<max?h->numList:max));
+    return h->numList;
 }
 
 /*********************************************************************************
- * Function:        appendEmptyBlock
- * Description:     append an new empty block filled with zero bytes at the end of the file.
- * Called By:       ensureCapacity
+ * Function:        warmUpPageFile
+ * Description:     start reading the saved hot pages into the page cache, in
+ *                  the background and in ranges, see prefetchBlocks. Meant for
+ *                  right after openPageFile.
  * Input:           SM_FileHandle* fHandle: file handle
  * Output:          None
  * Return:          RC: return code
  **********************************************************************************/
-RC appendEmptyBlock(SM_FileHandle *fHandle)
+RC warmUpPageFile(SM_FileHandle *fHandle)
 {
-    //check if handle given is valid
-    if(fHandle==0)
-    {
-        printf("The fileHandle is NULL!!!, Function will exit.");
-        return RC_FILE_HANDLE_NOT_INIT;
-    }
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
 
-    //get information from handle
-    p_dataBaseHeader=(DataBaseHeader*)fHandle->mgmtInfo;
-    FILE* fp=p_dataBaseHeader->filePointer;
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    HotPages* h=header->hot;
+    int n=0, i;
+    if(h==0||h->numList==0)
+        return RC_OK;
 
-    // get the last position of file
-    rewind(fp);
-    fseek(fp,0,SEEK_END);
+    // pages of a file that has shrunk since are left out
+    int* pages=(int*)malloc(sizeof(int)*h->numList);
+    if(pages==0) return RC_ERROR;
+    for(i=0;i<h->numList;i++)
+        if(h->list[i]>=0&&h->list[i]<header->maxPageCount)
+            pages[n++]=h->list[i];
+    RC ret=prefetchBlocks(fHandle,pages,n);
+    free(pages);
+    return ret;
+}
 
-    // increase the number of pages in file
-    int num=p_dataBaseHeader->maxPageCount+1;
+/*  parallel scans: the page range is cut into morsels of morselPages pages
+ *  and every worker starts with an equal share of them, taken from the front
+ *  one morsel at a time. A worker that runs out steals the back half of the
+ *  largest share left, so the workers finish together even when some pages
+ *  are slower to read or to visit than others. Each worker reads its morsels
+ *  with its own positioned reads into its own buffer; the calling thread is
+ *  worker 0. A scan does not count towards the hot page list. */
+#define SCAN_MORSEL_PAGES 64
+#define SCAN_MAX_THREADS  64
 
-    // write a page of zero bytes at the end of the file
-	char* data = (char*)calloc(PAGE_SIZE, 1);
-    fwrite(data,1,PAGE_SIZE,fp);
+struct ScanState;
 
-    //update the handle information
-    fHandle->totalNumPages=num;
-    p_dataBaseHeader->maxPageCount=num;
-	fHandle->curPagePos = num - 1;
-	p_dataBaseHeader->currentPage = num - 1;
+typedef struct ScanWorker{
+    struct ScanState* scan;
+    int id;
+    int next;                // morsels [next, end) are this worker's, under lock
+    int end;
+#ifdef __linux__
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int started;
+#endif
+}ScanWorker;
 
-    return RC_OK;
-}
+typedef struct ScanState{
+    DataBaseHeader* header;
+    int firstPage;
+    int numPages;
+    int morselPages;
+    int numWorkers;
+    int ioClass;             // of the calling thread, the workers take it over
+    SM_ScanVisitor visit;
+    void* ctx;
+    RC rc;                   // first error, RC_OK while the scan goes on
+    ScanWorker* workers;
+}ScanState;
 
 /*********************************************************************************
- * Function:        ensureCapacity
- * Description:     increase the number of pages to numberOfPages if it is less than that.
- * Calls:           appendEmptyBlock
- * Input:           SM_FileHandle* fHandle: file handle
- * Output:          None
- * Return:          RC: return code
+ * Function:        scanTake
+ * Description:     take the next morsel of a worker, stealing when it has none
+ * Input:           ScanWorker* w: worker
+ * Output:          int* morsel: morsel number
+ * Return:          int: 1 if there was a morsel, 0 when the scan is done
  **********************************************************************************/
-RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle)
+static int scanTake(ScanWorker* w, int* morsel)
 {
-    if (fHandle->totalNumPages > numberOfPages)
-        return error peipei4
-    // use a loop to check and increase the number of pages
-    while(fHandle->totalNumPages<numberOfPages)
+    ScanState* scan=w->scan;
+    int i, found=0;
+
+#ifdef __linux__
+    pthread_mutex_lock(&w->lock);
+#endif
+    if(w->next<w->end)
     {
-        RC ret=appendEmptyBlock(fHandle);
-		if (ret != RC_OK) return ret;
+        *morsel=w->next++;
+        found=1;
     }
-	return RC_OK;
-}
-
+#ifdef __linux__
+    pthread_mutex_unlock(&w->lock);
+#endif
+    if(found||scan->numWorkers==1)
+        return found;
 
+#ifdef __linux__
+    // the largest share may be gone by the time it is locked, then look again
+    for(;;)
+    {
+        ScanWorker* victim=0;
+        int most=0, start=0, end=0;
+        for(i=0;i<scan->numWorkers;i++)
+        {
+            ScanWorker* v=&scan->workers[i];
+            if(v==w)
+                continue;
+            pthread_mutex_lock(&v->lock);
+            if(v->end-v->next>most)
+            {
+                most=v->end-v->next;
+                victim=v;
+            }
+            pthread_mutex_unlock(&v->lock);
+        }
+        if(victim==0)
+            return 0;
 
+        pthread_mutex_lock(&victim->lock);
+        if(victim->next<victim->end)
+        {
+            end=victim->end;
+            start=victim->next+(victim->end-victim->next)/2;
+            victim->end=start;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if(end>start)
+        {
+            pthread_mutex_lock(&w->lock);
+            w->next=start+1;
+            w->end=end;
+            pthread_mutex_unlock(&w->lock);
+            *morsel=start;
+            return 1;
+        }
+    }
+#else
+    (void)i;
+    return 0;
+#endif
+}
 
+/*********************************************************************************
+ * Function:        scanRead
+ * Description:     read numPages pages from pageNum on without touching the
+ *                  handle, with one positioned read where there is one
+ * Input:           DataBaseHeader* header: header of the open file
+                    int pageNum: first page, already checked
+                    int numPages: number of pages
+ * Output:          char* memPages: page content
+ * Return:          RC: return code
+ **********************************************************************************/
+static RC scanRead(DataBaseHeader* header, int pageNum, int numPages, char* memPages)
+{
+    int i;
+#ifdef __linux__
+    // holes read back as zeros, write-behind was flushed by the caller
+    size_t length=(size_t)numPages*PAGE_SIZE;
+    size_t done=0;
+    long off=(long)PAGE_SIZE*pageNum+header->sizeofHeader;
+    int cls=ioBegin((long)length);
+    while(done<length)
+    {
+        ssize_t n=pread(fileno(header->filePointer),memPages+done,length-done,off+done);
+        if(n<0&&errno==EINTR)
+            continue;
+        if(n<=0)
+            break;
+        done+=n;
+    }
+    ioEnd(cls);
+    if(done<length)
+        return RC_ERROR;
+    memTouch(header->mem,pageNum,numPages);
 
+    // shared pages are holes at their own place, their bytes are elsewhere
+    if(header->dedup!=0)
+        for(i=0;i<numPages;i++)
+        {
+            int source=pageSource(header,pageNum+i);
+            if(source==pageNum+i)
+                continue;
+            cls=ioBegin(PAGE_SIZE);
+            ssize_t n=pread(fileno(header->filePointer),memPages+(long)i*PAGE_SIZE,PAGE_SIZE,
+                            (long)PAGE_SIZE*source+header->sizeofHeader);
+            ioEnd(cls);
+            if(n!=PAGE_SIZE)
+                return RC_ERROR;
+        }
 
+    // staged ranges are newer than the file content
+    if(header->numStagedPages>0)
+        for(i=0;i<numPages;i++)
+        {
+            StagedPage* staged=findStagedPage(header,pageNum+i);
+            int j;
+            if(staged!=0)
+                for(j=0;j<staged->numRanges;j++)
+                    memcpy(memPages+(long)i*PAGE_SIZE+staged->ranges[j].offset,
+                           staged->image+staged->ranges[j].offset,staged->ranges[j].length);
+        }
+    return RC_OK;
+#else
+    for(i=0;i<numPages;i++)
+    {
+        RC ret=readPageData(header,pageNum+i,memPages+(long)i*PAGE_SIZE);
+        if(ret!=RC_OK)
+            return ret;
+    }
+    return RC_OK;
+#endif
+}
 
+/*********************************************************************************
+ * Function:        scanWorkerMain
+ * Description:     read and visit morsels until there are none left or the
+ *                  scan failed
+ * Input:           void* arg: ScanWorker
+ * Return:          void*: 0
+ **********************************************************************************/
+static void* scanWorkerMain(void* arg)
+{
+    ScanWorker* w=(ScanWorker*)arg;
+    ScanState* scan=w->scan;
+    int morsel;
 
+    ioClass=scan->ioClass;
+    char* pages=allocPageMemory(scan->morselPages);
+    if(pages==0)
+    {
+        RC expected=RC_OK;
+        __atomic_compare_exchange_n(&scan->rc,&expected,RC_ERROR,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED);
+        return 0;
+    }
+    while(__atomic_load_n(&scan->rc,__ATOMIC_RELAXED)==RC_OK&&scanTake(w,&morsel))
+    {
+        int first=morsel*scan->morselPages;
+        int n=scan->numPages-first<scan->morselPages?scan->numPages-first:scan->morselPages;
+        RC ret=scanRead(scan->header,scan->firstPage+first,n,pages);
+        if(ret==RC_OK)
+            ret=scan->visit(scan->firstPage+first,n,pages,w->id,scan->ctx);
+        if(ret!=RC_OK)
+        {
+            RC expected=RC_OK;
+            __atomic_compare_exchange_n(&scan->rc,&expected,ret,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED);
+        }
+    }
+    freePageMemory(pages);
+    return 0;
+}
 
+/*********************************************************************************
+ * Function:        scanPagesParallel
+ * Description:     read numPages pages from firstPage on with numThreads
+ *                  threads and hand them to visit, a morsel of up to
+ *                  morselPages consecutive pages at a time. Morsels are
+ *                  visited concurrently and in no particular order; visit
+ *                  gets the number of the worker, below numThreads, for per
+ *                  worker state. The file must not be written during the scan.
+ * Input:           SM_FileHandle* fHandle: file handle
+                    int firstPage: first page
+                    int numPages: number of pages
+                    int numThreads: workers, the calling thread included
+                    int morselPages: pages per morsel, 0 for the default
+                    SM_ScanVisitor visit: called for every morsel
+                    void* ctx: passed to visit
+ * Output:          None
+ * Return:          RC: return code, the first error of a read or of visit
+ **********************************************************************************/
+RC scanPagesParallel(SM_FileHandle *fHandle, int firstPage, int numPages, int numThreads, int morselPages, SM_ScanVisitor visit, void *ctx)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
 
+    DataBaseHeader* header=(DataBaseHeader*)fHandle->mgmtInfo;
+    ScanState scan;
+    int i, numMorsels;
 
+    if(visit==0||numThreads<0||morselPages<0)
+        THROW(RC_ERROR, "invalid parallel scan arguments");
+    if(firstPage<0||numPages<0||firstPage+numPages>header->maxPageCount)
+    {
+        THROW_LOG(RC_READ_NON_EXISTING_PAGE, LOG_LEVEL_DEBUG, "PAGENUM exceed MAXPAGECOUNT");
+    }
+    if(numPages==0)
+        return RC_OK;
 
+    // the file has to hold every page the scan reads directly
+    RC ret=flushWriteBehind(fHandle);
+    if(ret!=RC_OK)
+        return ret;
 
+    if(morselPages==0)
+        morselPages=SCAN_MORSEL_PAGES;
+    numMorsels=(numPages+morselPages-1)/morselPages;
+#ifdef __linux__
+    if(numThreads>SCAN_MAX_THREADS)
+        numThreads=SCAN_MAX_THREADS;
+#else
+    numThreads=1;
+#endif
+    if(numThreads<1)
+        numThreads=1;
+    if(numThreads>numMorsels)
+        numThreads=numMorsels;
 
+    scan.header=header;
+    scan.firstPage=firstPage;
+    scan.numPages=numPages;
+    scan.morselPages=morselPages;
+    scan.numWorkers=numThreads;
+    scan.ioClass=ioClass;
+    scan.visit=visit;
+    scan.ctx=ctx;
+    scan.rc=RC_OK;
+    scan.workers=(ScanWorker*)calloc(numThreads,sizeof(ScanWorker));
+    if(scan.workers==0)
+        return RC_ERROR;
+    for(i=0;i<numThreads;i++)
+    {
+        ScanWorker* w=&scan.workers[i];
+        w->scan=&scan;
+        w->id=i;
+        w->next=(int)((long)numMorsels*i/numThreads);
+        w->end=(int)((long)numMorsels*(i+1)/numThreads);
+#ifdef __linux__
+        pthread_mutex_init(&w->lock,0);
+#endif
+    }
 
+#ifdef __linux__
+    // a worker that does not start leaves its share to be stolen
+    for(i=1;i<numThreads;i++)
+        scan.workers[i].started=pthread_create(&scan.workers[i].thread,0,scanWorkerMain,&scan.workers[i])==0;
+#endif
+    scanWorkerMain(&scan.workers[0]);
+#ifdef __linux__
+    for(i=1;i<numThreads;i++)
+        if(scan.workers[i].started)
+            pthread_join(scan.workers[i].thread,0);
+    for(i=0;i<numThreads;i++)
+        pthread_mutex_destroy(&scan.workers[i].lock);
+#endif
+    free(scan.workers);
+    return scan.rc;
+}
 
+/*********************************************************************************
+ * Function:        enablePageDedup
+ * Description:     store pages with the same bytes once. writeBlock then looks
+ *                  every page up by its hash, and a page holding the bytes of
+ *                  another one becomes a reference to it, a hole in the file.
+ *                  The pages already in the file are shared right away. Stays
+ *                  on when the file is opened again. Byte range writes rewrite
+ *                  the whole page; not with write-behind or temporary files.
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC enablePageDedup(SM_FileHandle *fHandle)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
 
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    int i;
+    if(header->dedup!=0)
+        return RC_OK;
+    if(header->temporary!=TEMP_NONE)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "a temporary page file has no shared page map");
+    if(header->writeBehind!=0)
+        THROW(RC_FEATURE_NOT_SUPPORTED, "page deduplication does not go with write-behind");
 
+    // the pages are hashed from the file, staged ranges have to be there
+    RC ret=flushBlockRanges(fHandle);
+    if(ret!=RC_OK) return ret;
+    ret=openDedup(header,fHandle->fileName,1);
+    p_dataBaseHeader=header;
+    if(ret!=RC_OK)
+        THROW_FMT(ret, LOG_LEVEL_ERROR, "Can not create the shared page map of %s!", fHandle->fileName);
 
+    char* page=(char*)malloc(PAGE_SIZE);
+    if(page==0) return RC_ERROR;
+    for(i=0;ret==RC_OK&&i<header->maxPageCount;i++)
+    {
+        ret=readPageFile(header,i,page);
+        if(ret==RC_OK)
+            ret=dedupPage(header,i,page,1);
+    }
+    free(page);
+    if(ret==RC_OK)
+        ret=writeDedup(header);
+    return ret;
+}
 
+/*********************************************************************************
+ * Function:        getPageDedupStats
+ * Description:     how many pages of a file are stored as references, all
+ *                  zeros but the page count if it is not deduplicated
+ * Input:           SM_FileHandle* fHandle: file handle
+ * Output:          SM_DedupStats* stats: counts
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getPageDedupStats(SM_FileHandle *fHandle, SM_DedupStats *stats)
+{
+	RC check = check_readBlock_commonError(fHandle);
+	if (check != RC_OK) return check;
 
+    DataBaseHeader* header=fHandle->mgmtInfo;
+    Dedup* d=header->dedup;
+    int i;
+    if(stats==0)
+        THROW(RC_ERROR, "no room for the statistics");
+    memset(stats,0,sizeof(SM_DedupStats));
+    stats->pages=header->maxPageCount;
+    if(d==0)
+        return RC_OK;
+    stats->references=d->numRefs;
+    for(i=0;i<d->capacity&&i<header->maxPageCount;i++)
+        if(d->firstRef[i]>=0)
+            stats->sharedPages++;
+    return RC_OK;
+}
 
+/*********************************************************************************
+ * Function:        setMemoryBudget
+ * Description:     limit the memory held for all open page files together, see
+ *                  the memory governor. Cached pages are tracked from the first
+ *                  call on; a smaller budget evicts right away. Write-behind 
+ *                  tables enabled before keep their size.
+ * Input:           long long bytes: budget, 0 for no limit
+ * Output:          None
+ * Return:          RC: return code
+ **********************************************************************************/
+RC setMemoryBudget(long long bytes)
+{
+    if(bytes<0)
+        THROW(RC_ERROR, "the memory budget can not be negative");
+    memLock();
+    memBudget=bytes;
+    __atomic_store_n(&memTracking,1,__ATOMIC_RELAXED);
+    memMakeRoom(0,0);
+    memUnlock();
+    return RC_OK;
+}
 
+/*********************************************************************************
+ * Function:        getMemoryStats
+ * Description:     the memory held for all open page files and what the budget
+ *                  took back
+ * Input:           None
+ * Output:          SM_MemoryStats* stats: totals
+ * Return:          RC: return code
+ **********************************************************************************/
+RC getMemoryStats(SM_MemoryStats *stats)
+{
+    if(stats==0)
+        THROW(RC_ERROR, "no room for the statistics");
+    memLock();
+    stats->budget=memBudget;
+    memcpy(stats->bytes,memBytes,sizeof(memBytes));
+    stats->files=memNumAccounts;
+    stats->evictions=memEvictions;
+    stats->evictedBytes=memEvictedBytes;
+    stats->deniedPages=memDeniedPages;
+    memUnlock();
+    return RC_OK;
+}
 
+/*********************************************************************************
+ * Function:        compareMemoryUse
+ * Description:     qsort comparator, the files using more memory first
+ **********************************************************************************/
+static int compareMemoryUse(const void* a, const void* b)
+{
+    const SM_MemoryUse* x=(const SM_MemoryUse*)a;
+    const SM_MemoryUse* y=(const SM_MemoryUse*)b;
+    long long bx=0, by=0;
+    int i;
+    for(i=0;i<SM_MEM_KINDS;i++)
+    {
+        bx+=x->bytes[i];
+        by+=y->bytes[i];
+    }
+    if(bx!=by)
+        return bx>by?-1:1;
+    return x->lastUse>y->lastUse?-1:x->lastUse<y->lastUse;
+}
 
+/*********************************************************************************
+ * Function:        getMemoryUsers
+ * Description:     the memory held for each open page file, the files using 
+ *                  the most first
+ * Input:           int max: room in users
+ * Output:          SM_MemoryUse* users: one entry per file
+ * Return:          int: number of entries stored, -1 on error
+ **********************************************************************************/
+int getMemoryUsers(SM_MemoryUse *users, int max)
+{
+    if(max<=0||users==0)
+        return 0;
 
+    memLock();
+    int n=memNumAccounts, i=0;
+    SM_MemoryUse* all=(SM_MemoryUse*)malloc(sizeof(SM_MemoryUse)*(n>0?n:1));
+    if(all==0)
+    {
+        memUnlock();
+        return -1;
+    }
+    MemAccount* a;
+    for(a=memAccounts;a!=0;a=a->next,i++)
+    {
+        memcpy(all[i].fileName,a->name,SM_MEM_NAME_SIZE);
+        memcpy(all[i].bytes,a->bytes,sizeof(a->bytes));
+        all[i].lastUse=a->lastUse;
+    }
+    memUnlock();
 
+    qsort(all,n,sizeof(SM_MemoryUse),compareMemoryUse);
+    if(n>max)
+        n=max;
+    memcpy(users,all,sizeof(SM_MemoryUse)*n);
+    free(all);
+    return n;
+}
@@ -15,6 +15,60 @@ typedef struct SM_FileHandle {
 
 typedef char* SM_PageHandle;
 
+/* flags of setPageMemoryFlags */
+#define SM_MEM_HUGEPAGES 1   /* back page buffers with 2 MB pages */
+#define SM_MEM_LOCKED    2   /* mlock page buffers */
+
+/* classes of page I/O, see setIOClass */
+#define SM_IO_INTERACTIVE 0   /* reads of user queries */
+#define SM_IO_NORMAL      1
+#define SM_IO_BACKGROUND  2   /* bulk loads, backups, flushing */
+#define SM_IO_CLASSES     3
+
+typedef struct SM_IOStats {
+  long long requests;
+  long long bytes;
+  long long waitMicros;     /* time spent waiting to be admitted */
+  long long maxWaitMicros;
+} SM_IOStats;
+
+typedef struct SM_DedupStats {
+  int pages;
+  int references;           /* pages stored as a reference to a page with the same bytes */
+  int sharedPages;          /* pages whose bytes stand for references too */
+} SM_DedupStats;
+
+/* kinds of memory held for open page files, see setMemoryBudget */
+#define SM_MEM_CACHE        0   /* file pages read, written or prefetched, in the OS page cache */
+#define SM_MEM_WRITE_BEHIND 1   /* write-behind tables */
+#define SM_MEM_STAGED       2   /* page images of staged byte ranges */
+#define SM_MEM_TEMP         3   /* temporary page files kept in memory */
+#define SM_MEM_KINDS        4
+#define SM_MEM_NAME_SIZE    64
+
+typedef struct SM_MemoryUse {
+  char fileName[SM_MEM_NAME_SIZE];  /* "(temporary)" for temporary page files */
+  long long bytes[SM_MEM_KINDS];
+  long long lastUse;        /* order of the last access, larger is more recent */
+} SM_MemoryUse;
+
+typedef struct SM_MemoryStats {
+  long long budget;         /* 0 for no limit */
+  long long bytes[SM_MEM_KINDS];
+  int files;                /* open page files */
+  long long evictions;      /* chunks of cached pages given back to stay in the budget */
+  long long evictedBytes;
+  long long deniedPages;    /* write-behind pages the budget could not hold */
+} SM_MemoryStats;
+
+/* key extractor of page summaries: store up to maxKeys keys of a page in keys
+ * and return their number, or -1 if the keys of the page are unknown */
+typedef int (*SM_PageKeys) (int pageNum, SM_PageHandle memPage, unsigned long long *keys, int maxKeys, void *ctx);
+
+/* visitor of a parallel scan: numPages consecutive pages from firstPage on,
+ * read by worker number worker; a return code other than RC_OK stops the scan */
+typedef RC (*SM_ScanVisitor) (int firstPage, int numPages, SM_PageHandle pages, int worker, void *ctx);
+
 /************************************************************
  *                    interface                             *
  ************************************************************/
@@ -23,21 +77,84 @@ extern void initStorageManager (void);
 extern RC createPageFile (char *fileName);
 extern RC openPageFile (char *fileName, SM_FileHandle *fHandle);
 extern RC closePageFile (SM_FileHandle *fHandle);
+extern RC checkpointPageFile (SM_FileHandle *fHandle);
 extern RC destroyPageFile (char *fileName);
 
+/* temporary page files: nameless, never synced, freed by closePageFile */
+extern RC openTempPageFile (SM_FileHandle *fHandle, int spillPages);
+extern int isTempFileInMemory (SM_FileHandle *fHandle);
+
 /* reading blocks from disc */
 extern RC readBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC readBlocks (int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle memPages);
 extern int getBlockPos (SM_FileHandle *fHandle);
+extern int getNextDataBlockPos (SM_FileHandle *fHandle, int pageNum);
 extern RC readFirstBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readPreviousBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readNextBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readLastBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC prefetchBlocks (SM_FileHandle *fHandle, int *pageNums, int n);
+
+/* parallel scans: morsels of a page range read and visited by a pool of threads */
+extern RC scanPagesParallel (SM_FileHandle *fHandle, int firstPage, int numPages, int numThreads, int morselPages, SM_ScanVisitor visit, void *ctx);
 
 /* writing blocks to a page file */
 extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC writeBlocks (int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle memPages);
+extern RC writeBlockRange (int pageNum, int offset, int length, SM_FileHandle *fHandle, char *data);
+extern RC stageBlockRange (int pageNum, int offset, int length, SM_FileHandle *fHandle, char *data);
+extern RC flushBlockRanges (SM_FileHandle *fHandle);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
 
+/* write-behind mode */
+extern RC enableWriteBehind (SM_FileHandle *fHandle, int maxDirtyPages);
+extern RC flushWriteBehind (SM_FileHandle *fHandle);
+extern RC disableWriteBehind (SM_FileHandle *fHandle);
+
+/* memory for buffers of many pages, see SM_MEM_HUGEPAGES and SM_MEM_LOCKED */
+extern void setPageMemoryFlags (int flags);
+extern SM_PageHandle allocPageMemory (int numPages);
+extern void freePageMemory (SM_PageHandle memPages);
+
+/* page summaries: per page key range and Bloom filter */
+extern RC enablePageSummaries (SM_FileHandle *fHandle, SM_PageKeys pageKeys, void *ctx);
+extern int hasPageSummaries (SM_FileHandle *fHandle);
+extern int pageMayContain (SM_FileHandle *fHandle, int pageNum, unsigned long long key);
+extern int pageMayOverlap (SM_FileHandle *fHandle, int pageNum, unsigned long long low, unsigned long long high);
+
+/* incremental backup: deltas of the pages changed since the last backup */
+extern RC enableChangeTracking (SM_FileHandle *fHandle);
+extern int getChangedPageCount (SM_FileHandle *fHandle);
+extern RC backupPageDelta (SM_FileHandle *fHandle, char *deltaName);
+extern RC applyPageDelta (char *baseName, char *deltaName);
+
+/* hot page list: the most read pages, saved for warming up after a restart */
+extern RC enableHotPages (SM_FileHandle *fHandle, int maxPages);
+extern int getHotPages (SM_FileHandle *fHandle, int *pageNums, int max);
+extern RC warmUpPageFile (SM_FileHandle *fHandle);
+
+/* page deduplication: pages with the same bytes are stored once */
+extern RC enablePageDedup (SM_FileHandle *fHandle);
+extern RC getPageDedupStats (SM_FileHandle *fHandle, SM_DedupStats *stats);
+
+/* log shipping to a follower on the same machine, over a pipe or Unix socket */
+extern RC enableReplication (SM_FileHandle *fHandle, int fd, int sendExisting);
+extern RC disableReplication (SM_FileHandle *fHandle);
+extern RC followPageFile (char *fileName, int fd);
+
+/* I/O scheduling: priority classes per thread, bandwidth per class */
+extern RC setIOClass (int ioClass);
+extern int getIOClass (void);
+extern RC setIOClassLimits (int ioClass, long bytesPerSecond, int deadlineMs);
+extern RC getIOClassStats (int ioClass, SM_IOStats *stats);
+
+/* memory budget: one limit for the memory held for all open page files,
+ * getMemoryUsers lists the files using the most first */
+extern RC setMemoryBudget (long long bytes);
+extern RC getMemoryStats (SM_MemoryStats *stats);
+extern int getMemoryUsers (SM_MemoryUse *users, int max);
+
 #endif
@@ -0,0 +1,61 @@
+#ifndef TABLES_H
+#define TABLES_H
+
+#include <stdbool.h>
+#include "dberror.h"
+
+/************************************************************
+ *                    data types                            *
+ ************************************************************/
+typedef enum DataType {
+  DT_INT = 0,
+  DT_STRING = 1,
+  DT_FLOAT = 2,
+  DT_BOOL = 3
+} DataType;
+
+typedef struct Value {
+  DataType dt;
+  union v {
+    int intV;
+    char *stringV;
+    float floatV;
+    bool boolV;
+  } v;
+} Value;
+
+/* a record is identified by the data page it lives on and its slot in that page */
+typedef struct RID {
+  int page;
+  int slot;
+} RID;
+
+/*  Encoded record layout (see getAttr / setAttr):
+ *  all DT_INT, DT_FLOAT and DT_BOOL attributes come first, at fixed offsets
+ *  in attribute order (4, 4 and 1 bytes), followed by every DT_STRING
+ *  attribute in attribute order as a 2 byte length and the bytes without
+ *  terminator. typeLength of a string attribute is its maximum length.
+ *  So records have a variable length, and size holds the encoded length. */
+typedef struct Record {
+  RID id;
+  char *data;
+  int size;
+} Record;
+
+typedef struct Schema {
+  int numAttr;
+  char **attrNames;
+  DataType *dataTypes;
+  int *typeLength;
+  int *keyAttrs;
+  int keySize;
+} Schema;
+
+/* information of a table */
+typedef struct RM_TableData {
+  char *name;
+  Schema *schema;
+  void *mgmtInfo;
+} RM_TableData;
+
+#endif // TABLES_H
@@ -2,16 +2,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "storage_mgr.h"
 #include "dberror.h"
-#include "test_helper.h"
+#include "test_assign1_1.h"
 
 // test name
 char *testName;
 
 /* test output files */
 #define TESTPF "test_pagefile.bin"
+#define TESTBASE "test_pagefile_base.bin"
+#define TESTDELTA0 "test_pagefile_delta0.bin"
+#define TESTDELTA1 "test_pagefile_delta1.bin"
+#define TESTFOLLOWER "test_pagefile_follower.bin"
+#define TESTMEM "test_pagefile_mem.bin"
 
 /* prototypes for test functions */
 static void testCreate(void);
@@ -19,6 +28,32 @@ static void testReadWriteMethod(void);
 static void testAppendPage(void);
 static void testMultiPageContent(void);
 static void testEnsureCapacity(void);
+static void testHeaderSlots(void);
+static void testBlockRanges(void);
+static void testSparsePages(void);
+static void testWriteBehind(void);
+static void testDiagnostics(void);
+static void testWriteBlocks(void);
+static void testPageSummaries(void);
+static void testPageMemory(void);
+static void testIncrementalBackup(void);
+static void testReplication(void);
+static void testPrefetch(void);
+static void testTempPageFile(void);
+static void testIOScheduler(void);
+static void testHotPages(void);
+static void testParallelScan(void);
+static void testPageDedup(void);
+static void testMemoryBudget(void);
+
+/* helpers */
+static int testPageKeys(int pageNum, SM_PageHandle memPage, unsigned long long *keys, int maxKeys, void *ctx);
+static void *testFollow(void *arg);
+static void *testBackgroundReads(void *arg);
+static RC testVisitPages(int firstPage, int numPages, SM_PageHandle pages, int worker, void *ctx);
+static void fillDedupPage(SM_PageHandle ph, int kind);
+static int isDedupPage(SM_PageHandle ph, int kind);
+static SM_MemoryUse *findMemoryUse(SM_MemoryUse *users, int n, char *fileName);
 
 /* main function running all tests */
 int
@@ -33,6 +68,23 @@ main (void)
   testAppendPage();
   testMultiPageContent();
   testEnsureCapacity();
+  testHeaderSlots();
+  testBlockRanges();
+  testSparsePages();
+  testWriteBehind();
+  testDiagnostics();
+  testWriteBlocks();
+  testPageSummaries();
+  testPageMemory();
+  testIncrementalBackup();
+  testReplication();
+  testPrefetch();
+  testTempPageFile();
+  testIOScheduler();
+  testHotPages();
+  testParallelScan();
+  testPageDedup();
+  testMemoryBudget();
 
   return 0;
 }
@@ -84,6 +136,7 @@ void testReadWriteMethod (void) {
   SM_FileHandle fh;
   SM_PageHandle ph;
   int i = 0;
+  RC rc;
   testName = "test read and write method ";
   ph = (SM_PageHandle) malloc(PAGE_SIZE);
 
@@ -110,6 +163,12 @@ void testReadWriteMethod (void) {
     ASSERT_TRUE((ph[i] == '1'), "the page should be filled with '1' ");
   }
 
+  // page -1 would be the file header
+  rc = writeBlock(-1, &fh, ph);
+  ASSERT_EQUALS_INT(RC_WRITE_NON_EXISTING_PAGE, rc, "negative page can not be written");
+  rc = readBlock(-1, &fh, ph);
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, rc, "negative page can not be read");
+
   //close and destroy
   TEST_CHECK(closePageFile (&fh));
   TEST_CHECK(destroyPageFile (TESTPF));
@@ -311,3 +370,1183 @@ void testEnsureCapacity(void) {
   TEST_DONE();
 
 }
+
+/*  Function Name: testHeaderSlots
+ *  Test:  Appended pages are only in memory until checkpoint or close.
+ *         A damaged header slot falls back to the older valid slot.
+ *         A file with no valid header slot cannot be opened.
+ */
+void testHeaderSlots(void) {
+  SM_FileHandle fh;
+  FILE *fp;
+  char garbage[16];
+  testName = "test double slot file header";
+
+  memset(garbage, 0x5a, sizeof(garbage));
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(3, &fh));
+  TEST_CHECK(checkpointPageFile(&fh));
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  ASSERT_EQUALS_INT(3, fh.totalNumPages, "expect 3 pages after checkpoint");
+  TEST_CHECK(closePageFile (&fh));
+
+  // tear the newer slot (the second one), the first slot still says 1 page
+  fp = fopen(TESTPF, "rb+");
+  fseek(fp, PAGE_SIZE / 2 + 8, SEEK_SET);
+  fwrite(garbage, 1, sizeof(garbage), fp);
+  fclose(fp);
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  ASSERT_EQUALS_INT(1, fh.totalNumPages, "expect the older header after the newer slot is damaged");
+  TEST_CHECK(closePageFile (&fh));
+
+  // damage the other slot as well
+  fp = fopen(TESTPF, "rb+");
+  fwrite(garbage, 1, sizeof(garbage), fp);
+  fclose(fp);
+  ASSERT_ERROR(openPageFile(TESTPF, &fh), "a file with no valid header slot should not open");
+
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testBlockRanges
+ *  Test:  writeBlockRange only changes the given bytes of a page.
+ *         Staged ranges are visible to readBlock before they are flushed.
+ *         A full writeBlock replaces staged ranges of the same page.
+ *         Staged ranges reach the file on close.
+ */
+void testBlockRanges(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int i;
+  testName = "test sub page range writes";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(2, &fh));
+
+  memset(ph, '0', PAGE_SIZE);
+  TEST_CHECK(writeBlock(0, &fh, ph));
+  TEST_CHECK(writeBlockRange(0, 10, 5, &fh, "abcde"));
+  ASSERT_ERROR(writeBlockRange(0, PAGE_SIZE - 2, 5, &fh, "abcde"), "a range past the end of the page should return an error");
+
+  // two adjacent ranges on page 0 and one on page 1
+  TEST_CHECK(stageBlockRange(0, 100, 4, &fh, "1111"));
+  TEST_CHECK(stageBlockRange(0, 104, 4, &fh, "2222"));
+  TEST_CHECK(stageBlockRange(1, 0, 3, &fh, "xyz"));
+
+  TEST_CHECK(readBlock(0, &fh, ph));
+  ASSERT_TRUE(memcmp(ph + 10, "abcde", 5) == 0, "range write is on disk");
+  ASSERT_TRUE(memcmp(ph + 100, "11112222", 8) == 0, "staged ranges are visible to readBlock");
+  ASSERT_TRUE(ph[9] == '0' && ph[15] == '0' && ph[108] == '0', "bytes outside the ranges are unchanged");
+
+  // a full page write wins over the staged bytes of page 1
+  memset(ph, '7', PAGE_SIZE);
+  TEST_CHECK(writeBlock(1, &fh, ph));
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(readBlock(0, &fh, ph));
+  ASSERT_TRUE(memcmp(ph + 100, "11112222", 8) == 0, "staged ranges are written on close");
+  TEST_CHECK(readBlock(1, &fh, ph));
+  for (i = 0; i < PAGE_SIZE; i++)
+    ASSERT_EQUALS_INT('7', ph[i], "writeBlock replaced the staged range");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testSparsePages
+ *  Test:  Pages added by ensureCapacity read back as zeros.
+ *         Writing an all zero page over data reads back as zeros.
+ *         getNextDataBlockPos never skips a page holding data.
+ */
+void testSparsePages(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int i;
+  testName = "test sparse pages";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(100, &fh));
+
+  memset(ph, '5', PAGE_SIZE);
+  TEST_CHECK(writeBlock(50, &fh, ph));
+  TEST_CHECK(writeBlock(60, &fh, ph));
+  ASSERT_TRUE(getNextDataBlockPos(&fh, 1) <= 50, "the scan must not skip page 50");
+  ASSERT_TRUE(getNextDataBlockPos(&fh, 51) <= 60, "the scan must not skip page 60");
+  ASSERT_EQUALS_INT(100, getNextDataBlockPos(&fh, 100), "nothing after the last page");
+
+  TEST_CHECK(readBlock(99, &fh, ph));
+  for (i = 0; i < PAGE_SIZE; i++)
+    ASSERT_EQUALS_INT(0, ph[i], "pages added by ensureCapacity are zero");
+
+  // zero page 50 again, it has to read back as zeros
+  TEST_CHECK(readBlock(50, &fh, ph));
+  memset(ph, 0, PAGE_SIZE);
+  TEST_CHECK(writeBlock(50, &fh, ph));
+  memset(ph, '1', PAGE_SIZE);
+  TEST_CHECK(readBlock(50, &fh, ph));
+  for (i = 0; i < PAGE_SIZE; i++)
+    ASSERT_EQUALS_INT(0, ph[i], "a page written with zeros reads back as zeros");
+
+  TEST_CHECK(readBlock(60, &fh, ph));
+  for (i = 0; i < PAGE_SIZE; i++)
+    ASSERT_EQUALS_INT('5', ph[i], "data next to holes is unchanged");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testWriteBehind
+ *  Test:  Pages written in write-behind mode read back right away.
+ *         Writing more pages than the dirty budget does not lose any.
+ *         After the flush barrier and close all pages are in the file.
+ */
+void testWriteBehind(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int i, p;
+  testName = "test write behind";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(40, &fh));
+  TEST_CHECK(enableWriteBehind(&fh, 8));
+
+  // five times the budget, the writer has to wait for the flusher
+  for (p = 0; p < 40; p++) {
+    memset(ph, 'a' + p % 26, PAGE_SIZE);
+    TEST_CHECK(writeBlock(p, &fh, ph));
+  }
+  // rewrite a page that is probably still buffered
+  memset(ph, '#', PAGE_SIZE);
+  TEST_CHECK(writeBlock(39, &fh, ph));
+  TEST_CHECK(readBlock(39, &fh, ph));
+  ASSERT_TRUE(ph[0] == '#' && ph[PAGE_SIZE - 1] == '#', "read sees the newest buffered page");
+
+  TEST_CHECK(writeBlockRange(3, 0, 4, &fh, "head"));
+  TEST_CHECK(flushWriteBehind(&fh));
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  for (p = 0; p < 39; p++) {
+    TEST_CHECK(readBlock(p, &fh, ph));
+    for (i = (p == 3 ? 4 : 0); i < PAGE_SIZE; i++)
+      ASSERT_EQUALS_INT('a' + p % 26, ph[i], "page written in write behind mode is in the file");
+  }
+  TEST_CHECK(readBlock(3, &fh, ph));
+  ASSERT_TRUE(memcmp(ph, "head", 4) == 0, "range write in write behind mode is in the file");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testDiagnostics
+ *  Test:  An error sets RC_message even when nothing is logged.
+ *         Records logged while the ring is enabled come out of drainLogRing.
+ *         Records below the runtime log level are dropped.
+ */
+void testDiagnostics(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  FILE *out;
+  char line[256];
+  int found = 0, lines = 0;
+  testName = "test diagnostics";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+
+  // end of file is a debug record, not logged at the default level
+  RC_message = NULL;
+  ASSERT_ERROR(readNextBlock(&fh, ph), "readNextBlock at the last block should return an error");
+  ASSERT_TRUE(RC_message != NULL && strstr(RC_message, "last Block") != NULL, "RC_message describes the error");
+
+  out = tmpfile();
+  TEST_CHECK(enableLogRing(8));
+  drainLogRing(out);
+  ASSERT_EQUALS_INT(0, (int) ftell(out), "nothing was logged at the default level");
+
+  setLogLevel(LOG_LEVEL_DEBUG);
+  ASSERT_ERROR(readNextBlock(&fh, ph), "readNextBlock at the last block should return an error");
+  ASSERT_ERROR(destroyPageFile("no_such_file.bin"), "destroying a missing file should return an error");
+  setLogLevel(LOG_LEVEL_ERROR);
+  drainLogRing(out);
+  disableLogRing();
+
+  rewind(out);
+  while (fgets(line, sizeof(line), out) != NULL) {
+    lines++;
+    if (strstr(line, "no_such_file.bin") != NULL && strstr(line, "ERROR") != NULL)
+      found = 1;
+  }
+  fclose(out);
+  ASSERT_EQUALS_INT(2, lines, "both records came out of the ring");
+  ASSERT_TRUE(found, "formatted message is in the ring");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testWriteBlocks
+ *  Test:  Consecutive pages written with one writeBlocks call read back,
+ *         also with one readBlocks call,
+ *         staged ranges of the written pages are dropped, and pages past
+ *         the end of the file are rejected
+ */
+void testWriteBlocks(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph, pages;
+  int i;
+  testName = "test multi-page writes and reads";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  pages = (SM_PageHandle) malloc(4 * PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(8, &fh));
+
+  TEST_CHECK(stageBlockRange(3, 0, 5, &fh, "stale"));
+  for (i = 0; i < 4; i++)
+    memset(pages + i * PAGE_SIZE, 'a' + i, PAGE_SIZE);
+  TEST_CHECK(writeBlocks(2, 4, &fh, pages));
+  TEST_CHECK(flushBlockRanges(&fh));
+
+  for (i = 0; i < 4; i++) {
+    TEST_CHECK(readBlock(2 + i, &fh, ph));
+    ASSERT_TRUE(ph[0] == 'a' + i && ph[PAGE_SIZE - 1] == 'a' + i, "page written by writeBlocks");
+  }
+  printf("Wrote four pages at once\n");
+
+  memset(pages, 0, 4 * PAGE_SIZE);
+  TEST_CHECK(readBlocks(2, 4, &fh, pages));
+  for (i = 0; i < 4; i++)
+    ASSERT_TRUE(pages[i * PAGE_SIZE] == 'a' + i && pages[(i + 1) * PAGE_SIZE - 1] == 'a' + i, "page read by readBlocks");
+  printf("Read four pages at once\n");
+
+  ASSERT_EQUALS_INT(RC_WRITE_NON_EXISTING_PAGE, writeBlocks(6, 4, &fh, pages), "pages past the end");
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, readBlocks(6, 4, &fh, pages), "pages past the end");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  free(ph);
+  free(pages);
+  TEST_DONE();
+}
+
+/* test pages hold a count and that many int keys, page 0 holds none */
+int
+testPageKeys(int pageNum, SM_PageHandle memPage, unsigned long long *keys, int maxKeys, void *ctx)
+{
+  int n, i, k;
+
+  (*(int *) ctx)++;
+  if (pageNum == 0)
+    return 0;
+  memcpy(&n, memPage, sizeof(int));
+  if (n > maxKeys)
+    return -1;
+  for (i = 0; i < n; i++) {
+    memcpy(&k, memPage + sizeof(int) * (i + 1), sizeof(int));
+    keys[i] = (unsigned long long) k;
+  }
+  return n;
+}
+
+/*  Function Name: testPageSummaries
+ *  Test:  Pages written with summaries on answer key and range checks without
+ *         being read, a range write makes a page unknown, the summaries
+ *         survive a reopen and go away with the file
+ */
+void testPageSummaries(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int calls = 0, i, p, absent = 0;
+  testName = "test page summaries";
+  ph = (SM_PageHandle) calloc(PAGE_SIZE, 1);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(5, &fh));
+  ASSERT_TRUE(!hasPageSummaries(&fh), "no summaries yet");
+  ASSERT_TRUE(pageMayContain(&fh, 1, 7), "a page without summary may hold anything");
+  TEST_CHECK(enablePageSummaries(&fh, testPageKeys, &calls));
+  ASSERT_TRUE(hasPageSummaries(&fh), "summaries on");
+  ASSERT_EQUALS_INT(5, calls, "existing pages summarized");
+
+  // page p holds the keys 1000*p, 1000*p+10, .. 1000*p+990
+  for (p = 1; p < 5; p++) {
+    int n = 100;
+    memcpy(ph, &n, sizeof(int));
+    for (i = 0; i < n; i++) {
+      int k = 1000 * p + 10 * i;
+      memcpy(ph + sizeof(int) * (i + 1), &k, sizeof(int));
+    }
+    TEST_CHECK(writeBlock(p, &fh, ph));
+  }
+  for (p = 1; p < 5; p++)
+    for (i = 0; i < 100; i++)
+      ASSERT_TRUE(pageMayContain(&fh, p, 1000 * p + 10 * i), "key of the page");
+  ASSERT_TRUE(!pageMayContain(&fh, 0, 1000), "page without keys");
+  ASSERT_TRUE(!pageMayContain(&fh, 2, 1000), "key below the page");
+  ASSERT_TRUE(!pageMayContain(&fh, 2, 2991), "key above the page");
+  for (i = 0; i < 99; i++)
+    absent += pageMayContain(&fh, 3, 3000 + 10 * i + 5) == 0;
+  ASSERT_TRUE(absent > 80, "the Bloom filter rules out most keys within the range");
+  ASSERT_TRUE(pageMayOverlap(&fh, 2, 2985, 2995), "range overlapping the page");
+  ASSERT_TRUE(!pageMayOverlap(&fh, 2, 2991, 2999), "range after the page");
+  ASSERT_TRUE(!pageMayOverlap(&fh, 3, 0, 2999), "range before the page");
+  printf("Ruled out keys and ranges by page summaries\n");
+
+  TEST_CHECK(writeBlockRange(4, 0, 4, &fh, "\0\0\0\0"));
+  ASSERT_TRUE(pageMayContain(&fh, 4, 7) && pageMayOverlap(&fh, 4, 0, 10), "range write makes the page unknown");
+
+  TEST_CHECK(closePageFile (&fh));
+  ASSERT_TRUE(access(TESTPF ".sum", F_OK) == 0, "summary file");
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  ASSERT_TRUE(hasPageSummaries(&fh), "summaries after reopen");
+  ASSERT_TRUE(!pageMayContain(&fh, 2, 1000) && pageMayContain(&fh, 2, 2040), "summary after reopen");
+  ASSERT_TRUE(pageMayContain(&fh, 4, 7), "unknown page after reopen");
+
+  // without an extractor a written page is unknown
+  TEST_CHECK(writeBlock(2, &fh, ph));
+  ASSERT_TRUE(pageMayContain(&fh, 2, 1000), "page written without extractor");
+  calls = 0;
+  TEST_CHECK(enablePageSummaries(&fh, testPageKeys, &calls));
+  ASSERT_EQUALS_INT(2, calls, "unknown pages summarized again");
+  ASSERT_TRUE(!pageMayContain(&fh, 2, 1000) && pageMayContain(&fh, 2, 4000), "page summarized again");
+  printf("Summaries survive a reopen\n");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  ASSERT_TRUE(access(TESTPF ".sum", F_OK) != 0, "summary file removed");
+  printf("Close and destroy file \n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/*  Function Name: testPageMemory
+ *  Test:  Page buffers from plain, huge page and locked memory hold pages
+ *         read and written through them, huge page buffers are 2 MB aligned,
+ *         and write-behind works on top of them
+ */
+void testPageMemory(void) {
+  SM_FileHandle fh;
+  SM_PageHandle pages, ph;
+  int flags, i, n = 600;
+  testName = "test page memory";
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(n, &fh));
+  for (flags = 0; flags <= (SM_MEM_HUGEPAGES | SM_MEM_LOCKED); flags++) {
+    setPageMemoryFlags(flags);
+    pages = allocPageMemory(n);
+    ASSERT_TRUE(pages != NULL, "page memory allocated");
+#ifdef __linux__
+    if (flags & SM_MEM_HUGEPAGES)
+      ASSERT_TRUE(((unsigned long) pages & (2UL * 1024 * 1024 - 1)) == 0, "huge page memory is 2 MB aligned");
+#endif
+    for (i = 0; i < n; i++)
+      memset(pages + (long) i * PAGE_SIZE, 'a' + (i + flags) % 26, PAGE_SIZE);
+    TEST_CHECK(writeBlocks(0, n, &fh, pages));
+    memset(pages, 0, (long) n * PAGE_SIZE);
+    TEST_CHECK(readBlocks(0, n, &fh, pages));
+    for (i = 0; i < n; i++)
+      ASSERT_TRUE(pages[(long) i * PAGE_SIZE] == 'a' + (i + flags) % 26
+          && pages[(long) (i + 1) * PAGE_SIZE - 1] == 'a' + (i + flags) % 26, "page through page memory");
+    freePageMemory(pages);
+  }
+  printf("Read and wrote pages with all kinds of page memory\n");
+
+  // the write-behind table takes its pages from page memory too
+  setPageMemoryFlags(SM_MEM_HUGEPAGES | SM_MEM_LOCKED);
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  TEST_CHECK(enableWriteBehind(&fh, 64));
+  for (i = 0; i < 200; i++) {
+    memset(ph, 'A' + i % 26, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(disableWriteBehind(&fh));
+  setPageMemoryFlags(0);
+  for (i = 0; i < 200; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    ASSERT_TRUE(ph[0] == 'A' + i % 26, "page written behind");
+  }
+  freePageMemory(NULL);
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/*  Function Name: testIncrementalBackup
+ *  Test:  The first delta holds every page and creates the copy, the next
+ *         only the pages written since, also across a reopen; deltas apply
+ *         in order only and leave the copy equal to the file
+ */
+void testIncrementalBackup(void) {
+  SM_FileHandle fh, base;
+  SM_PageHandle ph, bh;
+  FILE *delta;
+  int i;
+  testName = "test incremental backup";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  bh = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(20, &fh));
+  for (i = 0; i < 20; i++) {
+    memset(ph, 'a' + i, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  ASSERT_EQUALS_INT(-1, getChangedPageCount(&fh), "changes not tracked");
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, backupPageDelta(&fh, TESTDELTA0), "backup without tracking");
+  TEST_CHECK(enableChangeTracking(&fh));
+  ASSERT_EQUALS_INT(20, getChangedPageCount(&fh), "every page is in the first backup");
+  TEST_CHECK(backupPageDelta(&fh, TESTDELTA0));
+  ASSERT_EQUALS_INT(0, getChangedPageCount(&fh), "nothing changed since the backup");
+  TEST_CHECK(applyPageDelta(TESTBASE, TESTDELTA0));
+  printf("Full backup applied\n");
+
+  for (i = 3; i < 6; i++) {
+    memset(ph, 'A' + i, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(writeBlock(17, &fh, ph));
+  TEST_CHECK(writeBlock(4, &fh, ph));
+  TEST_CHECK(writeBlockRange(9, 100, 5, &fh, "range"));
+  TEST_CHECK(stageBlockRange(11, 200, 6, &fh, "staged"));
+  TEST_CHECK(appendEmptyBlock(&fh));
+  TEST_CHECK(writeBlock(20, &fh, ph));
+  ASSERT_EQUALS_INT(7, getChangedPageCount(&fh), "changed pages");
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  ASSERT_EQUALS_INT(7, getChangedPageCount(&fh), "changed pages after a reopen");
+
+  TEST_CHECK(backupPageDelta(&fh, TESTDELTA1));
+  ASSERT_EQUALS_INT(RC_FILE_ALREADY_EXIST, backupPageDelta(&fh, TESTDELTA1), "delta file exists");
+  delta = fopen(TESTDELTA1, "rb");
+  fseek(delta, 0, SEEK_END);
+  ASSERT_EQUALS_INT(9 * PAGE_SIZE, (int) ftell(delta), "delta holds only the changed pages");
+  fclose(delta);
+  printf("Incremental backup of the changed pages\n");
+
+  ASSERT_EQUALS_INT(RC_FILE_NOT_FOUND, applyPageDelta(TESTBASE, TESTDELTA1 "x"), "missing delta");
+  TEST_CHECK(applyPageDelta(TESTBASE, TESTDELTA1));
+  ASSERT_EQUALS_INT(RC_DELTA_EPOCH_MISMATCH, applyPageDelta(TESTBASE, TESTDELTA0), "old delta");
+  TEST_CHECK(openPageFile (TESTBASE, &base));
+  ASSERT_EQUALS_INT(fh.totalNumPages, base.totalNumPages, "pages of the copy");
+  for (i = 0; i < fh.totalNumPages; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    TEST_CHECK(readBlock(i, &base, bh));
+    ASSERT_TRUE(memcmp(ph, bh, PAGE_SIZE) == 0, "copy equals the file");
+  }
+  TEST_CHECK(closePageFile (&base));
+  printf("Deltas applied in order\n");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  TEST_CHECK(destroyPageFile (TESTBASE));
+  ASSERT_TRUE(access(TESTPF ".chg", F_OK) != 0 && access(TESTBASE ".chg", F_OK) != 0, "change files removed");
+  remove(TESTDELTA0);
+  remove(TESTDELTA1);
+  printf("Close and destroy file \n");
+
+  free(ph);
+  free(bh);
+  TEST_DONE();
+}
+
+/* follower thread of testReplication: arg points to the read end and
+ * receives the result of followPageFile */
+static void *testFollow(void *arg) {
+  int *fd = (int *) arg;
+  *fd = followPageFile(TESTFOLLOWER, *fd);
+  return NULL;
+}
+
+/*  Function Name: testReplication
+ *  Test:  A follower fed over a pipe, then over a Unix socket, ends up with
+ *         the same pages as the leader: existing pages, whole page writes,
+ *         multi-page writes, range writes and appended pages
+ */
+void testReplication(void) {
+  SM_FileHandle fh, copy;
+  SM_PageHandle ph, bh;
+  pthread_t follower;
+  int fds[2], arg, round, i;
+  int bad[6] = { 0x31504853, 1, -5, 0, PAGE_SIZE, 8 };
+  RC rc;
+  testName = "test replication";
+  ph = (SM_PageHandle) malloc(4 * PAGE_SIZE);
+  bh = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(8, &fh));
+  for (i = 0; i < 8; i++) {
+    memset(ph, 'a' + i, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+
+  for (round = 0; round < 2; round++) {
+    if (round == 0)
+      ASSERT_TRUE(pipe(fds) == 0, "pipe");
+    else
+      ASSERT_TRUE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socket pair");
+    arg = fds[0];
+    ASSERT_TRUE(pthread_create(&follower, NULL, testFollow, &arg) == 0, "start follower");
+    // the first follower starts from nothing, the second from the first copy
+    TEST_CHECK(enableReplication(&fh, fds[1], round == 0));
+    ASSERT_EQUALS_INT(RC_FILE_ALREADY_EXIST, enableReplication(&fh, fds[1], 0), "one follower per file");
+
+    for (i = 0; i < 200; i++) {
+      memset(ph, 'A' + (i + round) % 26, PAGE_SIZE);
+      TEST_CHECK(writeBlock(i % 8, &fh, ph));
+    }
+    memset(ph, 'x' + round, 4 * PAGE_SIZE);
+    TEST_CHECK(writeBlocks(2, 4, &fh, ph));
+    TEST_CHECK(writeBlockRange(1, 100, 5, &fh, round ? "RANGE" : "range"));
+    TEST_CHECK(stageBlockRange(3, 300, 6, &fh, round ? "STAGED" : "staged"));
+    TEST_CHECK(appendEmptyBlock(&fh));
+    memset(ph, 'z', PAGE_SIZE);
+    TEST_CHECK(writeBlock(fh.totalNumPages - 1, &fh, ph));
+    TEST_CHECK(checkpointPageFile(&fh));
+    TEST_CHECK(disableReplication(&fh));
+    TEST_CHECK(disableReplication(&fh));
+    close(fds[1]);
+    pthread_join(follower, NULL);
+    close(fds[0]);
+    TEST_CHECK(arg);
+
+    TEST_CHECK(openPageFile (TESTFOLLOWER, &copy));
+    ASSERT_EQUALS_INT(fh.totalNumPages, copy.totalNumPages, "pages of the copy");
+    for (i = 0; i < fh.totalNumPages; i++) {
+      TEST_CHECK(readBlock(i, &fh, ph));
+      TEST_CHECK(readBlock(i, &copy, bh));
+      ASSERT_TRUE(memcmp(ph, bh, PAGE_SIZE) == 0, "copy equals the leader");
+    }
+    TEST_CHECK(closePageFile (&copy));
+    printf("Follower caught up over a %s\n", round ? "socket" : "pipe");
+  }
+
+  ASSERT_TRUE(pipe(fds) == 0, "pipe");
+  ASSERT_TRUE(write(fds[1], "not a change stream, just some bytes", 36) == 36, "write garbage");
+  close(fds[1]);
+  ASSERT_EQUALS_INT(RC_FILE_HEADER_CORRUPT, followPageFile(TESTFOLLOWER, fds[0]), "garbage stream");
+  close(fds[0]);
+
+  // a page record for page -5: magic "SHP1", type, page, offset, length, pages
+  ASSERT_TRUE(pipe(fds) == 0, "pipe");
+  ASSERT_TRUE(write(fds[1], bad, sizeof(bad)) == sizeof(bad) && write(fds[1], ph, PAGE_SIZE) == PAGE_SIZE, "write bad record");
+  close(fds[1]);
+  rc = followPageFile(TESTFOLLOWER, fds[0]);
+  ASSERT_EQUALS_INT(RC_FILE_HEADER_CORRUPT, rc, "negative page in the stream");
+  close(fds[0]);
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  TEST_CHECK(destroyPageFile (TESTFOLLOWER));
+  printf("Close and destroy file \n");
+
+  free(ph);
+  free(bh);
+  TEST_DONE();
+}
+
+/*  Function Name: testPrefetch
+ *  Test:  Prefetching accepts pages in any order with duplicates, rejects
+ *         pages outside the file and leaves reads returning the same data
+ */
+void testPrefetch(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int pages[] = {40, 3, 17, 4, 3, 39, 5, 90, 41, 0};
+  int bad[] = {2, 100};
+  int i, j;
+  testName = "test prefetch";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(100, &fh));
+  for (i = 0; i < 100; i++) {
+    memset(ph, i, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(prefetchBlocks(&fh, pages, 0));
+  TEST_CHECK(prefetchBlocks(&fh, pages, 10));
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, prefetchBlocks(&fh, bad, 2), "page outside the file");
+  bad[1] = -1;
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, prefetchBlocks(&fh, bad, 2), "negative page");
+  for (i = 0; i < 10; i++) {
+    TEST_CHECK(readBlock(pages[i], &fh, ph));
+    for (j = 0; j < PAGE_SIZE && ph[j] == (char) pages[i]; j++);
+    ASSERT_EQUALS_INT(PAGE_SIZE, j, "prefetched page content");
+  }
+  printf("Prefetched pages read back\n");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/*  Function Name: testTempPageFile
+ *  Test:  A temporary file reads back what was written, stays in memory up
+ *         to its limit, keeps its pages when it spills to disk and has no
+ *         side files
+ */
+void testTempPageFile(void) {
+  SM_FileHandle fh, disk;
+  SM_PageHandle ph;
+  int i, j;
+  testName = "test temporary page file";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  TEST_CHECK(openTempPageFile(&fh, 8));
+  ASSERT_EQUALS_INT(1, fh.totalNumPages, "one page to start with");
+#ifdef __linux__
+  ASSERT_TRUE(isTempFileInMemory(&fh), "pages in memory");
+#endif
+  TEST_CHECK(ensureCapacity(8, &fh));
+  for (i = 0; i < 8; i++) {
+    memset(ph, 'a' + i, PAGE_SIZE);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(checkpointPageFile(&fh));
+#ifdef __linux__
+  ASSERT_TRUE(isTempFileInMemory(&fh), "still in memory at the limit");
+#endif
+  TEST_CHECK(appendEmptyBlock(&fh));
+  ASSERT_TRUE(!isTempFileInMemory(&fh), "spilled past the limit");
+  TEST_CHECK(ensureCapacity(20, &fh));
+  memset(ph, 'z', PAGE_SIZE);
+  TEST_CHECK(writeBlock(19, &fh, ph));
+  for (i = 0; i < 20; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    char expect = i < 8 ? 'a' + i : (i == 19 ? 'z' : 0);
+    for (j = 0; j < PAGE_SIZE && ph[j] == expect; j++);
+    ASSERT_EQUALS_INT(PAGE_SIZE, j, "page content after the spill");
+  }
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, enableChangeTracking(&fh), "no change file");
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, enablePageSummaries(&fh, testPageKeys, NULL), "no summary file");
+  TEST_CHECK(closePageFile(&fh));
+  printf("Temporary file spilled to disk\n");
+
+  TEST_CHECK(openTempPageFile(&disk, 0));
+  ASSERT_TRUE(!isTempFileInMemory(&disk), "no memory allowed");
+  TEST_CHECK(writeBlock(0, &disk, ph));
+  TEST_CHECK(readBlock(0, &disk, ph));
+  TEST_CHECK(closePageFile(&disk));
+  printf("Temporary file on disk\n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/* background thread of testIOScheduler: reads the 64 pages of the file
+ * through a handle of its own */
+static void *testBackgroundReads(void *arg) {
+  SM_FileHandle fh;
+  SM_PageHandle ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  int i;
+  (void) arg;
+  setIOClass(SM_IO_BACKGROUND);
+  if (openPageFile(TESTPF, &fh) == RC_OK) {
+    for (i = 0; i < 64; i++)
+      readBlock(i, &fh, ph);
+    closePageFile(&fh);
+  }
+  free(ph);
+  return NULL;
+}
+
+/*  Function Name: testIOScheduler
+ *  Test:  I/O classes are per thread, a rate limit slows down only its own
+ *         class and the requests of every class are counted
+ */
+void testIOScheduler(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  SM_IOStats before, after, interactive;
+  pthread_t background;
+  struct timespec start, end;
+  double seconds;
+  int i;
+  testName = "test I/O scheduler";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+
+  ASSERT_EQUALS_INT(SM_IO_NORMAL, getIOClass(), "normal class by default");
+  ASSERT_EQUALS_INT(RC_ERROR, setIOClass(SM_IO_CLASSES), "no such class");
+  ASSERT_EQUALS_INT(RC_ERROR, setIOClassLimits(SM_IO_BACKGROUND, -1, 0), "bad rate");
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(64, &fh));
+  memset(ph, 'p', PAGE_SIZE);
+  for (i = 0; i < 64; i++)
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  TEST_CHECK(checkpointPageFile(&fh));
+
+  // 64 pages at 32 pages a second, minus the first burst of 4 pages
+  TEST_CHECK(setIOClassLimits(SM_IO_BACKGROUND, 32L * PAGE_SIZE, 100));
+  TEST_CHECK(getIOClassStats(SM_IO_BACKGROUND, &before));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ASSERT_TRUE(pthread_create(&background, NULL, testBackgroundReads, NULL) == 0, "start background reader");
+
+  TEST_CHECK(setIOClass(SM_IO_INTERACTIVE));
+  for (i = 0; i < 64; i++)
+    TEST_CHECK(readBlock(63 - i, &fh, ph));
+  TEST_CHECK(getIOClassStats(SM_IO_INTERACTIVE, &interactive));
+  ASSERT_TRUE(interactive.requests >= 64, "interactive reads counted");
+  ASSERT_TRUE(interactive.maxWaitMicros < 500000, "interactive reads are not rate limited");
+
+  pthread_join(background, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  TEST_CHECK(getIOClassStats(SM_IO_BACKGROUND, &after));
+  ASSERT_EQUALS_INT(64, (int) (after.requests - before.requests), "background reads counted");
+  ASSERT_TRUE(after.bytes - before.bytes == 64L * PAGE_SIZE, "background bytes counted");
+  ASSERT_TRUE(seconds > 1.5, "background reads held to their rate");
+  printf("64 background reads took %.2f s\n", seconds);
+
+  TEST_CHECK(setIOClassLimits(SM_IO_BACKGROUND, 0, 100));
+  TEST_CHECK(setIOClass(SM_IO_NORMAL));
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/*  Function Name: testHotPages
+ *  Test:  The most read pages are saved at close and found again after an
+ *         open, a short run only displaces them with hotter pages, and the
+ *         side file goes with the page file
+ */
+void testHotPages(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  int reads[][2] = {{7, 10}, {40, 8}, {3, 5}, {12, 3}, {20, 2}, {1, 1}};
+  int first[] = {3, 7, 12, 20, 40};
+  int second[] = {3, 7, 12, 20, 45};
+  int list[8];
+  int i, j;
+  testName = "test hot pages";
+  ph = (SM_PageHandle) malloc(2 * PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(50, &fh));
+  memset(ph, 'h', PAGE_SIZE);
+  for (i = 0; i < 50; i++)
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  ASSERT_EQUALS_INT(-1, getHotPages(&fh, list, 8), "no hot page list");
+  TEST_CHECK(warmUpPageFile(&fh));
+  TEST_CHECK(enableHotPages(&fh, 5));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < reads[i][1]; j++)
+      TEST_CHECK(readBlock(reads[i][0], &fh, ph));
+  TEST_CHECK(readBlocks(30, 2, &fh, ph));
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  ASSERT_EQUALS_INT(5, getHotPages(&fh, list, 8), "length of the saved list");
+  ASSERT_TRUE(memcmp(list, first, sizeof(first)) == 0, "most read pages, sorted");
+  TEST_CHECK(warmUpPageFile(&fh));
+  TEST_CHECK(readBlock(45, &fh, ph));
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  getHotPages(&fh, list, 8);
+  ASSERT_TRUE(memcmp(list, first, sizeof(first)) == 0, "a page read once does not displace the list");
+  TEST_CHECK(readBlock(45, &fh, ph));
+  TEST_CHECK(readBlock(45, &fh, ph));
+  TEST_CHECK(checkpointPageFile (&fh));
+  getHotPages(&fh, list, 8);
+  ASSERT_TRUE(memcmp(list, second, sizeof(second)) == 0, "a hotter page does");
+  printf("Hot pages saved and loaded\n");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  ASSERT_TRUE(access(TESTPF ".hot", F_OK) != 0, "hot page file removed");
+  printf("Close and destroy file \n");
+
+  free(ph);
+  TEST_DONE();
+}
+
+/* what testVisitPages saw, per page and per worker */
+typedef struct ScanSeen {
+  int visits[1024];
+  int morsels[4];
+  int slowWorker;     /* sleeps on every morsel, -1 for none */
+  int failPage;       /* visit fails on the morsel holding it, -1 for none */
+} ScanSeen;
+
+static RC testVisitPages(int firstPage, int numPages, SM_PageHandle pages, int worker, void *ctx) {
+  ScanSeen *seen = (ScanSeen *) ctx;
+  int i;
+  for (i = 0; i < numPages; i++)
+    if (*(int *) (pages + i * PAGE_SIZE) == firstPage + i)
+      seen->visits[firstPage + i]++;
+  seen->morsels[worker]++;
+  if (worker == seen->slowWorker)
+    usleep(20000);
+  if (seen->failPage >= firstPage && seen->failPage < firstPage + numPages)
+    return RC_WRITE_FAILED;
+  return RC_OK;
+}
+
+/*  Function Name: testParallelScan
+ *  Test:  Every page of a range is visited exactly once with its content,
+ *         staged ranges and write-behind pages included; the fast workers
+ *         take over the morsels of a slow one; a failing visit stops the scan
+ */
+void testParallelScan(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph;
+  ScanSeen *seen;
+  int i, ok;
+  RC rc;
+  testName = "test parallel scan";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  seen = (ScanSeen *) calloc(1, sizeof(ScanSeen));
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(1024, &fh));
+  memset(ph, 's', PAGE_SIZE);
+  for (i = 0; i < 1000; i++) {
+    *(int *) ph = i;
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  *(int *) ph = 1000;
+  TEST_CHECK(stageBlockRange(1000, 0, sizeof(int), &fh, ph));
+  TEST_CHECK(enableWriteBehind(&fh, 16));
+  for (i = 1001; i < 1024; i++) {
+    *(int *) ph = i;
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+
+  seen->slowWorker = -1;
+  seen->failPage = -1;
+  TEST_CHECK(scanPagesParallel(&fh, 0, 1024, 4, 16, testVisitPages, seen));
+  for (i = 0, ok = 1; i < 1024; i++)
+    ok &= seen->visits[i] == 1;
+  ASSERT_TRUE(ok, "every page visited once");
+  ASSERT_EQUALS_INT(64, seen->morsels[0] + seen->morsels[1] + seen->morsels[2] + seen->morsels[3], "number of morsels");
+
+  // a worker that is slow gets through a fraction of its share of 16
+  memset(seen, 0, sizeof(ScanSeen));
+  seen->slowWorker = 0;
+  seen->failPage = -1;
+  TEST_CHECK(scanPagesParallel(&fh, 0, 1024, 4, 16, testVisitPages, seen));
+  for (i = 0, ok = 1; i < 1024; i++)
+    ok &= seen->visits[i] == 1;
+  ASSERT_TRUE(ok, "every page visited once with a slow worker");
+  printf("Morsels per worker with a slow worker 0: %d %d %d %d\n",
+      seen->morsels[0], seen->morsels[1], seen->morsels[2], seen->morsels[3]);
+  ASSERT_TRUE(seen->morsels[0] < 8, "the slow worker's morsels are stolen");
+
+  // one thread, a part of the file, a morsel size that does not divide it
+  memset(seen, 0, sizeof(ScanSeen));
+  seen->slowWorker = -1;
+  seen->failPage = -1;
+  TEST_CHECK(scanPagesParallel(&fh, 100, 250, 1, 0, testVisitPages, seen));
+  for (i = 0, ok = 1; i < 1024; i++)
+    ok &= seen->visits[i] == (i >= 100 && i < 350);
+  ASSERT_TRUE(ok, "pages of the range visited once");
+  ASSERT_EQUALS_INT(4, seen->morsels[0], "default morsels of 64 pages");
+
+  seen->failPage = 500;
+  rc = scanPagesParallel(&fh, 0, 1024, 3, 8, testVisitPages, seen);
+  ASSERT_EQUALS_INT(RC_WRITE_FAILED, rc, "error of the visitor");
+  rc = scanPagesParallel(&fh, 1000, 25, 2, 8, testVisitPages, seen);
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, rc, "range past the end");
+  printf("Scanned with 4 threads\n");
+
+  TEST_CHECK(closePageFile (&fh));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  printf("Close and destroy file \n");
+
+  free(seen);
+  free(ph);
+  TEST_DONE();
+}
+
+/* page of one of a few kinds, every kind has its own bytes */
+static void fillDedupPage(SM_PageHandle ph, int kind) {
+  memset(ph, 'a' + kind, PAGE_SIZE);
+  memcpy(ph + 100, &kind, sizeof(int));
+}
+
+static int isDedupPage(SM_PageHandle ph, int kind) {
+  char want[PAGE_SIZE];
+  fillDedupPage(want, kind);
+  return memcmp(ph, want, PAGE_SIZE) == 0;
+}
+
+/*  Function Name: testPageDedup
+ *  Test:  Pages with the same bytes are stored once, pages already in the
+ *         file included; overwriting a shared page or a reference, range
+ *         writes and multi-page writes keep every other page; the map
+ *         survives reopening and goes with the file
+ */
+void testPageDedup(void) {
+  SM_FileHandle fh;
+  SM_PageHandle ph, many;
+  SM_DedupStats stats;
+  struct stat st;
+  int i, ok;
+  RC rc;
+  testName = "test page dedup";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  many = (SM_PageHandle) malloc(4 * PAGE_SIZE);
+
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(ensureCapacity(200, &fh));
+  // pages written before dedup is enabled are shared by enablePageDedup
+  for (i = 0; i < 40; i++) {
+    fillDedupPage(ph, i % 8);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(enablePageDedup(&fh));
+  TEST_CHECK(getPageDedupStats(&fh, &stats));
+  ASSERT_EQUALS_INT(32, stats.references, "existing duplicates shared");
+  ASSERT_EQUALS_INT(8, stats.sharedPages, "one page per kind");
+  for (i = 40; i < 200; i++) {
+    fillDedupPage(ph, i % 8);
+    TEST_CHECK(writeBlock(i, &fh, ph));
+  }
+  TEST_CHECK(getPageDedupStats(&fh, &stats));
+  ASSERT_EQUALS_INT(192, stats.references, "written duplicates shared");
+  TEST_CHECK(checkpointPageFile(&fh));
+  ASSERT_TRUE(stat(TESTPF, &st) == 0 && st.st_blocks * 512L < 50L * PAGE_SIZE, "the file takes the room of the distinct pages");
+  printf("200 pages stored in %ld KB\n", (long) st.st_blocks / 2);
+
+  for (i = 0, ok = 1; i < 200; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    ok &= isDedupPage(ph, i % 8);
+  }
+  ASSERT_TRUE(ok, "every page reads back");
+  ASSERT_EQUALS_INT(8, getNextDataBlockPos(&fh, 8), "shared pages are not empty");
+
+  // page 0 holds the bytes of kind 0 for the others, pages 11 to 13 are references
+  fillDedupPage(ph, 9);
+  TEST_CHECK(writeBlock(0, &fh, ph));
+  fillDedupPage(ph, 10);
+  TEST_CHECK(writeBlock(11, &fh, ph));
+  memset(ph, 0, PAGE_SIZE);
+  TEST_CHECK(writeBlock(12, &fh, ph));
+  TEST_CHECK(writeBlockRange(13, 0, 1, &fh, "z"));
+  for (i = 0; i < 4; i++)
+    fillDedupPage(many + i * PAGE_SIZE, 9);
+  TEST_CHECK(writeBlocks(20, 4, &fh, many));
+  for (i = 0, ok = 1; i < 200; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    if (i == 0 || (i >= 20 && i < 24))
+      ok &= isDedupPage(ph, 9);
+    else if (i == 11)
+      ok &= isDedupPage(ph, 10);
+    else if (i == 12)
+      ok &= ph[0] == 0 && memcmp(ph, ph + 1, PAGE_SIZE - 1) == 0;
+    else if (i == 13)
+      ok &= ph[0] == 'z' && ph[1] == 'a' + 5;
+    else
+      ok &= isDedupPage(ph, i % 8);
+  }
+  ASSERT_TRUE(ok, "overwriting shared pages and references leaves the others");
+  TEST_CHECK(getPageDedupStats(&fh, &stats));
+  printf("%d of %d pages are references to %d shared pages\n", stats.references, stats.pages, stats.sharedPages);
+  ASSERT_EQUALS_INT(188, stats.references, "references after the overwrites");
+  rc = enableWriteBehind(&fh, 16);
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, rc, "no write-behind with dedup");
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(openPageFile (TESTPF, &fh));
+  TEST_CHECK(getPageDedupStats(&fh, &stats));
+  ASSERT_EQUALS_INT(188, stats.references, "references after reopening");
+  for (i = 30, ok = 1; i < 200; i++) {
+    TEST_CHECK(readBlock(i, &fh, ph));
+    ok &= isDedupPage(ph, i % 8);
+  }
+  ASSERT_TRUE(ok, "pages read back after reopening");
+  TEST_CHECK(readBlocks(24, 4, &fh, many));
+  for (i = 0, ok = 1; i < 4; i++)
+    ok &= isDedupPage(many + i * PAGE_SIZE, (24 + i) % 8);
+  ASSERT_TRUE(ok, "multi-page reads of shared pages");
+  // a page written after reopening is still matched
+  fillDedupPage(ph, 10);
+  TEST_CHECK(writeBlock(13, &fh, ph));
+  TEST_CHECK(getPageDedupStats(&fh, &stats));
+  ASSERT_EQUALS_INT(189, stats.references, "hashes survive reopening");
+  TEST_CHECK(closePageFile (&fh));
+
+  TEST_CHECK(destroyPageFile (TESTPF));
+  ASSERT_TRUE(access(TESTPF ".dup", F_OK) != 0, "map file removed");
+  printf("Close and destroy file \n");
+
+  free(many);
+  free(ph);
+  TEST_DONE();
+}
+
+/* the memory entry of a file, 0 if the file is not listed */
+static SM_MemoryUse *findMemoryUse(SM_MemoryUse *users, int n, char *fileName) {
+  int i;
+  for (i = 0; i < n; i++)
+    if (strcmp(users[i].fileName, fileName) == 0)
+      return &users[i];
+  return 0;
+}
+
+/*  Function Name: testMemoryBudget
+ *  Test:  Cached pages of two files share one budget and the least recently
+ *         used are evicted from either file; write-behind tables are cut to
+ *         the budget; staged pages and temporary files are charged; the
+ *         report lists every open file and pages read back after eviction
+ */
+void testMemoryBudget(void) {
+  SM_FileHandle fa, fb, ft;
+  SM_PageHandle ph, many;
+  SM_MemoryStats stats;
+  SM_MemoryUse users[16], *a, *b;
+  long long denied;
+  int i, n, ok;
+  RC rc;
+  testName = "test memory budget";
+  ph = (SM_PageHandle) malloc(PAGE_SIZE);
+  many = (SM_PageHandle) malloc(128 * PAGE_SIZE);
+
+  rc = setMemoryBudget(-1);
+  ASSERT_EQUALS_INT(RC_ERROR, rc, "negative budget");
+  TEST_CHECK(setMemoryBudget(0));
+  TEST_CHECK(createPageFile (TESTPF));
+  TEST_CHECK(createPageFile (TESTMEM));
+  TEST_CHECK(openPageFile (TESTPF, &fa));
+  TEST_CHECK(openPageFile (TESTMEM, &fb));
+  TEST_CHECK(ensureCapacity(128, &fa));
+  TEST_CHECK(ensureCapacity(128, &fb));
+  for (i = 0; i < 128 * PAGE_SIZE; i++)
+    many[i] = (char) (i / PAGE_SIZE + 1);
+  TEST_CHECK(writeBlocks(0, 128, &fa, many));
+  n = getMemoryUsers(users, 16);
+  a = findMemoryUse(users, n, TESTPF);
+  ASSERT_TRUE(a != 0 && a->bytes[SM_MEM_CACHE] == 128L * PAGE_SIZE, "written pages are charged");
+
+  // the pages of the second file push out those of the first
+  TEST_CHECK(setMemoryBudget(128L * PAGE_SIZE));
+  TEST_CHECK(writeBlocks(0, 128, &fb, many));
+  n = getMemoryUsers(users, 16);
+  a = findMemoryUse(users, n, TESTPF);
+  b = findMemoryUse(users, n, TESTMEM);
+  ASSERT_TRUE(a != 0 && b != 0, "both files are listed");
+  ASSERT_TRUE(a->bytes[SM_MEM_CACHE] == 0, "first file evicted");
+  ASSERT_TRUE(b->bytes[SM_MEM_CACHE] == 128L * PAGE_SIZE, "second file cached");
+  ASSERT_TRUE(b == &users[0] || users[0].bytes[SM_MEM_CACHE] >= b->bytes[SM_MEM_CACHE], "biggest user first");
+  TEST_CHECK(getMemoryStats(&stats));
+  ASSERT_TRUE(stats.bytes[SM_MEM_CACHE] <= stats.budget && stats.evictions >= 2, "within the budget");
+
+  // reading the first file again evicts the oldest chunk of the second
+  TEST_CHECK(readBlock(5, &fa, ph));
+  ASSERT_TRUE(ph[0] == 6 && ph[PAGE_SIZE - 1] == 6, "evicted page reads back");
+  n = getMemoryUsers(users, 16);
+  a = findMemoryUse(users, n, TESTPF);
+  b = findMemoryUse(users, n, TESTMEM);
+  ASSERT_TRUE(a->bytes[SM_MEM_CACHE] == PAGE_SIZE, "read page charged");
+  ASSERT_TRUE(b->bytes[SM_MEM_CACHE] == 64L * PAGE_SIZE, "oldest chunk of the other file evicted");
+  ASSERT_TRUE(a->lastUse > b->lastUse, "recency of the files");
+
+  // a write-behind table gets what the budget holds
+  TEST_CHECK(getMemoryStats(&stats));
+  denied = stats.deniedPages;
+  TEST_CHECK(enableWriteBehind(&fa, 1000));
+  n = getMemoryUsers(users, 16);
+  a = findMemoryUse(users, n, TESTPF);
+  ASSERT_TRUE(a->bytes[SM_MEM_WRITE_BEHIND] == 128L * PAGE_SIZE, "write-behind table cut to the budget");
+  TEST_CHECK(getMemoryStats(&stats));
+  ASSERT_TRUE(stats.deniedPages - denied == 872, "denied write-behind pages");
+  for (i = 0; i < 128 * PAGE_SIZE; i++)
+    many[i] = (char) (i / PAGE_SIZE + 2);
+  TEST_CHECK(writeBlocks(0, 128, &fa, many));
+  TEST_CHECK(disableWriteBehind(&fa));
+  n = getMemoryUsers(users, 16);
+  a = findMemoryUse(users, n, TESTPF);
+  ASSERT_TRUE(a->bytes[SM_MEM_WRITE_BEHIND] == 0, "write-behind table given back");
+
+  // staged pages and temporary files in memory are charged too
+  TEST_CHECK(stageBlockRange(3, 0, 1, &fb, "s"));
+  TEST_CHECK(openTempPageFile(&ft, -1));
+  TEST_CHECK(ensureCapacity(10, &ft));
+  n = getMemoryUsers(users, 16);
+  b = findMemoryUse(users, n, TESTMEM);
+  ASSERT_TRUE(b->bytes[SM_MEM_STAGED] == PAGE_SIZE, "staged page charged");
+  if (isTempFileInMemory(&ft)) {
+    a = findMemoryUse(users, n, "(temporary)");
+    ASSERT_TRUE(a != 0 && a->bytes[SM_MEM_TEMP] == 10L * PAGE_SIZE, "temporary file charged");
+  }
+  TEST_CHECK(closePageFile (&ft));
+
+  for (i = 0, ok = 1; i < 128; i++) {
+    TEST_CHECK(readBlock(i, &fa, ph));
+    ok &= ph[0] == (char) (i + 2) && ph[PAGE_SIZE - 1] == (char) (i + 2);
+    TEST_CHECK(readBlock(i, &fb, ph));
+    ok &= ph[0] == (i == 3 ? 's' : (char) (i + 1)) && ph[PAGE_SIZE - 1] == (char) (i + 1);
+  }
+  ASSERT_TRUE(ok, "every page reads back");
+  TEST_CHECK(getMemoryStats(&stats));
+  printf("%lld KB cached in a %lld KB budget, %lld chunks evicted\n",
+      stats.bytes[SM_MEM_CACHE] / 1024, stats.budget / 1024, stats.evictions);
+  ASSERT_TRUE(stats.bytes[SM_MEM_CACHE] <= stats.budget, "within the budget after reading both files");
+
+  TEST_CHECK(closePageFile (&fa));
+  TEST_CHECK(closePageFile (&fb));
+  n = getMemoryUsers(users, 16);
+  ASSERT_TRUE(findMemoryUse(users, n, TESTPF) == 0 && findMemoryUse(users, n, TESTMEM) == 0, "closed files are not listed");
+  TEST_CHECK(setMemoryBudget(0));
+  TEST_CHECK(destroyPageFile (TESTPF));
+  TEST_CHECK(destroyPageFile (TESTMEM));
+  printf("Close and destroy file \n");
+
+  free(many);
+  free(ph);
+  TEST_DONE();
+}
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree_mgr.h"
+#include "dberror.h"
+#include "test_assign1_1.h"
+
+// test name
+char *testName;
+
+/* test output files */
+#define TESTIDX "test_index_b"
+
+/* prototypes for test functions */
+static void testInsertFind(int n);
+static void testDelete(int n);
+static void testRangeScan(void);
+static void testKeyTypes(void);
+static void testBulkLoad(int n, float fillFactor, int count);
+
+/* helpers */
+static int *permutation(int count, unsigned int seed);
+static Value intKey(int k);
+
+/* main function running all tests */
+int
+main (void)
+{
+  testName = "";
+
+  initIndexManager(NULL);
+  testInsertFind(2);
+  testInsertFind(5);
+  testInsertFind(300);
+  testDelete(3);
+  testDelete(4);
+  testDelete(64);
+  testRangeScan();
+  testKeyTypes();
+  testBulkLoad(4, 1.0f, 0);
+  testBulkLoad(4, 1.0f, 1);
+  testBulkLoad(3, 0.7f, 1001);
+  testBulkLoad(64, 0.5f, 20000);
+  testBulkLoad(300, 0.9f, 100000);
+  shutdownIndexManager();
+
+  return 0;
+}
+
+int *
+permutation(int count, unsigned int seed)
+{
+  int *p = (int *) malloc(sizeof(int) * count);
+  int i;
+
+  srand(seed);
+  for (i = 0; i < count; i++)
+    p[i] = i;
+  for (i = count - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+  }
+  return p;
+}
+
+Value
+intKey(int k)
+{
+  Value v;
+  v.dt = DT_INT;
+  v.v.intV = k;
+  return v;
+}
+
+/*  Function Name: testInsertFind
+ *  Test:  Keys inserted in random order are all found with their RIDs,
+ *         also after reopening; duplicates and missing keys are errors;
+ *         a full scan returns the keys in order
+ */
+void testInsertFind(int n) {
+  BTreeHandle *tree;
+  BT_ScanHandle *scan;
+  int count = 5000, i, num;
+  int *keys = permutation(count, n);
+  Value k;
+  RID rid;
+
+  testName = "test b+-tree insert and find ";
+
+  TEST_CHECK(createBtree(TESTIDX, DT_INT, n));
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i] * 2);
+    rid.page = keys[i];
+    rid.slot = keys[i] % 7;
+    TEST_CHECK(insertKey(tree, &k, rid));
+  }
+  k = intKey(keys[0] * 2);
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKey(tree, &k, rid), "duplicate key");
+  TEST_CHECK(getNumEntries(tree, &num));
+  ASSERT_EQUALS_INT(count, num, "number of entries");
+  TEST_CHECK(closeBtree(tree));
+
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 2);
+    TEST_CHECK(findKey(tree, &k, &rid));
+    ASSERT_TRUE(rid.page == i && rid.slot == i % 7, "RID of key");
+    k = intKey(i * 2 + 1);
+    ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &k, &rid), "odd keys are not in the index");
+  }
+  printf("Found all keys with n = %d\n", n);
+
+  TEST_CHECK(openTreeScan(tree, &scan));
+  i = 0;
+  while (nextEntry(scan, &rid) == RC_OK) {
+    if (rid.page != i)
+      break;
+    i++;
+  }
+  TEST_CHECK(closeTreeScan(scan));
+  ASSERT_EQUALS_INT(count, i, "scan returns the keys in order");
+
+  free(keys);
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testDelete
+ *  Test:  Deleting keys in random order keeps the others findable, nodes are
+ *         merged and reused, and deleting everything leaves a single leaf
+ */
+void testDelete(int n) {
+  BTreeHandle *tree;
+  BT_ScanHandle *scan;
+  int count = 3000, i, nodesFull, nodes, num;
+  int *keys = permutation(count, 7 * n);
+  int *order = permutation(count, 11 * n);
+  Value k;
+  RID rid;
+
+  testName = "test b+-tree delete ";
+
+  TEST_CHECK(createBtree(TESTIDX, DT_INT, n));
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    rid.page = keys[i];
+    rid.slot = 0;
+    TEST_CHECK(insertKey(tree, &k, rid));
+  }
+  TEST_CHECK(getNumNodes(tree, &nodesFull));
+
+  // delete the first half of a random order
+  for (i = 0; i < count / 2; i++) {
+    k = intKey(order[i]);
+    TEST_CHECK(deleteKey(tree, &k));
+  }
+  k = intKey(order[0]);
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, deleteKey(tree, &k), "cannot delete twice");
+  TEST_CHECK(getNumEntries(tree, &num));
+  ASSERT_EQUALS_INT(count - count / 2, num, "number of entries");
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_TRUE(nodes < nodesFull, "nodes are merged");
+
+  for (i = 0; i < count; i++) {
+    k = intKey(order[i]);
+    if (i < count / 2)
+      ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &k, &rid), "deleted key is gone");
+    else {
+      TEST_CHECK(findKey(tree, &k, &rid));
+      ASSERT_EQUALS_INT(order[i], rid.page, "remaining key is found");
+    }
+  }
+
+  TEST_CHECK(openTreeScan(tree, &scan));
+  num = 0;
+  i = -1;
+  while (nextEntry(scan, &rid) == RC_OK) {
+    if (rid.page <= i)
+      break;
+    i = rid.page;
+    num++;
+  }
+  TEST_CHECK(closeTreeScan(scan));
+  ASSERT_EQUALS_INT(count - count / 2, num, "scan after deletes is in order");
+  printf("Deleted half of the keys with n = %d\n", n);
+
+  // reinsert the deleted keys into the freed nodes, then delete everything
+  for (i = 0; i < count / 2; i++) {
+    k = intKey(order[i]);
+    rid.page = order[i];
+    TEST_CHECK(insertKey(tree, &k, rid));
+  }
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_TRUE(nodes <= nodesFull + nodesFull / 2, "free nodes are reused");
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    TEST_CHECK(deleteKey(tree, &k));
+  }
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_EQUALS_INT(1, nodes, "an empty tree is one leaf");
+  TEST_CHECK(openTreeScan(tree, &scan));
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, nextEntry(scan, &rid), "empty tree has no entries");
+  TEST_CHECK(closeTreeScan(scan));
+
+  free(keys);
+  free(order);
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testRangeScan
+ *  Test:  A range scan returns exactly the keys between its bounds, with
+ *         bounds that are and are not in the index and open bounds
+ */
+void testRangeScan(void) {
+  BTreeHandle *tree;
+  BT_ScanHandle *scan;
+  int i, count;
+  Value low, high;
+  RID rid;
+
+  testName = "test b+-tree range scan ";
+
+  TEST_CHECK(createBtree(TESTIDX, DT_INT, 8));
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  for (i = 0; i < 1000; i++) {
+    low = intKey(i * 10);
+    rid.page = i * 10;
+    rid.slot = 0;
+    TEST_CHECK(insertKey(tree, &low, rid));
+  }
+
+  low = intKey(100);
+  high = intKey(200);
+  TEST_CHECK(openTreeRangeScan(tree, &low, &high, &scan));
+  count = 0;
+  while (nextEntry(scan, &rid) == RC_OK) {
+    ASSERT_EQUALS_INT(100 + count * 10, rid.page, "keys in range in order");
+    count++;
+  }
+  TEST_CHECK(closeTreeScan(scan));
+  ASSERT_EQUALS_INT(11, count, "bounds are inclusive");
+
+  low = intKey(105);
+  high = intKey(199);
+  TEST_CHECK(openTreeRangeScan(tree, &low, &high, &scan));
+  count = 0;
+  while (nextEntry(scan, &rid) == RC_OK)
+    count++;
+  TEST_CHECK(closeTreeScan(scan));
+  ASSERT_EQUALS_INT(9, count, "bounds between keys");
+
+  low = intKey(9985);
+  TEST_CHECK(openTreeRangeScan(tree, &low, NULL, &scan));
+  TEST_CHECK(nextEntry(scan, &rid));
+  ASSERT_EQUALS_INT(9990, rid.page, "open high bound");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, nextEntry(scan, &rid), "open high bound ends at the last key");
+  TEST_CHECK(closeTreeScan(scan));
+
+  high = intKey(-1);
+  TEST_CHECK(openTreeRangeScan(tree, NULL, &high, &scan));
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, nextEntry(scan, &rid), "empty range");
+  TEST_CHECK(closeTreeScan(scan));
+
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testKeyTypes
+ *  Test:  Float keys keep their order including negative values, -0.0 finds
+ *         0.0; wrong key types, string keys and a too large n are errors
+ */
+void testKeyTypes(void) {
+  BTreeHandle *tree;
+  BT_ScanHandle *scan;
+  float values[] = { 3.5f, -0.25f, 100.0f, -7.0f, 0.0f, 1e-3f, -1e6f, 42.0f };
+  int sorted[] = { 6, 3, 1, 4, 5, 0, 7, 2 };
+  int i;
+  Value k;
+  RID rid;
+
+  testName = "test b+-tree key types ";
+
+  TEST_CHECK(createBtree(TESTIDX, DT_FLOAT, 3));
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  for (i = 0; i < 8; i++) {
+    k.dt = DT_FLOAT;
+    k.v.floatV = values[i];
+    rid.page = i;
+    rid.slot = 0;
+    TEST_CHECK(insertKey(tree, &k, rid));
+  }
+  TEST_CHECK(openTreeScan(tree, &scan));
+  for (i = 0; i < 8; i++) {
+    TEST_CHECK(nextEntry(scan, &rid));
+    ASSERT_EQUALS_INT(sorted[i], rid.page, "float keys in order");
+  }
+  TEST_CHECK(closeTreeScan(scan));
+  k.dt = DT_FLOAT;
+  k.v.floatV = -0.0f;
+  TEST_CHECK(findKey(tree, &k, &rid));
+  ASSERT_EQUALS_INT(4, rid.page, "-0.0 finds 0.0");
+
+  k = intKey(1);
+  ASSERT_EQUALS_INT(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, findKey(tree, &k, &rid), "key of the wrong type");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree(TESTIDX));
+
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, createBtree(TESTIDX, DT_STRING, 4), "string keys");
+  ASSERT_EQUALS_INT(RC_IM_N_TO_LAGE, createBtree(TESTIDX, DT_INT, 100000), "n too large");
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testBulkLoad
+ *  Test:  A bulk loaded index finds every key, scans in order, has nodes
+ *         filled to the fill factor, and takes inserts and deletes
+ *         afterwards; keys out of order are rejected
+ */
+void testBulkLoad(int n, float fillFactor, int count) {
+  BTreeHandle *tree;
+  BT_LoadHandle *load;
+  BT_ScanHandle *scan;
+  int i, num, nodes, leafKeys;
+  Value k;
+  RID rid;
+
+  testName = "test b+-tree bulk load ";
+
+  TEST_CHECK(openBulkLoad(TESTIDX, DT_INT, n, fillFactor, count, &load));
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 3);
+    rid.page = i;
+    rid.slot = 1;
+    TEST_CHECK(bulkLoadKey(load, &k, rid));
+  }
+  if (count > 0) {
+    k = intKey((count - 1) * 3);
+    ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, bulkLoadKey(load, &k, rid), "keys must increase");
+  }
+  TEST_CHECK(closeBulkLoad(load));
+
+  TEST_CHECK(openBtree(&tree, TESTIDX));
+  TEST_CHECK(getNumEntries(tree, &num));
+  ASSERT_EQUALS_INT(count, num, "number of entries");
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  // internal nodes have at least two children, so less than twice the leaves
+  leafKeys = (int) (n * fillFactor) > (n + 1) / 2 ? (int) (n * fillFactor) : (n + 1) / 2;
+  ASSERT_TRUE(nodes <= 2 * (count / leafKeys + 1), "leaves are filled to the fill factor");
+
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 3);
+    TEST_CHECK(findKey(tree, &k, &rid));
+    ASSERT_TRUE(rid.page == i && rid.slot == 1, "RID of bulk loaded key");
+  }
+  TEST_CHECK(openTreeScan(tree, &scan));
+  i = 0;
+  while (nextEntry(scan, &rid) == RC_OK && rid.page == i)
+    i++;
+  TEST_CHECK(closeTreeScan(scan));
+  ASSERT_EQUALS_INT(count, i, "scan returns the keys in order");
+  printf("Bulk loaded %d keys with n = %d\n", count, n);
+
+  // the tree behaves like any other afterwards
+  for (i = 0; i < count; i += 2) {
+    k = intKey(i * 3 + 1);
+    rid.page = -i;
+    TEST_CHECK(insertKey(tree, &k, rid));
+  }
+  for (i = 0; i < count; i += 3) {
+    k = intKey(i * 3);
+    TEST_CHECK(deleteKey(tree, &k));
+  }
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 3);
+    if (i % 3 == 0)
+      ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &k, &rid), "deleted after bulk load");
+    else
+      TEST_CHECK(findKey(tree, &k, &rid));
+    k = intKey(i * 3 + 1);
+    if (i % 2 == 0) {
+      TEST_CHECK(findKey(tree, &k, &rid));
+      ASSERT_EQUALS_INT(-i, rid.page, "inserted after bulk load");
+    }
+  }
+
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
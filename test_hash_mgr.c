@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_mgr.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+#include "test_assign1_1.h"
+
+// test name
+char *testName;
+
+/* test output files */
+#define TESTIDX "test_index_h"
+
+/* prototypes for test functions */
+static void testInsertFind(int count);
+static void testDelete(void);
+static void testGrowth(void);
+static void testKeyTypes(void);
+
+/* helpers */
+static int *permutation(int count, unsigned int seed);
+static Value intKey(int k);
+
+/* main function running all tests */
+int
+main (void)
+{
+  testName = "";
+
+  initStorageManager();
+  testInsertFind(10);
+  testInsertFind(5000);
+  testDelete();
+  testGrowth();
+  testKeyTypes();
+
+  return 0;
+}
+
+int *
+permutation(int count, unsigned int seed)
+{
+  int *p = (int *) malloc(sizeof(int) * count);
+  int i;
+
+  srand(seed);
+  for (i = 0; i < count; i++)
+    p[i] = i;
+  for (i = count - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+  }
+  return p;
+}
+
+Value
+intKey(int k)
+{
+  Value v;
+  v.dt = DT_INT;
+  v.v.intV = k;
+  return v;
+}
+
+/*  Function Name: testInsertFind
+ *  Test:  Keys inserted in random order are all found with their RIDs,
+ *         also after reopening; duplicates and missing keys are errors
+ */
+void testInsertFind(int count) {
+  HashHandle *index;
+  int *keys = permutation(count, count);
+  int i, num, buckets;
+  Value k;
+  RID rid;
+
+  testName = "test hash index insert and find ";
+
+  TEST_CHECK(createHashIndex(TESTIDX, DT_INT));
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i] * 2);
+    rid.page = keys[i];
+    rid.slot = keys[i] % 7;
+    TEST_CHECK(insertHashKey(index, &k, rid));
+  }
+  k = intKey(keys[0] * 2);
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertHashKey(index, &k, rid), "duplicate key");
+  TEST_CHECK(getHashNumEntries(index, &num));
+  ASSERT_EQUALS_INT(count, num, "number of entries");
+  TEST_CHECK(getHashNumBuckets(index, &buckets));
+  TEST_CHECK(closeHashIndex(index));
+
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  TEST_CHECK(getHashNumBuckets(index, &num));
+  ASSERT_EQUALS_INT(buckets, num, "number of buckets after reopening");
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 2);
+    TEST_CHECK(findHashKey(index, &k, &rid));
+    ASSERT_TRUE(rid.page == i && rid.slot == i % 7, "RID of key");
+    k = intKey(i * 2 + 1);
+    ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findHashKey(index, &k, &rid), "odd keys are not in the index");
+  }
+  printf("Found all %d keys in %d buckets\n", count, buckets);
+
+  free(keys);
+  TEST_CHECK(closeHashIndex(index));
+  TEST_CHECK(deleteHashIndex(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testDelete
+ *  Test:  Deleting keys in random order keeps the others findable, emptied
+ *         overflow pages are freed and reused
+ */
+void testDelete(void) {
+  HashHandle *index;
+  int count = 4000, i, num, overflow;
+  int *keys = permutation(count, 7);
+  Value k;
+  RID rid;
+
+  testName = "test hash index delete ";
+
+  TEST_CHECK(createHashIndex(TESTIDX, DT_INT));
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(i);
+    rid.page = i;
+    rid.slot = 0;
+    TEST_CHECK(insertHashKey(index, &k, rid));
+  }
+
+  for (i = 0; i < count / 2; i++) {
+    k = intKey(keys[i]);
+    TEST_CHECK(deleteHashKey(index, &k));
+  }
+  k = intKey(keys[0]);
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, deleteHashKey(index, &k), "deleting a deleted key");
+  TEST_CHECK(getHashNumEntries(index, &num));
+  ASSERT_EQUALS_INT(count / 2, num, "number of entries after deleting half");
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    if (i < count / 2)
+      ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findHashKey(index, &k, &rid), "deleted key");
+    else {
+      TEST_CHECK(findHashKey(index, &k, &rid));
+      ASSERT_EQUALS_INT(keys[i], rid.page, "RID of a remaining key");
+    }
+  }
+
+  for (i = count / 2; i < count; i++) {
+    k = intKey(keys[i]);
+    TEST_CHECK(deleteHashKey(index, &k));
+  }
+  TEST_CHECK(getHashNumEntries(index, &num));
+  ASSERT_EQUALS_INT(0, num, "empty index");
+  TEST_CHECK(getHashNumOverflowPages(index, &overflow));
+  ASSERT_EQUALS_INT(0, overflow, "no overflow pages left");
+
+  // deleted keys can be inserted again
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    rid.page = i;
+    TEST_CHECK(insertHashKey(index, &k, rid));
+  }
+  k = intKey(keys[count - 1]);
+  TEST_CHECK(findHashKey(index, &k, &rid));
+  ASSERT_EQUALS_INT(count - 1, rid.page, "RID of a key inserted again");
+
+  free(keys);
+  TEST_CHECK(closeHashIndex(index));
+  TEST_CHECK(deleteHashIndex(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testGrowth
+ *  Test:  The index grows one bucket at a time with the number of keys and
+ *         only a few buckets need overflow pages
+ */
+void testGrowth(void) {
+  HashHandle *index;
+  int count = 100000, i, num, buckets, overflow;
+  Value k;
+  RID rid;
+
+  testName = "test hash index growth ";
+
+  TEST_CHECK(createHashIndex(TESTIDX, DT_INT));
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 1000);
+    rid.page = i;
+    rid.slot = 2;
+    TEST_CHECK(insertHashKey(index, &k, rid));
+  }
+  TEST_CHECK(getHashNumBuckets(index, &buckets));
+  TEST_CHECK(getHashNumOverflowPages(index, &overflow));
+  printf("%d keys: %d buckets, %d overflow pages\n", count, buckets, overflow);
+  ASSERT_TRUE(buckets * 312 * 3 / 4 >= count - 312, "buckets grow with the keys");
+  ASSERT_TRUE(buckets * 312 / 2 <= count, "buckets do not grow past the keys");
+  ASSERT_TRUE(overflow <= buckets / 4, "few overflow pages");
+
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 1000);
+    TEST_CHECK(findHashKey(index, &k, &rid));
+    ASSERT_EQUALS_INT(i, rid.page, "RID of key");
+  }
+  TEST_CHECK(getHashNumEntries(index, &num));
+  ASSERT_EQUALS_INT(count, num, "number of entries");
+
+  TEST_CHECK(closeHashIndex(index));
+  TEST_CHECK(deleteHashIndex(TESTIDX));
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testKeyTypes
+ *  Test:  Float and bool keys are found, 0.0 and -0.0 are the same key;
+ *         wrong key types and string keys are errors
+ */
+void testKeyTypes(void) {
+  HashHandle *index;
+  float values[] = { 3.5f, -0.25f, 100.0f, -7.0f, 0.0f, 1e-3f, -1e6f, 42.0f };
+  int i;
+  Value k;
+  RID rid;
+
+  testName = "test hash index key types ";
+
+  TEST_CHECK(createHashIndex(TESTIDX, DT_FLOAT));
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  for (i = 0; i < 8; i++) {
+    k.dt = DT_FLOAT;
+    k.v.floatV = values[i];
+    rid.page = i;
+    rid.slot = 0;
+    TEST_CHECK(insertHashKey(index, &k, rid));
+  }
+  for (i = 0; i < 8; i++) {
+    k.dt = DT_FLOAT;
+    k.v.floatV = values[i];
+    TEST_CHECK(findHashKey(index, &k, &rid));
+    ASSERT_EQUALS_INT(i, rid.page, "RID of float key");
+  }
+  k.dt = DT_FLOAT;
+  k.v.floatV = -0.0f;
+  TEST_CHECK(findHashKey(index, &k, &rid));
+  ASSERT_EQUALS_INT(4, rid.page, "-0.0 finds 0.0");
+
+  k = intKey(1);
+  ASSERT_EQUALS_INT(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, findHashKey(index, &k, &rid), "key of the wrong type");
+  TEST_CHECK(closeHashIndex(index));
+  TEST_CHECK(deleteHashIndex(TESTIDX));
+
+  TEST_CHECK(createHashIndex(TESTIDX, DT_BOOL));
+  TEST_CHECK(openHashIndex(&index, TESTIDX));
+  k.dt = DT_BOOL;
+  k.v.boolV = true;
+  rid.page = 1;
+  TEST_CHECK(insertHashKey(index, &k, rid));
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertHashKey(index, &k, rid), "second true key");
+  k.v.boolV = false;
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findHashKey(index, &k, &rid), "false is not in the index");
+  TEST_CHECK(closeHashIndex(index));
+  TEST_CHECK(deleteHashIndex(TESTIDX));
+
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, createHashIndex(TESTIDX, DT_STRING), "string keys");
+  printf("Close and destroy index \n");
+
+  TEST_DONE();
+}
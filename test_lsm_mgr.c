@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsm_mgr.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+#include "test_assign1_1.h"
+
+// test name
+char *testName;
+
+/* test output files */
+#define TESTLSM "test_lsm"
+
+/* prototypes for test functions */
+static void testPutGet(int numThreads);
+static void testBloomFilter(void);
+static void testErrors(void);
+
+/* helpers */
+static int *permutation(int count, unsigned int seed);
+static Value intKey(int k);
+static int makeValue(int k, int version, char *buf);
+static void checkValue(LSM_Handle *lsm, int k, int version, char *msg);
+
+/* main function running all tests */
+int
+main (void)
+{
+  testName = "";
+
+  initStorageManager();
+  testPutGet(0);
+  testPutGet(1);
+  testPutGet(3);
+  testBloomFilter();
+  testErrors();
+
+  return 0;
+}
+
+int *
+permutation(int count, unsigned int seed)
+{
+  int *p = (int *) malloc(sizeof(int) * count);
+  int i;
+
+  srand(seed);
+  for (i = 0; i < count; i++)
+    p[i] = i;
+  for (i = count - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+  }
+  return p;
+}
+
+Value
+intKey(int k)
+{
+  Value v;
+  v.dt = DT_INT;
+  v.v.intV = k;
+  return v;
+}
+
+/* value of key k after version updates, of 0 to 299 bytes */
+int
+makeValue(int k, int version, char *buf)
+{
+  int length = (k * 7 + version * 13) % 300, i;
+  for (i = 0; i < length; i++)
+    buf[i] = (char) (k + version + i);
+  return length;
+}
+
+/* version -1: the key is deleted */
+void
+checkValue(LSM_Handle *lsm, int k, int version, char *msg)
+{
+  char want[LSM_MAX_VALUE], got[LSM_MAX_VALUE];
+  int length = LSM_MAX_VALUE;
+  Value key = intKey(k);
+  RC rc;
+
+  if (version < 0) {
+    rc = lsmGet(lsm, &key, got, &length);
+    ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, msg);
+    return;
+  }
+  int wantLength = makeValue(k, version, want);
+  TEST_CHECK(lsmGet(lsm, &key, got, &length));
+  ASSERT_TRUE(length == wantLength && memcmp(want, got, length) == 0, msg);
+}
+
+/*  Function Name: testPutGet
+ *  Test:  Puts, updates and deletes in random order are seen by lookups
+ *         while runs are written and compacted, after lsmFlush and after
+ *         reopening; compaction leaves level 0 short and fills deeper levels
+ */
+void testPutGet(int numThreads) {
+  LSM_Handle *lsm;
+  LSM_Stats stats;
+  int count = 20000, i, deeper = 0;
+  int *keys = permutation(count, numThreads + 1);
+  int *version = (int *) malloc(sizeof(int) * count);
+  char buf[LSM_MAX_VALUE];
+  Value k;
+
+  testName = "test lsm put and get ";
+
+  TEST_CHECK(createLsm(TESTLSM, DT_INT));
+  TEST_CHECK(openLsm(&lsm, TESTLSM, 64 * 1024, numThreads));
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    version[keys[i]] = 0;
+    TEST_CHECK(lsmPut(lsm, &k, buf, makeValue(keys[i], 0, buf)));
+  }
+  // update every third key, delete every fifth
+  for (i = 0; i < count; i++) {
+    k = intKey(keys[i]);
+    if (keys[i] % 5 == 0) {
+      version[keys[i]] = -1;
+      TEST_CHECK(lsmDelete(lsm, &k));
+    }
+    else if (keys[i] % 3 == 0) {
+      version[keys[i]] = 1;
+      TEST_CHECK(lsmPut(lsm, &k, buf, makeValue(keys[i], 1, buf)));
+    }
+  }
+  for (i = 0; i < count; i += 7)
+    checkValue(lsm, i, version[i], "value before the flush");
+
+  TEST_CHECK(lsmFlush(lsm));
+  TEST_CHECK(getLsmStats(lsm, &stats));
+  for (i = 1; i < LSM_LEVELS; i++)
+    deeper += stats.runs[i];
+  printf("%d threads: %lld flushes, %lld compactions, %lld pages written, runs:",
+      numThreads, stats.flushes, stats.compactions, stats.pagesWritten);
+  for (i = 0; i < LSM_LEVELS; i++)
+    printf(" %d", stats.runs[i]);
+  printf("\n");
+  ASSERT_TRUE(stats.runs[0] < 4, "level 0 is compacted");
+  ASSERT_TRUE(deeper > 0 && stats.compactions > 0, "runs in deeper levels");
+  for (i = 0; i < count; i++)
+    checkValue(lsm, i, version[i], "value after the flush");
+  TEST_CHECK(closeLsm(lsm));
+
+  TEST_CHECK(openLsm(&lsm, TESTLSM, 64 * 1024, numThreads));
+  for (i = 0; i < count; i++)
+    checkValue(lsm, i, version[i], "value after reopening");
+  // updates after reopening shadow the runs
+  for (i = 0; i < count; i += 2) {
+    k = intKey(i);
+    version[i] = 2;
+    TEST_CHECK(lsmPut(lsm, &k, buf, makeValue(i, 2, buf)));
+  }
+  TEST_CHECK(closeLsm(lsm));
+  TEST_CHECK(openLsm(&lsm, TESTLSM, 64 * 1024, numThreads));
+  for (i = 0; i < count; i++)
+    checkValue(lsm, i, version[i], "value after updating and reopening");
+  TEST_CHECK(closeLsm(lsm));
+  TEST_CHECK(deleteLsm(TESTLSM));
+
+  free(keys);
+  free(version);
+  printf("Close and destroy store \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testBloomFilter
+ *  Test:  Lookups of keys between the keys of the runs are nearly all
+ *         answered by the Bloom filters without reading a page
+ */
+void testBloomFilter(void) {
+  LSM_Handle *lsm;
+  LSM_Stats stats;
+  int count = 10000, i;
+  char buf[16];
+  int length;
+  Value k;
+  RC rc;
+
+  testName = "test lsm bloom filter ";
+
+  TEST_CHECK(createLsm(TESTLSM, DT_INT));
+  TEST_CHECK(openLsm(&lsm, TESTLSM, 32 * 1024, 2));
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 2);
+    TEST_CHECK(lsmPut(lsm, &k, buf, 8));
+  }
+  TEST_CHECK(lsmFlush(lsm));
+  for (i = 0; i < count; i++) {
+    k = intKey(i * 2 + 1);
+    length = sizeof(buf);
+    rc = lsmGet(lsm, &k, buf, &length);
+    ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, "odd keys are not in the store");
+  }
+  TEST_CHECK(getLsmStats(lsm, &stats));
+  printf("%lld run lookups of %d missing keys skipped by the Bloom filters\n", stats.bloomSkips, count);
+  ASSERT_TRUE(stats.bloomSkips >= count * 95L / 100, "Bloom filters skip the runs");
+
+  TEST_CHECK(closeLsm(lsm));
+  TEST_CHECK(deleteLsm(TESTLSM));
+
+  TEST_DONE();
+}
+
+/*  Function Name: testErrors
+ *  Test:  Float keys with -0.0, too long values, too small buffers, keys of
+ *         the wrong type and string keys
+ */
+void testErrors(void) {
+  LSM_Handle *lsm;
+  char big[LSM_MAX_VALUE + 1], buf[8];
+  int length;
+  Value k;
+  RC rc;
+
+  testName = "test lsm errors ";
+
+  TEST_CHECK(createLsm(TESTLSM, DT_FLOAT));
+  TEST_CHECK(openLsm(&lsm, TESTLSM, 16 * 1024, 1));
+  memset(big, 'x', sizeof(big));
+  k.dt = DT_FLOAT;
+  k.v.floatV = 0.0f;
+  TEST_CHECK(lsmPut(lsm, &k, big, LSM_MAX_VALUE));
+  ASSERT_EQUALS_INT(RC_RM_RECORD_TOO_BIG, lsmPut(lsm, &k, big, LSM_MAX_VALUE + 1), "value too long");
+  TEST_CHECK(lsmFlush(lsm));
+
+  k.v.floatV = -0.0f;
+  length = sizeof(buf);
+  rc = lsmGet(lsm, &k, buf, &length);
+  ASSERT_EQUALS_INT(RC_RM_RECORD_TOO_BIG, rc, "buffer too small");
+  ASSERT_EQUALS_INT(LSM_MAX_VALUE, length, "length of the value");
+  TEST_CHECK(lsmDelete(lsm, &k));
+  length = sizeof(buf);
+  rc = lsmGet(lsm, &k, buf, &length);
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, "deleted key");
+
+  k = intKey(1);
+  ASSERT_EQUALS_INT(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, lsmPut(lsm, &k, buf, 1), "key of the wrong type");
+  TEST_CHECK(closeLsm(lsm));
+  TEST_CHECK(deleteLsm(TESTLSM));
+
+  ASSERT_EQUALS_INT(RC_FEATURE_NOT_SUPPORTED, createLsm(TESTLSM, DT_STRING), "string keys");
+
+  TEST_DONE();
+}
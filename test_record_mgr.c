@@ -0,0 +1,935 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_mgr.h"
+#include "dberror.h"
+#include "test_assign1_1.h"
+
+// test name
+char *testName;
+
+/* test output files */
+#define TESTTABLE "test_table_r"
+
+/* prototypes for test functions */
+static void testRecords(void);
+static void testUpdateMoves(void);
+static void testManyRecords(void);
+static void testBulkInsert(void);
+static void testFilteredScan(void);
+static void testColumnarTable(void);
+static void testKeySummaries(TableLayout layout);
+static void testBlobs(void);
+
+/* helpers */
+static Schema *testSchema(void);
+static Record *makeRecord(Schema *schema, int a, char *b, int c);
+static void checkRecord(Schema *schema, Record *r, int a, char *b, int c);
+static int matches(Schema *schema, Record *r, ScanPredicate *preds, int numPreds);
+static void checkFilter(RM_TableData *table, ScanPredicate *preds, int numPreds);
+
+/* main function running all tests */
+int
+main (void)
+{
+  testName = "";
+
+  initRecordManager(NULL);
+  testRecords();
+  testUpdateMoves();
+  testManyRecords();
+  testBulkInsert();
+  testFilteredScan();
+  testColumnarTable();
+  testKeySummaries(TABLE_ROWS);
+  testKeySummaries(TABLE_COLUMNS);
+  testBlobs();
+  shutdownRecordManager();
+
+  return 0;
+}
+
+/* schema (a INT, b STRING(2000), c INT) with key a */
+Schema *
+testSchema(void)
+{
+  char **names = (char **) malloc(sizeof(char*) * 3);
+  DataType *types = (DataType *) malloc(sizeof(DataType) * 3);
+  int *lengths = (int *) malloc(sizeof(int) * 3);
+  int *keys = (int *) malloc(sizeof(int));
+
+  names[0] = strdup("a"); names[1] = strdup("b"); names[2] = strdup("c");
+  types[0] = DT_INT; types[1] = DT_STRING; types[2] = DT_INT;
+  lengths[0] = 0; lengths[1] = 2000; lengths[2] = 0;
+  keys[0] = 0;
+  return createSchema(3, names, types, lengths, 1, keys);
+}
+
+Record *
+makeRecord(Schema *schema, int a, char *b, int c)
+{
+  Record *r;
+  Value v;
+
+  createRecord(&r, schema);
+  v.dt = DT_INT; v.v.intV = a;
+  setAttr(r, schema, 0, &v);
+  v.dt = DT_STRING; v.v.stringV = b;
+  setAttr(r, schema, 1, &v);
+  v.dt = DT_INT; v.v.intV = c;
+  setAttr(r, schema, 2, &v);
+  return r;
+}
+
+void
+checkRecord(Schema *schema, Record *r, int a, char *b, int c)
+{
+  Value *v;
+
+  TEST_CHECK(getAttr(r, schema, 0, &v));
+  ASSERT_EQUALS_INT(a, v->v.intV, "attribute a");
+  freeVal(v);
+  TEST_CHECK(getAttr(r, schema, 1, &v));
+  ASSERT_EQUALS_STRING(b, v->v.stringV, "attribute b");
+  freeVal(v);
+  TEST_CHECK(getAttr(r, schema, 2, &v));
+  ASSERT_EQUALS_INT(c, v->v.intV, "attribute c");
+  freeVal(v);
+}
+
+/*  Function Name: testRecords
+ *  Test:  Insert, read, update and delete records, a deleted RID is gone,
+ *         a scan returns every record once and the table survives a reopen
+ */
+void testRecords(void) {
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema = testSchema();
+  Record *r[10];
+  Record *out;
+  int i, count, seen;
+  char name[16];
+
+  testName = "test insert, get, update, delete and scan ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+
+  for (i = 0; i < 10; i++) {
+    sprintf(name, "row%d", i);
+    r[i] = makeRecord(schema, i, name, i * 10);
+    TEST_CHECK(insertRecord(&table, r[i]));
+  }
+  ASSERT_EQUALS_INT(10, getNumTuples(&table), "ten records");
+  printf("Inserted ten records\n");
+
+  createRecord(&out, schema);
+  for (i = 0; i < 10; i++) {
+    sprintf(name, "row%d", i);
+    TEST_CHECK(getRecord(&table, r[i]->id, out));
+    checkRecord(schema, out, i, name, i * 10);
+  }
+
+  // same length, shorter and longer updates
+  freeRecord(r[3]); r[3] = makeRecord(schema, 3, "ROW3", 33); r[3]->id.page = 0; r[3]->id.slot = 3;
+  TEST_CHECK(updateRecord(&table, r[3]));
+  TEST_CHECK(getRecord(&table, r[3]->id, out));
+  checkRecord(schema, out, 3, "ROW3", 33);
+  freeRecord(r[4]); r[4] = makeRecord(schema, 4, "", 44); r[4]->id.page = 0; r[4]->id.slot = 4;
+  TEST_CHECK(updateRecord(&table, r[4]));
+  TEST_CHECK(getRecord(&table, r[4]->id, out));
+  checkRecord(schema, out, 4, "", 44);
+  freeRecord(r[5]); r[5] = makeRecord(schema, 5, "a somewhat longer fifth row", 55); r[5]->id.page = 0; r[5]->id.slot = 5;
+  TEST_CHECK(updateRecord(&table, r[5]));
+  TEST_CHECK(getRecord(&table, r[5]->id, out));
+  checkRecord(schema, out, 5, "a somewhat longer fifth row", 55);
+  printf("Updated records in place\n");
+
+  TEST_CHECK(deleteRecord(&table, r[7]->id));
+  ASSERT_EQUALS_INT(RC_RM_NO_SUCH_RECORD, getRecord(&table, r[7]->id, out), "deleted record is gone");
+  ASSERT_EQUALS_INT(RC_RM_NO_SUCH_RECORD, deleteRecord(&table, r[7]->id), "cannot delete twice");
+  ASSERT_EQUALS_INT(9, getNumTuples(&table), "nine records");
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+  ASSERT_EQUALS_INT(9, getNumTuples(&table), "nine records after reopen");
+  ASSERT_EQUALS_INT(3, schema->numAttr, "schema is read back");
+  ASSERT_EQUALS_STRING("b", schema->attrNames[1], "schema is read back");
+  printf("Reopened table\n");
+
+  TEST_CHECK(startScan(&table, &scan));
+  count = 0; seen = 0;
+  while (next(&scan, out) == RC_OK) {
+    Value *v;
+    getAttr(out, schema, 0, &v);
+    seen |= 1 << v->v.intV;
+    freeVal(v);
+    count++;
+  }
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(9, count, "scan returns every record once");
+  ASSERT_EQUALS_INT(0x3FF & ~(1 << 7), seen, "scan returns every record once");
+
+  for (i = 0; i < 10; i++)
+    freeRecord(r[i]);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testUpdateMoves
+ *  Test:  A record that outgrows its page moves to another page and keeps
+ *         its RID; a scan returns it once; growing it again and deleting it
+ *         work through the forward pointer
+ */
+void testUpdateMoves(void) {
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema = testSchema();
+  Record *r[6];
+  Record *out;
+  char big[2001];
+  int i, count;
+
+  testName = "test records moving to other pages ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+
+  // three records of 1200 bytes almost fill a page
+  memset(big, 'x', 1200); big[1200] = '\0';
+  for (i = 0; i < 3; i++) {
+    r[i] = makeRecord(schema, i, big, i);
+    TEST_CHECK(insertRecord(&table, r[i]));
+    ASSERT_EQUALS_INT(0, r[i]->id.page, "first page");
+  }
+
+  // record 1 grows past the free space of the page
+  memset(big, 'y', 1800); big[1800] = '\0';
+  RID id = r[1]->id;
+  freeRecord(r[1]);
+  r[1] = makeRecord(schema, 1, big, 11);
+  r[1]->id = id;
+  TEST_CHECK(updateRecord(&table, r[1]));
+  createRecord(&out, schema);
+  TEST_CHECK(getRecord(&table, id, out));
+  checkRecord(schema, out, 1, big, 11);
+  ASSERT_EQUALS_INT(0, out->id.page, "RID does not change");
+  ASSERT_EQUALS_INT(1, out->id.slot, "RID does not change");
+  printf("Record moved to another page\n");
+
+  // fill the page the record moved to, then grow the moved record again
+  for (i = 3; i < 5; i++) {
+    memset(big, 'a' + i, 1030); big[1030] = '\0';
+    r[i] = makeRecord(schema, i, big, i);
+    TEST_CHECK(insertRecord(&table, r[i]));
+  }
+  memset(big, 'z', 2000); big[2000] = '\0';
+  freeRecord(r[1]);
+  r[1] = makeRecord(schema, 1, big, 111);
+  r[1]->id = id;
+  TEST_CHECK(updateRecord(&table, r[1]));
+  TEST_CHECK(getRecord(&table, id, out));
+  checkRecord(schema, out, 1, big, 111);
+
+  TEST_CHECK(startScan(&table, &scan));
+  count = 0;
+  while (next(&scan, out) == RC_OK)
+    count++;
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(5, count, "moved record is returned once");
+
+  TEST_CHECK(deleteRecord(&table, id));
+  ASSERT_EQUALS_INT(RC_RM_NO_SUCH_RECORD, getRecord(&table, id, out), "deleted record is gone");
+  TEST_CHECK(startScan(&table, &scan));
+  count = 0;
+  while (next(&scan, out) == RC_OK)
+    count++;
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(4, count, "moved copy is deleted as well");
+
+  for (i = 0; i < 5; i++)
+    freeRecord(r[i]);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testManyRecords
+ *  Test:  Enough records for many pages; deleted space is used again by
+ *         later inserts, also after the table is reopened
+ */
+void testManyRecords(void) {
+  RM_TableData table;
+  Schema *schema = testSchema();
+  Record *r, *out;
+  RID *ids;
+  int i, n = 5000, reused;
+  char name[32];
+
+  testName = "test many records and free space reuse ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+  ids = (RID *) malloc(sizeof(RID) * n);
+
+  for (i = 0; i < n; i++) {
+    sprintf(name, "record number %d", i);
+    r = makeRecord(schema, i, name, -i);
+    TEST_CHECK(insertRecord(&table, r));
+    ids[i] = r->id;
+    freeRecord(r);
+  }
+  ASSERT_TRUE(ids[n - 1].page > 20, "records span many pages");
+
+  // free every other record of the first pages
+  for (i = 0; i < 1000; i += 2)
+    TEST_CHECK(deleteRecord(&table, ids[i]));
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+  ASSERT_EQUALS_INT(n - 500, getNumTuples(&table), "count after reopen");
+
+  // more new records than fit into the last page, but no new page is needed
+  reused = 0;
+  for (i = 0; i < 500; i++) {
+    r = makeRecord(schema, n + i, "new", 0);
+    TEST_CHECK(insertRecord(&table, r));
+    if (r->id.page <= ids[n - 1].page)
+      reused++;
+    freeRecord(r);
+  }
+  ASSERT_EQUALS_INT(500, reused, "inserts reuse free space of earlier pages");
+
+  createRecord(&out, schema);
+  for (i = 1; i < n; i += 499) {
+    if (i < 1000 && i % 2 == 0)
+      continue;
+    sprintf(name, "record number %d", i);
+    TEST_CHECK(getRecord(&table, ids[i], out));
+    checkRecord(schema, out, i, name, -i);
+  }
+  freeRecord(out);
+  free(ids);
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testBulkInsert
+ *  Test:  Bulk inserted records are found under their RIDs and in a scan,
+ *         pages keep the free space the fill factor leaves, and that space
+ *         takes later inserts and growing updates
+ */
+void testBulkInsert(void) {
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema = testSchema();
+  int n = 20000, i, count, pages;
+  Record **records;
+  Record *r, *out;
+  char name[32];
+
+  testName = "test bulk insert ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+
+  records = (Record **) malloc(sizeof(Record *) * n);
+  for (i = 0; i < n; i++) {
+    sprintf(name, "bulk record %d", i);
+    records[i] = makeRecord(schema, i, name, i % 100);
+  }
+  TEST_CHECK(bulkInsertRecords(&table, records, n, 0.5f));
+  ASSERT_EQUALS_INT(n, getNumTuples(&table), "all records inserted");
+  pages = records[n - 1]->id.page + 1;
+  ASSERT_TRUE(pages > 2 * 20000 * 31 / PAGE_SIZE - 10, "pages are filled to about half");
+  ASSERT_TRUE(pages < 2 * 20000 * 31 / PAGE_SIZE + 10, "pages are filled to about half");
+
+  createRecord(&out, schema);
+  for (i = 0; i < n; i += 97) {
+    sprintf(name, "bulk record %d", i);
+    TEST_CHECK(getRecord(&table, records[i]->id, out));
+    checkRecord(schema, out, i, name, i % 100);
+  }
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+
+  TEST_CHECK(startScan(&table, &scan));
+  count = 0;
+  while (next(&scan, out) == RC_OK)
+    count++;
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(n, count, "scan after reopen");
+  printf("Bulk inserted %d records into %d pages\n", n, pages);
+
+  // the free half of the pages takes new and growing records
+  r = makeRecord(schema, -1, "after the bulk insert", 0);
+  TEST_CHECK(insertRecord(&table, r));
+  ASSERT_TRUE(r->id.page < pages, "insert uses free space of the bulk loaded pages");
+  freeRecord(r);
+  r = makeRecord(schema, 5, "bulk record 5 has grown a lot longer than before", 5);
+  r->id = records[5]->id;
+  TEST_CHECK(updateRecord(&table, r));
+  TEST_CHECK(getRecord(&table, r->id, out));
+  checkRecord(schema, out, 5, "bulk record 5 has grown a lot longer than before", 5);
+  freeRecord(r);
+
+  for (i = 0; i < n; i++)
+    freeRecord(records[i]);
+  free(records);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/* predicates evaluated with getAttr, as a filtered scan should */
+int
+matches(Schema *schema, Record *r, ScanPredicate *preds, int numPreds)
+{
+  int p, c = 0, ok = 1;
+  Value *v;
+
+  for (p = 0; p < numPreds && ok; p++) {
+    getAttr(r, schema, preds[p].attrNum, &v);
+    switch (v->dt) {
+    case DT_INT:
+      c = (v->v.intV > preds[p].value.v.intV) - (v->v.intV < preds[p].value.v.intV);
+      break;
+    case DT_FLOAT:
+      c = (v->v.floatV > preds[p].value.v.floatV) - (v->v.floatV < preds[p].value.v.floatV);
+      break;
+    case DT_BOOL:
+      c = (int) v->v.boolV - (int) preds[p].value.v.boolV;
+      break;
+    default:
+      if (preds[p].op == CMP_PREFIX)
+        c = strncmp(v->v.stringV, preds[p].value.v.stringV, strlen(preds[p].value.v.stringV)) != 0;
+      else
+        c = strcmp(v->v.stringV, preds[p].value.v.stringV);
+      break;
+    }
+    freeVal(v);
+    switch (preds[p].op) {
+    case CMP_NE: ok = c != 0; break;
+    case CMP_LT: ok = c < 0; break;
+    case CMP_LE: ok = c <= 0; break;
+    case CMP_GT: ok = c > 0; break;
+    case CMP_GE: ok = c >= 0; break;
+    default:     ok = c == 0; break;
+    }
+  }
+  return ok;
+}
+
+/* a filtered scan returns exactly the records of a full scan that match */
+void
+checkFilter(RM_TableData *table, ScanPredicate *preds, int numPreds)
+{
+  RM_ScanHandle scan, filtered;
+  Record *r, *f;
+  int expected = 0, found = 0;
+
+  createRecord(&r, table->schema);
+  createRecord(&f, table->schema);
+  TEST_CHECK(startScan(table, &scan));
+  TEST_CHECK(startFilteredScan(table, &filtered, preds, numPreds));
+  while (next(&scan, r) == RC_OK) {
+    if (!matches(table->schema, r, preds, numPreds))
+      continue;
+    expected++;
+    if (next(&filtered, f) != RC_OK || f->id.page != r->id.page || f->id.slot != r->id.slot) {
+      ASSERT_TRUE(false, "filtered scan returns the next matching record");
+      break;
+    }
+    found++;
+  }
+  ASSERT_ERROR(next(&filtered, f), "no records after the last match");
+  ASSERT_EQUALS_INT(expected, found, "filtered scan finds all matching records");
+  TEST_CHECK(closeScan(&scan));
+  TEST_CHECK(closeScan(&filtered));
+  freeRecord(r);
+  freeRecord(f);
+}
+
+/*  Function Name: testFilteredScan
+ *  Test:  Filtered scans with int, string, float and bool predicates, alone
+ *         and combined, return the same records as a full scan checked one
+ *         by one, also records that moved to other pages
+ */
+void testFilteredScan(void) {
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema = testSchema();
+  ScanPredicate preds[3];
+  Record *r;
+  RID *ids;
+  int i, n = 3000;
+  char name[1600];
+  char **names;
+  DataType *types;
+  int *lengths, *keys;
+  Value v;
+
+  testName = "test filtered scans ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+  ids = (RID *) malloc(sizeof(RID) * n);
+  for (i = 0; i < n; i++) {
+    sprintf(name, "%s %d", (i % 3) ? "record" : "recorded long prefix", i % 1000);
+    r = makeRecord(schema, i, name, i % 7);
+    TEST_CHECK(insertRecord(&table, r));
+    ids[i] = r->id;
+    freeRecord(r);
+  }
+  // grow some records until they move to other pages
+  memset(name, 'z', 1500);
+  name[1500] = '\0';
+  for (i = 0; i < n; i += 37) {
+    r = makeRecord(schema, i, name, i % 7);
+    r->id = ids[i];
+    TEST_CHECK(updateRecord(&table, r));
+    freeRecord(r);
+  }
+
+  preds[0].attrNum = 0; preds[0].op = CMP_LT;
+  preds[0].value.dt = DT_INT; preds[0].value.v.intV = 1000;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GE;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_EQ; preds[0].value.v.intV = 74;
+  checkFilter(&table, preds, 1);
+
+  preds[1].attrNum = 2; preds[1].op = CMP_NE;
+  preds[1].value.dt = DT_INT; preds[1].value.v.intV = 3;
+  preds[0].op = CMP_GT; preds[0].value.v.intV = 100;
+  checkFilter(&table, preds, 2);
+
+  preds[0].attrNum = 1; preds[0].value.dt = DT_STRING;
+  preds[0].op = CMP_PREFIX; preds[0].value.v.stringV = "recorded long prefix 12";
+  checkFilter(&table, preds, 2);
+  preds[0].op = CMP_PREFIX; preds[0].value.v.stringV = "rec";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_PREFIX; preds[0].value.v.stringV = "";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_LE; preds[0].value.v.stringV = "record 5";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GT; preds[0].value.v.stringV = "recorded long prefix 5";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_EQ; preds[0].value.v.stringV = "record 77";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GE; preds[0].value.v.stringV = name;
+  checkFilter(&table, preds, 1);
+  printf("Filtered int and string attributes\n");
+
+  preds[0].value.dt = DT_INT;
+  ASSERT_EQUALS_INT(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, startFilteredScan(&table, &scan, preds, 1), "constant of the wrong type");
+
+  free(ids);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+
+  // floats and booleans
+  names = (char **) malloc(sizeof(char*) * 2);
+  types = (DataType *) malloc(sizeof(DataType) * 2);
+  lengths = (int *) malloc(sizeof(int) * 2);
+  keys = (int *) malloc(sizeof(int));
+  names[0] = strdup("f"); names[1] = strdup("b");
+  types[0] = DT_FLOAT; types[1] = DT_BOOL;
+  lengths[0] = 0; lengths[1] = 0;
+  keys[0] = 0;
+  schema = createSchema(2, names, types, lengths, 1, keys);
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+  createRecord(&r, schema);
+  for (i = 0; i < 2000; i++) {
+    v.dt = DT_FLOAT; v.v.floatV = (float) (i % 401 - 200) / 4.0f;
+    setAttr(r, schema, 0, &v);
+    v.dt = DT_BOOL; v.v.boolV = (i % 5) == 0;
+    setAttr(r, schema, 1, &v);
+    TEST_CHECK(insertRecord(&table, r));
+  }
+  freeRecord(r);
+
+  preds[0].attrNum = 0; preds[0].op = CMP_LT;
+  preds[0].value.dt = DT_FLOAT; preds[0].value.v.floatV = -12.25f;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GE; preds[0].value.v.floatV = 0.0f;
+  preds[1].attrNum = 1; preds[1].op = CMP_EQ;
+  preds[1].value.dt = DT_BOOL; preds[1].value.v.boolV = true;
+  checkFilter(&table, preds, 2);
+  printf("Filtered float and bool attributes\n");
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testColumnarTable
+ *  Test:  A table with the columnar layout stores, reads, updates and deletes
+ *         records like a row table, also bulk inserted ones and after a
+ *         reopen, and filtered scans skip nothing they should return
+ */
+void testColumnarTable(void) {
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema;
+  ScanPredicate preds[2];
+  Record **records, *out;
+  int i, n = 4000, bulk = 3000, count;
+  char name[32];
+  char **names = (char **) malloc(sizeof(char*) * 4);
+  DataType *types = (DataType *) malloc(sizeof(DataType) * 4);
+  int *lengths = (int *) malloc(sizeof(int) * 4);
+  int *keys = (int *) malloc(sizeof(int));
+  Value v;
+
+  testName = "test columnar table ";
+
+  names[0] = strdup("a"); names[1] = strdup("b"); names[2] = strdup("c"); names[3] = strdup("d");
+  types[0] = DT_INT; types[1] = DT_STRING; types[2] = DT_FLOAT; types[3] = DT_BOOL;
+  lengths[0] = 0; lengths[1] = 24; lengths[2] = 0; lengths[3] = 0;
+  keys[0] = 0;
+  schema = createSchema(4, names, types, lengths, 1, keys);
+  TEST_CHECK(createTableWithLayout(TESTTABLE, schema, TABLE_COLUMNS));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+
+  records = (Record **) malloc(sizeof(Record *) * (n + bulk));
+  for (i = 0; i < n + bulk; i++) {
+    createRecord(&records[i], schema);
+    v.dt = DT_INT; v.v.intV = i;
+    setAttr(records[i], schema, 0, &v);
+    sprintf(name, "value %d", i % 500);
+    v.dt = DT_STRING; v.v.stringV = name;
+    setAttr(records[i], schema, 1, &v);
+    v.dt = DT_FLOAT; v.v.floatV = (float) (i % 200) - 99.5f;
+    setAttr(records[i], schema, 2, &v);
+    v.dt = DT_BOOL; v.v.boolV = i % 3 == 0;
+    setAttr(records[i], schema, 3, &v);
+  }
+  for (i = 0; i < n; i++)
+    TEST_CHECK(insertRecord(&table, records[i]));
+  TEST_CHECK(bulkInsertRecords(&table, records + n, bulk, 0.5f));
+  ASSERT_EQUALS_INT(n + bulk, getNumTuples(&table), "all records inserted");
+
+  createRecord(&out, schema);
+  for (i = 0; i < n + bulk; i += 101) {
+    TEST_CHECK(getRecord(&table, records[i]->id, out));
+    ASSERT_EQUALS_INT(records[i]->size, out->size, "size of a columnar record");
+    ASSERT_TRUE(memcmp(records[i]->data, out->data, out->size) == 0, "columnar record read back");
+  }
+
+  // delete every tenth record, change every seventh
+  for (i = 0; i < n + bulk; i += 10)
+    TEST_CHECK(deleteRecord(&table, records[i]->id));
+  ASSERT_EQUALS_INT(RC_RM_NO_SUCH_RECORD, getRecord(&table, records[0]->id, out), "deleted record is gone");
+  for (i = 3; i < n + bulk; i += 7) {
+    v.dt = DT_STRING; v.v.stringV = "changed";
+    setAttr(records[i], schema, 1, &v);
+    v.dt = DT_INT; v.v.intV = -i;
+    setAttr(records[i], schema, 0, &v);
+    if (i % 10 != 0)
+      TEST_CHECK(updateRecord(&table, records[i]));
+  }
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+  ASSERT_EQUALS_INT(n + bulk - (n + bulk) / 10, getNumTuples(&table), "count after reopen");
+
+  TEST_CHECK(startScan(&table, &scan));
+  count = 0;
+  while (next(&scan, out) == RC_OK)
+    count++;
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(getNumTuples(&table), count, "scan returns every record");
+  TEST_CHECK(getRecord(&table, records[3]->id, out));
+  ASSERT_TRUE(memcmp(records[3]->data, out->data, out->size) == 0, "updated record");
+  printf("Columnar table with %d records\n", count);
+
+  preds[0].attrNum = 0; preds[0].op = CMP_LT;
+  preds[0].value.dt = DT_INT; preds[0].value.v.intV = 50;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_EQ; preds[0].value.v.intV = 5002;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GE; preds[0].value.v.intV = 6000;
+  preds[1].attrNum = 3; preds[1].op = CMP_EQ;
+  preds[1].value.dt = DT_BOOL; preds[1].value.v.boolV = true;
+  checkFilter(&table, preds, 2);
+  preds[0].attrNum = 1; preds[0].op = CMP_PREFIX;
+  preds[0].value.dt = DT_STRING; preds[0].value.v.stringV = "value 4";
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_EQ; preds[0].value.v.stringV = "changed";
+  checkFilter(&table, preds, 2);
+  preds[0].attrNum = 2; preds[0].op = CMP_GT;
+  preds[0].value.dt = DT_FLOAT; preds[0].value.v.floatV = 90.0f;
+  checkFilter(&table, preds, 1);
+
+  for (i = 0; i < n + bulk; i++)
+    freeRecord(records[i]);
+  free(records);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/*  Function Name: testKeySummaries
+ *  Test:  Filtered scans on the key of a table with key summaries return the
+ *         same records as without, after key updates, moved records, a
+ *         reopen and new inserts; the summary file goes with the table
+ */
+void testKeySummaries(TableLayout layout) {
+  RM_TableData table;
+  Schema *schema = testSchema();
+  ScanPredicate preds[2];
+  Record *r;
+  RID *ids;
+  int i, n = 4000;
+  char name[1600];
+  FILE *sum;
+
+  testName = "test key summaries ";
+
+  TEST_CHECK(createTableWithLayout(TESTTABLE, schema, layout));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+  ids = (RID *) malloc(sizeof(RID) * (n + 500));
+  for (i = 0; i < n; i++) {
+    sprintf(name, "name %d", i);
+    r = makeRecord(schema, 2 * i, name, i % 7);
+    TEST_CHECK(insertRecord(&table, r));
+    ids[i] = r->id;
+    freeRecord(r);
+  }
+  TEST_CHECK(enableKeySummaries(&table));
+
+  preds[0].attrNum = 0; preds[0].value.dt = DT_INT;
+  preds[0].op = CMP_EQ; preds[0].value.v.intV = 2 * 1234;
+  checkFilter(&table, preds, 1);
+  preds[0].value.v.intV = 2 * 1234 + 1;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_LT; preds[0].value.v.intV = 300;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GE; preds[0].value.v.intV = 2 * n - 40;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_NE;
+  checkFilter(&table, preds, 1);
+
+  // move keys to other pages' ranges, in place and by moving records
+  memset(name, 'z', 1500);
+  name[1500] = '\0';
+  for (i = 0; i < n; i += 97) {
+    r = makeRecord(schema, 5 * i + 1, (i % 2) ? name : "name", i % 7);
+    r->id = ids[i];
+    TEST_CHECK(updateRecord(&table, r));
+    freeRecord(r);
+  }
+  preds[0].op = CMP_EQ; preds[0].value.v.intV = 5 * 97 * 3 + 1;
+  checkFilter(&table, preds, 1);
+  preds[0].value.v.intV = 5 * 97 * 4 + 1;
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_GT; preds[0].value.v.intV = 2 * n;
+  checkFilter(&table, preds, 1);
+  printf("Filtered with key summaries\n");
+
+  TEST_CHECK(closeTable(&table));
+  sum = fopen(TESTTABLE ".sum", "rb");
+  ASSERT_TRUE(sum != NULL, "summary file");
+  if (sum != NULL)
+    fclose(sum);
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+  for (i = n; i < n + 500; i++) {
+    r = makeRecord(schema, -i, "new", i % 7);
+    TEST_CHECK(insertRecord(&table, r));
+    freeRecord(r);
+  }
+  preds[0].op = CMP_EQ; preds[0].value.v.intV = -(n + 123);
+  checkFilter(&table, preds, 1);
+  preds[0].op = CMP_LE; preds[0].value.v.intV = 10;
+  preds[1].attrNum = 0; preds[1].op = CMP_GT;
+  preds[1].value.dt = DT_INT; preds[1].value.v.intV = -(n + 10);
+  checkFilter(&table, preds, 2);
+  printf("Filtered with key summaries after a reopen\n");
+
+  free(ids);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  sum = fopen(TESTTABLE ".sum", "rb");
+  ASSERT_TRUE(sum == NULL, "summary file removed");
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
+
+/* byte i of large value v */
+static char
+blobByte(int v, long long i)
+{
+  return (char) (i * 31 + i / 4096 + v);
+}
+
+/* write a value of size bytes in pieces of chunk bytes */
+static int
+writeTestBlob(RM_TableData *table, int v, long long size, int chunk)
+{
+  RM_BlobHandle blob;
+  char *buf = (char *) malloc(chunk);
+  long long done = 0;
+  int i;
+
+  TEST_CHECK(createBlob(table, &blob));
+  while (done < size) {
+    int n = size - done < chunk ? (int) (size - done) : chunk;
+    for (i = 0; i < n; i++)
+      buf[i] = blobByte(v, done + i);
+    TEST_CHECK(writeBlob(&blob, buf, n));
+    done += n;
+  }
+  TEST_CHECK(closeBlob(&blob));
+  ASSERT_TRUE(blob.size == size, "size of the written value");
+  free(buf);
+  return blob.id;
+}
+
+/* read a value from offset in pieces of chunk bytes and compare it */
+static void
+checkTestBlob(RM_TableData *table, int id, int v, long long size, long long offset, int chunk)
+{
+  RM_BlobHandle blob;
+  char *buf = (char *) malloc(chunk);
+  long long pos = offset;
+  int i, n, bad = 0;
+
+  TEST_CHECK(openBlob(table, id, &blob));
+  ASSERT_TRUE(blob.size == size, "size of the value");
+  TEST_CHECK(seekBlob(&blob, offset));
+  do {
+    TEST_CHECK(readBlob(&blob, buf, chunk, &n));
+    for (i = 0; i < n; i++)
+      if (buf[i] != blobByte(v, pos + i))
+        bad++;
+    pos += n;
+  } while (n == chunk);
+  TEST_CHECK(closeBlob(&blob));
+  ASSERT_EQUALS_INT(0, bad, "bytes of the value");
+  ASSERT_TRUE(pos == size, "read to the end of the value");
+  free(buf);
+}
+
+/*  Function Name: testBlobs
+ *  Test:  Large values written in pieces of any size read back the same in
+ *         pieces of any size and from any position, also after a reopen and
+ *         through the id stored in a record; deleted values are gone and
+ *         their pages are used again; deleteTable removes the value file
+ */
+void testBlobs(void) {
+  RM_TableData table;
+  Schema *schema = testSchema();
+  Record *r, *out;
+  Value *v;
+  FILE *lob;
+  long long big = 5L * 1024 * 1024 + 1234;
+  int idBig, idSmall, idEmpty, idAgain, n;
+  long sizeBefore;
+  char byte;
+  RM_BlobHandle blob;
+
+  testName = "test large values ";
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  freeSchema(schema);
+  schema = table.schema;
+
+  idBig = writeTestBlob(&table, 1, big, 10007);
+  idSmall = writeTestBlob(&table, 2, 5000, 5000);
+  idEmpty = writeTestBlob(&table, 3, 0, 16);
+  r = makeRecord(schema, 1, "has a large value", idBig);
+  TEST_CHECK(insertRecord(&table, r));
+  checkTestBlob(&table, idBig, 1, big, 0, 65536);
+  checkTestBlob(&table, idBig, 1, big, 0, 1000);
+  checkTestBlob(&table, idSmall, 2, 5000, 0, 1);
+  checkTestBlob(&table, idEmpty, 3, 0, 0, 16);
+  printf("Wrote and read large values\n");
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(openTable(&table, TESTTABLE));
+  schema = table.schema;
+  createRecord(&out, schema);
+  TEST_CHECK(getRecord(&table, r->id, out));
+  getAttr(out, schema, 2, &v);
+  ASSERT_EQUALS_INT(idBig, v->v.intV, "id of the value in the record");
+  checkTestBlob(&table, v->v.intV, 1, big, 3 * 4096, 4 * 4096);
+  checkTestBlob(&table, v->v.intV, 1, big, big - 77, 4096);
+  checkTestBlob(&table, idSmall, 2, 5000, 4999, 100);
+  freeVal(v);
+
+  TEST_CHECK(openBlob(&table, idSmall, &blob));
+  ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, seekBlob(&blob, 5001), "seek past the end");
+  TEST_CHECK(seekBlob(&blob, 5000));
+  TEST_CHECK(readBlob(&blob, &byte, 1, &n));
+  ASSERT_EQUALS_INT(0, n, "nothing to read at the end");
+  TEST_CHECK(closeBlob(&blob));
+  printf("Read large values after a reopen\n");
+
+  lob = fopen(TESTTABLE ".lob", "rb");
+  fseek(lob, 0, SEEK_END);
+  sizeBefore = ftell(lob);
+  fclose(lob);
+  TEST_CHECK(deleteBlob(&table, idBig));
+  ASSERT_EQUALS_INT(RC_RM_NO_SUCH_RECORD, openBlob(&table, idBig, &blob), "deleted value is gone");
+  idAgain = writeTestBlob(&table, 4, big, 65536);
+  checkTestBlob(&table, idAgain, 4, big, 0, 100000);
+  checkTestBlob(&table, idSmall, 2, 5000, 0, 4096);
+  lob = fopen(TESTTABLE ".lob", "rb");
+  fseek(lob, 0, SEEK_END);
+  ASSERT_TRUE(ftell(lob) == sizeBefore, "pages of the deleted value are used again");
+  fclose(lob);
+  printf("Deleted a large value and reused its pages\n");
+
+  freeRecord(r);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+  lob = fopen(TESTTABLE ".lob", "rb");
+  ASSERT_TRUE(lob == NULL, "large value file removed");
+  printf("Close and destroy table \n");
+
+  TEST_DONE();
+}
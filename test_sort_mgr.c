@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort_mgr.h"
+#include "record_mgr.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+#include "test_assign1_1.h"
+
+// test name
+char *testName;
+
+/* test output files */
+#define TESTTABLE "test_table_s"
+
+/* prototypes for test functions */
+static void testSortInMemory(void);
+static void testSortRuns(int attrNum, long budget, int numThreads, int count);
+static void testSortFloat(void);
+static void testSortSpill(void);
+
+/* helpers */
+static Schema *testSchema(void);
+static void fillTable(RM_TableData *table, int count, unsigned int seed);
+static int compareAttr(Schema *schema, Record *a, Record *b, int attrNum);
+
+/* main function running all tests */
+int
+main (void)
+{
+  testName = "";
+
+  initRecordManager(NULL);
+  testSortInMemory();
+  testSortRuns(0, 256 * 1024, 1, 20000);
+  testSortRuns(0, 256 * 1024, 3, 50000);
+  testSortRuns(1, 128 * 1024, 2, 30000);
+  testSortFloat();
+  testSortSpill();
+  shutdownRecordManager();
+
+  return 0;
+}
+
+/* schema (a INT, b STRING(40), c FLOAT) */
+Schema *
+testSchema(void)
+{
+  char **names = (char **) malloc(sizeof(char*) * 3);
+  DataType *types = (DataType *) malloc(sizeof(DataType) * 3);
+  int *lengths = (int *) malloc(sizeof(int) * 3);
+  int *keys = (int *) malloc(sizeof(int));
+
+  names[0] = strdup("a"); names[1] = strdup("b"); names[2] = strdup("c");
+  types[0] = DT_INT; types[1] = DT_STRING; types[2] = DT_FLOAT;
+  lengths[0] = 0; lengths[1] = 40; lengths[2] = 0;
+  keys[0] = 0;
+  return createSchema(3, names, types, lengths, 1, keys);
+}
+
+/* create the test table with count records, a has many duplicates and
+ * strings share long prefixes */
+void
+fillTable(RM_TableData *table, int count, unsigned int seed)
+{
+  Schema *schema = testSchema();
+  Record *r;
+  Value v;
+  char name[48];
+  int i;
+
+  TEST_CHECK(createTable(TESTTABLE, schema));
+  TEST_CHECK(openTable(table, TESTTABLE));
+  freeSchema(schema);
+  schema = table->schema;
+
+  srand(seed);
+  createRecord(&r, schema);
+  for (i = 0; i < count; i++) {
+    int x = rand() % (count / 4 + 1) - count / 8;
+    v.dt = DT_INT; v.v.intV = x;
+    setAttr(r, schema, 0, &v);
+    sprintf(name, "common prefix %d %s", rand() % 1000, (i % 3) ? "x" : "");
+    v.dt = DT_STRING; v.v.stringV = name;
+    setAttr(r, schema, 1, &v);
+    v.dt = DT_FLOAT; v.v.floatV = (float) (rand() % 2001 - 1000) / 8.0f;
+    setAttr(r, schema, 2, &v);
+    TEST_CHECK(insertRecord(table, r));
+  }
+  freeRecord(r);
+}
+
+/* order of two records by one attribute, like the sort should see it */
+int
+compareAttr(Schema *schema, Record *a, Record *b, int attrNum)
+{
+  Value *x, *y;
+  int c;
+
+  getAttr(a, schema, attrNum, &x);
+  getAttr(b, schema, attrNum, &y);
+  switch (schema->dataTypes[attrNum]) {
+  case DT_INT:
+    c = (x->v.intV > y->v.intV) - (x->v.intV < y->v.intV);
+    break;
+  case DT_FLOAT:
+    c = (x->v.floatV > y->v.floatV) - (x->v.floatV < y->v.floatV);
+    break;
+  default:
+    c = strcmp(x->v.stringV, y->v.stringV);
+    break;
+  }
+  freeVal(x);
+  freeVal(y);
+  return c;
+}
+
+/*  Function Name: testSortInMemory
+ *  Test:  A table that fits into the budget is sorted without runs and
+ *         every record comes back once, with ties in RID order
+ */
+void testSortInMemory(void) {
+  RM_TableData table;
+  RM_SortHandle *sort;
+  Record *prev, *out;
+  int count = 0;
+  FILE *run;
+
+  testName = "test sort in memory ";
+
+  fillTable(&table, 1000, 1);
+  TEST_CHECK(openSort(&table, 0, 1024 * 1024, 2, &sort));
+  run = fopen(TESTTABLE ".run0", "rb");
+  ASSERT_TRUE(run == NULL, "no run file for a small table");
+
+  createRecord(&prev, table.schema);
+  createRecord(&out, table.schema);
+  while (nextSorted(sort, out) == RC_OK) {
+    if (count > 0) {
+      int c = compareAttr(table.schema, prev, out, 0);
+      ASSERT_TRUE(c < 0 || (c == 0 && (prev->id.page < out->id.page
+          || (prev->id.page == out->id.page && prev->id.slot < out->id.slot))),
+          "sorted with ties in RID order");
+    }
+    TEST_CHECK(getRecord(&table, out->id, prev));
+    ASSERT_TRUE(memcmp(prev->data, out->data, out->size) == 0, "RID of a sorted record");
+    memcpy(prev->data, out->data, out->size);
+    prev->id = out->id;
+    count++;
+  }
+  ASSERT_EQUALS_INT(1000, count, "all records sorted");
+  ASSERT_ERROR(nextSorted(sort, out), "no more records");
+  TEST_CHECK(closeSort(sort));
+
+  freeRecord(prev);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+
+  TEST_DONE();
+}
+
+/*  Function Name: testSortRuns
+ *  Test:  A table many times the budget is sorted through runs, also when
+ *         there are too many runs to merge in one pass, and the run files
+ *         are gone after closeSort
+ */
+void testSortRuns(int attrNum, long budget, int numThreads, int count) {
+  RM_TableData table;
+  RM_SortHandle *sort;
+  Record *prev, *out;
+  int sorted = 0;
+  long sumIn = 0, sumOut = 0;
+  RM_ScanHandle scan;
+  Value *v;
+  FILE *run;
+
+  testName = "test sort with runs ";
+
+  fillTable(&table, count, 7 + numThreads);
+  createRecord(&prev, table.schema);
+  createRecord(&out, table.schema);
+
+  TEST_CHECK(startScan(&table, &scan));
+  while (next(&scan, out) == RC_OK) {
+    getAttr(out, table.schema, 0, &v);
+    sumIn += v->v.intV;
+    freeVal(v);
+  }
+  TEST_CHECK(closeScan(&scan));
+
+  TEST_CHECK(openSort(&table, attrNum, budget, numThreads, &sort));
+  while (nextSorted(sort, out) == RC_OK) {
+    if (sorted > 0)
+      ASSERT_TRUE(compareAttr(table.schema, prev, out, attrNum) <= 0, "records in order");
+    getAttr(out, table.schema, 0, &v);
+    sumOut += v->v.intV;
+    freeVal(v);
+    memcpy(prev->data, out->data, out->size);
+    sorted++;
+  }
+  ASSERT_EQUALS_INT(count, sorted, "all records sorted");
+  ASSERT_TRUE(sumIn == sumOut, "same records as in the table");
+  TEST_CHECK(closeSort(sort));
+  run = fopen(TESTTABLE ".run0", "rb");
+  ASSERT_TRUE(run == NULL, "runs removed");
+  printf("Sorted %d records by attribute %d with %d threads\n", count, attrNum, numThreads);
+
+  freeRecord(prev);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+
+  TEST_DONE();
+}
+
+/*  Function Name: testSortFloat
+ *  Test:  Negative and positive floats sort in numeric order, -0.0 and 0.0
+ *         are equal and so come in RID order
+ */
+void testSortFloat(void) {
+  RM_TableData table;
+  RM_SortHandle *sort;
+  Record *prev, *out;
+  Value v;
+  int sorted = 0, i;
+
+  testName = "test sort floats ";
+
+  fillTable(&table, 5000, 3);
+  createRecord(&prev, table.schema);
+  createRecord(&out, table.schema);
+  // zeros of both signs, inserted in turns
+  for (i = 0; i < 20; i++) {
+    v.dt = DT_FLOAT;
+    v.v.floatV = (i % 2) ? -0.0f : 0.0f;
+    setAttr(out, table.schema, 2, &v);
+    TEST_CHECK(insertRecord(&table, out));
+  }
+  TEST_CHECK(openSort(&table, 2, 64 * 1024, 1, &sort));
+  while (nextSorted(sort, out) == RC_OK) {
+    if (sorted > 0) {
+      int c = compareAttr(table.schema, prev, out, 2);
+      ASSERT_TRUE(c <= 0, "floats in order");
+      if (c == 0)
+        ASSERT_TRUE(prev->id.page < out->id.page || (prev->id.page == out->id.page && prev->id.slot < out->id.slot), "equal floats in RID order");
+    }
+    memcpy(prev->data, out->data, out->size);
+    prev->id = out->id;
+    sorted++;
+  }
+  ASSERT_EQUALS_INT(5020, sorted, "all records sorted");
+  TEST_CHECK(closeSort(sort));
+
+  freeRecord(prev);
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+
+  TEST_DONE();
+}
+
+/*  Function Name: testSortSpill
+ *  Test:  The runs of a table many times the budget do not all stay in
+ *         memory: those in memory fit into the budget together, the others
+ *         are on disk
+ */
+void testSortSpill(void) {
+  RM_TableData table;
+  RM_SortHandle *sort;
+  Record *out;
+  SM_MemoryStats stats;
+  SM_MemoryUse users[64];
+  long budget = 1024 * 1024;
+  int sorted = 0, runs = 0, onDisk = 0, n, i;
+
+  testName = "test sort spills runs ";
+
+  fillTable(&table, 60000, 11);
+  createRecord(&out, table.schema);
+  TEST_CHECK(openSort(&table, 0, budget, 1, &sort));
+  TEST_CHECK(getMemoryStats(&stats));
+  n = getMemoryUsers(users, 64);
+  for (i = 0; i < n; i++)
+    if (strcmp(users[i].fileName, "(temporary)") == 0) {
+      runs++;
+      onDisk += users[i].bytes[SM_MEM_TEMP] == 0;
+    }
+  printf("%d runs open, %d on disk, %lld KB in memory\n", runs, onDisk, stats.bytes[SM_MEM_TEMP] / 1024);
+  ASSERT_TRUE(stats.bytes[SM_MEM_TEMP] <= budget, "runs in memory fit into the budget");
+  ASSERT_TRUE(onDisk > 0, "runs went to disk");
+
+  while (nextSorted(sort, out) == RC_OK)
+    sorted++;
+  ASSERT_EQUALS_INT(60000, sorted, "all records sorted");
+  TEST_CHECK(closeSort(sort));
+
+  freeRecord(out);
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TESTTABLE));
+
+  TEST_DONE();
+}